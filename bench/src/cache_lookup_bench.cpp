@@ -0,0 +1,81 @@
+#include "io/provider.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+using namespace IO;
+
+// Count every heap allocation made by the process
+static std::atomic<size_t> allocationCount = 0;
+
+void *operator new(size_t size) {
+  ++allocationCount;
+  if(void *ptr = malloc(size ? size : 1))
+    return ptr;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+  free(ptr);
+}
+
+// Provider producing small 3 layer images
+class DummyProvider : public ImageProvider {
+public:
+  DummyProvider() {
+    m_imageCount = 64;
+  }
+
+  virtual DataParameters getImageParameters(int index) override {
+    long dims[3] = { 32, 32, 3 };
+    return DataParameters(index, DataType::USHORT, 3, dims);
+  }
+
+  virtual bool readPixels(const DataParameters& params, void *ptr) override {
+    memset(ptr, 0, params.byteSize());
+    return true;
+  }
+
+  virtual double maxTypeValue() override {
+    return 65535;
+  }
+};
+
+int main(int argc, char **argv) {
+  const int iterations = argc > 1 ? atoi(argv[1]) : 1000000;
+
+  CachedImageProvider cache(new DummyProvider(), 64 << 20);
+
+  std::vector<DataParameters> params;
+  for(int i = 0; i < cache.imageCount(); ++i)
+    params.push_back(cache.getImageParameters(i));
+
+  // Fill the cache
+  for(auto& p : params)
+    cache.getPixels(p);
+
+  size_t allocations = allocationCount;
+  auto begin = std::chrono::steady_clock::now();
+
+  for(int i = 0; i < iterations; ++i) {
+    // Build a new key every time, like the views do
+    auto key = params[i % params.size()].withIndex(i % params.size());
+    cache.getPixels(key);
+  }
+
+  auto duration = std::chrono::steady_clock::now() - begin;
+  allocations = allocationCount - allocations;
+
+  double ns = std::chrono::duration<double, std::nano>(duration).count() / iterations;
+  printf("%d lookups, %.1f ns per lookup, %zu allocations\n", iterations, ns, allocations);
+
+  return allocations == 0 ? 0 : 1;
+}
@@ -0,0 +1,79 @@
+#include "io/kernels.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+using namespace IO;
+
+// Size of the frames of a 24 MP camera
+static const int WIDTH = 6000;
+static const int HEIGHT = 4000;
+
+// Levels used by the keypoint detection
+static const float LOW = 990.0f;
+static const float HIGH = 3900.0f;
+
+template<typename Fn>
+static double measure(Fn&& fn) {
+  // Best of a few runs, the first one also faults the pages in
+  double best = 1e30;
+  for(int run = 0; run < 5; ++run) {
+    auto begin = std::chrono::steady_clock::now();
+    fn();
+    auto duration = std::chrono::steady_clock::now() - begin;
+    best = std::min(best, std::chrono::duration<double, std::milli>(duration).count());
+  }
+  return best;
+}
+
+int main() {
+  const size_t count = (size_t)WIDTH * HEIGHT;
+
+  // Big-endian signed data as stored in a FITS file with BZERO = 32768
+  std::vector<uint8_t> file(2 * count);
+  for(auto& byte : file)
+    byte = rand();
+
+  cv::Mat words(HEIGHT, WIDTH, CV_16UC1);
+  cv::Mat bytes(HEIGHT, WIDTH, CV_8UC1);
+
+  // What cfitsio and processImage did: a byte swap and zero point pass,
+  // then OpenCV passes for the conversion, the levels and the bytes
+  double multiPass = measure([&]() {
+    uint16_t *dst = words.ptr<uint16_t>();
+    for(size_t i = 0; i < count; ++i)
+      dst[i] = (uint16_t)(((file[2 * i] << 8) | file[2 * i + 1]) + 32768);
+
+    cv::Mat raw;
+    words.convertTo(raw, CV_32F);
+    raw = ((cv::min(cv::max(raw, LOW), HIGH) - LOW) / (HIGH - LOW));
+    raw.convertTo(bytes, CV_8U, 255);
+  });
+  printf("%-10s %8.2f ms per frame\n", "multi-pass", multiPass);
+
+  for(int level = Kernels::SCALAR; level <= Kernels::supportedLevel(); ++level) {
+    Kernels::setLevel((Kernels::Level)level);
+
+    double swap = measure([&]() {
+      Kernels::swap16(file.data(), words.ptr<uint16_t>(), count, 32768);
+    });
+    double levels = measure([&]() {
+      Kernels::levelsToByte(words.ptr<uint16_t>(), bytes.ptr<uint8_t>(), count, 1.0f, LOW, HIGH);
+    });
+
+    printf("%-10s %8.2f ms per frame (swap %.2f ms, levels %.2f ms)\n",
+           Kernels::levelName((Kernels::Level)level), swap + levels, swap, levels);
+  }
+
+  std::vector<float> floats(count);
+  double toFloat = measure([&]() {
+    Kernels::swap16ToFloat(file.data(), floats.data(), count, 1.0f, 32768.0f);
+  });
+  printf("%-10s %8.2f ms per frame\n", "to float", toFloat);
+
+  return 0;
+}
@@ -0,0 +1,92 @@
+#include "io/sequence_file.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <format>
+#include <sstream>
+#include <string>
+
+using namespace IO;
+
+// Sequence with stats for 3 layers and a registration for every frame
+static std::string sequenceText(int frames) {
+  std::string text = std::format("S 'bench' 1 {} {} 5 0 4 0 0\nL 3\n", frames, frames);
+  for(int i = 0; i < frames; ++i)
+    text += std::format("I {} 1\n", i + 1);
+  for(int i = 0; i < frames; ++i) {
+    for(int layer = 0; layer < 3; ++layer) {
+      text += std::format("M{}-{} 24000000 23999000 {} {} {} {} {} {} {} {} 990 65535 {} {}\n", layer, i,
+                          1234.5678 + i, 1200.25, 55.125 + layer, 40.0625, 37.5, 52.75, 1201.5, 1.0 + i * 1e-6,
+                          3200.125, 12.5);
+    }
+  }
+  for(int i = 0; i < frames; ++i) {
+    text += std::format("R1 {} {} {} {} {} {} H 1 0 {} 0 1 {} 0 0 1\n", 2.5 + i * 1e-4, 2.75, 0.875, 0.5 + i * 1e-5,
+                        1200.5, 180 + i % 50, -3.125 + i * 1e-3, 7.75 - i * 1e-3);
+  }
+  return text;
+}
+
+// What Sequence::readStream used to do, without creating the objects
+static size_t sscanfParse(const std::string& text) {
+  std::istringstream stream(text);
+  char line[512];
+  size_t values = 0;
+  while(stream.good()) {
+    stream.getline(line, 512);
+    if(line[0] == 'I') {
+      int fileIndex, included, width, height;
+      values += sscanf(line + 2, "%d %d %d,%d", &fileIndex, &included, &width, &height);
+    } else if(line[0] == 'M') {
+      int image, consumed;
+      sscanf(line + 3, "%d%n", &image, &consumed);
+      long totalPixels, goodPixels;
+      double v[12];
+      values += sscanf(line + 4 + consumed, "%ld %ld %lg %lg %lg %lg %lg %lg %lg %lg %lg %lg %lg %lg",
+                       &totalPixels, &goodPixels, &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7], &v[8],
+                       &v[9], &v[10], &v[11]);
+    } else if(line[0] == 'R') {
+      float FWHM, weightedFWHM, roundness, backgroundLevel;
+      double quality, h[9];
+      int numberOfStars;
+      values += sscanf(line + 3, "%g %g %g %lg %g %d H %lg %lg %lg %lg %lg %lg %lg %lg %lg",
+                       &FWHM, &weightedFWHM, &roundness, &quality, &backgroundLevel, &numberOfStars,
+                       &h[0], &h[1], &h[2], &h[3], &h[4], &h[5], &h[6], &h[7], &h[8]);
+    }
+  }
+  return values;
+}
+
+template<typename Fn>
+static double measure(Fn&& fn) {
+  double best = 1e30;
+  for(int run = 0; run < 3; ++run) {
+    auto begin = std::chrono::steady_clock::now();
+    fn();
+    auto duration = std::chrono::steady_clock::now() - begin;
+    best = std::min(best, std::chrono::duration<double, std::milli>(duration).count());
+  }
+  return best;
+}
+
+int main() {
+  for(int frames : { 1000, 10000, 100000 }) {
+    auto text = sequenceText(frames);
+
+    size_t values = 0;
+    double sscanfTime = measure([&]() {
+      values = sscanfParse(text);
+    });
+
+    SequenceFile file;
+    double parseTime = measure([&]() {
+      file.parse(text);
+    });
+
+    printf("%6d frames (%5.1f MB): sscanf %8.2f ms, from_chars %8.2f ms (%zu lines)\n", frames, text.size() / 1e6,
+           sscanfTime, parseTime, file.m_images.size() + file.m_stats.size() + file.m_registrations.size());
+    if(values == 0)
+      return 1;
+  }
+  return 0;
+}
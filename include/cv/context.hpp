@@ -47,6 +47,9 @@ public:
 
   // Processing calls
   void findKeypoints(const ImgPtr& image, bool reprocess = false);
+  // Reads all images as one batch, images are processed in the order
+  // in which their reads finish
+  void findKeypoints(const std::list<ImgPtr>& images, bool reprocess = false);
   void matchFeatures(const ImgPtr& image);
   void alignFeatures(const ImgPtr& image);
   void matchAndAlignFeatures(const ImgPtr& image);
@@ -54,6 +57,7 @@ public:
 private:
   std::shared_ptr<ImgData> processImage(const ImgPtr& image, bool force = false);
   std::shared_ptr<ImgData> getData(const ImgPtr& image);
+  std::shared_ptr<ImgData> detect(const ImgPtr& image, const cv::Mat& matrix);
 };
 
 }
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <optional>
+
+namespace IO {
+
+// Runs jobs, usually on another thread
+class Executor {
+public:
+  virtual ~Executor() = default;
+
+  virtual void post(std::function<void()>&& job) = 0;
+};
+
+// Threads which run the blocking calls of awaited provider calls
+Executor& ioExecutor();
+
+// Detached coroutine, it starts right away and frees itself once it's
+// done. Event handlers use it to co_await provider calls, exceptions
+// escaping it are logged and end the coroutine.
+struct Task {
+  struct promise_type {
+    Task get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception();
+  };
+};
+
+// Awaitable running a blocking call on the I/O executor. The awaiting
+// coroutine is resumed through the given executor (the main loop for UI
+// code), without one it continues on the I/O thread. Exceptions thrown
+// by the call are rethrown in the awaiting coroutine.
+template<typename T>
+class Async {
+  std::function<T()> m_job;
+  Executor *m_resume;
+  std::optional<T> m_result;
+  std::exception_ptr m_exception;
+
+public:
+  Async(std::function<T()>&& job, Executor *resume = nullptr)
+    : m_job(std::move(job))
+    , m_resume(resume) {
+  }
+
+  bool await_ready() const noexcept {
+    return false;
+  }
+
+  void await_suspend(std::coroutine_handle<> handle) {
+    ioExecutor().post([this, handle]() {
+      try {
+        m_result = m_job();
+      } catch(...) {
+        m_exception = std::current_exception();
+      }
+      if(m_resume)
+        m_resume->post([handle]() { handle.resume(); });
+      else
+        handle.resume();
+    });
+  }
+
+  T await_resume() {
+    if(m_exception)
+      std::rethrow_exception(m_exception);
+    return std::move(*m_result);
+  }
+};
+
+} // namespace IO
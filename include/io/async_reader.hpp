@@ -0,0 +1,124 @@
+#pragma once
+
+#include "io/hdu.hpp"
+#include "io/thread_pool.hpp"
+
+#include <deque>
+#include <filesystem>
+#include <optional>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+namespace IO {
+
+// Reads batches of regions without blocking on each of them. Results are
+// collected in the order in which the reads finish. Reads in flight and
+// finished reads which weren't collected yet are limited to a number of
+// bytes, the next read is started once next() made room for it. A single
+// read larger than the limit is still allowed. Readers are meant to be
+// used from one thread.
+class AsyncReader {
+public:
+  struct Completion {
+    DataParameters m_params;
+    // Null if the read failed
+    std::shared_ptr<uint8_t[]> m_data;
+  };
+
+  static constexpr size_t DEFAULT_QUEUE_DEPTH = 16;
+  static constexpr size_t DEFAULT_MAX_BYTES = 512ul << 20;
+
+  virtual ~AsyncReader() = default;
+
+  virtual void submit(const std::vector<DataParameters>& batch) = 0;
+  // Waits for the next finished read, nothing is returned once all
+  // submitted reads were collected
+  virtual std::optional<Completion> next() = 0;
+  virtual size_t pending() const = 0;
+};
+
+// Calls getPixels of a provider on worker threads, one thread per read
+// that is allowed to be in flight
+class ThreadPoolReader : public AsyncReader {
+  ImageProvider *m_provider;
+
+  mutable std::mutex m_mutex;
+  std::condition_variable m_finished;
+  std::deque<DataParameters> m_waiting;
+  std::deque<Completion> m_completions;
+  size_t m_pending;
+  size_t m_maxBytes;
+  // Bytes of reads in flight and collected completions
+  size_t m_bytes;
+
+  // Declared last, workers are stopped before anything else is destroyed
+  ThreadPool m_pool;
+
+public:
+  ThreadPoolReader(ImageProvider *provider, size_t queueDepth = DEFAULT_QUEUE_DEPTH, size_t maxBytes = DEFAULT_MAX_BYTES);
+
+  virtual void submit(const std::vector<DataParameters>& batch) override;
+  virtual std::optional<Completion> next() override;
+  virtual size_t pending() const override;
+
+private:
+  // Starts waiting reads that fit, expects the mutex to be held
+  void start();
+};
+
+#ifdef HAVE_LIBURING
+// Reads contiguous regions of uncompressed FITS files with io_uring, many
+// reads are kept in flight so fast drives see a deep queue. Regions which
+// aren't contiguous in the file are read from the fallback provider.
+class UringReader : public AsyncReader {
+  struct Request {
+    DataParameters m_params;
+    std::shared_ptr<uint8_t[]> m_buffer;
+    size_t m_dataStart;
+    size_t m_offset;
+    size_t m_size;
+    size_t m_done;
+    // Bytes accounted for the buffer
+    size_t m_bufferSize;
+  };
+
+  ImageProvider *m_fallback;
+  const HduIndex& m_hdus;
+  int m_fd;
+  io_uring m_ring;
+  bool m_valid;
+
+  size_t m_queueDepth;
+  size_t m_inFlight;
+  size_t m_maxBytes;
+  // Buffers of reads in flight and completions which weren't collected
+  size_t m_bytes;
+  std::deque<DataParameters> m_waiting;
+  std::deque<Completion> m_completions;
+
+public:
+  UringReader(ImageProvider *fallback, const std::filesystem::path& path, const HduIndex& hdus, size_t queueDepth = 64, size_t maxBytes = DEFAULT_MAX_BYTES);
+  virtual ~UringReader();
+
+  UringReader(const UringReader& other) = delete;
+
+  bool valid() const;
+
+  virtual void submit(const std::vector<DataParameters>& batch) override;
+  virtual std::optional<Completion> next() override;
+  virtual size_t pending() const override;
+
+private:
+  // Moves waiting regions into the ring as long as they fit
+  void fill();
+  bool fits(size_t bytes) const;
+  // Hands the result of a request to next() and frees the request
+  void complete(Request *request, std::shared_ptr<uint8_t[]> data);
+  void queueRead(Request *request);
+  void finish(Request *request, int result);
+};
+#endif
+
+} // namespace IO
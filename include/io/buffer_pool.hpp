@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace IO {
+
+// Recycles pixel buffers. Sizes are rounded up to size classes and
+// released buffers are kept per class, so reading frames of the same size
+// reuses the memory of evicted frames instead of getting fresh pages from
+// the kernel. Buffers are 64 byte aligned, large ones are aligned to and
+// padded to huge pages.
+class BufferPool {
+public:
+  struct Statistics {
+    // Buffers which had to be allocated
+    size_t m_allocations;
+    // Buffers handed out again after being released
+    size_t m_reuses;
+    // Released buffers which didn't fit into the idle budget
+    size_t m_drops;
+
+    size_t m_idleBuffers;
+    size_t m_idleBytes;
+
+    double reuseRate() const;
+  };
+
+  static constexpr size_t ALIGNMENT = 64;
+  static constexpr size_t HUGE_PAGE_SIZE = 2 << 20;
+  static constexpr size_t DEFAULT_MAX_IDLE_BYTES = 512 << 20;
+
+private:
+  // Outlives the pool as long as any of its buffers are alive
+  struct Shared {
+    std::mutex m_mutex;
+    std::unordered_map<size_t, std::vector<void*>> m_idle;
+
+    size_t m_maxIdleBytes;
+    size_t m_idleBytes;
+    size_t m_idleBuffers;
+
+    size_t m_allocations;
+    size_t m_reuses;
+    size_t m_drops;
+
+    ~Shared();
+    void release(void *ptr, size_t size);
+    void trim(size_t maxIdleBytes);
+  };
+
+  std::shared_ptr<Shared> m_shared;
+
+public:
+  BufferPool(size_t maxIdleBytes = DEFAULT_MAX_IDLE_BYTES);
+
+  BufferPool(const BufferPool& other) = delete;
+
+  // Pool used by the providers
+  static BufferPool& global();
+
+  static size_t sizeClass(size_t size);
+
+  // Contents of the buffer are undefined
+  std::shared_ptr<uint8_t[]> acquire(size_t size);
+
+  void setMaxIdleBytes(size_t maxIdleBytes);
+  // Frees all idle buffers
+  void trim();
+
+  Statistics statistics() const;
+};
+
+} // namespace IO
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "io/provider.hpp"
+
+#include <type_traits>
+
+namespace IO {
+
+// Calls fn with the std::type_identity of the C++ type stored for a data
+// type. Kernels get instantiated for every type and the switch only runs
+// once per call instead of once per pixel.
+template<typename Fn>
+bool dispatchDataType(DataType::EnumType type, Fn&& fn) {
+  switch(type) {
+    case DataType::BYTE: fn(std::type_identity<int8_t>{}); return true;
+    case DataType::UBYTE: fn(std::type_identity<uint8_t>{}); return true;
+    case DataType::SHORT: fn(std::type_identity<int16_t>{}); return true;
+    case DataType::USHORT: fn(std::type_identity<uint16_t>{}); return true;
+    case DataType::INT: fn(std::type_identity<int32_t>{}); return true;
+    case DataType::UINT: fn(std::type_identity<uint32_t>{}); return true;
+    case DataType::LONG: fn(std::type_identity<int64_t>{}); return true;
+    case DataType::ULONG: fn(std::type_identity<uint64_t>{}); return true;
+    case DataType::FLOAT: fn(std::type_identity<float>{}); return true;
+    case DataType::DOUBLE: fn(std::type_identity<double>{}); return true;
+  }
+  return false;
+}
+
+// Converts pixels of any type into floats multiplied by scale
+bool convertToFloat(DataType::EnumType type, const void *src, float *dst, size_t count, double scale);
+
+// Converts pixels of any type into 16 bit values scaled to the full
+// range, value * scale of 1 maps to 65535 and everything is clamped
+bool convertToUnorm16(DataType::EnumType type, const void *src, uint16_t *dst, size_t count, double scale);
+
+} // namespace IO
+
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "io/sequence_store.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+namespace IO {
+
+// Append-only log of the registration and inclusion edits made since the
+// sequence was last saved, kept next to the sequence file. Every record
+// holds the complete state of one image (or the reference image index)
+// after the edit, so replaying them in order is the same as making the
+// edits again, no matter if some of them were saved already.
+//
+// Records are written as the edits happen without syncing them, they
+// survive the program dying but not the machine. Saves drop the records
+// their snapshot covered with dropSaved().
+class EditJournal {
+  std::filesystem::path m_path;
+  size_t m_imageCount;
+  int m_fd;
+  // Number of records in the file and of records dropped before them,
+  // their sum numbers the next record
+  uint64_t m_records;
+  uint64_t m_dropped;
+
+public:
+  // Keeps appending to a journal left behind for a sequence with the same
+  // image count, starts a new one otherwise
+  EditJournal(const std::filesystem::path& sequencePath, size_t imageCount);
+  ~EditJournal();
+
+  EditJournal(const EditJournal& other) = delete;
+
+  bool valid() const;
+  // Number of the next record, a snapshot taken now covers all records
+  // before it
+  uint64_t position() const;
+
+  void appendImage(const SequenceStore& store, size_t row);
+  void appendReference(int reference);
+  // Removes the records before the position, they are in the saved file
+  bool dropSaved(uint64_t position);
+  // Removes the journal, unsaved edits are given up
+  void discard();
+
+  static std::filesystem::path journalPath(const std::filesystem::path& sequencePath);
+  // Applies the records of the journal to the store and reference index,
+  // returns the number of applied records. Records of images which don't
+  // match the store and everything after a torn record are skipped.
+  static size_t replay(const std::filesystem::path& sequencePath, SequenceStore& store, int& reference);
+
+private:
+  // Replaces the journal with one holding the records
+  bool start(const std::string& records = {});
+};
+
+} // namespace IO
+
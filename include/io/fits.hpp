@@ -1,15 +1,27 @@
 #pragma once
 
-#include "io/provider.hpp"
+#include "io/hdu.hpp"
 
 #include <filesystem>
+#include <unordered_map>
 #include <fitsio.h>
 
 namespace IO {
+class RiceTiles;
 
 class Fits : public ImageProvider {
   fitsfile *m_fileptr;
   int m_status;
+  std::filesystem::path m_path;
+
+  std::shared_ptr<const HduIndex> m_index;
+  double m_maxTypeValue;
+  int m_currentHdu;
+
+  // Tile tables of compressed HDUs, loaded on first read. Null when the
+  // HDU can't be decompressed in parallel. All of them read through m_fd.
+  std::unordered_map<int, std::unique_ptr<RiceTiles>> m_riceTiles;
+  int m_fd;
 
   class ErrorGuard {
     Fits& m_parent;
@@ -20,7 +32,9 @@ class Fits : public ImageProvider {
   };
 
 public:
-  Fits(const std::filesystem::path& filename);
+  // Opening a file builds an index of all HDUs, handles opened on the same
+  // file can share an already built index and skip the header scan.
+  Fits(const std::filesystem::path& filename, const std::shared_ptr<const HduIndex>& index = nullptr);
   Fits(Fits&& other);
 
   // no copy constructor
@@ -34,10 +48,16 @@ public:
   int imageDimensionCount();
   void imageSize(int dimCount, long *dimensions);
 
+  std::shared_ptr<const HduIndex> index() const;
+
   virtual DataParameters getImageParameters(int index) override;
   // virtual std::shared_ptr<uint8_t[]> getPixels(const DataParameters& params) override;
   virtual bool readPixels(const DataParameters& params, void *ptr) override;
   virtual double maxTypeValue() override;
+
+private:
+  void buildIndex();
+  RiceTiles *riceTiles(int index);
 };
 
 } // namespace IO
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "io/fits.hpp"
+
+#include <condition_variable>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace IO {
+
+// Keeps a number of independent cfitsio handles opened on the same file
+// and leases one out for every call, which makes it possible to read
+// different HDUs from multiple threads at the same time.
+class FitsPool : public ImageProvider {
+  std::filesystem::path m_path;
+  size_t m_maxHandles;
+
+  std::mutex m_mutex;
+  std::condition_variable m_handleReleased;
+  std::vector<std::unique_ptr<Fits>> m_handles;
+  std::vector<Fits*> m_freeHandles;
+  // Handles being opened without the lock, they count towards the limit
+  size_t m_opening;
+
+  // Shared by all handles, lookups don't need a handle
+  std::shared_ptr<const HduIndex> m_index;
+  double m_maxTypeValue;
+
+  class Lease {
+    FitsPool& m_pool;
+    Fits *m_handle;
+
+  public:
+    Lease(FitsPool& pool);
+    ~Lease();
+
+    Lease(const Lease& other) = delete;
+
+    Fits *operator->();
+  };
+
+public:
+  // maxHandles = 0 picks the handle count based on the hardware concurrency
+  FitsPool(const std::filesystem::path& filename, size_t maxHandles = 0);
+  virtual ~FitsPool() = default;
+
+  size_t handleCount();
+  std::shared_ptr<const HduIndex> index() const;
+
+  virtual DataParameters getImageParameters(int index) override;
+  virtual bool readPixels(const DataParameters& params, void *ptr) override;
+  virtual double maxTypeValue() override;
+
+private:
+  Fits *acquire();
+  void release(Fits *handle);
+};
+
+} // namespace IO
+
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "io/provider.hpp"
+
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace IO {
+
+// Summary of a single HDU. It is collected once when a file is opened,
+// so image parameters can be looked up without seeking through the file.
+struct HduInfo {
+  DataType::EnumType m_type;
+  int m_bitpix;
+  std::vector<long> m_dims;
+  double m_bzero;
+  double m_bscale;
+  bool m_compressed;
+
+  // Byte offsets inside of the file
+  size_t m_headerOffset;
+  size_t m_dataOffset;
+  size_t m_dataSize;
+
+  // Values of the header cards listed in HduInfo::KEYWORDS,
+  // strings are stored without quotes.
+  std::map<std::string, std::string, std::less<>> m_cards;
+
+  HduInfo();
+
+  bool isImage() const;
+  DataParameters parameters(int index) const;
+  const std::string *card(std::string_view keyword) const;
+
+  // Header cards which get copied into the index
+  static const std::vector<std::string_view> KEYWORDS;
+
+  static bool isIndexedKeyword(std::string_view keyword);
+  // Strips quotes and comments from a raw card value
+  static std::string cardValue(std::string_view raw);
+  // Same rules as fits_get_img_equivtype, integer data shifted by BZERO
+  // gets the smallest integer type holding its range
+  static DataType::EnumType equivalentType(int bitpix, double bzero, double bscale);
+};
+
+using HduIndex = std::vector<HduInfo>;
+
+// Maximum value of the pixel type used by images in the index, float data
+// looks at the DATAMAX card of every HDU. Readers compute it once after
+// building the index.
+double indexMaxTypeValue(const HduIndex& index);
+
+} // namespace IO
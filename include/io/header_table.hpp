@@ -0,0 +1,78 @@
+#pragma once
+
+#include "io/hdu.hpp"
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace IO {
+
+// Values of the indexed header keywords (HduInfo::KEYWORDS) of all images
+// of a sequence, stored by column so a keyword can be read or filtered
+// for every image at once without touching the FITS files. Rows are image
+// indices, as used by the providers.
+//
+// The table is saved next to the sequence together with the size and
+// modification time of the source files, tables of files which changed
+// are not loaded.
+class HeaderTable {
+public:
+  struct Column {
+    std::string m_keyword;
+    // NaN where the card is missing or isn't a number, dates (DATE-OBS)
+    // are stored as seconds since the Unix epoch
+    std::vector<double> m_numbers;
+    // Card values, empty where the card is missing
+    std::vector<std::string> m_strings;
+  };
+
+private:
+  struct Source {
+    std::string m_path;
+    uint64_t m_size;
+    int64_t m_mtime;
+  };
+
+  std::vector<int> m_indices;
+  std::unordered_map<int, size_t> m_rows;
+  std::vector<Column> m_columns;
+  std::vector<Source> m_sources;
+
+public:
+  using Lookup = std::function<const HduInfo*(int index)>;
+
+  // Fills the rows in parallel, lookup is called from multiple threads
+  static std::unique_ptr<HeaderTable> build(const std::vector<int>& indices, const Lookup& lookup,
+                                            const std::vector<std::filesystem::path>& sources);
+  // Null if the file is missing, invalid or out of date
+  static std::unique_ptr<HeaderTable> load(const std::filesystem::path& path);
+  bool save(const std::filesystem::path& path) const;
+
+  size_t rowCount() const;
+  const std::vector<int>& indices() const;
+
+  const Column *column(std::string_view keyword) const;
+  // Value of a single image, NaN if there is none
+  double number(std::string_view keyword, int index) const;
+
+  // Images with a value within [min, max]
+  std::vector<int> filter(std::string_view keyword, double min, double max) const;
+  // Images with exactly this value
+  std::vector<int> filter(std::string_view keyword, std::string_view value) const;
+
+  // Number of a card value, NaN if it isn't one
+  static double parseNumber(std::string_view value);
+  // Seconds since the Unix epoch of a FITS date (YYYY-MM-DD[Thh:mm:ss[.s]]),
+  // NaN if it isn't one
+  static double parseDate(std::string_view value);
+
+private:
+  void indexRows();
+};
+
+} // namespace IO
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace IO {
+
+// Pixel conversion loops which do the byte swap, zero point and type
+// conversion of a frame in a single pass. Every kernel has a scalar
+// version and SSE2, AVX2 and AVX-512 versions on x86, the best one the
+// CPU supports is picked when the program starts.
+namespace Kernels {
+
+enum Level {
+  SCALAR,
+  SSE2,
+  AVX2,
+  AVX512,
+};
+
+// Best level supported by the CPU
+Level supportedLevel();
+Level level();
+// Used by tests and benchmarks, levels above the supported one are ignored
+void setLevel(Level level);
+const char *levelName(Level level);
+
+// Big-endian 16 bit integers to native ones with an integer zero point
+// added (wrapping), BZERO = 32768 turns FITS data into unsigned shorts
+void swap16(const uint8_t *src, uint16_t *dst, size_t count, int32_t zero);
+// Big-endian signed 16 bit integers to floats, value * scale + zero
+void swap16ToFloat(const uint8_t *src, float *dst, size_t count, float scale, float zero);
+// Unsigned 16 bit values to bytes, value * scale is clamped to [low, high]
+// which is mapped to [0, 255]
+void levelsToByte(const uint16_t *src, uint8_t *dst, size_t count, float scale, float low, float high);
+// Averages 2x2 blocks of two unsigned 16 bit rows into count pixels,
+// halves are rounded up
+void halve16(const uint16_t *row0, const uint16_t *row1, uint16_t *dst, size_t count);
+
+} // namespace Kernels
+
+} // namespace IO
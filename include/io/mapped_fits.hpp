@@ -0,0 +1,70 @@
+#pragma once
+
+#include "io/hdu.hpp"
+#include "io/read_ahead.hpp"
+
+#include <filesystem>
+#include <mutex>
+#include <vector>
+
+namespace IO {
+
+// Reader for uncompressed FITS files. The file is mapped into memory and
+// all headers are parsed once when it's opened, pixel reads are served
+// straight from the mapping and the page cache takes care of caching.
+// Data is only converted from the big-endian on-disk format when it's
+// copied into a caller provided buffer.
+//
+// Reads are tracked with a ReadAhead, the data of the images which are
+// going to be read next is handed to the kernel with MADV_WILLNEED so it
+// gets paged in while the current image is converted.
+class MappedFits : public ImageProvider {
+  struct Mapping;
+
+  std::filesystem::path m_path;
+  std::shared_ptr<Mapping> m_mapping;
+  HduIndex m_hdus;
+  double m_maxTypeValue;
+
+  ReadAhead m_readAhead;
+  std::mutex m_mutex;
+  std::vector<int> m_advised;
+
+public:
+  MappedFits(const std::filesystem::path& filename, size_t readAhead = ReadAhead::DEFAULT_DEPTH);
+  virtual ~MappedFits() = default;
+
+  // no copy constructor
+  MappedFits(const MappedFits& other) = delete;
+
+  // Raw big-endian image data of an HDU, as it is stored in the file
+  const uint8_t *rawPixels(int index) const;
+  const HduIndex& index() const;
+  // Images advised after the last read, closest first
+  std::vector<int> advisedImages();
+
+  // Byte range of the HDU data holding the region, only regions covering
+  // complete rows (and layers) without gaps are contiguous
+  static bool contiguousRange(const HduInfo& hdu, const DataParameters& params, size_t& start, size_t& size);
+  // Converts a region from big-endian file data, data holds the HDU data
+  // starting at byte dataStart
+  static bool convertPixels(const HduInfo& hdu, const DataParameters& params, const uint8_t *data, size_t dataStart, void *ptr);
+
+  virtual void setAccessOrder(const std::vector<int>& indices) override;
+
+  virtual DataParameters getImageParameters(int index) override;
+  virtual std::shared_ptr<uint8_t[]> getPixels(const DataParameters& params) override;
+  virtual bool readPixels(const DataParameters& params, void *ptr) override;
+  virtual double maxTypeValue() override;
+  virtual std::unique_ptr<AsyncReader> createAsyncReader() override;
+
+private:
+  bool parseHeaders(const std::filesystem::path& filename);
+  void accessed(int index);
+  // Unscaled 8 bit regions are served straight from the mapping, start
+  // is the byte offset of the region inside of the HDU data
+  bool isDirectView(const DataParameters& params, size_t& start) const;
+};
+
+} // namespace IO
+
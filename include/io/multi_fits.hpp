@@ -0,0 +1,96 @@
+#pragma once
+
+#include "io/fits.hpp"
+
+#include <condition_variable>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace IO {
+
+// Provider for sequences stored as one FITS file per image. Image indices
+// are the file indices of the sequence, they are turned into file names
+// the same way Siril does (name, zero padded index, extension).
+//
+// Headers of all files are read in parallel when the provider is created.
+// cfitsio handles are opened lazily and kept in a LRU pool with a bounded
+// size, so large sequences don't run out of file descriptors.
+class MultiFits : public ImageProvider {
+  struct File {
+    std::filesystem::path m_path;
+    // Position of the image HDU inside of the file
+    int m_hdu;
+    std::shared_ptr<const HduIndex> m_index;
+  };
+
+  struct Handle {
+    int m_fileIndex;
+    // Null while the handle is being opened
+    std::unique_ptr<Fits> m_fits;
+    bool m_busy;
+  };
+  using HandleList = std::list<Handle>;
+
+  std::unordered_map<int, File> m_files;
+  HduIndex m_images;
+  double m_maxTypeValue;
+
+  size_t m_maxHandles;
+  std::mutex m_mutex;
+  std::condition_variable m_handleReleased;
+  // Most recently used handles are at the front
+  HandleList m_handles;
+  std::unordered_map<int, HandleList::iterator> m_openHandles;
+
+  // Handle of a file for the duration of a read, null if the file
+  // couldn't be opened
+  class Lease {
+    MultiFits& m_parent;
+    int m_fileIndex;
+    Fits *m_handle;
+
+  public:
+    Lease(MultiFits& parent, int fileIndex, const File& file);
+    ~Lease();
+
+    Lease(const Lease& other) = delete;
+
+    Fits *operator->();
+    operator bool() const;
+  };
+
+public:
+  static constexpr size_t DEFAULT_MAX_HANDLES = 64;
+
+  MultiFits(const std::filesystem::path& directory, const std::string& name,
+            const std::vector<int>& fileIndices, int fixedLength, bool compressed,
+            size_t maxHandles = DEFAULT_MAX_HANDLES);
+  virtual ~MultiFits() = default;
+
+  MultiFits(const MultiFits& other) = delete;
+
+  // File holding the image, empty if it wasn't found
+  std::filesystem::path path(int fileIndex) const;
+  // Header summary of the image, null if it wasn't found
+  const HduInfo *info(int fileIndex) const;
+  size_t handleCount();
+
+  static std::filesystem::path filePath(const std::filesystem::path& directory, const std::string& name,
+                                        int fileIndex, int fixedLength, const std::string& extension);
+
+  virtual DataParameters getImageParameters(int index) override;
+  virtual bool readPixels(const DataParameters& params, void *ptr) override;
+  virtual double maxTypeValue() override;
+
+private:
+  Fits *acquire(int fileIndex, const File& file);
+  void release(int fileIndex);
+};
+
+} // namespace IO
+
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "io/provider.hpp"
+#include "io/read_ahead.hpp"
+#include "io/thread_pool.hpp"
+
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace IO {
+
+// Reads images ahead of time into a cache on background threads. The
+// access pattern is tracked on every read with a ReadAhead, stepping
+// through the images forwards or backwards prefetches the next images in
+// the same direction. The order given with setAccessOrder() limits
+// prefetches to the listed indices (providers with gaps in their indices
+// give all of them).
+//
+// Prefetched images use the same region and increments as the read which
+// triggered them, regions read with getParts() prefetch all of their parts.
+class PrefetchingProvider : public ImageProvider {
+  CachedImageProvider *m_cache;
+  std::unique_ptr<ThreadPool> m_pool;
+  ReadAhead m_readAhead;
+
+public:
+  static constexpr size_t DEFAULT_DEPTH = ReadAhead::DEFAULT_DEPTH;
+  static constexpr size_t DEFAULT_THREAD_COUNT = 2;
+
+  PrefetchingProvider(CachedImageProvider *cache, size_t depth = DEFAULT_DEPTH, size_t threadCount = DEFAULT_THREAD_COUNT);
+  virtual ~PrefetchingProvider();
+
+  PrefetchingProvider(const PrefetchingProvider& other) = delete;
+
+  CachedImageProvider& cache();
+  // Blocks until all scheduled prefetches are done
+  void waitIdle();
+
+  virtual void setAccessOrder(const std::vector<int>& indices) override;
+
+  virtual DataParameters getImageParameters(int index) override;
+  virtual std::shared_ptr<uint8_t[]> getPixels(const DataParameters& params) override;
+  virtual std::vector<std::shared_ptr<uint8_t[]>> getParts(const std::vector<DataParameters>& parts) override;
+  virtual bool readPixels(const DataParameters& params, void *ptr) override;
+  virtual double maxTypeValue() override;
+
+private:
+  // The first part decides the image, all parts are prefetched
+  void accessed(std::span<const DataParameters> parts);
+  DataParameters prefetchParameters(int index, const DataParameters& like);
+};
+
+} // namespace IO
+
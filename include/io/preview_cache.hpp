@@ -0,0 +1,71 @@
+#pragma once
+
+#include "io/pyramid.hpp"
+
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+namespace IO {
+
+// Downsampled 16 bit image previews stored in a sidecar file next to the
+// sequence. Images with other data types are normalized to the maximum
+// value of their type. Previews are keyed by the source file path and image index,
+// the size and modification time of every source file is stored with them
+// so previews of files which changed are dropped when the cache is opened.
+//
+// The cache file is memory mapped, previews read from it aren't copied.
+// New previews are kept in memory until save() is called.
+class PreviewCache {
+public:
+  struct Preview {
+    uint32_t m_width;
+    uint32_t m_height;
+    DataType::EnumType m_type;
+    std::shared_ptr<const uint16_t[]> m_data;
+
+    operator bool() const;
+  };
+
+  // Previews are downsampled to be at most this wide
+  static constexpr uint32_t PREVIEW_WIDTH = 500;
+
+private:
+  struct Mapping;
+  using Key = std::pair<std::string, int>;
+
+  std::filesystem::path m_cachePath;
+
+  std::mutex m_mutex;
+  std::shared_ptr<Mapping> m_mapping;
+  std::map<Key, Preview> m_previews;
+  bool m_dirty;
+
+public:
+  PreviewCache(const std::filesystem::path& cachePath);
+  ~PreviewCache() = default;
+
+  PreviewCache(const PreviewCache& other) = delete;
+
+  const std::filesystem::path& path() const;
+  size_t size();
+
+  Preview find(const std::filesystem::path& source, int index);
+  // Returns a cached preview or creates one from the pyramid levels
+  Preview get(PyramidProvider& pyramid, const std::filesystem::path& source, int index);
+
+  // Writes the cache file if new previews were added
+  bool save();
+
+  // Largest pyramid level of an image which is at most PREVIEW_WIDTH wide
+  static Preview makePreview(PyramidProvider& pyramid, int index);
+
+private:
+  bool load();
+};
+
+} // namespace IO
+
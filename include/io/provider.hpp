@@ -1,9 +1,16 @@
 #pragma once
 
+#include "io/async.hpp"
+
 #include <unordered_map>
 #include <memory>
 #include <cstdint>
 #include <list>
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <vector>
+#include <type_traits>
 
 #include <opencv2/core/mat.hpp>
 
@@ -30,23 +37,29 @@ struct DataType {
 };
 
 
+// Region of an image, every axis has a 1 based inclusive start and end
+// and an increment. Axes are stored inline, so parameters are trivially
+// copyable and the hash used for cache lookups is computed up front.
 class DataParameters {
+public:
+  // FITS images used here have at most 3 axes
+  static constexpr int MAX_DIMS = 3;
+
+private:
   DataType::EnumType m_type;
   int m_index;
   int m_dimCount;
 
-  long *m_start;
-  long *m_end;
-  long *m_inc;
+  long m_start[MAX_DIMS];
+  long m_end[MAX_DIMS];
+  long m_inc[MAX_DIMS];
+
+  size_t m_hash;
 
 public:
   DataParameters(int index);
-  DataParameters(int index, DataType::EnumType type, int dimCount, long *end);
-  DataParameters(int index, DataType::EnumType type, int dimCount, long *start, long *end, long *inc = 0);
-  DataParameters(const DataParameters& other);
-  DataParameters(DataParameters&& other);
-
-  ~DataParameters();
+  DataParameters(int index, DataType::EnumType type, int dimCount, const long *end);
+  DataParameters(int index, DataType::EnumType type, int dimCount, const long *start, const long *end, const long *inc = 0);
 
   operator bool() const;
   bool operator!() const;
@@ -61,23 +74,37 @@ public:
   const long *end() const;
   const long *inc() const;
 
-  long *start();
-  long *end();
-  long *inc();
-
   long width() const;
   long height() const;
   long layerCount() const;
 
+  // Size of the buffer needed to hold the described pixels
+  size_t byteSize() const;
+
   void setDimension(int dim, long start = -1, long end = -1, long inc = -1);
+  // Same region of another image
+  DataParameters withIndex(int index) const;
+  // Same region converted to another type
+  DataParameters withType(DataType::EnumType type) const;
 
   friend struct DataParamHash;
+
+private:
+  void updateHash();
 };
 
+static_assert(std::is_trivially_copyable_v<DataParameters>);
+
 struct DataParamHash {
   size_t operator()(const IO::DataParameters& obj) const;
 };
 
+// Matrix header over a pixel buffer, the matrix keeps a reference to the
+// buffer for as long as it (or any copy of it) is alive
+cv::Mat wrapBuffer(std::shared_ptr<uint8_t[]> buffer, int rows, int cols, int type);
+
+class AsyncReader;
+
 class ImageProvider {
 
 protected:
@@ -89,33 +116,128 @@ public:
 
   int imageCount();
 
+  // First layer of an image, the matrix shares the buffer returned by
+  // getPixels (and so the cached one) and must not be written to
   cv::Mat getImageMatrix(int index);
+  // Parameters read by getImageMatrix
+  DataParameters matrixParameters(int index);
+  // OpenCV matrix type of the data type, -1 if there is none
+  static int matrixType(DataType::EnumType type);
+
+  // Awaitable versions of getPixels and getImageMatrix, the read is done on
+  // the I/O executor and the caller is resumed through the resume executor
+  Async<std::shared_ptr<uint8_t[]>> pixels(const DataParameters& params, Executor *resume = nullptr);
+  Async<cv::Mat> matrix(int index, Executor *resume = nullptr);
 
   virtual std::shared_ptr<uint8_t[]> getPixels(const DataParameters& params);
+  // Reads the parts of one region (e.g. its tiles) with getPixels,
+  // providers which read ahead count them as a single read
+  virtual std::vector<std::shared_ptr<uint8_t[]>> getParts(const std::vector<DataParameters>& parts);
+
+  // Hint about the order in which file indices are going to be read,
+  // providers which don't read ahead ignore it
+  virtual void setAccessOrder(const std::vector<int>& indices);
+
+  // Reader for batches of regions, by default getPixels is called on
+  // worker threads. Providers which know where the pixels are stored
+  // can issue the reads directly.
+  virtual std::unique_ptr<AsyncReader> createAsyncReader();
 
   virtual double maxTypeValue() = 0;
   virtual DataParameters getImageParameters(int index) = 0;
   virtual bool readPixels(const DataParameters& params, void *ptr) = 0;
 };
 
+// Keeps recently read pixel buffers in memory, the cache is bounded by the
+// total size of the buffers and evicts the least recently used ones first.
+// Buffers still referenced outside of the cache are pinned and don't get
+// evicted, but they do count towards the budget.
+//
+// The cache can be used from multiple threads. Entries are split into
+// shards by their hash, each shard has its own lock, lookup and LRU list.
+// The budget is shared by all shards, every shard publishes the last use
+// of its oldest entry so eviction finds the least recently used entry of
+// the whole cache without taking the shard locks. Pinned entries found at
+// the back of a list are moved to the front, they are in use and only get
+// looked at again after a round through the list. Concurrent requests for the same
+// parameters are coalesced, only the first one reads from the underlying
+// provider.
 class CachedImageProvider : public ImageProvider {
+public:
+  struct Statistics {
+    size_t m_hits;
+    size_t m_misses;
+    size_t m_coalesced;
+    size_t m_evictions;
+
+    size_t m_entries;
+    size_t m_bytes;
+    size_t m_pinnedEntries;
+    size_t m_pinnedBytes;
+  };
+
+  static constexpr size_t DEFAULT_SHARD_COUNT = 16;
+
+private:
+  using Buffer = std::shared_ptr<uint8_t[]>;
+
+  struct Entry {
+    DataParameters m_params;
+    Buffer m_data;
+    size_t m_size;
+    // Value of the use clock when the entry was last read
+    uint64_t m_lastUse;
+  };
+  using EntryList = std::list<Entry>;
+
+  struct Shard {
+    std::mutex m_mutex;
+
+    // Most recently used entries are at the front
+    EntryList m_entries;
+    std::unordered_map<DataParameters, EntryList::iterator, DataParamHash> m_lookup;
+    // Reads which are currently being done by other threads
+    std::unordered_map<DataParameters, std::shared_future<Buffer>, DataParamHash> m_inFlight;
+    // Last use of the entry at the back of the list, UINT64_MAX if empty
+    std::atomic<uint64_t> m_oldestUse = UINT64_MAX;
+  };
+
   ImageProvider *m_provider;
 
-  std::unordered_map<DataParameters, std::shared_ptr<uint8_t[]>, DataParamHash> m_cache;
-  std::list<const DataParameters*> m_loadOrder;
-  size_t m_cacheSize;
+  std::vector<std::unique_ptr<Shard>> m_shards;
+  std::atomic<size_t> m_maxBytes;
+  std::atomic<size_t> m_usedBytes;
+  std::atomic<uint64_t> m_useClock;
+  // Only one thread evicts at a time
+  std::mutex m_evictMutex;
+
+  std::atomic<size_t> m_hits;
+  std::atomic<size_t> m_misses;
+  std::atomic<size_t> m_coalesced;
+  std::atomic<size_t> m_evictions;
 
 public:
-  CachedImageProvider(ImageProvider* provider, size_t maxCachedEntries);
+  CachedImageProvider(ImageProvider* provider, size_t maxBytes, size_t shardCount = DEFAULT_SHARD_COUNT);
   virtual ~CachedImageProvider();
 
+  void setMaxBytes(size_t maxBytes);
+  size_t maxBytes() const;
+  Statistics statistics() const;
+
   virtual DataParameters getImageParameters(int index) override;
   virtual std::shared_ptr<uint8_t[]> getPixels(const DataParameters& params) override;
+  virtual bool readPixels(const DataParameters& params, void *ptr) override;
 
   virtual double maxTypeValue() override;
 private:
-  void cleanupCache();
+  Shard& shardFor(const DataParameters& params);
+  // Both expect the shard lock to be held
+  static void updateOldest(Shard& shard);
+  // Moves pinned entries from the back of the list to the front until an
+  // unpinned one is the oldest, false if all of them are pinned
+  bool skipPinned(Shard& shard);
+  // Evicts entries until the budget is met, takes the shard locks itself
+  void evict();
 };
 
 } // namespace IO
-
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "io/provider.hpp"
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace IO {
+
+// Exposes every image as a mip pyramid of its first layer. Level 0 is the
+// full resolution image read through the wrapped provider, every following
+// level averages 2x2 pixel blocks of the previous one (odd rows and columns
+// are dropped). Pyramids are built on first use and kept in a LRU bounded
+// by the size of the levels, the full resolution level isn't counted since
+// it's owned by the wrapped provider.
+class PyramidProvider : public ImageProvider {
+public:
+  struct Level {
+    int m_level;
+    long m_width;
+    long m_height;
+    DataType::EnumType m_type;
+    std::shared_ptr<uint8_t[]> m_data;
+
+    operator bool() const;
+  };
+
+  // Levels narrower than this aren't built
+  static constexpr long MIN_LEVEL_WIDTH = 16;
+
+private:
+  struct Pyramid {
+    int m_index;
+    // Levels from 1 downwards
+    std::vector<Level> m_levels;
+    size_t m_size;
+  };
+  using PyramidList = std::list<Pyramid>;
+
+  ImageProvider *m_provider;
+
+  std::mutex m_mutex;
+  // Most recently used pyramids are at the front
+  PyramidList m_pyramids;
+  std::unordered_map<int, PyramidList::iterator> m_lookup;
+  size_t m_maxBytes;
+  size_t m_usedBytes;
+
+public:
+  PyramidProvider(ImageProvider *provider, size_t maxBytes);
+  virtual ~PyramidProvider();
+
+  PyramidProvider(const PyramidProvider& other) = delete;
+
+  // Number of levels the image has, including the full resolution one
+  int levelCount(int index);
+  Level level(int index, int level);
+  // Smallest level which is at least minWidth pixels wide, the full
+  // resolution level if the image itself is narrower
+  Level getLevel(int index, long minWidth);
+
+  virtual void setAccessOrder(const std::vector<int>& indices) override;
+  virtual std::unique_ptr<AsyncReader> createAsyncReader() override;
+
+  virtual DataParameters getImageParameters(int index) override;
+  virtual std::shared_ptr<uint8_t[]> getPixels(const DataParameters& params) override;
+  virtual bool readPixels(const DataParameters& params, void *ptr) override;
+  virtual double maxTypeValue() override;
+
+private:
+  DataParameters baseParameters(int index);
+  Level baseLevel(int index);
+  bool buildPyramid(int index, Pyramid& pyramid);
+  // Expects the lock to be held
+  void cleanupCache();
+};
+
+} // namespace IO
+
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace IO {
+
+// Tracks the order in which images are read and tells which images are
+// going to be read next. Stepping through the images forwards or
+// backwards continues in the same direction. Images are stepped through
+// in the order given with setOrder(), which also limits the read ahead to
+// the listed indices. Without an order the indices from 0 up to the image
+// count are used.
+class ReadAhead {
+  std::mutex m_mutex;
+  size_t m_depth;
+
+  // Position of the last read in the order, -1 if it wasn't in it
+  long m_lastPosition;
+  int m_direction;
+  std::vector<int> m_order;
+  std::unordered_map<int, size_t> m_orderPosition;
+
+public:
+  static constexpr size_t DEFAULT_DEPTH = 4;
+
+  ReadAhead(size_t depth = DEFAULT_DEPTH);
+
+  ReadAhead(const ReadAhead& other) = delete;
+
+  size_t depth() const;
+  void setOrder(const std::vector<int>& indices);
+
+  // Records a read of the image and returns up to depth() images which
+  // should be read ahead, closest first
+  std::vector<int> accessed(int index, long imageCount);
+};
+
+} // namespace IO
+
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "io/hdu.hpp"
+
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include <fitsio.h>
+
+namespace IO {
+
+// Tile table of a Rice compressed (fpack) image HDU. Compressed tiles are
+// read straight from the file and decompressed in parallel on a shared
+// thread pool, instead of one after another inside of cfitsio. Images
+// using other compression types, quantized floating point data or tiles
+// which weren't Rice compressed are not supported and load() fails for
+// them, those have to be read through cfitsio.
+class RiceTiles {
+  struct Tile {
+    // Absolute position of the compressed bytes in the file
+    uint64_t m_offset;
+    uint64_t m_size;
+  };
+
+  // Owned by the Fits handle, shared by the tile tables of all its HDUs
+  int m_fd;
+  int m_bytePix;
+  int m_blockSize;
+  double m_bzero;
+  double m_bscale;
+
+  std::vector<long> m_dims;
+  std::vector<long> m_tileDims;
+  std::vector<long> m_tileCounts;
+  std::vector<Tile> m_tiles;
+
+  RiceTiles();
+
+public:
+  RiceTiles(const RiceTiles& other) = delete;
+
+  // Expects the file to point at the compressed HDU, tiles are read from
+  // fd which has to stay open as long as the tile table is used
+  static std::unique_ptr<RiceTiles> load(fitsfile *fptr, const HduInfo& hdu, int fd);
+
+  size_t tileCount() const;
+
+  // Parameters must use an increment of 1 on every axis
+  bool read(const DataParameters& params, void *ptr) const;
+
+private:
+  bool decompressTile(size_t tile, const uint8_t *data, const DataParameters& params, uint8_t *dst) const;
+};
+
+} // namespace IO
+
@@ -2,18 +2,21 @@
 
 #include <gtkmm.h>
 #include "objects/image.hpp"
+#include "io/edit_journal.hpp"
+#include "io/sequence_file.hpp"
+#include "io/sequence_store.hpp"
 
 #include <filesystem>
+#include <memory>
+#include <optional>
 #include <vector>
 
 namespace IO {
 
-enum class SequenceType {
-  MULTI_FITS = 0,
-  SINGLE_FITS = 1,
-};
-
-class Sequence : public Glib::Object {
+// List model of the images of a sequence. The image data lives in a
+// SequenceStore, Obj::Image objects are only created for the rows that
+// are asked for and are shared while they are alive.
+class Sequence : public Glib::Object, public Gio::ListModel {
   Glib::Property<Glib::ustring> m_sequenceName;
   Glib::Property<int> m_fileIndexFirst;
   Glib::Property<int> m_imageCount;
@@ -29,10 +32,26 @@ class Sequence : public Glib::Object {
 
   Glib::Property<int> m_registrationLayer;
 
-  std::vector<Glib::RefPtr<Obj::Image>> m_images;
+  SequenceStore m_store;
+  // Live image objects by row, they remove themselves when destroyed
+  std::vector<Obj::Image*> m_wrappers;
 
   Glib::Property<bool> m_dirty;
   int m_oldReference;
+  // Unsaved edits, null when they aren't journaled
+  std::unique_ptr<EditJournal> m_journal;
+
+public:
+  using image_changed_signal_type = sigc::signal<void(int)>;
+
+private:
+  image_changed_signal_type m_signalImageChanged;
+  int m_updateDepth;
+  // Image that changed while updating, -1 for more than one
+  std::optional<int> m_pendingChange;
+
+  bool fillStats(int index, IO::ImageProvider& provider);
+  void reloadImages();
 
 public:
   Sequence();
@@ -43,6 +62,8 @@ public:
   void validate();
   void prepareWrite(IO::ImageProvider& provider);
 
+  // Plain copy of everything that is stored in the sequence file
+  SequenceFile contents() const;
   void writeStream(std::ostream& stream);
 
   void markDirty();
@@ -78,14 +99,58 @@ public:
 
   void referenceChanged();
 
-  Glib::RefPtr<Obj::Image> image(int index) const;
+  SequenceStore& store();
+  const SequenceStore& store() const;
+
+  // Creates an image object for the row unless one is alive already
+  Glib::RefPtr<Obj::Image> image(int index);
+  void forgetImage(int index, Obj::Image *image);
+
+  // Adds default stats to layers of the image that don't have them
+  void calculateStats(int index, IO::ImageProvider& provider);
 
-  // virtual GType get_item_type_vfunc() override;
-  // virtual guint get_n_items_vfunc() override;
-  // virtual gpointer get_item_vfunc(guint position) override;
+  // Emitted for every change of an image, whether it has an object or not,
+  // with -1 when all images may have changed
+  image_changed_signal_type signalImageChanged();
+  void notifyImageChanged(int index);
+  // Called by images when they are edited, not when they are loaded
+  void imageEdited(int index);
+
+  // Edits from now on are appended to the journal
+  void setJournal(std::unique_ptr<EditJournal>&& journal);
+  EditJournal *journal();
+  // Applies the edits of a journal left behind, the sequence is dirty
+  // afterwards if there were any
+  bool replayJournal(const std::filesystem::path& sequencePath);
+
+  // Image changes between these calls are reported with a single image
+  // changed signal when the outermost update ends
+  void beginUpdate();
+  void endUpdate();
+
+  // Keeps an update running for its lifetime, so an exception can't
+  // leave the sequence holding back its signals
+  class UpdateScope {
+    Sequence& m_sequence;
+
+  public:
+    UpdateScope(Sequence& sequence);
+    ~UpdateScope();
+
+    UpdateScope(const UpdateScope& other) = delete;
+  };
+
+protected:
+  virtual GType get_item_type_vfunc() override;
+  virtual guint get_n_items_vfunc() override;
+  virtual gpointer get_item_vfunc(guint position) override;
+
+public:
 
   static Glib::RefPtr<Sequence> readSequence(const std::filesystem::path& file);
   static Glib::RefPtr<Sequence> readStream(std::istream& stream);
+  // Creates the objects for the parsed contents of a sequence file
+  static Glib::RefPtr<Sequence> create(const SequenceFile& file);
 };
 
 } // namespace IO
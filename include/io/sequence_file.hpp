@@ -0,0 +1,91 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace IO {
+
+enum class SequenceType {
+  MULTI_FITS = 0,
+  SINGLE_FITS = 1,
+  // Frames of a SER video
+  SER = 2,
+};
+
+// Plain contents of a Siril sequence file. Parsing is kept apart from
+// building the sequence objects, so a file is read in one pass over the
+// text and the objects are created afterwards with the final sizes known.
+struct SequenceFile {
+  struct ImageLine {
+    int m_fileIndex;
+    bool m_included;
+    // Only set for sequences with variable size images, -1 otherwise
+    int m_width;
+    int m_height;
+
+    bool operator==(const ImageLine& other) const = default;
+  };
+
+  struct StatsLine {
+    int m_image;
+    int m_layer;
+    long m_totalPixels;
+    long m_goodPixels;
+    double m_mean;
+    double m_median;
+    double m_sigma;
+    double m_avgDev;
+    double m_mad;
+    double m_sqrtBWMV;
+    double m_location;
+    double m_scale;
+    double m_min;
+    double m_max;
+    double m_normValue;
+    double m_bgNoise;
+
+    bool operator==(const StatsLine& other) const = default;
+  };
+
+  // Registrations belong to the images in the order they are listed
+  struct RegistrationLine {
+    float m_FWHM;
+    float m_weightedFWHM;
+    float m_roundness;
+    double m_quality;
+    float m_backgroundLevel;
+    int m_numberOfStars;
+    double m_matrix[9];
+
+    bool operator==(const RegistrationLine& other) const = default;
+  };
+
+  bool m_hasHeader = false;
+  std::string m_name;
+  int m_fileIndexFirst = 0;
+  int m_imageCount = 0;
+  int m_selectedCount = 0;
+  int m_fileIndexFixedLength = 0;
+  int m_referenceImageIndex = 0;
+  int m_version = 0;
+  bool m_variableSizeImages = false;
+  bool m_fzFlag = false;
+
+  int m_layerCount = 0;
+  SequenceType m_type = SequenceType::MULTI_FITS;
+  // Layer the registrations were done on, -1 for the CFA channel
+  int m_registrationLayer = 0;
+
+  std::vector<ImageLine> m_images;
+  std::vector<StatsLine> m_stats;
+  std::vector<RegistrationLine> m_registrations;
+
+  // Errors are logged, the contents are only valid if true is returned
+  bool parse(std::string_view text);
+  // Maps the file into memory and parses it
+  bool read(const std::filesystem::path& path);
+};
+
+} // namespace IO
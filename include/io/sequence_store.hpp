@@ -0,0 +1,98 @@
+#pragma once
+
+#include "io/sequence_file.hpp"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace IO {
+
+// Metadata of all images of a sequence, stored by column. This is what a
+// sequence holds, the Obj::Image, Registration and Stats objects are only
+// created for the rows the UI works with and read and write through to
+// it. Rows are sequence indices.
+class SequenceStore {
+public:
+  using Matrix = std::array<double, 9>;
+
+  struct RegistrationValues {
+    float m_FWHM;
+    float m_weightedFWHM;
+    float m_roundness;
+    double m_quality;
+    float m_backgroundLevel;
+    int m_numberOfStars;
+  };
+
+private:
+  int m_layerCount;
+
+  std::vector<int> m_fileIndex;
+  std::vector<uint8_t> m_included;
+  std::vector<int> m_width;
+  std::vector<int> m_height;
+
+  std::vector<uint8_t> m_hasRegistration;
+  // Row major homographies, 9 values per image
+  std::vector<double> m_matrices;
+  std::vector<float> m_FWHM;
+  std::vector<float> m_weightedFWHM;
+  std::vector<float> m_roundness;
+  std::vector<double> m_quality;
+  std::vector<float> m_backgroundLevel;
+  std::vector<int> m_numberOfStars;
+
+  // Per layer
+  std::vector<std::vector<uint8_t>> m_hasStats;
+  std::vector<std::vector<SequenceFile::StatsLine>> m_stats;
+
+public:
+  SequenceStore();
+
+  size_t size() const;
+  int layerCount() const;
+  void resize(size_t size, int layerCount);
+
+  // Fills the rows from a parsed sequence file, false if it references
+  // images or layers that don't exist
+  bool load(const SequenceFile& file);
+  // Adds the images, registrations and stats to a sequence file. Both are
+  // written without gaps, so they end at the first image without them.
+  void save(SequenceFile& file) const;
+
+  int fileIndex(size_t row) const;
+  bool included(size_t row) const;
+  int width(size_t row) const;
+  int height(size_t row) const;
+  void setFileIndex(size_t row, int value);
+  void setIncluded(size_t row, bool value);
+  void setWidth(size_t row, int value);
+  void setHeight(size_t row, int value);
+  size_t includedCount() const;
+
+  bool hasRegistration(size_t row) const;
+  // Identity for images without a registration
+  const double *matrix(size_t row) const;
+  RegistrationValues registration(size_t row) const;
+  // Rows without a registration get one with an identity matrix
+  void setRegistration(size_t row, const RegistrationValues& values);
+  void setMatrix(size_t row, const double *matrix);
+  void clearRegistration(size_t row);
+
+  // Null if the layer of the image has no stats
+  const SequenceFile::StatsLine *stats(size_t row, int layer) const;
+  void setStats(size_t row, int layer, const SequenceFile::StatsLine& values);
+  void clearStats(size_t row, int layer);
+
+  // Expresses all registrations relative to a new reference image, the
+  // old reference gets an identity registration
+  void changeReference(size_t oldReference, size_t newReference);
+  // Gives every image before the last registered one an identity
+  // registration, returns false if nothing changed
+  bool fillRegistrationGaps();
+
+  static bool invert(const double *matrix, double *inverse);
+};
+
+} // namespace IO
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "io/sequence_file.hpp"
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace IO {
+
+// Writes sequence files. Lines are formatted with std::to_chars into a
+// buffer which is reused between saves and written with a single call.
+//
+// Complete files are written to a temporary file which replaces the
+// sequence, so a crash leaves either the old or the new file behind.
+//
+// The writer remembers where every line of the last written file is.
+// Later saves of the same layout only format the lines whose records
+// changed and patch them in the file. A line that got longer is padded
+// with some spare room, and only the part of the file after it is
+// written again. Patches are appended to a journal next to the sequence
+// and synced before the sequence is touched, recover() applies them
+// again if the program died while patching. The journal is dropped once
+// the patched sequence is synced. Records carry checksums of the lines
+// they don't touch and of the patched file, a journal is only replayed
+// over the file it was written for. Edits made between saves are kept by
+// EditJournal instead.
+class SequenceWriter {
+  // Room added to lines which outgrow their place
+  static constexpr size_t LINE_SLACK = 8;
+  // Journals above this size are folded into a complete write
+  static constexpr size_t MAX_JOURNAL_SIZE = 4 * 1024 * 1024;
+
+  enum SlotKind {
+    HEADER,
+    LAYERS,
+    IMAGE,
+    REGISTRATION,
+    STATS,
+  };
+
+  // Place of a line in the file
+  struct Slot {
+    size_t m_offset;
+    // Including the padding and the line end
+    size_t m_size;
+    SlotKind m_kind;
+    // Index of the record the line was formatted from
+    size_t m_record;
+  };
+
+  std::filesystem::path m_path;
+  std::filesystem::path m_journalPath;
+  size_t m_journalSize;
+  // Contents and layout of the file as it was last written
+  SequenceFile m_written;
+  bool m_hasWritten;
+  std::string m_buffer;
+  std::vector<Slot> m_slots;
+  uint64_t m_fileSize;
+  int64_t m_fileTime;
+  size_t m_lastWriteSize;
+  bool m_keepJournal;
+
+  // Reused between saves
+  std::string m_next;
+  std::string m_line;
+
+public:
+  SequenceWriter(const std::filesystem::path& path);
+
+  // Writes the complete file
+  bool write(const SequenceFile& file);
+  // Only writes the lines which changed since the last save, falls back
+  // to write when the layout of the file is different
+  bool update(const SequenceFile& file);
+
+  // Bytes written by the last save, for tests and logging
+  size_t lastWriteSize() const;
+  // Keeps the journal after successful saves, lets tests replay it as if
+  // the program died while patching
+  void keepJournal(bool keep);
+
+  // Applies the patches of a journal left behind by an interrupted save,
+  // false if the journal didn't belong to the sequence (e.g. another
+  // program saved it since) and was dropped
+  static bool recover(const std::filesystem::path& path);
+  static std::filesystem::path journalPath(const std::filesystem::path& path);
+
+  // Formats a complete file into text
+  static void format(const SequenceFile& file, std::string& text);
+
+private:
+  // Appends the lines and records their places when slots is set
+  static void formatFile(const SequenceFile& file, std::string& text, std::vector<Slot> *slots);
+  static void formatSlot(const SequenceFile& file, const Slot& slot, std::string& text);
+  static void formatHeader(const SequenceFile& file, std::string& text);
+  static void formatImage(const SequenceFile& file, const SequenceFile::ImageLine& line, std::string& text);
+  static void formatRegistration(int layer, const SequenceFile::RegistrationLine& line, std::string& text);
+  static void formatStats(const SequenceFile::StatsLine& line, std::string& text);
+
+  // Appends the patches and syncs the journal
+  bool appendJournal(const std::vector<size_t>& patches, size_t tail, uint64_t oldSize);
+  bool sameLayout(const SequenceFile& file) const;
+  bool fileUnchanged() const;
+  void rememberFile();
+};
+
+} // namespace IO
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "io/provider.hpp"
+
+#include <filesystem>
+#include <string>
+
+namespace IO {
+
+// Reader for SER video files as written by planetary capture software.
+// All frames have the same size and follow the 178 byte header, so the
+// file is mapped into memory and a frame is found with a multiplication.
+// Mono and Bayer frames have two axes, RGB and BGR frames are served with
+// a third axis holding the red, green and blue planes.
+class SerFile : public ImageProvider {
+public:
+  enum ColorId {
+    MONO = 0,
+    BAYER_RGGB = 8,
+    BAYER_GRBG = 9,
+    BAYER_GBRG = 10,
+    BAYER_BGGR = 11,
+    BAYER_CYYM = 16,
+    BAYER_YCMY = 17,
+    BAYER_YMCY = 18,
+    BAYER_MYYC = 19,
+    RGB = 100,
+    BGR = 101,
+  };
+
+  static constexpr size_t HEADER_SIZE = 178;
+
+private:
+  struct Mapping;
+
+  std::filesystem::path m_path;
+  std::shared_ptr<Mapping> m_mapping;
+
+  ColorId m_colorId;
+  bool m_littleEndian;
+  long m_width;
+  long m_height;
+  int m_pixelDepth;
+  int m_planes;
+  size_t m_bytesPerPixel;
+  size_t m_frameSize;
+  std::string m_observer;
+  std::string m_instrument;
+  std::string m_telescope;
+  // Per frame timestamps from the trailer, null if the file has none
+  const uint8_t *m_timestamps;
+
+public:
+  SerFile(const std::filesystem::path& filename);
+  virtual ~SerFile() = default;
+
+  // no copy constructor
+  SerFile(const SerFile& other) = delete;
+
+  ColorId colorId() const;
+  int pixelDepth() const;
+  const std::string& observer() const;
+  const std::string& instrument() const;
+  const std::string& telescope() const;
+
+  // Frame data as it is stored in the file, null for invalid indices
+  const uint8_t *rawFrame(int index) const;
+
+  bool hasTimestamps() const;
+  // UTC capture time of a frame in 100 ns ticks since 0001-01-01, 0 if
+  // there is none
+  int64_t timestamp(int index) const;
+  // Seconds since the Unix epoch of a SER timestamp
+  static double unixTime(int64_t timestamp);
+
+  virtual DataParameters getImageParameters(int index) override;
+  virtual std::shared_ptr<uint8_t[]> getPixels(const DataParameters& params) override;
+  virtual bool readPixels(const DataParameters& params, void *ptr) override;
+  virtual double maxTypeValue() override;
+
+private:
+  bool parseHeader();
+  bool isDirectView(const DataParameters& params) const;
+};
+
+} // namespace IO
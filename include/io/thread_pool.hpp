@@ -0,0 +1,47 @@
+#pragma once
+
+#include "io/async.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace IO {
+
+// Fixed set of worker threads running queued jobs in FIFO order.
+// Jobs which haven't started yet can be dropped with clear().
+class ThreadPool : public Executor {
+  std::mutex m_mutex;
+  std::condition_variable m_jobAdded;
+  std::condition_variable m_idle;
+  std::deque<std::function<void()>> m_jobs;
+  std::vector<std::thread> m_threads;
+
+  size_t m_running;
+  bool m_stop;
+
+public:
+  // threadCount = 0 picks the thread count based on the hardware concurrency
+  ThreadPool(size_t threadCount = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool& other) = delete;
+
+  size_t threadCount() const;
+
+  void submit(std::function<void()>&& job);
+  virtual void post(std::function<void()>&& job) override;
+  // Drops all jobs which haven't been started yet
+  void clear();
+  // Blocks until the queue is empty and no job is running
+  void wait();
+
+private:
+  void worker();
+};
+
+} // namespace IO
+
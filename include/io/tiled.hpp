@@ -0,0 +1,40 @@
+#pragma once
+
+#include "io/provider.hpp"
+
+namespace IO {
+
+// Serves region of interest reads from fixed size tiles. Every tile is
+// requested from the wrapped provider on its own with getParts(), so a
+// caching provider underneath keeps them individually and overlapping
+// regions share the tiles they have in common. Only reads of a part of an
+// image with unit increments on both axes are tiled, everything else goes
+// straight to the wrapped provider.
+class TiledImageProvider : public ImageProvider {
+  ImageProvider *m_provider;
+  long m_tileSize;
+
+public:
+  static constexpr long DEFAULT_TILE_SIZE = 256;
+
+  TiledImageProvider(ImageProvider *provider, long tileSize = DEFAULT_TILE_SIZE);
+  virtual ~TiledImageProvider();
+
+  TiledImageProvider(const TiledImageProvider& other) = delete;
+
+  long tileSize() const;
+
+  virtual void setAccessOrder(const std::vector<int>& indices) override;
+
+  virtual DataParameters getImageParameters(int index) override;
+  virtual std::shared_ptr<uint8_t[]> getPixels(const DataParameters& params) override;
+  virtual bool readPixels(const DataParameters& params, void *ptr) override;
+  virtual double maxTypeValue() override;
+
+private:
+  bool isTiled(const DataParameters& params, const DataParameters& image) const;
+  DataParameters tileParameters(const DataParameters& image, long tileX, long tileY, long layer) const;
+};
+
+} // namespace IO
+
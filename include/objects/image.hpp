@@ -10,6 +10,8 @@ namespace IO {
 
 namespace Obj {
 
+// View of one row of a sequence's store. Changes to the properties,
+// registration and stats are written through to the store.
 class Image : public Glib::Object {
   Glib::Property_ReadOnly<int> m_sequenceIndex;
   Glib::Property<int> m_fileIndex;
@@ -20,7 +22,9 @@ class Image : public Glib::Object {
   std::vector<Glib::RefPtr<Stats>> m_stats;
   Glib::RefPtr<Registration> m_registration;
 
-  std::weak_ptr<IO::Sequence> m_sequence;
+  Glib::RefPtr<IO::Sequence> m_sequence;
+  // Set while the values are read from the store
+  bool m_loading;
 
   sigc::connection m_connRegistration;
   std::vector<sigc::connection> m_connStats;
@@ -39,9 +43,19 @@ private:
   redraw_signal_type m_redrawSignal;
   bool m_notified;
 
+  void valuesModified();
+  void registrationModified();
+  void statsModified(int layer);
+  void writeValues();
+  void writeRegistration();
+  void writeStats(int layer);
+
 public:
-  Image(int index, int layerCount, const Glib::RefPtr<IO::Sequence>& sequence);
-  virtual ~Image() = default;
+  Image(int index, const Glib::RefPtr<IO::Sequence>& sequence);
+  virtual ~Image();
+
+  // Reads the values of the image's row from the sequence store
+  void load();
 
   void notifyRedraw();
 
@@ -78,7 +92,7 @@ public:
   Glib::PropertyProxy<double> propertyXOffset();
   Glib::PropertyProxy<double> propertyYOffset();
 
-  static Glib::RefPtr<Image> create(int seqIndex, int layerCount, const Glib::RefPtr<IO::Sequence>& sequence);
+  static Glib::RefPtr<Image> create(int seqIndex, const Glib::RefPtr<IO::Sequence>& sequence);
 };
 
 } // namespace Obj
@@ -21,6 +21,15 @@ class HomographyMatrix : public Glib::Object {
 
   Glib::Property<double>* m_accessArray[9];
 
+public:
+  using modified_signal_type = sigc::signal<void()>;
+
+private:
+  modified_signal_type m_signalModified;
+  int m_updateDepth;
+  bool m_modifiedPending;
+  void emitModified();
+
 public:
   enum OrderEnum {
     ROW_MAJOR,
@@ -36,6 +45,12 @@ public:
   Glib::PropertyProxy_ReadOnly<double> property(int i) const;
   Glib::PropertyProxy_ReadOnly<double> property(int col, int row) const;
 
+  modified_signal_type signalModified();
+
+  // Changes made between these calls emit a single modified signal
+  void beginUpdate();
+  void endUpdate();
+
   void reset();
 
   double get(int i) const;
@@ -79,6 +94,7 @@ public:
   void write(const T *data, OrderEnum ordering = ROW_MAJOR) {
     static_assert(std::is_convertible_v<T, double>);
 
+    beginUpdate();
     for(uint i = 0; i < 9; ++i) {
       if(ordering == ROW_MAJOR)
         set(i, static_cast<double>(data[i]));
@@ -88,6 +104,7 @@ public:
         set(i, static_cast<double>(data[row + col * 3]));
       }
     }
+    endUpdate();
   }
 
   cv::Mat read() const;
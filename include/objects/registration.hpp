@@ -20,6 +20,8 @@ public:
 
 private:
   modified_signal_type m_signalModified;
+  int m_updateDepth;
+  bool m_modifiedPending;
   void emitModified();
 
 public:
@@ -28,6 +30,10 @@ public:
 
   modified_signal_type signalModified();
 
+  // Changes made between these calls emit a single modified signal
+  void beginUpdate();
+  void endUpdate();
+
   HomographyMatrix& matrix();
   const HomographyMatrix& matrix() const;
 
@@ -27,6 +27,8 @@ public:
 
 private:
   modified_signal_type m_signalModified;
+  int m_updateDepth;
+  bool m_modifiedPending;
   void emitModified();
 
 public:
@@ -35,6 +37,10 @@ public:
 
   modified_signal_type signalModified();
 
+  // Changes made between these calls emit a single modified signal
+  void beginUpdate();
+  void endUpdate();
+
   Glib::PropertyProxy<long> propertyTotalPixels();
   Glib::PropertyProxy<long> propertyGoodPixels();
   Glib::PropertyProxy<double> propertyMean();
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "io/async.hpp"
+
+namespace UI {
+
+// Runs jobs on the GLib main loop, coroutines awaiting provider calls
+// from the UI resume through it so they can touch widgets again
+class MainLoopExecutor : public IO::Executor {
+public:
+  virtual void post(std::function<void()>&& job) override;
+};
+
+MainLoopExecutor& mainLoop();
+
+} // namespace UI
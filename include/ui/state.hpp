@@ -1,27 +1,78 @@
 #pragma once
 
 #include <filesystem>
+#include <functional>
+#include <memory>
+#include <vector>
 
 #include "io/sequence.hpp"
-#include "io/fits.hpp"
+#include "io/provider.hpp"
+#include "io/preview_cache.hpp"
+#include "io/pyramid.hpp"
+#include "io/multi_fits.hpp"
+#include "io/header_table.hpp"
+#include "io/sequence_writer.hpp"
+#include "io/thread_pool.hpp"
 
 namespace UI {
 class Window;
 
-class State {
+class State : public std::enable_shared_from_this<State> {
   std::filesystem::path m_sequenceFilePath;
+  // Saves after the first one only rewrite changed lines, it's only
+  // used from the save thread
+  IO::SequenceWriter m_writer;
+  // Runs saves one after another, off the main loop
+  IO::ThreadPool m_saveThread;
+  // Saves whose result didn't reach the main loop yet and jobs waiting
+  // for them, both are only used on the main loop
+  int m_pendingSaves;
+  std::vector<std::function<void()>> m_afterSave;
 
 public:
   std::shared_ptr<IO::Sequence> m_sequence;
-  IO::Fits m_imageFile;
+  // Pyramid on top of the provider chain, levels are used for display
+  std::unique_ptr<IO::PyramidProvider> m_imageFile;
+  // File indices in the order images are stepped through, empty when
+  // that's the order of the provider indices
+  std::vector<int> m_accessOrder;
+  // File the images are read from
+  std::filesystem::path m_imagePath;
+  // Set for one file per image sequences, owned by m_imageFile
+  IO::MultiFits *m_multiFits;
+  std::unique_ptr<IO::PreviewCache> m_previews;
+  // Header keywords of all images, indexed by the provider image index,
+  // null for SER files which have no headers
+  std::unique_ptr<IO::HeaderTable> m_headers;
 
-  State(const std::filesystem::path& sequenceFilePath, const std::shared_ptr<IO::Sequence>& sequence, IO::Fits&& image);
-  ~State() = default;
+  State(const std::filesystem::path& sequenceFilePath, const std::shared_ptr<IO::Sequence>& sequence, std::unique_ptr<IO::ImageProvider>&& image);
+  ~State();
 
+  // Takes a snapshot of the sequence and writes it in the background,
+  // a failed save marks the sequence dirty again
   void saveSequence();
+  // Blocks until all started saves are written
+  void waitForSave();
+  // True until the results of all started saves reached the main loop
+  bool savePending() const;
+  // Runs the job on the main loop once no save is pending, the sequence
+  // is dirty again by then if any of the saves failed
+  void afterSave(std::function<void()>&& job);
+  // File an image is stored in
+  std::filesystem::path imageSource(int fileIndex) const;
+
+  // Default size of the decoded pixel cache in bytes
+  static constexpr size_t DEFAULT_CACHE_BUDGET = 2ull * 1024 * 1024 * 1024;
+  static size_t cacheBudget();
 
   static std::shared_ptr<State> fromSequenceFile(const std::filesystem::path& sequence_path);
+
+private:
+  static std::shared_ptr<State> fromMultiFits(const std::filesystem::path& sequence_path, const std::shared_ptr<IO::Sequence>& sequence);
+  static std::shared_ptr<State> fromSer(const std::filesystem::path& sequence_path, const std::shared_ptr<IO::Sequence>& sequence);
+  // Loads the saved table of the sequence, rebuilds it if it's out of date
+  void loadHeaders(const std::vector<int>& indices, const IO::HeaderTable::Lookup& lookup,
+                   const std::vector<std::filesystem::path>& sources);
 };
 
 } // namespace UI
-
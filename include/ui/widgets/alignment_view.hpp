@@ -5,6 +5,7 @@
 #include "ui/widgets/gl_area_plus.hpp"
 #include "ui/widgets/main_view.hpp"
 #include "ui/widgets/sequence_list.hpp"
+#include "io/async.hpp"
 
 namespace UI {
 class State;
@@ -35,6 +36,14 @@ class AlignmentView : public GLAreaPlus {
   double m_refWidth;
   double m_refHeight;
 
+  // Part of the image the textures hold, as UV offset and size
+  float m_refRegion[4];
+  float m_alignRegion[4];
+  // Incremented for every texture load, so older loads finishing late
+  // don't replace newer ones
+  uint m_refLoad;
+  uint m_alignLoad;
+
   Glib::RefPtr<Obj::Image> m_referenceImage;
   Glib::RefPtr<Obj::Image> m_alignImage;
 
@@ -56,6 +65,14 @@ protected:
   void sequenceViewSelectionChanged(uint position, uint nitems);
   void viewTypeChanged();
   void pickArea();
+
+private:
+  // Width of the pyramid level textures are loaded from
+  long textureWidth();
+  // Loads the whole image or the picked area, region receives the part of
+  // the image the texture covers. Pixels are read off the main loop and
+  // uploaded once the read has finished.
+  IO::Task loadTexture(std::shared_ptr<GL::Texture> texture, Glib::RefPtr<Obj::Image> image, float *region, uint& loadId);
 };
 
 }
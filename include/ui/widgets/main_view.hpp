@@ -12,8 +12,11 @@ namespace UI {
 class State;
 class MainView;
 
+// Texture of one sequence image, what is drawn is read from the
+// sequence store so no image object is needed
 class ViewImage {
-  Glib::RefPtr<Obj::Image> m_imageObject;
+  Glib::RefPtr<IO::Sequence> m_sequence;
+  int m_index;
   std::shared_ptr<GL::Buffer> m_vertices;
   std::shared_ptr<GL::Texture> m_texture;
   std::shared_ptr<GL::VAO> m_vao;
@@ -23,15 +26,15 @@ class ViewImage {
   double m_maxValue;
 
 public:
-  ViewImage(MainView& area, const Glib::RefPtr<Obj::Image>& image);
+  ViewImage(MainView& area, const Glib::RefPtr<IO::Sequence>& sequence, int index);
   ~ViewImage() = default;
 
 private:
   void makeVertices(float scaleX, float scaleY);
-  void loadTexture(IO::ImageProvider& image, int index);
+  void loadTexture(State& state, int index);
 
 public:
-  Glib::RefPtr<Obj::Image> imageObject();
+  int index() const;
   void render(GL::Program& program, bool applyMatrix = true);
 };
 
@@ -69,6 +72,9 @@ class MainView : public GLAreaPlus {
 
   std::shared_ptr<UI::State> m_state;
   std::list<std::shared_ptr<ViewImage>> m_images;
+  sigc::connection m_connImageChanged;
+  // Keeps the level bindings of the selected image alive
+  Glib::RefPtr<Obj::Image> m_selectedImage;
 
   SequenceView* m_sequenceView;
   Gtk::CheckButton *m_hideUnselected;
@@ -2,12 +2,16 @@
 
 #include <gtkmm.h>
 #include "objects/image.hpp"
+#include "io/sequence.hpp"
 
 namespace UI {
 class State;
 
 class SequenceView : public Gtk::ColumnView {
-  Glib::RefPtr<Gio::ListStore<Obj::Image>> m_model;
+  // The sequence itself is the list model, rows only get image objects
+  // while they are bound
+  Glib::RefPtr<IO::Sequence> m_sequence;
+  Glib::RefPtr<Gtk::SingleSelection> m_selection;
 
   using Factory = Glib::RefPtr<Gtk::SignalListItemFactory>;
   using ListItem = Glib::RefPtr<Gtk::ListItem>;
@@ -28,8 +32,6 @@ public:
 
   void connectState(const std::shared_ptr<UI::State>& state);
 
-  Glib::RefPtr<Gio::ListStore<Obj::Image>>& model();
-
   uint getSelectedIndex();
   Glib::RefPtr<Obj::Image> getSelected();
 
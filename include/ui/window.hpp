@@ -14,6 +14,8 @@ class Window : public Gtk::Window {
   std::shared_ptr<UI::State> m_state;
 
   AdwDialog *m_saveChangesDialog;
+  // Closing is retried once the running save finished
+  bool m_closeAfterSave;
 
   std::list<std::unique_ptr<Pages::Page>> m_toolPages;
 
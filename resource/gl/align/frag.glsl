@@ -8,6 +8,10 @@ out vec4 o_FragColor;
 uniform sampler2D u_RefTexture;
 uniform sampler2D u_AlignTexture;
 
+// Part of the image each texture holds, offset and size in UV
+uniform vec4 u_RefRegion;
+uniform vec4 u_AlignRegion;
+
 uniform int u_DisplayType;
 uniform float u_DisplayParam;
 
@@ -19,16 +23,19 @@ vec3 applyLevels(vec3 val, float m, float M) {
 }
 
 void main() {
+  vec2 refUV = (p_RefUV - u_RefRegion.xy) / u_RefRegion.zw;
+  vec2 alignUV = (p_AlignUV - u_AlignRegion.xy) / u_AlignRegion.zw;
+
   vec3 colRef;
   // TODO: Use border clamping for this
-  if(p_RefUV.x >= 0.0 && p_RefUV.x <= 1.0 && p_RefUV.y >= 0.0 && p_RefUV.y <= 1.0) {
-    colRef = texture(u_RefTexture, p_RefUV).xyz;
+  if(refUV.x >= 0.0 && refUV.x <= 1.0 && refUV.y >= 0.0 && refUV.y <= 1.0) {
+    colRef = texture(u_RefTexture, refUV).xyz;
   } else {
     colRef = vec3(0.0, 0.0, 0.0);
   }
   vec3 colAli;// = texture(u_AlignTexture, p_UV) * 10.0;
-  if(p_AlignUV.x >= 0.0 && p_AlignUV.x <= 1.0 && p_AlignUV.y >= 0.0 && p_AlignUV.y <= 1.0) {
-    colAli = texture(u_AlignTexture, p_AlignUV).xyz;
+  if(alignUV.x >= 0.0 && alignUV.x <= 1.0 && alignUV.y >= 0.0 && alignUV.y <= 1.0) {
+    colAli = texture(u_AlignTexture, alignUV).xyz;
   } else {
     colAli = vec3(0.0, 0.0, 0.0);
   }
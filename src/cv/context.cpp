@@ -1,4 +1,6 @@
 #include "cv/context.hpp"
+#include "io/async_reader.hpp"
+#include "io/kernels.hpp"
 
 #include <opencv2/calib3d.hpp>
 #include <opencv2/core/base.hpp>
@@ -53,6 +55,36 @@ void Context::findKeypoints(const ImgPtr& image, bool reprocess) {
   static_cast<void>(processImage(image, reprocess));
 }
 
+void Context::findKeypoints(const std::list<ImgPtr>& images, bool reprocess) {
+  std::unordered_map<int, ImgPtr> pending;
+  std::vector<DataParameters> batch;
+  for(auto& image : images) {
+    auto iter = m_imageData.find(image);
+    if(iter != m_imageData.end()) {
+      if(!reprocess)
+        continue;
+      m_imageData.erase(iter);
+    }
+
+    pending.insert({ image->getFileIndex(), image });
+    batch.push_back(m_provider.matrixParameters(image->getFileIndex()));
+  }
+
+  auto reader = m_provider.createAsyncReader();
+  reader->submit(batch);
+  while(auto completion = reader->next()) {
+    auto& params = completion->m_params;
+    auto& image = pending[params.index()];
+    if(!completion->m_data) {
+      spdlog::error("Reading image (sequence index = {}) failed", image->getSequenceIndex());
+      continue;
+    }
+
+    auto matrix = wrapBuffer(std::move(completion->m_data), params.height(), params.width(), ImageProvider::matrixType(params.type()));
+    static_cast<void>(detect(image, matrix));
+  }
+}
+
 void Context::matchFeatures(const ImgPtr& image) {
   auto& ref = m_referenceImages.front();
   auto align = getData(image);
@@ -199,16 +231,28 @@ std::shared_ptr<Context::ImgData> Context::processImage(const ImgPtr& image, boo
     }
   }
 
-  // Process image
-  cv::Mat raw;
-  m_provider.getImageMatrix(image->getFileIndex()).convertTo(raw, CV_32F);
+  return detect(image, m_provider.getImageMatrix(image->getFileIndex()));
+}
+
+std::shared_ptr<Context::ImgData> Context::detect(const ImgPtr& image, const cv::Mat& matrix) {
+  // Scaled to the 16 bit range, so the levels below fit every data type
+  const double scale = 65535.0 / m_provider.maxTypeValue();
   // TODO: Use levels from image object
-  raw = ((cv::min(cv::max(raw, 990.0), 3900.0) - 990.0) / (3900.0 - 990.0));
+  const double low = 990.0, high = 3900.0;
 
   cv::Mat mat;
-  raw.convertTo(mat, CV_8U, 255);
+  if(matrix.type() == CV_16UC1 && matrix.isContinuous()) {
+    // Scale, levels and byte conversion in a single pass
+    mat.create(matrix.rows, matrix.cols, CV_8UC1);
+    Kernels::levelsToByte(matrix.ptr<uint16_t>(), mat.ptr<uint8_t>(), matrix.total(), scale, low, high);
+  } else {
+    cv::Mat raw;
+    matrix.convertTo(raw, CV_32F, scale);
+    raw = ((cv::min(cv::max(raw, low), high) - low) / (high - low));
+    raw.convertTo(mat, CV_8U, 255);
+  }
 
-  std::shared_ptr<ImgData> data(new ImgData(image, raw.cols, raw.rows));
+  std::shared_ptr<ImgData> data(new ImgData(image, matrix.cols, matrix.rows));
 
   data->m_keypoints.clear();
   m_detector->detectAndCompute(mat, cv::noArray(), data->m_keypoints, data->m_descriptors);
@@ -0,0 +1,24 @@
+#include "io/async.hpp"
+#include "io/thread_pool.hpp"
+
+#include <exception>
+
+#include <spdlog/spdlog.h>
+
+using namespace IO;
+
+Executor& IO::ioExecutor() {
+  static ThreadPool pool;
+  return pool;
+}
+
+void Task::promise_type::unhandled_exception() {
+  // The frame is freed after final_suspend, like a coroutine which returned
+  try {
+    throw;
+  } catch(const std::exception& e) {
+    spdlog::error("Unhandled exception in a coroutine: {}", e.what());
+  } catch(...) {
+    spdlog::error("Unhandled exception in a coroutine");
+  }
+}
@@ -0,0 +1,278 @@
+#include "io/async_reader.hpp"
+#include "io/buffer_pool.hpp"
+#include "io/mapped_fits.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <spdlog/spdlog.h>
+
+using namespace IO;
+
+// Failed reads complete with null data, exceptions never leave the reader
+static std::shared_ptr<uint8_t[]> readOrNull(ImageProvider *provider, const DataParameters& params) {
+  try {
+    return provider->getPixels(params);
+  } catch(const std::exception& e) {
+    spdlog::error("Failed to read image {}: {}", params.index(), e.what());
+    return nullptr;
+  }
+}
+
+ThreadPoolReader::ThreadPoolReader(ImageProvider *provider, size_t queueDepth, size_t maxBytes)
+  : m_provider(provider)
+  , m_pending(0)
+  , m_maxBytes(maxBytes)
+  , m_bytes(0)
+  , m_pool(queueDepth) {
+}
+
+void ThreadPoolReader::submit(const std::vector<DataParameters>& batch) {
+  std::lock_guard lock(m_mutex);
+  m_pending += batch.size();
+  m_waiting.insert(m_waiting.end(), batch.begin(), batch.end());
+  start();
+}
+
+void ThreadPoolReader::start() {
+  while(!m_waiting.empty()) {
+    size_t bytes = m_waiting.front().byteSize();
+    if(m_bytes > 0 && m_bytes + bytes > m_maxBytes)
+      break;
+
+    auto params = m_waiting.front();
+    m_waiting.pop_front();
+    m_bytes += bytes;
+    m_pool.submit([this, params]() {
+      auto data = readOrNull(m_provider, params);
+      {
+        std::lock_guard lock(m_mutex);
+        m_completions.push_back({ params, std::move(data) });
+      }
+      m_finished.notify_one();
+    });
+  }
+}
+
+std::optional<AsyncReader::Completion> ThreadPoolReader::next() {
+  std::unique_lock lock(m_mutex);
+  if(m_pending == 0)
+    return std::nullopt;
+
+  m_finished.wait(lock, [this]() { return !m_completions.empty(); });
+  auto completion = std::move(m_completions.front());
+  m_completions.pop_front();
+  --m_pending;
+
+  // The caller owns the data now, which makes room for the next reads
+  m_bytes -= completion.m_params.byteSize();
+  start();
+  return completion;
+}
+
+size_t ThreadPoolReader::pending() const {
+  std::lock_guard lock(m_mutex);
+  return m_pending;
+}
+
+#ifdef HAVE_LIBURING
+UringReader::UringReader(ImageProvider *fallback, const std::filesystem::path& path, const HduIndex& hdus, size_t queueDepth, size_t maxBytes)
+  : m_fallback(fallback)
+  , m_hdus(hdus)
+  , m_fd(-1)
+  , m_valid(false)
+  , m_queueDepth(queueDepth)
+  , m_inFlight(0)
+  , m_maxBytes(maxBytes)
+  , m_bytes(0) {
+  m_fd = open(path.c_str(), O_RDONLY);
+  if(m_fd < 0) {
+    spdlog::error("Failed to open {} for asynchronous reads", path.c_str());
+    return;
+  }
+
+  int result = io_uring_queue_init(m_queueDepth, &m_ring, 0);
+  if(result < 0) {
+    // Kernels without io_uring (or with it disabled) use the thread pool
+    spdlog::warn("io_uring is not available ({}), using threads for reads", strerror(-result));
+    close(m_fd);
+    m_fd = -1;
+    return;
+  }
+
+  m_valid = true;
+}
+
+UringReader::~UringReader() {
+  if(!m_valid) {
+    if(m_fd >= 0)
+      close(m_fd);
+    return;
+  }
+
+  // Reads still in flight write into their buffers, wait for them
+  while(m_inFlight > 0) {
+    io_uring_cqe *cqe;
+    if(io_uring_wait_cqe(&m_ring, &cqe) < 0)
+      break;
+    delete static_cast<Request*>(io_uring_cqe_get_data(cqe));
+    io_uring_cqe_seen(&m_ring, cqe);
+    --m_inFlight;
+  }
+
+  io_uring_queue_exit(&m_ring);
+  close(m_fd);
+}
+
+bool UringReader::valid() const {
+  return m_valid;
+}
+
+void UringReader::submit(const std::vector<DataParameters>& batch) {
+  m_waiting.insert(m_waiting.end(), batch.begin(), batch.end());
+  fill();
+}
+
+std::optional<AsyncReader::Completion> UringReader::next() {
+  while(m_completions.empty()) {
+    fill();
+    if(!m_completions.empty())
+      break;
+    if(m_inFlight == 0)
+      return std::nullopt;
+
+    io_uring_cqe *cqe;
+    int result = io_uring_wait_cqe(&m_ring, &cqe);
+    if(result < 0) {
+      if(result == -EINTR)
+        continue;
+      spdlog::error("Waiting for reads failed: {}", strerror(-result));
+      return std::nullopt;
+    }
+
+    auto request = static_cast<Request*>(io_uring_cqe_get_data(cqe));
+    result = cqe->res;
+    io_uring_cqe_seen(&m_ring, cqe);
+    --m_inFlight;
+    finish(request, result);
+  }
+
+  auto completion = std::move(m_completions.front());
+  m_completions.pop_front();
+
+  // The caller owns the data now, which makes room for the next reads
+  m_bytes -= completion.m_params.byteSize();
+  fill();
+  return completion;
+}
+
+size_t UringReader::pending() const {
+  return m_waiting.size() + m_inFlight + m_completions.size();
+}
+
+bool UringReader::fits(size_t bytes) const {
+  return m_bytes == 0 || m_bytes + bytes <= m_maxBytes;
+}
+
+void UringReader::fill() {
+  while(m_inFlight < m_queueDepth && !m_waiting.empty()) {
+    auto params = m_waiting.front();
+
+    size_t start, size;
+    if(params.index() < 0 || (size_t)params.index() >= m_hdus.size() || !MappedFits::contiguousRange(m_hdus[params.index()], params, start, size)) {
+      // Scattered regions are read right away
+      if(!fits(params.byteSize()))
+        break;
+      m_waiting.pop_front();
+      m_bytes += params.byteSize();
+      m_completions.push_back({ params, readOrNull(m_fallback, params) });
+      continue;
+    }
+
+    // Data is converted in place when the file and the requested type
+    // have the same size, otherwise it's read into a separate buffer
+    size_t bufferSize = std::max(size, params.byteSize());
+    if(!fits(bufferSize))
+      break;
+    m_waiting.pop_front();
+    m_bytes += bufferSize;
+
+    auto request = new Request {
+      .m_params = params,
+      .m_buffer = BufferPool::global().acquire(bufferSize),
+      .m_dataStart = start,
+      .m_offset = m_hdus[params.index()].m_dataOffset + start,
+      .m_size = size,
+      .m_done = 0,
+      .m_bufferSize = bufferSize,
+    };
+    if(!request->m_buffer) {
+      complete(request, nullptr);
+      continue;
+    }
+
+    queueRead(request);
+  }
+
+  io_uring_submit(&m_ring);
+}
+
+void UringReader::queueRead(Request *request) {
+  auto sqe = io_uring_get_sqe(&m_ring);
+  // The ring has room for every read in flight, but keep going if not
+  if(!sqe) {
+    io_uring_submit(&m_ring);
+    sqe = io_uring_get_sqe(&m_ring);
+  }
+
+  io_uring_prep_read(sqe, m_fd, request->m_buffer.get() + request->m_done, request->m_size - request->m_done, request->m_offset + request->m_done);
+  io_uring_sqe_set_data(sqe, request);
+  ++m_inFlight;
+}
+
+void UringReader::finish(Request *request, int result) {
+  if(result < 0 && result != -EAGAIN) {
+    spdlog::error("Reading image {} failed: {}", request->m_params.index(), strerror(-result));
+    complete(request, nullptr);
+    return;
+  }
+
+  if(result == 0) {
+    spdlog::error("Reading image {} failed: unexpected end of file", request->m_params.index());
+    complete(request, nullptr);
+    return;
+  }
+
+  // Short reads are continued where they stopped
+  if(result > 0)
+    request->m_done += result;
+  if(request->m_done < request->m_size) {
+    queueRead(request);
+    io_uring_submit(&m_ring);
+    return;
+  }
+
+  auto& params = request->m_params;
+  auto& hdu = m_hdus[params.index()];
+  std::shared_ptr<uint8_t[]> data = request->m_buffer;
+  if(request->m_size != params.byteSize()) {
+    data = BufferPool::global().acquire(params.byteSize());
+    if(data && !MappedFits::convertPixels(hdu, params, request->m_buffer.get(), request->m_dataStart, data.get()))
+      data = nullptr;
+  } else if(!MappedFits::convertPixels(hdu, params, data.get(), request->m_dataStart, data.get())) {
+    data = nullptr;
+  }
+
+  complete(request, std::move(data));
+}
+
+void UringReader::complete(Request *request, std::shared_ptr<uint8_t[]> data) {
+  // Only the completion is accounted from now on, next() releases it
+  m_bytes -= request->m_bufferSize - request->m_params.byteSize();
+  m_completions.push_back({ request->m_params, std::move(data) });
+  delete request;
+}
+#endif
@@ -0,0 +1,141 @@
+#include "io/buffer_pool.hpp"
+
+#include <bit>
+#include <cstdlib>
+
+#include <sys/mman.h>
+
+#include <spdlog/spdlog.h>
+
+using namespace IO;
+
+double BufferPool::Statistics::reuseRate() const {
+  size_t total = m_allocations + m_reuses;
+  return total > 0 ? (double)m_reuses / total : 0;
+}
+
+BufferPool::Shared::~Shared() {
+  trim(0);
+}
+
+void BufferPool::Shared::release(void *ptr, size_t size) {
+  {
+    std::lock_guard lock(m_mutex);
+    if(m_idleBytes + size <= m_maxIdleBytes) {
+      m_idle[size].push_back(ptr);
+      m_idleBytes += size;
+      ++m_idleBuffers;
+      return;
+    }
+    ++m_drops;
+  }
+
+  free(ptr);
+}
+
+void BufferPool::Shared::trim(size_t maxIdleBytes) {
+  std::vector<void*> buffers;
+  {
+    std::lock_guard lock(m_mutex);
+    for(auto iter = m_idle.begin(); iter != m_idle.end() && m_idleBytes > maxIdleBytes;) {
+      auto& list = iter->second;
+      while(!list.empty() && m_idleBytes > maxIdleBytes) {
+        buffers.push_back(list.back());
+        list.pop_back();
+        m_idleBytes -= iter->first;
+        --m_idleBuffers;
+      }
+
+      if(list.empty())
+        iter = m_idle.erase(iter);
+      else
+        ++iter;
+    }
+  }
+
+  // Freeing large buffers can take a while, do it without the lock
+  for(auto ptr : buffers)
+    free(ptr);
+}
+
+BufferPool::BufferPool(size_t maxIdleBytes)
+  : m_shared(std::make_shared<Shared>()) {
+  m_shared->m_maxIdleBytes = maxIdleBytes;
+  m_shared->m_idleBytes = 0;
+  m_shared->m_idleBuffers = 0;
+  m_shared->m_allocations = 0;
+  m_shared->m_reuses = 0;
+  m_shared->m_drops = 0;
+}
+
+BufferPool& BufferPool::global() {
+  static BufferPool pool;
+  return pool;
+}
+
+size_t BufferPool::sizeClass(size_t size) {
+  if(size >= HUGE_PAGE_SIZE)
+    return (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+
+  return std::max(ALIGNMENT, std::bit_ceil(size));
+}
+
+std::shared_ptr<uint8_t[]> BufferPool::acquire(size_t size) {
+  size_t cls = sizeClass(size);
+  void *ptr = nullptr;
+
+  {
+    std::lock_guard lock(m_shared->m_mutex);
+    auto iter = m_shared->m_idle.find(cls);
+    if(iter != m_shared->m_idle.end() && !iter->second.empty()) {
+      ptr = iter->second.back();
+      iter->second.pop_back();
+      m_shared->m_idleBytes -= cls;
+      --m_shared->m_idleBuffers;
+      ++m_shared->m_reuses;
+    } else {
+      ++m_shared->m_allocations;
+    }
+  }
+
+  if(!ptr) {
+    ptr = aligned_alloc(cls >= HUGE_PAGE_SIZE ? HUGE_PAGE_SIZE : ALIGNMENT, cls);
+    if(!ptr) {
+      spdlog::error("Failed to allocate a buffer of {} bytes", cls);
+      return nullptr;
+    }
+
+#ifdef MADV_HUGEPAGE
+    if(cls >= HUGE_PAGE_SIZE)
+      madvise(ptr, cls, MADV_HUGEPAGE);
+#endif
+  }
+
+  auto shared = m_shared;
+  return std::shared_ptr<uint8_t[]>((uint8_t*)ptr, [shared, cls](uint8_t *ptr) {
+    shared->release(ptr, cls);
+  });
+}
+
+void BufferPool::setMaxIdleBytes(size_t maxIdleBytes) {
+  {
+    std::lock_guard lock(m_shared->m_mutex);
+    m_shared->m_maxIdleBytes = maxIdleBytes;
+  }
+  m_shared->trim(maxIdleBytes);
+}
+
+void BufferPool::trim() {
+  m_shared->trim(0);
+}
+
+BufferPool::Statistics BufferPool::statistics() const {
+  std::lock_guard lock(m_shared->m_mutex);
+  return {
+    .m_allocations = m_shared->m_allocations,
+    .m_reuses = m_shared->m_reuses,
+    .m_drops = m_shared->m_drops,
+    .m_idleBuffers = m_shared->m_idleBuffers,
+    .m_idleBytes = m_shared->m_idleBytes,
+  };
+}
@@ -0,0 +1,30 @@
+#include "io/convert.hpp"
+
+#include <algorithm>
+
+using namespace IO;
+
+template<typename T>
+static void toFloat(const T *src, float *dst, size_t count, float scale) {
+  for(size_t i = 0; i < count; ++i)
+    dst[i] = static_cast<float>(src[i]) * scale;
+}
+
+template<typename T>
+static void toUnorm16(const T *src, uint16_t *dst, size_t count, float scale) {
+  for(size_t i = 0; i < count; ++i)
+    dst[i] = static_cast<uint16_t>(std::clamp(static_cast<float>(src[i]) * scale, 0.0f, 65535.0f) + 0.5f);
+}
+
+bool IO::convertToFloat(DataType::EnumType type, const void *src, float *dst, size_t count, double scale) {
+  return dispatchDataType(type, [&]<typename T>(std::type_identity<T>) {
+    toFloat((const T*)src, dst, count, scale);
+  });
+}
+
+bool IO::convertToUnorm16(DataType::EnumType type, const void *src, uint16_t *dst, size_t count, double scale) {
+  return dispatchDataType(type, [&]<typename T>(std::type_identity<T>) {
+    toUnorm16((const T*)src, dst, count, scale * 65535.0);
+  });
+}
+
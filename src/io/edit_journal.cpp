@@ -0,0 +1,280 @@
+#include "io/edit_journal.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <spdlog/spdlog.h>
+
+using namespace IO;
+
+// The file is a header followed by fixed size records, each with a
+// checksum over the rest of it. A torn record at the end fails it.
+static const uint32_t EDITS_MAGIC = 0x31455149; // "IQE1"
+
+struct EditsHeader {
+  uint32_t m_magic;
+  uint32_t m_reserved;
+  uint64_t m_imageCount;
+};
+
+enum RecordKind : uint32_t {
+  IMAGE = 1,
+  REFERENCE = 2,
+};
+
+struct EditRecord {
+  uint32_t m_kind;
+  // Sequence index of the image or the new reference image
+  int32_t m_row;
+  // Guards against replaying over a different list of images
+  int32_t m_fileIndex;
+  uint8_t m_included;
+  uint8_t m_hasRegistration;
+  SequenceStore::RegistrationValues m_registration;
+  double m_matrix[9];
+  uint64_t m_checksum;
+};
+
+static uint64_t recordChecksum(const EditRecord& record) {
+  // FNV-1a over everything before the checksum
+  const uint8_t *data = reinterpret_cast<const uint8_t *>(&record);
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for(size_t i = 0; i < offsetof(EditRecord, m_checksum); ++i) {
+    hash ^= data[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+static bool writeAll(int fd, const void *data, size_t size) {
+  const char *ptr = static_cast<const char *>(data);
+  while(size > 0) {
+    ssize_t written = write(fd, ptr, size);
+    if(written < 0) {
+      if(errno == EINTR)
+        continue;
+      return false;
+    }
+    ptr += written;
+    size -= written;
+  }
+  return true;
+}
+
+static bool readJournal(const std::filesystem::path& path, EditsHeader& header, std::string& records) {
+  std::ifstream stream(path, std::ios::binary);
+  if(!stream.read(reinterpret_cast<char *>(&header), sizeof(header)) || header.m_magic != EDITS_MAGIC)
+    return false;
+
+  records.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+  return true;
+}
+
+EditJournal::EditJournal(const std::filesystem::path& sequencePath, size_t imageCount)
+  : m_path(journalPath(sequencePath))
+  , m_imageCount(imageCount)
+  , m_fd(-1)
+  , m_records(0)
+  , m_dropped(0) {
+  EditsHeader header;
+  std::string records;
+  if(readJournal(m_path, header, records) && header.m_imageCount == imageCount) {
+    m_fd = open(m_path.c_str(), O_WRONLY | O_APPEND);
+    if(m_fd >= 0) {
+      // A torn record at the end is cut off, so new ones stay readable
+      m_records = records.size() / sizeof(EditRecord);
+      if(ftruncate(m_fd, sizeof(EditsHeader) + m_records * sizeof(EditRecord)) == 0)
+        return;
+      close(m_fd);
+      m_fd = -1;
+      m_records = 0;
+    }
+  }
+
+  if(!start())
+    spdlog::error("Failed to start the edit journal {}, edits are only kept in memory", m_path.c_str());
+}
+
+EditJournal::~EditJournal() {
+  if(m_fd >= 0)
+    close(m_fd);
+}
+
+bool EditJournal::valid() const {
+  return m_fd >= 0;
+}
+
+uint64_t EditJournal::position() const {
+  return m_dropped + m_records;
+}
+
+bool EditJournal::start(const std::string& records) {
+  if(m_fd >= 0)
+    close(m_fd);
+
+  // The new journal is written to a temporary file, so a journal left
+  // behind is never replaced by a partial one
+  auto tempPath = m_path;
+  tempPath += ".tmp";
+  m_fd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+  if(m_fd < 0)
+    return false;
+
+  EditsHeader header = {
+    .m_magic = EDITS_MAGIC,
+    .m_reserved = 0,
+    .m_imageCount = m_imageCount,
+  };
+  std::error_code error;
+  bool success = writeAll(m_fd, &header, sizeof(header)) && writeAll(m_fd, records.data(), records.size());
+  if(success)
+    std::filesystem::rename(tempPath, m_path, error);
+  if(!success || error) {
+    close(m_fd);
+    m_fd = -1;
+    std::filesystem::remove(tempPath, error);
+    return false;
+  }
+
+  m_records = records.size() / sizeof(EditRecord);
+  return true;
+}
+
+void EditJournal::appendImage(const SequenceStore& store, size_t row) {
+  if(m_fd < 0 || row >= store.size())
+    return;
+
+  EditRecord record;
+  // Padding is part of the checksum
+  memset(&record, 0, sizeof(record));
+  record.m_kind = IMAGE;
+  record.m_row = row;
+  record.m_fileIndex = store.fileIndex(row);
+  record.m_included = store.included(row);
+  record.m_hasRegistration = store.hasRegistration(row);
+  if(record.m_hasRegistration) {
+    record.m_registration = store.registration(row);
+    memcpy(record.m_matrix, store.matrix(row), sizeof(record.m_matrix));
+  }
+  record.m_checksum = recordChecksum(record);
+
+  if(!writeAll(m_fd, &record, sizeof(record))) {
+    spdlog::error("Failed to journal the edit of image {}", row);
+    return;
+  }
+  ++m_records;
+}
+
+void EditJournal::appendReference(int reference) {
+  if(m_fd < 0)
+    return;
+
+  EditRecord record;
+  memset(&record, 0, sizeof(record));
+  record.m_kind = REFERENCE;
+  record.m_row = reference;
+  record.m_checksum = recordChecksum(record);
+
+  if(!writeAll(m_fd, &record, sizeof(record))) {
+    spdlog::error("Failed to journal the reference change to image {}", reference);
+    return;
+  }
+  ++m_records;
+}
+
+bool EditJournal::dropSaved(uint64_t position) {
+  if(m_fd < 0 || position <= m_dropped)
+    return true;
+
+  uint64_t saved = std::min(position - m_dropped, m_records);
+  EditsHeader header;
+  std::string records;
+  if(!readJournal(m_path, header, records))
+    return false;
+
+  // Records written after the snapshot move to the front of a new journal
+  records.resize(m_records * sizeof(EditRecord));
+  records.erase(0, saved * sizeof(EditRecord));
+  if(!start(records)) {
+    spdlog::error("Failed to drop saved edits from {}", m_path.c_str());
+    return false;
+  }
+
+  m_dropped += saved;
+  return true;
+}
+
+void EditJournal::discard() {
+  if(m_fd >= 0)
+    close(m_fd);
+  m_fd = -1;
+  m_dropped += m_records;
+  m_records = 0;
+
+  std::error_code error;
+  std::filesystem::remove(m_path, error);
+}
+
+std::filesystem::path EditJournal::journalPath(const std::filesystem::path& sequencePath) {
+  auto journal = sequencePath;
+  journal += ".edits";
+  return journal;
+}
+
+size_t EditJournal::replay(const std::filesystem::path& sequencePath, SequenceStore& store, int& reference) {
+  auto path = journalPath(sequencePath);
+  EditsHeader header;
+  std::string records;
+  if(!readJournal(path, header, records))
+    return 0;
+
+  if(header.m_imageCount != store.size()) {
+    spdlog::warn("Dropping edit journal {}, it was written for {} images", path.c_str(), header.m_imageCount);
+    std::error_code error;
+    std::filesystem::remove(path, error);
+    return 0;
+  }
+
+  size_t applied = 0;
+  for(size_t offset = 0; offset + sizeof(EditRecord) <= records.size(); offset += sizeof(EditRecord)) {
+    EditRecord record;
+    memcpy(&record, records.data() + offset, sizeof(record));
+    if(record.m_checksum != recordChecksum(record)) {
+      spdlog::warn("Edit journal {} ends with a torn record", path.c_str());
+      break;
+    }
+
+    if(record.m_kind == REFERENCE) {
+      if(record.m_row >= 0 && (size_t)record.m_row < store.size()) {
+        reference = record.m_row;
+        ++applied;
+      }
+      continue;
+    }
+
+    size_t row = record.m_row;
+    if(record.m_kind != IMAGE || record.m_row < 0 || row >= store.size() || store.fileIndex(row) != record.m_fileIndex) {
+      spdlog::warn("Skipping journaled edit of an image which isn't in the sequence");
+      continue;
+    }
+
+    store.setIncluded(row, record.m_included);
+    if(record.m_hasRegistration) {
+      store.setRegistration(row, record.m_registration);
+      store.setMatrix(row, record.m_matrix);
+    } else {
+      store.clearRegistration(row);
+    }
+    ++applied;
+  }
+
+  if(applied > 0)
+    spdlog::info("Replayed {} unsaved edits of {}", applied, sequencePath.c_str());
+  return applied;
+}
@@ -1,7 +1,11 @@
 #include "io/fits.hpp"
+#include "io/rice.hpp"
 
 #include <cassert>
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <spdlog/spdlog.h>
 
 #define GUARD() ErrorGuard _guard(*this)
@@ -46,57 +50,57 @@ Fits::ErrorGuard::~ErrorGuard() {
   }
 }
 
-Fits::Fits(const std::filesystem::path& filename)
-  : m_status(0) {
+Fits::Fits(const std::filesystem::path& filename, const std::shared_ptr<const HduIndex>& index)
+  : m_status(0)
+  , m_path(filename)
+  , m_index(index)
+  , m_maxTypeValue(0)
+  , m_currentHdu(0)
+  , m_fd(-1) {
   GUARD();
 
   fits_open_file(&m_fileptr, filename.c_str(), READONLY, &m_status);
 
-  fits_get_num_hdus(m_fileptr, &m_imageCount, &m_status);
+  // Counting HDUs walks the whole file, reuse the count if we can
+  if(m_index)
+    m_imageCount = m_index->size();
+  else
+    fits_get_num_hdus(m_fileptr, &m_imageCount, &m_status);
 
   if(m_status) {
     // An error has occurred
     m_imageCount = -1;
     spdlog::error("Failed to open FITS file {}", filename.c_str());
-  } else {
-    spdlog::info("Opened FITS file {} with {} HDUs", filename.c_str(), m_imageCount);
+    return;
   }
 
-  // int hdupos, nkeys;
-  // char card[FLEN_CARD];
-  // fits_get_hdu_num(m_fileptr, &hdupos);
-
-  // for (; !m_status; hdupos++)  /* Main loop through each extension */
-  // {
-  //   fits_get_hdrspace(m_fileptr, &nkeys, NULL, &m_status); /* get # of keywords */
-
-  //   printf("Header listing for HDU #%d:\n", hdupos);
-
-  //   for (int i = 1; i <= nkeys; i++) { /* Read and print each keywords */
-
-  //      if (fits_read_record(m_fileptr, i, card, &m_status))break;
-  //     // fits_get
-  //      printf("%s\n", card);
-  //   }
-  //   printf("END\n\n");  /* terminate listing with END */
-
-  //   fits_movrel_hdu(m_fileptr, 1, NULL, &m_status);  /* try to move to next HDU */
-  //   break;
-  // }
-
-  // if (m_status == END_OF_FILE)  m_status = 0; /* Reset after normal error */
-
-  // if (m_status) fits_report_error(stderr, m_status); /* print any error message */
+  // After opening, cfitsio points at the primary HDU
+  m_currentHdu = 1;
+  if(!m_index)
+    buildIndex();
+  if(m_index)
+    m_maxTypeValue = indexMaxTypeValue(*m_index);
+  spdlog::debug("Opened FITS file {} with {} HDUs", filename.c_str(), m_imageCount);
 }
 
 Fits::Fits(Fits&& other)
   : m_fileptr(other.m_fileptr)
-  , m_status(other.m_status) {
+  , m_status(other.m_status)
+  , m_path(std::move(other.m_path))
+  , m_index(std::move(other.m_index))
+  , m_maxTypeValue(other.m_maxTypeValue)
+  , m_currentHdu(other.m_currentHdu)
+  , m_riceTiles(std::move(other.m_riceTiles))
+  , m_fd(other.m_fd) {
   m_imageCount = other.m_imageCount;
   other.m_fileptr = nullptr;
+  other.m_fd = -1;
 }
 
 Fits::~Fits() {
+  if(m_fd >= 0)
+    close(m_fd);
+
   if(m_fileptr) {
     GUARD();
 
@@ -105,9 +109,79 @@ Fits::~Fits() {
 }
 
 void Fits::select(int index) {
+  if(index == m_currentHdu)
+    return;
+
   GUARD();
 
   fits_movabs_hdu(m_fileptr, index, NULL, &m_status);
+  m_currentHdu = m_status == 0 ? index : 0;
+}
+
+void Fits::buildIndex() {
+  auto index = std::make_shared<HduIndex>(m_imageCount);
+
+  for(int i = 0; i < m_imageCount && m_status == 0; ++i) {
+    auto& hdu = (*index)[i];
+    // The guard of select() clears the status, a failed move leaves
+    // cfitsio on another HDU which must not end up in this slot
+    select(i + 1);
+    if(m_currentHdu != i + 1) {
+      spdlog::error("Failed to move to HDU {} while indexing", i + 1);
+      return;
+    }
+
+    LONGLONG headerStart, dataStart, dataEnd;
+    fits_get_hduaddrll(m_fileptr, &headerStart, &dataStart, &dataEnd, &m_status);
+    hdu.m_headerOffset = headerStart;
+    hdu.m_dataOffset = dataStart;
+    hdu.m_dataSize = dataEnd - dataStart;
+
+    int hduType;
+    fits_get_hdu_type(m_fileptr, &hduType, &m_status);
+    int compressed = fits_is_compressed_image(m_fileptr, &m_status);
+    if(hduType != IMAGE_HDU && !compressed)
+      continue;
+    hdu.m_compressed = compressed;
+
+    fits_get_img_type(m_fileptr, &hdu.m_bitpix, &m_status);
+    int dimCount = 0;
+    fits_get_img_dim(m_fileptr, &dimCount, &m_status);
+    hdu.m_dims.resize(dimCount);
+    if(dimCount > 0)
+      fits_get_img_size(m_fileptr, dimCount, hdu.m_dims.data(), &m_status);
+
+    // Missing scaling keywords mean an identity transform
+    if(fits_read_key(m_fileptr, TDOUBLE, "BZERO", &hdu.m_bzero, nullptr, &m_status) == KEY_NO_EXIST) {
+      hdu.m_bzero = 0;
+      m_status = 0;
+    }
+    if(fits_read_key(m_fileptr, TDOUBLE, "BSCALE", &hdu.m_bscale, nullptr, &m_status) == KEY_NO_EXIST) {
+      hdu.m_bscale = 1;
+      m_status = 0;
+    }
+    hdu.m_type = HduInfo::equivalentType(hdu.m_bitpix, hdu.m_bzero, hdu.m_bscale);
+
+    for(auto keyword : HduInfo::KEYWORDS) {
+      char value[FLEN_VALUE];
+      std::string name(keyword);
+      if(fits_read_keyword(m_fileptr, name.c_str(), value, nullptr, &m_status) == 0) {
+        hdu.m_cards.emplace(name, HduInfo::cardValue(value));
+      } else if(m_status == KEY_NO_EXIST) {
+        m_status = 0;
+      }
+    }
+  }
+
+  if(m_status) {
+    spdlog::error("Failed to index HDUs");
+    return;
+  }
+  m_index = index;
+}
+
+std::shared_ptr<const HduIndex> Fits::index() const {
+  return m_index;
 }
 
 int Fits::imageType() {
@@ -133,93 +207,34 @@ void Fits::imageSize(int dimCount, long *dimensions) {
 }
 
 DataParameters Fits::getImageParameters(int index) {
-  GUARD();
-  select(index + 1);
-  
-  // int hdupos, nkeys;
-  // char card[FLEN_CARD];
-  // fits_get_hdu_num(m_fileptr, &hdupos);
-  // fits_get_hdrspace(m_fileptr, &nkeys, NULL, &m_status); /* get # of keywords */
-  // printf("Header listing for HDU #%d:\n", hdupos);
-  // for (int i = 1; i <= nkeys; i++) { /* Read and print each keywords */
-  //    if (fits_read_record(m_fileptr, i, card, &m_status))break;
-  //    printf("%s\n", card);
-  // }
-  // printf("END\n\n");  /* terminate listing with END */
-
-
-  int dimCount = imageDimensionCount();
-  long dims[dimCount];
-  imageSize(dimCount, dims);
-
-  int equivType;
-  fits_get_img_equivtype(m_fileptr, &equivType, &m_status);
-
-  DataType::EnumType type;
-  switch(equivType) {
-    case BYTE_IMG: type = DataType::UBYTE; break;
-    case SHORT_IMG: type = DataType::SHORT; break;
-    case USHORT_IMG: type = DataType::USHORT; break;
-    case LONG_IMG: type = DataType::INT; break;
-    case LONGLONG_IMG: type = DataType::LONG; break;
-    case FLOAT_IMG: type = DataType::FLOAT; break;
-    case DOUBLE_IMG: type = DataType::DOUBLE; break;
-    default:
-      spdlog::error("Unknown equivType received from FITSIO: {}", equivType);
-      assert(false);
-      // return DataParameters(index);
-  }
-
-  if(m_status == 0) {
-    return DataParameters(index, type, dimCount, dims);
-  } else {
-    // Invalid parameters
+  if(!m_index || index < 0 || (size_t)index >= m_index->size())
     return DataParameters(index);
-  }
-}
-
-// std::shared_ptr<uint8_t[]> Fits::getPixels(const DataParameters& params) {
-//   if(!params)
-//     return nullptr;
 
-//   GUARD();
-
-//   select(params.index() + 1);
-//   int dimCount = imageDimensionCount();
-//   if(dimCount != params.dimCount())
-//     return nullptr;
-
-//   long start[dimCount], end[dimCount], inc[dimCount];
-//   size_t pixelCount = 1;
-//   for(int i = 0; i < dimCount; ++i) {
-//     start[i] = params.start()[i];
-//     end[i] = params.end()[i];
-//     inc[i] = params.inc()[i];
-
-//     size_t length = (end[i] - start[i] + 1) / inc[i];
-//     pixelCount *= length;
-//   }
-
-//   std::shared_ptr<uint8_t[]> data(new uint8_t[pixelCount * DataType::dataSize(params.type())]);
-//   fits_read_subset(m_fileptr, fitsDataType(params.type()), start, end, inc, nullptr, data.get(), nullptr, &m_status);
-
-//   if(m_status != 0)
-//     return nullptr;
-
-//   return data;
-// }
+  return (*m_index)[index].parameters(index);
+}
 
 bool Fits::readPixels(const DataParameters& params, void *ptr) {
   if(!params)
     return false;
 
-  GUARD();
+  if(!m_index || params.index() < 0 || (size_t)params.index() >= m_index->size())
+    return false;
 
-  select(params.index() + 1);
-  int dimCount = imageDimensionCount();
+  int dimCount = (*m_index)[params.index()].m_dims.size();
   if(dimCount != params.dimCount())
     return false;
 
+  if((*m_index)[params.index()].m_compressed) {
+    // Rice tiles are decompressed in parallel, anything else goes through cfitsio
+    auto tiles = riceTiles(params.index());
+    if(tiles && tiles->read(params, ptr))
+      return true;
+  }
+
+  GUARD();
+
+  select(params.index() + 1);
+
   long start[dimCount], end[dimCount], inc[dimCount];
   size_t pixelCount = 1;
   for(int i = 0; i < dimCount; ++i) {
@@ -235,26 +250,25 @@ bool Fits::readPixels(const DataParameters& params, void *ptr) {
   return m_status == 0;
 }
 
-double Fits::maxTypeValue() {
-  GUARD();
-  // Right now this code is assuming that every image
-  // has the same data type and the same type max value.
-  // This should be fine but I'm not 100% sure.
-  int equivType;
-  fits_get_img_equivtype(m_fileptr, &equivType, &m_status);
-
-  switch(equivType) {
-    case BYTE_IMG: return (1 << 8) - 1;
-    case SHORT_IMG: return (1 << 15) - 1;
-    case USHORT_IMG: return (1 << 16) - 1;
-    case LONG_IMG: return INT_MAX;
-    case LONGLONG_IMG: return LONG_MAX;
-    // TODO: These two are almost certainly wrong
-    case FLOAT_IMG: return 1.0;
-    case DOUBLE_IMG: return 1.0;
-    default:
-      spdlog::error("Unknown equivType received from FITSIO: {}", equivType);
-      assert(false);
-  }
+RiceTiles *Fits::riceTiles(int index) {
+  auto iter = m_riceTiles.find(index);
+  if(iter != m_riceTiles.end())
+    return iter->second.get();
+
+  // One descriptor serves the tiles of every HDU in the file
+  if(m_fd < 0)
+    m_fd = open(m_path.c_str(), O_RDONLY);
+
+  select(index + 1);
+  std::unique_ptr<RiceTiles> tiles;
+  if(m_currentHdu == index + 1)
+    tiles = RiceTiles::load(m_fileptr, (*m_index)[index], m_fd);
+
+  auto ptr = tiles.get();
+  m_riceTiles[index] = std::move(tiles);
+  return ptr;
 }
 
+double Fits::maxTypeValue() {
+  return m_maxTypeValue;
+}
@@ -0,0 +1,135 @@
+#include "io/fits_pool.hpp"
+
+#include <thread>
+
+#include <spdlog/spdlog.h>
+
+using namespace IO;
+
+FitsPool::Lease::Lease(FitsPool& pool)
+  : m_pool(pool)
+  , m_handle(pool.acquire()) {
+}
+
+FitsPool::Lease::~Lease() {
+  m_pool.release(m_handle);
+}
+
+Fits *FitsPool::Lease::operator->() {
+  return m_handle;
+}
+
+FitsPool::FitsPool(const std::filesystem::path& filename, size_t maxHandles)
+  : m_path(filename)
+  , m_maxHandles(maxHandles)
+  , m_opening(0)
+  , m_maxTypeValue(0) {
+  if(m_maxHandles == 0)
+    m_maxHandles = std::max(1u, std::thread::hardware_concurrency());
+
+  if(!fits_is_reentrant() && m_maxHandles > 1) {
+    // Non reentrant builds of cfitsio share internal state between handles
+    spdlog::warn("cfitsio was built without reentrant support, FITS reads will not be parallel");
+    m_maxHandles = 1;
+  }
+
+  // The first handle is opened eagerly, it provides the image count
+  // and tells us if the file can be read at all.
+  auto handle = std::make_unique<Fits>(m_path);
+  m_imageCount = handle->imageCount();
+  m_index = handle->index();
+  if(m_imageCount < 0 || !m_index) {
+    m_imageCount = -1;
+    return;
+  }
+  m_maxTypeValue = handle->maxTypeValue();
+
+  m_freeHandles.push_back(handle.get());
+  m_handles.push_back(std::move(handle));
+}
+
+size_t FitsPool::handleCount() {
+  std::lock_guard lock(m_mutex);
+  return m_handles.size();
+}
+
+std::shared_ptr<const HduIndex> FitsPool::index() const {
+  return m_index;
+}
+
+Fits *FitsPool::acquire() {
+  std::unique_lock lock(m_mutex);
+  while(true) {
+    if(!m_freeHandles.empty()) {
+      auto ptr = m_freeHandles.back();
+      m_freeHandles.pop_back();
+      return ptr;
+    }
+
+    if(m_handles.size() + m_opening >= m_maxHandles) {
+      // Woken up by a released handle or by a slot which was given up
+      m_handleReleased.wait(lock);
+      continue;
+    }
+
+    // All handles are busy but we are allowed to open a new one. The slot
+    // is reserved, so other threads don't wait for the open to finish.
+    ++m_opening;
+    lock.unlock();
+
+    std::unique_ptr<Fits> handle;
+    try {
+      handle = std::make_unique<Fits>(m_path, m_index);
+    } catch(...) {
+      // Give the slot up again, a waiting thread may open it instead
+      lock.lock();
+      --m_opening;
+      lock.unlock();
+      m_handleReleased.notify_all();
+      throw;
+    }
+
+    lock.lock();
+    --m_opening;
+
+    if(handle->imageCount() >= 0) {
+      spdlog::debug("Opened FITS handle {} for {}", m_handles.size() + 1, m_path.c_str());
+      auto ptr = handle.get();
+      m_handles.push_back(std::move(handle));
+      return ptr;
+    }
+
+    // Stop trying to open new handles (we most likely hit a file descriptor
+    // limit) and wait for the ones we already have.
+    m_maxHandles = m_handles.size() + m_opening;
+    spdlog::warn("Failed to open additional FITS handle, limiting pool to {} handles", m_maxHandles);
+  }
+}
+
+void FitsPool::release(Fits *handle) {
+  {
+    std::lock_guard lock(m_mutex);
+    m_freeHandles.push_back(handle);
+  }
+  m_handleReleased.notify_one();
+}
+
+DataParameters FitsPool::getImageParameters(int index) {
+  if(!m_index || index < 0 || index >= m_index->size())
+    return DataParameters(index);
+
+  return (*m_index)[index].parameters(index);
+}
+
+bool FitsPool::readPixels(const DataParameters& params, void *ptr) {
+  if(!m_index)
+    return false;
+
+  Lease handle(*this);
+  return handle->readPixels(params, ptr);
+}
+
+double FitsPool::maxTypeValue() {
+  return m_maxTypeValue;
+}
+
@@ -0,0 +1,182 @@
+#include "io/hdu.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+using namespace IO;
+
+const std::vector<std::string_view> HduInfo::KEYWORDS = {
+  "DATE-OBS",
+  "EXPTIME",
+  "FILTER",
+  "AIRMASS",
+  "CCD-TEMP",
+  "DATAMIN",
+  "DATAMAX",
+};
+
+HduInfo::HduInfo()
+  : m_type(DataType::UBYTE)
+  , m_bitpix(0)
+  , m_bzero(0)
+  , m_bscale(1)
+  , m_compressed(false)
+  , m_headerOffset(0)
+  , m_dataOffset(0)
+  , m_dataSize(0) {
+}
+
+bool HduInfo::isImage() const {
+  return !m_dims.empty();
+}
+
+DataParameters HduInfo::parameters(int index) const {
+  if(!isImage())
+    return DataParameters(index);
+  // DataParameters copies the dimensions
+  return DataParameters(index, m_type, m_dims.size(), const_cast<long *>(m_dims.data()));
+}
+
+const std::string *HduInfo::card(std::string_view keyword) const {
+  auto iter = m_cards.find(keyword);
+  return iter != m_cards.end() ? &iter->second : nullptr;
+}
+
+bool HduInfo::isIndexedKeyword(std::string_view keyword) {
+  return std::find(KEYWORDS.begin(), KEYWORDS.end(), keyword) != KEYWORDS.end();
+}
+
+std::string HduInfo::cardValue(std::string_view raw) {
+  auto start = raw.find_first_not_of(' ');
+  if(start == std::string_view::npos)
+    return "";
+  raw = raw.substr(start);
+
+  if(raw[0] == '\'') {
+    // String value, a doubled quote is an escaped quote
+    std::string value;
+    for(size_t i = 1; i < raw.size(); ++i) {
+      if(raw[i] == '\'') {
+        if(i + 1 < raw.size() && raw[i + 1] == '\'') {
+          value.push_back('\'');
+          ++i;
+          continue;
+        }
+        break;
+      }
+      value.push_back(raw[i]);
+    }
+    // Trailing spaces are not significant
+    value.erase(value.find_last_not_of(' ') + 1);
+    return value;
+  }
+
+  auto end = raw.find('/');
+  raw = raw.substr(0, end);
+  return std::string(raw.substr(0, raw.find_last_not_of(' ') + 1));
+}
+
+DataType::EnumType HduInfo::equivalentType(int bitpix, double bzero, double bscale) {
+  // Range of the values stored in the file
+  double min, max;
+  switch(bitpix) {
+    case 8:
+      min = 0;
+      max = 255;
+      break;
+    case 16:
+      min = INT16_MIN;
+      max = INT16_MAX;
+      break;
+    case 32:
+      min = INT32_MIN;
+      max = INT32_MAX;
+      break;
+    case 64:
+      min = (double)INT64_MIN;
+      max = (double)INT64_MAX;
+      break;
+    case -32:
+      return DataType::FLOAT;
+    default:
+      return DataType::DOUBLE;
+  }
+
+  if(bscale == 1.0 && bzero == 0) {
+    switch(bitpix) {
+      case 8: return DataType::UBYTE;
+      case 16: return DataType::SHORT;
+      case 32: return DataType::INT;
+      default: return DataType::LONG;
+    }
+  }
+
+  // Scaled data which isn't integer any more
+  if(bscale != 1.0 || std::trunc(bzero) != bzero)
+    return bitpix <= 16 ? DataType::FLOAT : DataType::DOUBLE;
+
+  // Smallest integer type holding the shifted range
+  min += bzero;
+  max += bzero;
+  if(min >= INT8_MIN && max <= INT8_MAX)
+    return DataType::BYTE;
+  if(min >= 0 && max <= UINT8_MAX)
+    return DataType::UBYTE;
+  if(min >= INT16_MIN && max <= INT16_MAX)
+    return DataType::SHORT;
+  if(min >= 0 && max <= UINT16_MAX)
+    return DataType::USHORT;
+  if(min >= INT32_MIN && max <= INT32_MAX)
+    return DataType::INT;
+  if(min >= 0 && max <= UINT32_MAX)
+    return DataType::UINT;
+  if(min >= (double)INT64_MIN && max <= (double)INT64_MAX)
+    return DataType::LONG;
+  if(min >= 0 && max <= (double)UINT64_MAX)
+    return DataType::ULONG;
+  return DataType::DOUBLE;
+}
+
+// Floating point data has no type range, use the largest DATAMAX of all
+// images. Without it the data is expected to be normalized like Siril does.
+static double floatMaxValue(const HduIndex& index) {
+  double max = 0;
+  for(auto& hdu : index) {
+    auto value = hdu.card("DATAMAX");
+    if(!value)
+      continue;
+
+    char *end;
+    double number = std::strtod(value->c_str(), &end);
+    if(end != value->c_str() && number > max)
+      max = number;
+  }
+  return max > 0 ? max : 1.0;
+}
+
+double IO::indexMaxTypeValue(const HduIndex& index) {
+  // Right now this code is assuming that every image
+  // has the same data type and the same type max value.
+  for(auto& hdu : index) {
+    if(!hdu.isImage())
+      continue;
+
+    switch(hdu.m_type) {
+      case DataType::BYTE: return (1 << 7) - 1;
+      case DataType::UBYTE: return (1 << 8) - 1;
+      case DataType::SHORT: return (1 << 15) - 1;
+      case DataType::USHORT: return (1 << 16) - 1;
+      case DataType::INT: return INT_MAX;
+      case DataType::UINT: return UINT_MAX;
+      case DataType::LONG: return LONG_MAX;
+      case DataType::ULONG: return ULONG_MAX;
+      case DataType::FLOAT:
+      case DataType::DOUBLE:
+        return floatMaxValue(index);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,329 @@
+#include "io/header_table.hpp"
+#include "io/thread_pool.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#include <spdlog/spdlog.h>
+
+using namespace IO;
+
+// Native byte order, tables are only read on the machine which wrote them
+static const char HEADER_MAGIC[8] = { 'I', 'A', 'H', 'D', 'R', 'S', 0, 0 };
+static const uint32_t HEADER_VERSION = 1;
+
+struct TableHeader {
+  char m_magic[8];
+  uint32_t m_version;
+  uint32_t m_sourceCount;
+  uint32_t m_rowCount;
+  uint32_t m_columnCount;
+};
+
+static bool stampOf(const std::string& path, uint64_t& size, int64_t& mtime) {
+  std::error_code error;
+  size = std::filesystem::file_size(path, error);
+  if(!error)
+    mtime = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+  return !error;
+}
+
+static void writeString(std::ofstream& stream, const std::string& value) {
+  uint32_t length = value.size();
+  stream.write((const char*)&length, sizeof(length));
+  stream.write(value.data(), length);
+}
+
+// Reads from an in memory copy of the file, every read checks the bounds
+class Reader {
+  const std::vector<char>& m_data;
+  size_t m_offset;
+  bool m_failed;
+
+public:
+  Reader(const std::vector<char>& data)
+    : m_data(data)
+    , m_offset(0)
+    , m_failed(false) {
+  }
+
+  bool failed() const {
+    return m_failed;
+  }
+
+  size_t remaining() const {
+    return m_failed ? 0 : m_data.size() - m_offset;
+  }
+
+  void read(void *ptr, size_t size) {
+    if(m_failed || m_offset + size > m_data.size()) {
+      m_failed = true;
+      return;
+    }
+    memcpy(ptr, m_data.data() + m_offset, size);
+    m_offset += size;
+  }
+
+  template<typename T>
+  T value() {
+    T result{};
+    read(&result, sizeof(T));
+    return result;
+  }
+
+  std::string string() {
+    uint32_t length = value<uint32_t>();
+    if(m_failed || m_offset + length > m_data.size()) {
+      m_failed = true;
+      return {};
+    }
+    std::string result(m_data.data() + m_offset, length);
+    m_offset += length;
+    return result;
+  }
+};
+
+std::unique_ptr<HeaderTable> HeaderTable::build(const std::vector<int>& indices, const Lookup& lookup,
+                                                const std::vector<std::filesystem::path>& sources) {
+  std::unique_ptr<HeaderTable> table(new HeaderTable());
+  table->m_indices = indices;
+  for(auto keyword : HduInfo::KEYWORDS) {
+    table->m_columns.push_back({
+      .m_keyword = std::string(keyword),
+      .m_numbers = std::vector<double>(indices.size(), NAN),
+      .m_strings = std::vector<std::string>(indices.size()),
+    });
+  }
+
+  // Every job fills its own range of rows
+  const size_t chunkSize = 256;
+  ThreadPool pool;
+  for(size_t begin = 0; begin < indices.size(); begin += chunkSize) {
+    pool.submit([&, begin]() {
+      size_t end = std::min(begin + chunkSize, indices.size());
+      for(size_t row = begin; row < end; ++row) {
+        auto info = lookup(indices[row]);
+        if(!info)
+          continue;
+
+        for(auto& column : table->m_columns) {
+          auto value = info->card(column.m_keyword);
+          if(!value)
+            continue;
+          column.m_strings[row] = *value;
+          column.m_numbers[row] = column.m_keyword == "DATE-OBS" ? parseDate(*value) : parseNumber(*value);
+        }
+      }
+    });
+  }
+  pool.wait();
+
+  for(auto& path : sources) {
+    Source source = { .m_path = path.string() };
+    if(stampOf(source.m_path, source.m_size, source.m_mtime))
+      table->m_sources.push_back(std::move(source));
+  }
+
+  table->indexRows();
+  return table;
+}
+
+std::unique_ptr<HeaderTable> HeaderTable::load(const std::filesystem::path& path) {
+  std::ifstream stream(path, std::ios::binary);
+  if(!stream.is_open())
+    return nullptr;
+  std::vector<char> data((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+  Reader reader(data);
+  auto header = reader.value<TableHeader>();
+  if(reader.failed() || memcmp(header.m_magic, HEADER_MAGIC, sizeof(HEADER_MAGIC)) != 0 || header.m_version != HEADER_VERSION) {
+    spdlog::warn("Ignoring invalid header table {}", path.c_str());
+    return nullptr;
+  }
+
+  std::unique_ptr<HeaderTable> table(new HeaderTable());
+  for(uint32_t i = 0; i < header.m_sourceCount; ++i) {
+    Source source;
+    source.m_size = reader.value<uint64_t>();
+    source.m_mtime = reader.value<int64_t>();
+    source.m_path = reader.string();
+    if(reader.failed())
+      break;
+
+    uint64_t size;
+    int64_t mtime;
+    if(!stampOf(source.m_path, size, mtime) || size != source.m_size || mtime != source.m_mtime) {
+      spdlog::debug("Header table {} is out of date, {} changed", path.c_str(), source.m_path);
+      return nullptr;
+    }
+    table->m_sources.push_back(std::move(source));
+  }
+
+  // Every row stores an index and, per column, a number and a string length,
+  // a corrupt row count must not allocate more than the file can hold
+  size_t rowSize = sizeof(int) + (size_t)header.m_columnCount * (sizeof(double) + sizeof(uint32_t));
+  if(reader.failed() || header.m_rowCount > reader.remaining() / rowSize) {
+    spdlog::warn("Ignoring truncated header table {}", path.c_str());
+    return nullptr;
+  }
+
+  table->m_indices.resize(header.m_rowCount);
+  reader.read(table->m_indices.data(), header.m_rowCount * sizeof(int));
+  for(uint32_t i = 0; i < header.m_columnCount && !reader.failed(); ++i) {
+    Column column;
+    column.m_keyword = reader.string();
+    column.m_numbers.resize(header.m_rowCount);
+    reader.read(column.m_numbers.data(), header.m_rowCount * sizeof(double));
+    column.m_strings.reserve(header.m_rowCount);
+    for(uint32_t row = 0; row < header.m_rowCount; ++row)
+      column.m_strings.push_back(reader.string());
+    table->m_columns.push_back(std::move(column));
+  }
+
+  if(reader.failed()) {
+    spdlog::warn("Ignoring truncated header table {}", path.c_str());
+    return nullptr;
+  }
+
+  table->indexRows();
+  return table;
+}
+
+bool HeaderTable::save(const std::filesystem::path& path) const {
+  // Replaced atomically, readers never see a partial table
+  auto tempPath = path;
+  tempPath += ".tmp";
+  std::ofstream stream(tempPath, std::ios::out | std::ios::trunc | std::ios::binary);
+  if(!stream.is_open()) {
+    spdlog::error("Failed to open header table {} for writing", tempPath.c_str());
+    return false;
+  }
+
+  TableHeader header = {};
+  memcpy(header.m_magic, HEADER_MAGIC, sizeof(HEADER_MAGIC));
+  header.m_version = HEADER_VERSION;
+  header.m_sourceCount = m_sources.size();
+  header.m_rowCount = m_indices.size();
+  header.m_columnCount = m_columns.size();
+  stream.write((const char*)&header, sizeof(header));
+
+  for(auto& source : m_sources) {
+    stream.write((const char*)&source.m_size, sizeof(source.m_size));
+    stream.write((const char*)&source.m_mtime, sizeof(source.m_mtime));
+    writeString(stream, source.m_path);
+  }
+
+  stream.write((const char*)m_indices.data(), m_indices.size() * sizeof(int));
+  for(auto& column : m_columns) {
+    writeString(stream, column.m_keyword);
+    stream.write((const char*)column.m_numbers.data(), column.m_numbers.size() * sizeof(double));
+    for(auto& value : column.m_strings)
+      writeString(stream, value);
+  }
+
+  stream.close();
+  if(stream.fail()) {
+    spdlog::error("Failed to write header table {}", tempPath.c_str());
+    return false;
+  }
+
+  std::error_code error;
+  std::filesystem::rename(tempPath, path, error);
+  if(error) {
+    spdlog::error("Failed to replace header table {}: {}", path.c_str(), error.message());
+    return false;
+  }
+  return true;
+}
+
+void HeaderTable::indexRows() {
+  m_rows.clear();
+  for(size_t row = 0; row < m_indices.size(); ++row)
+    m_rows[m_indices[row]] = row;
+}
+
+size_t HeaderTable::rowCount() const {
+  return m_indices.size();
+}
+
+const std::vector<int>& HeaderTable::indices() const {
+  return m_indices;
+}
+
+const HeaderTable::Column *HeaderTable::column(std::string_view keyword) const {
+  for(auto& column : m_columns) {
+    if(column.m_keyword == keyword)
+      return &column;
+  }
+  return nullptr;
+}
+
+double HeaderTable::number(std::string_view keyword, int index) const {
+  auto values = column(keyword);
+  auto row = m_rows.find(index);
+  if(!values || row == m_rows.end())
+    return NAN;
+  return values->m_numbers[row->second];
+}
+
+std::vector<int> HeaderTable::filter(std::string_view keyword, double min, double max) const {
+  std::vector<int> result;
+  auto values = column(keyword);
+  if(!values)
+    return result;
+
+  // NaN never passes the comparison
+  for(size_t row = 0; row < m_indices.size(); ++row) {
+    double value = values->m_numbers[row];
+    if(value >= min && value <= max)
+      result.push_back(m_indices[row]);
+  }
+  return result;
+}
+
+std::vector<int> HeaderTable::filter(std::string_view keyword, std::string_view value) const {
+  std::vector<int> result;
+  auto values = column(keyword);
+  if(!values)
+    return result;
+
+  for(size_t row = 0; row < m_indices.size(); ++row) {
+    if(values->m_strings[row] == value)
+      result.push_back(m_indices[row]);
+  }
+  return result;
+}
+
+double HeaderTable::parseNumber(std::string_view value) {
+  std::string text(value);
+  // Fortran style exponents are allowed by the standard
+  for(char& c : text) {
+    if(c == 'D' || c == 'd')
+      c = 'E';
+  }
+
+  char *end;
+  double number = strtod(text.c_str(), &end);
+  if(end == text.c_str() || *end != 0)
+    return NAN;
+  return number;
+}
+
+double HeaderTable::parseDate(std::string_view value) {
+  int year, month, day, hour = 0, minute = 0;
+  double second = 0;
+  std::string text(value);
+  int fields = sscanf(text.c_str(), "%d-%d-%dT%d:%d:%lf", &year, &month, &day, &hour, &minute, &second);
+  if(fields != 3 && fields != 6)
+    return NAN;
+
+  std::chrono::year_month_day date{ std::chrono::year(year), std::chrono::month(month), std::chrono::day(day) };
+  if(!date.ok())
+    return NAN;
+
+  auto days = std::chrono::sys_days(date).time_since_epoch().count();
+  return days * 86400.0 + hour * 3600.0 + minute * 60.0 + second;
+}
@@ -0,0 +1,333 @@
+#include "io/kernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNELS_X86
+#include <immintrin.h>
+#endif
+
+using namespace IO;
+using namespace IO::Kernels;
+
+// Scalar versions, also used for the tails of the vector loops
+
+static void swap16Scalar(const uint8_t *src, uint16_t *dst, size_t count, int32_t zero) {
+  for(size_t i = 0; i < count; ++i)
+    dst[i] = (uint16_t)(((src[2 * i] << 8) | src[2 * i + 1]) + zero);
+}
+
+static void swap16ToFloatScalar(const uint8_t *src, float *dst, size_t count, float scale, float zero) {
+  for(size_t i = 0; i < count; ++i) {
+    float value = (int16_t)((src[2 * i] << 8) | src[2 * i + 1]);
+    dst[i] = value * scale + zero;
+  }
+}
+
+static void levelsToByteScalar(const uint16_t *src, uint8_t *dst, size_t count, float scale, float low, float high) {
+  const float factor = 255.0f / (high - low);
+  for(size_t i = 0; i < count; ++i) {
+    float value = std::min(std::max(src[i] * scale, low), high);
+    dst[i] = (uint8_t)std::nearbyint((value - low) * factor);
+  }
+}
+
+static void halve16Scalar(const uint16_t *row0, const uint16_t *row1, uint16_t *dst, size_t count) {
+  for(size_t i = 0; i < count; ++i) {
+    uint32_t sum = (uint32_t)row0[2 * i] + row0[2 * i + 1] + row1[2 * i] + row1[2 * i + 1];
+    dst[i] = (uint16_t)((sum + 2) >> 2);
+  }
+}
+
+#ifdef KERNELS_X86
+
+// SSE2, 8 pixels per step
+
+__attribute__((target("sse2")))
+static void swap16Sse2(const uint8_t *src, uint16_t *dst, size_t count, int32_t zero) {
+  const __m128i offset = _mm_set1_epi16((int16_t)zero);
+  size_t i = 0;
+  for(; i + 8 <= count; i += 8) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(src + 2 * i));
+    x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_add_epi16(x, offset));
+  }
+  swap16Scalar(src + 2 * i, dst + i, count - i, zero);
+}
+
+__attribute__((target("sse2")))
+static void swap16ToFloatSse2(const uint8_t *src, float *dst, size_t count, float scale, float zero) {
+  const __m128 s = _mm_set1_ps(scale);
+  const __m128 z = _mm_set1_ps(zero);
+  size_t i = 0;
+  for(; i + 8 <= count; i += 8) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(src + 2 * i));
+    x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+    // Sign extend by moving the values into the upper halves
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+    _mm_storeu_ps(dst + i, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(lo), s), z));
+    _mm_storeu_ps(dst + i + 4, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(hi), s), z));
+  }
+  swap16ToFloatScalar(src + 2 * i, dst + i, count - i, scale, zero);
+}
+
+__attribute__((target("sse2")))
+static inline __m128i levels4Sse2(__m128i x, __m128 s, __m128 l, __m128 h, __m128 f) {
+  __m128 value = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(x), s), l), h);
+  return _mm_cvtps_epi32(_mm_mul_ps(_mm_sub_ps(value, l), f));
+}
+
+__attribute__((target("sse2")))
+static void levelsToByteSse2(const uint16_t *src, uint8_t *dst, size_t count, float scale, float low, float high) {
+  const __m128 s = _mm_set1_ps(scale), l = _mm_set1_ps(low), h = _mm_set1_ps(high);
+  const __m128 f = _mm_set1_ps(255.0f / (high - low));
+  const __m128i zero = _mm_setzero_si128();
+  size_t i = 0;
+  for(; i + 8 <= count; i += 8) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(src + i));
+    __m128i lo = levels4Sse2(_mm_unpacklo_epi16(x, zero), s, l, h, f);
+    __m128i hi = levels4Sse2(_mm_unpackhi_epi16(x, zero), s, l, h, f);
+    __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(lo, hi), zero);
+    _mm_storel_epi64((__m128i*)(dst + i), bytes);
+  }
+  levelsToByteScalar(src + i, dst + i, count - i, scale, low, high);
+}
+
+// Sums of the horizontal pairs of a row, 32 bit lanes hold a pair each
+__attribute__((target("sse2")))
+static inline __m128i pairSums4Sse2(__m128i x) {
+  return _mm_add_epi32(_mm_and_si128(x, _mm_set1_epi32(0xffff)), _mm_srli_epi32(x, 16));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i halve4Sse2(const uint16_t *row0, const uint16_t *row1) {
+  __m128i sum = _mm_add_epi32(pairSums4Sse2(_mm_loadu_si128((const __m128i*)row0)),
+                              pairSums4Sse2(_mm_loadu_si128((const __m128i*)row1)));
+  return _mm_srli_epi32(_mm_add_epi32(sum, _mm_set1_epi32(2)), 2);
+}
+
+__attribute__((target("sse2")))
+static void halve16Sse2(const uint16_t *row0, const uint16_t *row1, uint16_t *dst, size_t count) {
+  // SSE2 only packs with signed saturation, shift the values into its range
+  const __m128i bias32 = _mm_set1_epi32(32768);
+  const __m128i bias16 = _mm_set1_epi16((int16_t)0x8000);
+  size_t i = 0;
+  for(; i + 8 <= count; i += 8) {
+    __m128i lo = _mm_sub_epi32(halve4Sse2(row0 + 2 * i, row1 + 2 * i), bias32);
+    __m128i hi = _mm_sub_epi32(halve4Sse2(row0 + 2 * i + 8, row1 + 2 * i + 8), bias32);
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(_mm_packs_epi32(lo, hi), bias16));
+  }
+  halve16Scalar(row0 + 2 * i, row1 + 2 * i, dst + i, count - i);
+}
+
+// AVX2, 16 pixels per step
+
+__attribute__((target("avx2")))
+static void swap16Avx2(const uint8_t *src, uint16_t *dst, size_t count, int32_t zero) {
+  const __m256i offset = _mm256_set1_epi16((int16_t)zero);
+  size_t i = 0;
+  for(; i + 16 <= count; i += 16) {
+    __m256i x = _mm256_loadu_si256((const __m256i*)(src + 2 * i));
+    x = _mm256_or_si256(_mm256_slli_epi16(x, 8), _mm256_srli_epi16(x, 8));
+    _mm256_storeu_si256((__m256i*)(dst + i), _mm256_add_epi16(x, offset));
+  }
+  swap16Sse2(src + 2 * i, dst + i, count - i, zero);
+}
+
+__attribute__((target("avx2")))
+static void swap16ToFloatAvx2(const uint8_t *src, float *dst, size_t count, float scale, float zero) {
+  const __m256 s = _mm256_set1_ps(scale);
+  const __m256 z = _mm256_set1_ps(zero);
+  size_t i = 0;
+  for(; i + 8 <= count; i += 8) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(src + 2 * i));
+    x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+    __m256 value = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(x));
+    _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_mul_ps(value, s), z));
+  }
+  swap16ToFloatScalar(src + 2 * i, dst + i, count - i, scale, zero);
+}
+
+__attribute__((target("avx2")))
+static void levelsToByteAvx2(const uint16_t *src, uint8_t *dst, size_t count, float scale, float low, float high) {
+  const __m256 s = _mm256_set1_ps(scale), l = _mm256_set1_ps(low), h = _mm256_set1_ps(high);
+  const __m256 f = _mm256_set1_ps(255.0f / (high - low));
+  size_t i = 0;
+  for(; i + 8 <= count; i += 8) {
+    __m256i x = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(src + i)));
+    __m256 value = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(x), s), l), h);
+    __m256i result = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_sub_ps(value, l), f));
+    // Packing works on 128 bit lanes
+    __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(result), _mm256_extracti128_si256(result, 1));
+    _mm_storel_epi64((__m128i*)(dst + i), _mm_packus_epi16(words, words));
+  }
+  levelsToByteScalar(src + i, dst + i, count - i, scale, low, high);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i halve8Avx2(const uint16_t *row0, const uint16_t *row1) {
+  const __m256i mask = _mm256_set1_epi32(0xffff);
+  __m256i x0 = _mm256_loadu_si256((const __m256i*)row0);
+  __m256i x1 = _mm256_loadu_si256((const __m256i*)row1);
+  __m256i sum = _mm256_add_epi32(_mm256_add_epi32(_mm256_and_si256(x0, mask), _mm256_srli_epi32(x0, 16)),
+                                 _mm256_add_epi32(_mm256_and_si256(x1, mask), _mm256_srli_epi32(x1, 16)));
+  return _mm256_srli_epi32(_mm256_add_epi32(sum, _mm256_set1_epi32(2)), 2);
+}
+
+__attribute__((target("avx2")))
+static void halve16Avx2(const uint16_t *row0, const uint16_t *row1, uint16_t *dst, size_t count) {
+  size_t i = 0;
+  for(; i + 16 <= count; i += 16) {
+    __m256i lo = halve8Avx2(row0 + 2 * i, row1 + 2 * i);
+    __m256i hi = halve8Avx2(row0 + 2 * i + 16, row1 + 2 * i + 16);
+    // Packing works on 128 bit lanes, put the halves back in order
+    __m256i words = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xd8);
+    _mm256_storeu_si256((__m256i*)(dst + i), words);
+  }
+  halve16Sse2(row0 + 2 * i, row1 + 2 * i, dst + i, count - i);
+}
+
+// AVX-512, 32 or 16 pixels per step
+
+// GCC 12 warns about the undefined vectors used inside its own AVX-512
+// headers (GCC bug 105593)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+__attribute__((target("avx512f,avx512bw")))
+static void swap16Avx512(const uint8_t *src, uint16_t *dst, size_t count, int32_t zero) {
+  const __m512i offset = _mm512_set1_epi16((int16_t)zero);
+  size_t i = 0;
+  for(; i + 32 <= count; i += 32) {
+    __m512i x = _mm512_loadu_si512(src + 2 * i);
+    x = _mm512_or_si512(_mm512_slli_epi16(x, 8), _mm512_srli_epi16(x, 8));
+    _mm512_storeu_si512(dst + i, _mm512_add_epi16(x, offset));
+  }
+  swap16Avx2(src + 2 * i, dst + i, count - i, zero);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void swap16ToFloatAvx512(const uint8_t *src, float *dst, size_t count, float scale, float zero) {
+  const __m512 s = _mm512_set1_ps(scale);
+  const __m512 z = _mm512_set1_ps(zero);
+  size_t i = 0;
+  for(; i + 16 <= count; i += 16) {
+    __m256i x = _mm256_loadu_si256((const __m256i*)(src + 2 * i));
+    x = _mm256_or_si256(_mm256_slli_epi16(x, 8), _mm256_srli_epi16(x, 8));
+    __m512 value = _mm512_cvtepi32_ps(_mm512_cvtepi16_epi32(x));
+    _mm512_storeu_ps(dst + i, _mm512_add_ps(_mm512_mul_ps(value, s), z));
+  }
+  swap16ToFloatAvx2(src + 2 * i, dst + i, count - i, scale, zero);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void levelsToByteAvx512(const uint16_t *src, uint8_t *dst, size_t count, float scale, float low, float high) {
+  const __m512 s = _mm512_set1_ps(scale), l = _mm512_set1_ps(low), h = _mm512_set1_ps(high);
+  const __m512 f = _mm512_set1_ps(255.0f / (high - low));
+  size_t i = 0;
+  for(; i + 16 <= count; i += 16) {
+    __m512i x = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)(src + i)));
+    __m512 value = _mm512_min_ps(_mm512_max_ps(_mm512_mul_ps(_mm512_cvtepi32_ps(x), s), l), h);
+    __m512i result = _mm512_cvtps_epi32(_mm512_mul_ps(_mm512_sub_ps(value, l), f));
+    _mm_storeu_si128((__m128i*)(dst + i), _mm512_cvtusepi32_epi8(result));
+  }
+  levelsToByteAvx2(src + i, dst + i, count - i, scale, low, high);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void halve16Avx512(const uint16_t *row0, const uint16_t *row1, uint16_t *dst, size_t count) {
+  const __m512i mask = _mm512_set1_epi32(0xffff);
+  const __m512i two = _mm512_set1_epi32(2);
+  size_t i = 0;
+  for(; i + 16 <= count; i += 16) {
+    __m512i x0 = _mm512_loadu_si512(row0 + 2 * i);
+    __m512i x1 = _mm512_loadu_si512(row1 + 2 * i);
+    __m512i sum = _mm512_add_epi32(_mm512_add_epi32(_mm512_and_si512(x0, mask), _mm512_srli_epi32(x0, 16)),
+                                   _mm512_add_epi32(_mm512_and_si512(x1, mask), _mm512_srli_epi32(x1, 16)));
+    __m512i result = _mm512_srli_epi32(_mm512_add_epi32(sum, two), 2);
+    _mm256_storeu_si256((__m256i*)(dst + i), _mm512_cvtepi32_epi16(result));
+  }
+  halve16Avx2(row0 + 2 * i, row1 + 2 * i, dst + i, count - i);
+}
+
+#pragma GCC diagnostic pop
+
+#endif
+
+namespace {
+
+struct Table {
+  void (*m_swap16)(const uint8_t*, uint16_t*, size_t, int32_t);
+  void (*m_swap16ToFloat)(const uint8_t*, float*, size_t, float, float);
+  void (*m_levelsToByte)(const uint16_t*, uint8_t*, size_t, float, float, float);
+  void (*m_halve16)(const uint16_t*, const uint16_t*, uint16_t*, size_t);
+};
+
+const Table tables[] = {
+  { swap16Scalar, swap16ToFloatScalar, levelsToByteScalar, halve16Scalar },
+#ifdef KERNELS_X86
+  { swap16Sse2, swap16ToFloatSse2, levelsToByteSse2, halve16Sse2 },
+  { swap16Avx2, swap16ToFloatAvx2, levelsToByteAvx2, halve16Avx2 },
+  { swap16Avx512, swap16ToFloatAvx512, levelsToByteAvx512, halve16Avx512 },
+#endif
+};
+
+Level detectLevel() {
+#ifdef KERNELS_X86
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+    return AVX512;
+  if(__builtin_cpu_supports("avx2"))
+    return AVX2;
+  if(__builtin_cpu_supports("sse2"))
+    return SSE2;
+#endif
+  return SCALAR;
+}
+
+const Level detected = detectLevel();
+Level current = detected;
+const Table *table = &tables[current];
+
+}
+
+Level Kernels::supportedLevel() {
+  return detected;
+}
+
+Level Kernels::level() {
+  return current;
+}
+
+void Kernels::setLevel(Level level) {
+  current = std::min(level, detected);
+  table = &tables[current];
+}
+
+const char *Kernels::levelName(Level level) {
+  switch(level) {
+    case SCALAR: return "scalar";
+    case SSE2: return "SSE2";
+    case AVX2: return "AVX2";
+    case AVX512: return "AVX-512";
+  }
+  return "unknown";
+}
+
+void Kernels::swap16(const uint8_t *src, uint16_t *dst, size_t count, int32_t zero) {
+  table->m_swap16(src, dst, count, zero);
+}
+
+void Kernels::swap16ToFloat(const uint8_t *src, float *dst, size_t count, float scale, float zero) {
+  table->m_swap16ToFloat(src, dst, count, scale, zero);
+}
+
+void Kernels::levelsToByte(const uint16_t *src, uint8_t *dst, size_t count, float scale, float low, float high) {
+  table->m_levelsToByte(src, dst, count, scale, low, high);
+}
+
+void Kernels::halve16(const uint16_t *row0, const uint16_t *row1, uint16_t *dst, size_t count) {
+  table->m_halve16(row0, row1, dst, count);
+}
@@ -0,0 +1,431 @@
+#include "io/mapped_fits.hpp"
+#include "io/async_reader.hpp"
+#include "io/convert.hpp"
+#include "io/kernels.hpp"
+
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <spdlog/spdlog.h>
+
+using namespace IO;
+
+// FITS files are made out of 2880 byte blocks, each header
+// block holds 36 cards of 80 characters.
+#define FITS_BLOCK_SIZE 2880
+#define FITS_CARD_SIZE 80
+
+struct MappedFits::Mapping {
+  uint8_t *m_address;
+  size_t m_size;
+
+  Mapping(uint8_t *address, size_t size)
+    : m_address(address)
+    , m_size(size) {
+  }
+
+  ~Mapping() {
+    munmap(m_address, m_size);
+  }
+};
+
+template<typename T>
+static inline T loadBigEndian(const uint8_t *ptr) {
+  using Bits = std::conditional_t<sizeof(T) == 1, uint8_t,
+               std::conditional_t<sizeof(T) == 2, uint16_t,
+               std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>>>;
+
+  Bits bits;
+  memcpy(&bits, ptr, sizeof(Bits));
+  if constexpr(std::endian::native == std::endian::little) {
+    if constexpr(sizeof(T) == 2)
+      bits = __builtin_bswap16(bits);
+    else if constexpr(sizeof(T) == 4)
+      bits = __builtin_bswap32(bits);
+    else if constexpr(sizeof(T) == 8)
+      bits = __builtin_bswap64(bits);
+  }
+  return std::bit_cast<T>(bits);
+}
+
+// Converts one row of big-endian file data into native values of the
+// destination type. Integer data with an integer zero point and no scaling
+// (which covers the BZERO = 32768 unsigned short images) avoids going
+// through floating point, so the loop stays simple enough to be vectorized.
+template<typename Src, typename Dst>
+static void convertRow(const uint8_t *src, Dst *dst, long count, long inc, double bscale, double bzero) {
+  const size_t step = inc * sizeof(Src);
+
+  // 16 bit rows without gaps, which is what most cameras produce, go
+  // through the vectorized kernels
+  if constexpr(std::is_same_v<Src, int16_t> && std::is_integral_v<Dst> && sizeof(Dst) == 2) {
+    if(inc == 1 && bscale == 1.0 && std::trunc(bzero) == bzero) {
+      Kernels::swap16(src, reinterpret_cast<uint16_t *>(dst), count, static_cast<int32_t>(static_cast<int64_t>(bzero) & 0xffff));
+      return;
+    }
+  } else if constexpr(std::is_same_v<Src, int16_t> && std::is_same_v<Dst, float>) {
+    if(inc == 1) {
+      Kernels::swap16ToFloat(src, dst, count, bscale, bzero);
+      return;
+    }
+  }
+
+  if constexpr(std::is_integral_v<Src> && std::is_integral_v<Dst>) {
+    if(bscale == 1.0 && std::trunc(bzero) == bzero) {
+      // Wrapping arithmetic also covers BZERO = 2^63 of unsigned 64 bit data
+      const uint64_t zero = bzero >= 0 ? static_cast<uint64_t>(bzero) : static_cast<uint64_t>(static_cast<int64_t>(bzero));
+      for(long i = 0; i < count; ++i)
+        dst[i] = static_cast<Dst>(static_cast<uint64_t>(static_cast<int64_t>(loadBigEndian<Src>(src + i * step))) + zero);
+      return;
+    }
+  }
+
+  for(long i = 0; i < count; ++i)
+    dst[i] = static_cast<Dst>(loadBigEndian<Src>(src + i * step) * bscale + bzero);
+}
+
+template<typename Fn>
+static bool dispatchBitpix(int bitpix, Fn&& fn) {
+  switch(bitpix) {
+    case 8: fn(std::type_identity<uint8_t>{}); return true;
+    case 16: fn(std::type_identity<int16_t>{}); return true;
+    case 32: fn(std::type_identity<int32_t>{}); return true;
+    case 64: fn(std::type_identity<int64_t>{}); return true;
+    case -32: fn(std::type_identity<float>{}); return true;
+    case -64: fn(std::type_identity<double>{}); return true;
+    default: return false;
+  }
+}
+
+static std::string_view cardKeyword(const char *card) {
+  std::string_view keyword(card, 8);
+  auto end = keyword.find_last_not_of(' ');
+  return end == std::string_view::npos ? std::string_view() : keyword.substr(0, end + 1);
+}
+
+static bool cardHasValue(const char *card) {
+  return card[8] == '=' && card[9] == ' ';
+}
+
+static double cardNumber(const char *card) {
+  // Value field spans from column 11 to the end of the card
+  char value[FITS_CARD_SIZE];
+  memcpy(value, card + 10, FITS_CARD_SIZE - 10);
+  value[FITS_CARD_SIZE - 10] = 0;
+  // Fortran style exponents are allowed by the standard
+  for(char& c : value) {
+    if(c == 'D' || c == 'd')
+      c = 'E';
+  }
+  return strtod(value, nullptr);
+}
+
+static bool cardLogical(const char *card) {
+  std::string_view value(card + 10, FITS_CARD_SIZE - 10);
+  auto pos = value.find_first_not_of(' ');
+  return pos != std::string_view::npos && value[pos] == 'T';
+}
+
+MappedFits::MappedFits(const std::filesystem::path& filename, size_t readAhead)
+  : m_path(filename)
+  , m_maxTypeValue(0)
+  , m_readAhead(readAhead) {
+  m_imageCount = -1;
+
+  int fd = open(filename.c_str(), O_RDONLY);
+  if(fd < 0) {
+    spdlog::error("Failed to open FITS file {}", filename.c_str());
+    return;
+  }
+
+  struct stat info;
+  if(fstat(fd, &info) != 0 || info.st_size < FITS_BLOCK_SIZE) {
+    spdlog::error("FITS file {} is too small to be valid", filename.c_str());
+    close(fd);
+    return;
+  }
+
+  void *address = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping stays valid after the descriptor is closed
+  close(fd);
+  if(address == MAP_FAILED) {
+    spdlog::error("Failed to map FITS file {}", filename.c_str());
+    return;
+  }
+
+  m_mapping = std::make_shared<Mapping>(static_cast<uint8_t *>(address), info.st_size);
+  if(!parseHeaders(filename)) {
+    m_hdus.clear();
+    m_mapping = nullptr;
+    return;
+  }
+
+  m_imageCount = m_hdus.size();
+  m_maxTypeValue = indexMaxTypeValue(m_hdus);
+  spdlog::info("Mapped FITS file {} with {} HDUs", filename.c_str(), m_imageCount);
+}
+
+bool MappedFits::parseHeaders(const std::filesystem::path& filename) {
+  const uint8_t *base = m_mapping->m_address;
+  const size_t size = m_mapping->m_size;
+
+  size_t offset = 0;
+  while(offset + FITS_BLOCK_SIZE <= size) {
+    HduInfo hdu;
+    hdu.m_headerOffset = offset;
+    long dimCount = 0;
+    long pcount = 0, gcount = 1;
+    bool image = true;
+    bool ended = false;
+
+    while(!ended) {
+      if(offset + FITS_BLOCK_SIZE > size) {
+        spdlog::error("FITS file {} ends in the middle of a header", filename.c_str());
+        return false;
+      }
+
+      for(size_t card = 0; card < FITS_BLOCK_SIZE / FITS_CARD_SIZE && !ended; ++card) {
+        const char *ptr = reinterpret_cast<const char *>(base + offset + card * FITS_CARD_SIZE);
+        auto keyword = cardKeyword(ptr);
+
+        if(keyword == "END") {
+          ended = true;
+        } else if(!cardHasValue(ptr)) {
+          continue;
+        } else if(keyword == "XTENSION") {
+          image = HduInfo::cardValue(std::string_view(ptr + 10, FITS_CARD_SIZE - 10)) == "IMAGE";
+        } else if(keyword == "BITPIX") {
+          hdu.m_bitpix = static_cast<int>(cardNumber(ptr));
+        } else if(keyword == "NAXIS") {
+          double value = cardNumber(ptr);
+          if(!(value >= 0 && value <= 999)) {
+            spdlog::error("Invalid NAXIS value {} in FITS file {}", value, filename.c_str());
+            return false;
+          }
+          dimCount = static_cast<long>(value);
+          hdu.m_dims.resize(dimCount, 0);
+        } else if(keyword.starts_with("NAXIS")) {
+          long axis = std::strtol(std::string(keyword.substr(5)).c_str(), nullptr, 10);
+          if(axis >= 1 && axis <= dimCount) {
+            hdu.m_dims[axis - 1] = static_cast<long>(cardNumber(ptr));
+            if(hdu.m_dims[axis - 1] < 0) {
+              spdlog::error("Invalid {} value in FITS file {}", keyword, filename.c_str());
+              return false;
+            }
+          }
+        } else if(keyword == "PCOUNT") {
+          pcount = static_cast<long>(cardNumber(ptr));
+        } else if(keyword == "GCOUNT") {
+          gcount = static_cast<long>(cardNumber(ptr));
+        } else if(keyword == "BZERO") {
+          hdu.m_bzero = cardNumber(ptr);
+        } else if(keyword == "BSCALE") {
+          hdu.m_bscale = cardNumber(ptr);
+        } else if(HduInfo::isIndexedKeyword(keyword)) {
+          hdu.m_cards.emplace(keyword, HduInfo::cardValue(std::string_view(ptr + 10, FITS_CARD_SIZE - 10)));
+        } else if(keyword == "ZIMAGE" && cardLogical(ptr)) {
+          // Tile compressed images are stored in binary tables,
+          // they can only be read through cfitsio.
+          spdlog::info("FITS file {} contains compressed images and can't be mapped", filename.c_str());
+          return false;
+        }
+      }
+      offset += FITS_BLOCK_SIZE;
+    }
+
+    size_t elementCount = dimCount > 0 ? 1 : 0;
+    for(long dim : hdu.m_dims)
+      elementCount *= dim;
+
+    hdu.m_type = HduInfo::equivalentType(hdu.m_bitpix, hdu.m_bzero, hdu.m_bscale);
+    hdu.m_dataOffset = offset;
+    hdu.m_dataSize = (std::abs(hdu.m_bitpix) / 8) * gcount * (pcount + elementCount);
+    if(hdu.m_dataOffset + hdu.m_dataSize > size) {
+      spdlog::error("FITS file {} is truncated", filename.c_str());
+      return false;
+    }
+
+    // Data is padded to a full block
+    offset += (hdu.m_dataSize + FITS_BLOCK_SIZE - 1) / FITS_BLOCK_SIZE * FITS_BLOCK_SIZE;
+
+    // Tables keep their slot like in Fits::buildIndex, but aren't images
+    if(!image)
+      hdu.m_dims.clear();
+    m_hdus.push_back(std::move(hdu));
+  }
+
+  return !m_hdus.empty();
+}
+
+const uint8_t *MappedFits::rawPixels(int index) const {
+  if(index < 0 || index >= m_hdus.size())
+    return nullptr;
+  return m_mapping->m_address + m_hdus[index].m_dataOffset;
+}
+
+const HduIndex& MappedFits::index() const {
+  return m_hdus;
+}
+
+std::vector<int> MappedFits::advisedImages() {
+  std::lock_guard lock(m_mutex);
+  return m_advised;
+}
+
+void MappedFits::setAccessOrder(const std::vector<int>& indices) {
+  m_readAhead.setOrder(indices);
+}
+
+void MappedFits::accessed(int index) {
+  auto next = m_readAhead.accessed(index, m_imageCount);
+
+  static const size_t pageSize = sysconf(_SC_PAGESIZE);
+  for(int image : next) {
+    // Indices of an access order don't have to be in the file
+    if(image < 0 || image >= (int)m_hdus.size())
+      continue;
+
+    auto& hdu = m_hdus[image];
+    if(!hdu.isImage() || hdu.m_dataSize == 0)
+      continue;
+
+    // madvise wants a page aligned address
+    size_t start = hdu.m_dataOffset / pageSize * pageSize;
+    size_t end = hdu.m_dataOffset + hdu.m_dataSize;
+    if(madvise(m_mapping->m_address + start, end - start, MADV_WILLNEED) != 0)
+      spdlog::debug("Failed to advise read ahead of image {}", image);
+  }
+
+  std::lock_guard lock(m_mutex);
+  m_advised = std::move(next);
+}
+
+DataParameters MappedFits::getImageParameters(int index) {
+  if(index < 0 || index >= m_hdus.size())
+    return DataParameters(index);
+
+  return m_hdus[index].parameters(index);
+}
+
+bool MappedFits::isDirectView(const DataParameters& params, size_t& start) const {
+  // Only unscaled 8 bit data can be handed out without a conversion
+  auto& hdu = m_hdus[params.index()];
+  if(hdu.m_bitpix != 8 || hdu.m_bscale != 1.0 || hdu.m_bzero != 0 || params.type() != DataType::UBYTE)
+    return false;
+
+  // The region has to be contiguous and inside of the HDU data
+  size_t size;
+  return contiguousRange(hdu, params, start, size);
+}
+
+std::shared_ptr<uint8_t[]> MappedFits::getPixels(const DataParameters& params) {
+  if(!params || params.index() >= m_hdus.size() || params.dimCount() != m_hdus[params.index()].m_dims.size())
+    return nullptr;
+
+  size_t start;
+  if(isDirectView(params, start)) {
+    accessed(params.index());
+    // Pointer into the mapping which keeps the whole mapping alive
+    auto ptr = m_mapping->m_address + m_hdus[params.index()].m_dataOffset + start;
+    return std::shared_ptr<uint8_t[]>(m_mapping, ptr);
+  }
+
+  return ImageProvider::getPixels(params);
+}
+
+bool MappedFits::readPixels(const DataParameters& params, void *ptr) {
+  if(!params || params.index() >= m_hdus.size())
+    return false;
+
+  accessed(params.index());
+  auto& hdu = m_hdus[params.index()];
+  return convertPixels(hdu, params, m_mapping->m_address + hdu.m_dataOffset, 0, ptr);
+}
+
+bool MappedFits::contiguousRange(const HduInfo& hdu, const DataParameters& params, size_t& start, size_t& size) {
+  int dimCount = params.dimCount();
+  if(!params || dimCount != hdu.m_dims.size())
+    return false;
+
+  // Every axis but the last one has to be read completely
+  size_t slice = std::abs(hdu.m_bitpix) / 8;
+  for(int i = 0; i < dimCount; ++i) {
+    if(params.inc()[i] != 1 || params.start()[i] < 1 || params.end()[i] > hdu.m_dims[i] || params.start()[i] > params.end()[i])
+      return false;
+    if(i != dimCount - 1) {
+      if(params.start()[i] != 1 || params.end()[i] != hdu.m_dims[i])
+        return false;
+      slice *= hdu.m_dims[i];
+    }
+  }
+
+  start = (params.start()[dimCount - 1] - 1) * slice;
+  size = (params.end()[dimCount - 1] - params.start()[dimCount - 1] + 1) * slice;
+  return true;
+}
+
+bool MappedFits::convertPixels(const HduInfo& hdu, const DataParameters& params, const uint8_t *data, size_t dataStart, void *ptr) {
+  int dimCount = params.dimCount();
+  if(dimCount != hdu.m_dims.size())
+    return false;
+
+  const size_t elementSize = std::abs(hdu.m_bitpix) / 8;
+  std::vector<long> count(dimCount);
+  std::vector<size_t> stride(dimCount);
+  for(int i = 0; i < dimCount; ++i) {
+    auto start = params.start()[i], end = params.end()[i], inc = params.inc()[i];
+    if(start < 1 || end > hdu.m_dims[i] || start > end || inc < 1)
+      return false;
+
+    count[i] = (end - start + 1) / inc;
+    stride[i] = i == 0 ? elementSize : stride[i - 1] * hdu.m_dims[i - 1];
+  }
+
+  long rowCount = 1;
+  for(int i = 1; i < dimCount; ++i)
+    rowCount *= count[i];
+
+  bool supported = dispatchBitpix(hdu.m_bitpix, [&]<typename Src>(std::type_identity<Src>) {
+    dispatchDataType(params.type(), [&]<typename Dst>(std::type_identity<Dst>) {
+      Dst *dst = static_cast<Dst *>(ptr);
+      for(long row = 0; row < rowCount; ++row) {
+        // Find where this row starts in the file
+        size_t offset = (params.start()[0] - 1) * stride[0] - dataStart;
+        long rest = row;
+        for(int i = 1; i < dimCount; ++i) {
+          long index = rest % count[i];
+          rest /= count[i];
+          offset += (params.start()[i] - 1 + index * params.inc()[i]) * stride[i];
+        }
+
+        convertRow<Src, Dst>(data + offset, dst + row * count[0], count[0], params.inc()[0], hdu.m_bscale, hdu.m_bzero);
+      }
+    });
+  });
+
+  if(!supported)
+    spdlog::error("Unsupported BITPIX value {} in HDU {}", hdu.m_bitpix, params.index());
+  return supported;
+}
+
+std::unique_ptr<AsyncReader> MappedFits::createAsyncReader() {
+#ifdef HAVE_LIBURING
+  auto reader = std::make_unique<UringReader>(this, m_path, m_hdus);
+  if(reader->valid())
+    return reader;
+#endif
+  return ImageProvider::createAsyncReader();
+}
+
+double MappedFits::maxTypeValue() {
+  return m_maxTypeValue;
+}
+
@@ -0,0 +1,225 @@
+#include "io/multi_fits.hpp"
+#include "io/thread_pool.hpp"
+
+#include <format>
+
+#include <spdlog/spdlog.h>
+
+using namespace IO;
+
+// Extensions Siril writes FITS files with
+static const char *FITS_EXTENSIONS[] = { ".fit", ".fits", ".fts" };
+
+MultiFits::Lease::Lease(MultiFits& parent, int fileIndex, const File& file)
+  : m_parent(parent)
+  , m_fileIndex(fileIndex)
+  , m_handle(parent.acquire(fileIndex, file)) {
+}
+
+MultiFits::Lease::~Lease() {
+  if(m_handle)
+    m_parent.release(m_fileIndex);
+}
+
+Fits *MultiFits::Lease::operator->() {
+  return m_handle;
+}
+
+MultiFits::Lease::operator bool() const {
+  return m_handle != nullptr;
+}
+
+MultiFits::MultiFits(const std::filesystem::path& directory, const std::string& name,
+                     const std::vector<int>& fileIndices, int fixedLength, bool compressed,
+                     size_t maxHandles)
+  : m_maxTypeValue(0)
+  , m_maxHandles(std::max<size_t>(maxHandles, 1)) {
+  m_imageCount = -1;
+  if(fileIndices.empty())
+    return;
+
+  // All files of a sequence share the extension, look it up with the first one
+  std::string extension;
+  for(auto candidate : FITS_EXTENSIONS) {
+    std::string ext = compressed ? std::string(candidate) + ".fz" : candidate;
+    if(std::filesystem::exists(filePath(directory, name, fileIndices.front(), fixedLength, ext))) {
+      extension = ext;
+      break;
+    }
+  }
+  if(extension.empty()) {
+    spdlog::error("No FITS files found for sequence {} in {}", name, directory.c_str());
+    return;
+  }
+
+  // Scan headers in parallel, every job only writes its own slot
+  std::vector<File> files(fileIndices.size());
+  {
+    ThreadPool pool(fits_is_reentrant() ? 0 : 1);
+    for(size_t i = 0; i < fileIndices.size(); ++i) {
+      pool.submit([&, i]() {
+        auto& file = files[i];
+        file.m_path = filePath(directory, name, fileIndices[i], fixedLength, extension);
+        file.m_hdu = -1;
+
+        Fits fits(file.m_path);
+        auto index = fits.index();
+        if(fits.imageCount() < 0 || !index)
+          return;
+
+        // Compressed files keep the image in an extension
+        for(size_t hdu = 0; hdu < index->size(); ++hdu) {
+          if((*index)[hdu].isImage()) {
+            file.m_hdu = hdu;
+            file.m_index = index;
+            break;
+          }
+        }
+      });
+    }
+    pool.wait();
+  }
+
+  for(size_t i = 0; i < fileIndices.size(); ++i) {
+    if(files[i].m_hdu < 0) {
+      spdlog::warn("Skipping unreadable sequence image {}", files[i].m_path.c_str());
+      continue;
+    }
+    m_images.push_back((*files[i].m_index)[files[i].m_hdu]);
+    m_files[fileIndices[i]] = std::move(files[i]);
+  }
+
+  if(m_files.empty()) {
+    spdlog::error("None of the images of sequence {} could be read", name);
+    return;
+  }
+
+  m_imageCount = m_files.size();
+  m_maxTypeValue = indexMaxTypeValue(m_images);
+  spdlog::info("Opened {} FITS files of sequence {}", m_imageCount, name);
+}
+
+std::filesystem::path MultiFits::filePath(const std::filesystem::path& directory, const std::string& name,
+                                          int fileIndex, int fixedLength, const std::string& extension) {
+  if(fixedLength > 0)
+    return directory / std::format("{}{:0{}}{}", name, fileIndex, fixedLength, extension);
+  return directory / std::format("{}{}{}", name, fileIndex, extension);
+}
+
+std::filesystem::path MultiFits::path(int fileIndex) const {
+  auto iter = m_files.find(fileIndex);
+  return iter != m_files.end() ? iter->second.m_path : std::filesystem::path();
+}
+
+const HduInfo *MultiFits::info(int fileIndex) const {
+  auto iter = m_files.find(fileIndex);
+  if(iter == m_files.end())
+    return nullptr;
+  return &(*iter->second.m_index)[iter->second.m_hdu];
+}
+
+size_t MultiFits::handleCount() {
+  std::lock_guard lock(m_mutex);
+  return m_handles.size();
+}
+
+Fits *MultiFits::acquire(int fileIndex, const File& file) {
+  std::unique_lock lock(m_mutex);
+  while(true) {
+    auto open = m_openHandles.find(fileIndex);
+    if(open != m_openHandles.end()) {
+      auto handle = open->second;
+      if(!handle->m_busy) {
+        handle->m_busy = true;
+        m_handles.splice(m_handles.begin(), m_handles, handle);
+        return handle->m_fits.get();
+      }
+      // Another thread is reading from this file
+      m_handleReleased.wait(lock);
+      continue;
+    }
+
+    if(m_handles.size() < m_maxHandles)
+      break;
+
+    // Close the least recently used idle handle to make room
+    auto idle = std::find_if(m_handles.rbegin(), m_handles.rend(), [](const Handle& handle) { return !handle.m_busy; });
+    if(idle != m_handles.rend()) {
+      m_openHandles.erase(idle->m_fileIndex);
+      m_handles.erase(std::next(idle).base());
+      break;
+    }
+
+    m_handleReleased.wait(lock);
+  }
+
+  // Reserve the slot, then open the file without holding the lock
+  m_handles.push_front({ fileIndex, nullptr, true });
+  auto handle = m_handles.begin();
+  m_openHandles[fileIndex] = handle;
+  lock.unlock();
+
+  // Gives the slot up again, threads waiting for this file open it themselves
+  auto unreserve = [&]() {
+    m_openHandles.erase(fileIndex);
+    m_handles.erase(handle);
+    lock.unlock();
+    m_handleReleased.notify_all();
+  };
+
+  std::unique_ptr<Fits> fits;
+  try {
+    fits = std::make_unique<Fits>(file.m_path, file.m_index);
+  } catch(...) {
+    lock.lock();
+    unreserve();
+    throw;
+  }
+
+  lock.lock();
+  if(fits->imageCount() < 0) {
+    unreserve();
+    return nullptr;
+  }
+
+  handle->m_fits = std::move(fits);
+  return handle->m_fits.get();
+}
+
+void MultiFits::release(int fileIndex) {
+  {
+    std::lock_guard lock(m_mutex);
+    auto open = m_openHandles.find(fileIndex);
+    if(open != m_openHandles.end())
+      open->second->m_busy = false;
+  }
+  m_handleReleased.notify_all();
+}
+
+DataParameters MultiFits::getImageParameters(int index) {
+  auto iter = m_files.find(index);
+  if(iter == m_files.end())
+    return DataParameters(index);
+
+  auto& file = iter->second;
+  return (*file.m_index)[file.m_hdu].parameters(index);
+}
+
+bool MultiFits::readPixels(const DataParameters& params, void *ptr) {
+  auto iter = m_files.find(params.index());
+  if(iter == m_files.end())
+    return false;
+
+  auto& file = iter->second;
+  Lease fits(*this, params.index(), file);
+  if(!fits)
+    return false;
+
+  // Inside of the file the image is addressed by its HDU
+  return fits->readPixels(params.withIndex(file.m_hdu), ptr);
+}
+
+double MultiFits::maxTypeValue() {
+  return m_maxTypeValue;
+}
+
@@ -0,0 +1,99 @@
+#include "io/prefetch.hpp"
+
+#include <spdlog/spdlog.h>
+
+using namespace IO;
+
+PrefetchingProvider::PrefetchingProvider(CachedImageProvider *cache, size_t depth, size_t threadCount)
+  : m_cache(cache)
+  , m_pool(std::make_unique<ThreadPool>(threadCount))
+  , m_readAhead(depth) {
+  m_imageCount = m_cache->imageCount();
+}
+
+PrefetchingProvider::~PrefetchingProvider() {
+  // Workers must be gone before the cache they are reading into
+  m_pool = nullptr;
+  delete m_cache;
+}
+
+CachedImageProvider& PrefetchingProvider::cache() {
+  return *m_cache;
+}
+
+void PrefetchingProvider::waitIdle() {
+  m_pool->wait();
+}
+
+void PrefetchingProvider::setAccessOrder(const std::vector<int>& indices) {
+  m_readAhead.setOrder(indices);
+}
+
+DataParameters PrefetchingProvider::getImageParameters(int index) {
+  return m_cache->getImageParameters(index);
+}
+
+std::shared_ptr<uint8_t[]> PrefetchingProvider::getPixels(const DataParameters& params) {
+  // Schedule first so the prefetches overlap with this read
+  accessed({ &params, 1 });
+  return m_cache->getPixels(params);
+}
+
+std::vector<std::shared_ptr<uint8_t[]>> PrefetchingProvider::getParts(const std::vector<DataParameters>& parts) {
+  // A single access, going through getPixels would reschedule the
+  // prefetches for every part
+  accessed(parts);
+  return m_cache->getParts(parts);
+}
+
+bool PrefetchingProvider::readPixels(const DataParameters& params, void *ptr) {
+  accessed({ &params, 1 });
+  return m_cache->readPixels(params, ptr);
+}
+
+double PrefetchingProvider::maxTypeValue() {
+  return m_cache->maxTypeValue();
+}
+
+void PrefetchingProvider::accessed(std::span<const DataParameters> parts) {
+  if(parts.empty() || !parts.front())
+    return;
+
+  auto next = m_readAhead.accessed(parts.front().index(), m_imageCount);
+
+  // Anything still queued is for a pattern we left, drop it. Already
+  // cached images are cheap hits so rescheduling them doesn't hurt.
+  m_pool->clear();
+  for(int index : next) {
+    for(auto& part : parts) {
+      auto prefetch = prefetchParameters(index, part);
+      if(!prefetch)
+        continue;
+
+      m_pool->submit([this, prefetch = std::move(prefetch)]() {
+        // A failed prefetch only costs the read it should have saved
+        try {
+          if(!m_cache->getPixels(prefetch))
+            spdlog::debug("Prefetching image {} failed", prefetch.index());
+        } catch(const std::exception& e) {
+          spdlog::debug("Prefetching image {} failed: {}", prefetch.index(), e.what());
+        }
+      });
+    }
+  }
+}
+
+DataParameters PrefetchingProvider::prefetchParameters(int index, const DataParameters& like) {
+  auto params = m_cache->getImageParameters(index);
+  if(!params || params.type() != like.type() || params.dimCount() != like.dimCount())
+    return DataParameters(index);
+
+  for(int i = 0; i < params.dimCount(); ++i) {
+    // Region doesn't fit into this image
+    if(like.end()[i] > params.end()[i])
+      return DataParameters(index);
+    params.setDimension(i, like.start()[i], like.end()[i], like.inc()[i]);
+  }
+  return params;
+}
+
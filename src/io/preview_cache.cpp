@@ -0,0 +1,327 @@
+#include "io/preview_cache.hpp"
+#include "io/convert.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <spdlog/spdlog.h>
+
+using namespace IO;
+
+// Cache files are only read back on the machine which wrote them, all
+// fields are stored in native byte order.
+static const char PREVIEW_MAGIC[8] = { 'I', 'A', 'P', 'R', 'E', 'V', 'W', 0 };
+static const uint32_t PREVIEW_VERSION = 1;
+
+struct FileHeader {
+  char m_magic[8];
+  uint32_t m_version;
+  uint32_t m_sourceCount;
+  uint32_t m_entryCount;
+  uint32_t m_reserved;
+};
+
+// Followed by the path, padded to 8 bytes
+struct SourceRecord {
+  uint64_t m_size;
+  int64_t m_mtime;
+  uint32_t m_pathLength;
+  uint32_t m_reserved;
+};
+
+struct EntryRecord {
+  uint32_t m_source;
+  int32_t m_index;
+  uint32_t m_width;
+  uint32_t m_height;
+  uint32_t m_type;
+  uint32_t m_reserved;
+  uint64_t m_offset;
+};
+
+static size_t padded(size_t size) {
+  return (size + 7) & ~size_t(7);
+}
+
+// Size and modification time of a source, false if it doesn't exist
+static bool sourceStamp(const std::string& path, uint64_t& size, int64_t& mtime) {
+  std::error_code error;
+  size = std::filesystem::file_size(path, error);
+  if(error)
+    return false;
+  mtime = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+  return !error;
+}
+
+struct PreviewCache::Mapping {
+  uint8_t *m_address;
+  size_t m_size;
+
+  Mapping(uint8_t *address, size_t size)
+    : m_address(address)
+    , m_size(size) {
+  }
+
+  ~Mapping() {
+    munmap(m_address, m_size);
+  }
+};
+
+PreviewCache::Preview::operator bool() const {
+  return m_data != nullptr;
+}
+
+PreviewCache::PreviewCache(const std::filesystem::path& cachePath)
+  : m_cachePath(cachePath)
+  , m_dirty(false) {
+  if(std::filesystem::exists(m_cachePath) && !load()) {
+    spdlog::warn("Ignoring invalid preview cache {}", m_cachePath.c_str());
+    m_previews.clear();
+    m_mapping = nullptr;
+  }
+}
+
+const std::filesystem::path& PreviewCache::path() const {
+  return m_cachePath;
+}
+
+size_t PreviewCache::size() {
+  std::lock_guard lock(m_mutex);
+  return m_previews.size();
+}
+
+bool PreviewCache::load() {
+  int fd = open(m_cachePath.c_str(), O_RDONLY);
+  if(fd < 0)
+    return false;
+
+  struct stat info;
+  if(fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(FileHeader)) {
+    close(fd);
+    return false;
+  }
+
+  void *address = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(address == MAP_FAILED)
+    return false;
+
+  m_mapping = std::make_shared<Mapping>((uint8_t*)address, info.st_size);
+  const uint8_t *begin = m_mapping->m_address;
+  const size_t size = m_mapping->m_size;
+
+  FileHeader header;
+  memcpy(&header, begin, sizeof(header));
+  if(memcmp(header.m_magic, PREVIEW_MAGIC, sizeof(PREVIEW_MAGIC)) != 0 || header.m_version != PREVIEW_VERSION)
+    return false;
+
+  // Sources which no longer match the files on disk are marked with an empty path
+  size_t offset = sizeof(FileHeader);
+  std::vector<std::string> sources;
+  for(uint32_t i = 0; i < header.m_sourceCount; ++i) {
+    SourceRecord record;
+    if(offset + sizeof(record) > size)
+      return false;
+    memcpy(&record, begin + offset, sizeof(record));
+    offset += sizeof(record);
+
+    if(offset + record.m_pathLength > size)
+      return false;
+    std::string path((const char*)begin + offset, record.m_pathLength);
+    offset += padded(record.m_pathLength);
+
+    uint64_t currentSize;
+    int64_t currentMtime;
+    if(!sourceStamp(path, currentSize, currentMtime) || currentSize != record.m_size || currentMtime != record.m_mtime) {
+      spdlog::debug("Previews of {} are out of date", path);
+      m_dirty = true;
+      path.clear();
+    }
+    sources.push_back(std::move(path));
+  }
+
+  for(uint32_t i = 0; i < header.m_entryCount; ++i) {
+    EntryRecord record;
+    if(offset + sizeof(record) > size)
+      return false;
+    memcpy(&record, begin + offset, sizeof(record));
+    offset += sizeof(record);
+
+    size_t dataSize = (size_t)record.m_width * record.m_height * sizeof(uint16_t);
+    if(record.m_source >= sources.size() || record.m_offset % alignof(uint16_t) != 0 || record.m_offset + dataSize > size)
+      return false;
+    if(sources[record.m_source].empty())
+      continue;
+
+    Preview preview = {
+      .m_width = record.m_width,
+      .m_height = record.m_height,
+      .m_type = (DataType::EnumType)record.m_type,
+      .m_data = std::shared_ptr<const uint16_t[]>(m_mapping, (const uint16_t*)(begin + record.m_offset)),
+    };
+    m_previews[{ sources[record.m_source], record.m_index }] = std::move(preview);
+  }
+
+  spdlog::debug("Loaded {} previews from {}", m_previews.size(), m_cachePath.c_str());
+  return true;
+}
+
+PreviewCache::Preview PreviewCache::find(const std::filesystem::path& source, int index) {
+  std::lock_guard lock(m_mutex);
+  auto iter = m_previews.find({ source.string(), index });
+  if(iter == m_previews.end())
+    return {};
+  return iter->second;
+}
+
+PreviewCache::Preview PreviewCache::get(PyramidProvider& pyramid, const std::filesystem::path& source, int index) {
+  auto preview = find(source, index);
+  if(preview)
+    return preview;
+
+  preview = makePreview(pyramid, index);
+  if(preview) {
+    std::lock_guard lock(m_mutex);
+    m_previews[{ source.string(), index }] = preview;
+    m_dirty = true;
+  }
+  return preview;
+}
+
+PreviewCache::Preview PreviewCache::makePreview(PyramidProvider& pyramid, int index) {
+  // The smallest level at least PREVIEW_WIDTH wide, the next one is used
+  // if it's wider so previews are never wider than PREVIEW_WIDTH
+  auto level = pyramid.getLevel(index, PREVIEW_WIDTH);
+  if(level && level.m_width > PREVIEW_WIDTH && level.m_level + 1 < pyramid.levelCount(index))
+    level = pyramid.level(index, level.m_level + 1);
+  if(!level)
+    return {};
+
+  Preview preview = {
+    .m_width = (uint32_t)level.m_width,
+    .m_height = (uint32_t)level.m_height,
+    .m_type = level.m_type,
+  };
+
+  // Copied, levels belong to the pyramid and the full resolution one to
+  // the pixel cache
+  const size_t count = (size_t)preview.m_width * preview.m_height;
+  std::shared_ptr<uint16_t[]> out(new uint16_t[count]);
+  if(DataType::dataSize(level.m_type) == sizeof(uint16_t)) {
+    // 16 bit data is kept as it is
+    memcpy(out.get(), level.m_data.get(), count * sizeof(uint16_t));
+  } else {
+    // Everything else is normalized to the type maximum, the same way
+    // 16 bit data gets normalized when it's sampled as a texture
+    convertToUnorm16(level.m_type, level.m_data.get(), out.get(), count, 1.0 / pyramid.maxTypeValue());
+  }
+
+  preview.m_data = out;
+  return preview;
+}
+
+bool PreviewCache::save() {
+  std::lock_guard lock(m_mutex);
+  if(!m_dirty)
+    return true;
+
+  // Assign source ids, sources which vanished are dropped
+  std::vector<std::string> sources;
+  std::vector<SourceRecord> sourceRecords;
+  std::map<std::string, uint32_t, std::less<>> sourceIds;
+  for(auto& [key, preview] : m_previews) {
+    if(sourceIds.contains(key.first))
+      continue;
+
+    SourceRecord record = {};
+    if(!sourceStamp(key.first, record.m_size, record.m_mtime))
+      continue;
+    record.m_pathLength = key.first.size();
+
+    sourceIds[key.first] = sources.size();
+    sources.push_back(key.first);
+    sourceRecords.push_back(record);
+  }
+
+  std::vector<EntryRecord> entries;
+  std::vector<const Preview*> entryPreviews;
+  for(auto& [key, preview] : m_previews) {
+    auto source = sourceIds.find(key.first);
+    if(source == sourceIds.end())
+      continue;
+
+    EntryRecord record = {
+      .m_source = source->second,
+      .m_index = key.second,
+      .m_width = preview.m_width,
+      .m_height = preview.m_height,
+      .m_type = (uint32_t)preview.m_type,
+    };
+    entries.push_back(record);
+    entryPreviews.push_back(&preview);
+  }
+
+  // Pixel data starts after all the records
+  size_t offset = sizeof(FileHeader) + entries.size() * sizeof(EntryRecord);
+  for(auto& source : sources)
+    offset += sizeof(SourceRecord) + padded(source.size());
+  for(auto& entry : entries) {
+    entry.m_offset = offset;
+    offset += padded((size_t)entry.m_width * entry.m_height * sizeof(uint16_t));
+  }
+
+  // Written to a temporary file first, the old one may still be mapped
+  auto tempPath = m_cachePath;
+  tempPath += ".tmp";
+  std::ofstream stream(tempPath, std::ios::out | std::ios::trunc | std::ios::binary);
+  if(!stream.is_open()) {
+    spdlog::error("Failed to open preview cache {} for writing", tempPath.c_str());
+    return false;
+  }
+
+  static const char zeros[8] = {};
+  FileHeader header = {};
+  memcpy(header.m_magic, PREVIEW_MAGIC, sizeof(PREVIEW_MAGIC));
+  header.m_version = PREVIEW_VERSION;
+  header.m_sourceCount = sources.size();
+  header.m_entryCount = entries.size();
+  stream.write((const char*)&header, sizeof(header));
+
+  for(size_t i = 0; i < sources.size(); ++i) {
+    stream.write((const char*)&sourceRecords[i], sizeof(SourceRecord));
+    stream.write(sources[i].data(), sources[i].size());
+    stream.write(zeros, padded(sources[i].size()) - sources[i].size());
+  }
+  stream.write((const char*)entries.data(), entries.size() * sizeof(EntryRecord));
+
+  for(size_t i = 0; i < entries.size(); ++i) {
+    size_t dataSize = (size_t)entries[i].m_width * entries[i].m_height * sizeof(uint16_t);
+    stream.write((const char*)entryPreviews[i]->m_data.get(), dataSize);
+    stream.write(zeros, padded(dataSize) - dataSize);
+  }
+
+  stream.close();
+  if(stream.fail()) {
+    spdlog::error("Failed to write preview cache {}", tempPath.c_str());
+    std::filesystem::remove(tempPath);
+    return false;
+  }
+
+  std::error_code error;
+  std::filesystem::rename(tempPath, m_cachePath, error);
+  if(error) {
+    spdlog::error("Failed to replace preview cache {}: {}", m_cachePath.c_str(), error.message());
+    return false;
+  }
+
+  spdlog::debug("Saved {} previews to {}", entries.size(), m_cachePath.c_str());
+  m_dirty = false;
+  return true;
+}
+
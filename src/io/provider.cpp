@@ -1,4 +1,8 @@
 #include "io/provider.hpp"
+#include "io/async_reader.hpp"
+#include "io/buffer_pool.hpp"
+
+#include <cstring>
 
 #include <opencv2/core/mat.hpp>
 #include <spdlog/spdlog.h>
@@ -57,76 +61,34 @@ DataParameters::DataParameters(int index)
   : m_type(DataType::BYTE)
   , m_index(index)
   , m_dimCount(-1)
-  , m_start(0)
-  , m_end(0)
-  , m_inc(0) {
-
+  , m_start{}
+  , m_end{}
+  , m_inc{} {
+  updateHash();
 }
 
-DataParameters::DataParameters(int index, DataType::EnumType type, int dimCount, long *end)
-  : m_type(type)
-  , m_index(index)
-  , m_dimCount(dimCount) {
-  m_start = new long[dimCount];
-  m_end = new long[dimCount];
-  m_inc = new long[dimCount];
-
-  for(int i = 0; i < dimCount; ++i) {
-    m_end[i] = end[i];
-    m_start[i] = 1;
-    m_inc[i] = 1;
-  }
+DataParameters::DataParameters(int index, DataType::EnumType type, int dimCount, const long *end)
+  : DataParameters(index, type, dimCount, nullptr, end, nullptr) {
 }
 
-DataParameters::DataParameters(int index, DataType::EnumType type, int dimCount, long *start, long *end, long *inc)
+DataParameters::DataParameters(int index, DataType::EnumType type, int dimCount, const long *start, const long *end, const long *inc)
   : m_type(type)
   , m_index(index)
-  , m_dimCount(dimCount) {
-  m_start = new long[dimCount];
-  m_end = new long[dimCount];
-  m_inc = new long[dimCount];
-
-  for(int i = 0; i < dimCount; ++i) {
-    m_start[i] = start[i];
-    m_end[i] = end[i];
-
-    if(inc != 0) m_inc[i] = inc[i];
-    else m_inc[i] = 1;
+  , m_dimCount(dimCount)
+  , m_start{}
+  , m_end{}
+  , m_inc{} {
+  if(dimCount > MAX_DIMS) {
+    spdlog::error("Images with {} axes are not supported", dimCount);
+    m_dimCount = -1;
   }
-}
-
-DataParameters::DataParameters(const DataParameters& other)
-  : m_type(other.m_type)
-  , m_index(other.m_index)
-  , m_dimCount(other.m_dimCount) {
-  m_start = new long[m_dimCount];
-  m_end = new long[m_dimCount];
-  m_inc = new long[m_dimCount];
 
   for(int i = 0; i < m_dimCount; ++i) {
-    m_start[i] = other.m_start[i];
-    m_end[i] = other.m_end[i];
-    m_inc[i] = other.m_inc[i];
+    m_start[i] = start != 0 ? start[i] : 1;
+    m_end[i] = end[i];
+    m_inc[i] = inc != 0 ? inc[i] : 1;
   }
-}
-
-DataParameters::DataParameters(DataParameters&& other)
-  : m_type(other.m_type)
-  , m_index(other.m_index)
-  , m_dimCount(other.m_dimCount) {
-  m_start = other.m_start;
-  m_end = other.m_end;
-  m_inc = other.m_inc;
-
-  other.m_start = 0;
-  other.m_end = 0;
-  other.m_inc = 0;
-}
-
-DataParameters::~DataParameters() {
-  delete[] m_start;
-  delete[] m_end;
-  delete[] m_inc;
+  updateHash();
 }
 
 DataParameters::operator bool() const {
@@ -138,6 +100,8 @@ bool DataParameters::operator!() const {
 }
 
 bool DataParameters::operator==(const DataParameters& other) const {
+  if(m_hash != other.m_hash)
+    return false;
   if(m_type != other.m_type || m_dimCount != other.m_dimCount || m_index != other.m_index)
     return false;
 
@@ -149,17 +113,21 @@ bool DataParameters::operator==(const DataParameters& other) const {
   return true;
 }
 
-size_t DataParamHash::operator()(const DataParameters& obj) const {
+void DataParameters::updateHash() {
   std::hash<long> hasher;
 
-  size_t h = obj.m_type + obj.m_dimCount * 100 + obj.m_index * 1000;
-  for(int i = 0; i < obj.m_dimCount; ++i) {
-    h ^= hasher(obj.m_start[i]) + 0x9e3779b9 + (h << 6) + (h >> 2);
-    h ^= hasher(obj.m_end[i]) + 0x9e3779b9 + (h << 6) + (h >> 2);
-    h ^= hasher(obj.m_inc[i]) + 0x9e3779b9 + (h << 6) + (h >> 2);
+  size_t h = m_type + m_dimCount * 100 + m_index * 1000;
+  for(int i = 0; i < m_dimCount; ++i) {
+    h ^= hasher(m_start[i]) + 0x9e3779b9 + (h << 6) + (h >> 2);
+    h ^= hasher(m_end[i]) + 0x9e3779b9 + (h << 6) + (h >> 2);
+    h ^= hasher(m_inc[i]) + 0x9e3779b9 + (h << 6) + (h >> 2);
   }
 
-  return h;
+  m_hash = h;
+}
+
+size_t DataParamHash::operator()(const DataParameters& obj) const {
+  return obj.m_hash;
 }
 
 DataType::EnumType DataParameters::type() const {
@@ -186,18 +154,6 @@ const long *DataParameters::inc() const {
   return m_inc;
 }
 
-long *DataParameters::start() {
-  return m_start;
-}
-
-long *DataParameters::end() {
-  return m_end;
-}
-
-long *DataParameters::inc() {
-  return m_inc;
-}
-
 long DataParameters::width() const {
   return m_dimCount >= 1 ? (m_end[0] - m_start[0] + 1) / m_inc[0] : 0;
 }
@@ -210,12 +166,83 @@ long DataParameters::layerCount() const {
   return m_dimCount >= 3 ? (m_end[2] - m_start[2] + 1) / m_inc[2] : 0;
 }
 
+size_t DataParameters::byteSize() const {
+  if(m_dimCount <= 0)
+    return 0;
+
+  size_t pixelCount = 1;
+  for(int i = 0; i < m_dimCount; ++i)
+    pixelCount *= (m_end[i] - m_start[i] + 1) / m_inc[i];
+  return pixelCount * DataType::dataSize(m_type);
+}
+
 void DataParameters::setDimension(int dim, long start, long end, long inc) {
   if(dim < m_dimCount) {
     if(start > 0) m_start[dim] = start;
     if(end > 0) m_end[dim] = end;
     if(inc > 0) m_inc[dim] = inc;
+    updateHash();
+  }
+}
+
+DataParameters DataParameters::withIndex(int index) const {
+  DataParameters params(*this);
+  params.m_index = index;
+  params.updateHash();
+  return params;
+}
+
+DataParameters DataParameters::withType(DataType::EnumType type) const {
+  DataParameters params(*this);
+  params.m_type = type;
+  params.updateHash();
+  return params;
+}
+
+namespace {
+
+// Lets matrices share the pixel buffers handed out by providers. The
+// UMatData of such a matrix owns a reference to the buffer which is
+// dropped once the last matrix using it is released.
+class SharedBufferAllocator : public cv::MatAllocator {
+public:
+  using Buffer = std::shared_ptr<uint8_t[]>;
+
+  cv::UMatData *wrap(Buffer&& buffer, size_t size) const {
+    auto u = new cv::UMatData(this);
+    u->data = u->origdata = buffer.get();
+    u->size = size;
+    u->refcount = 1;
+    u->userdata = new Buffer(std::move(buffer));
+    return u;
   }
+
+  // Matrices reallocating their data get regular buffers
+  virtual cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step, cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override {
+    return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+  }
+
+  virtual bool allocate(cv::UMatData *data, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const override {
+    return cv::Mat::getStdAllocator()->allocate(data, accessFlags, usageFlags);
+  }
+
+  virtual void deallocate(cv::UMatData *u) const override {
+    if(!u)
+      return;
+
+    delete static_cast<Buffer*>(u->userdata);
+    delete u;
+  }
+};
+
+const SharedBufferAllocator sharedBufferAllocator;
+
+}
+
+cv::Mat IO::wrapBuffer(std::shared_ptr<uint8_t[]> buffer, int rows, int cols, int type) {
+  cv::Mat mat(rows, cols, type, buffer.get());
+  mat.u = sharedBufferAllocator.wrap(std::move(buffer), mat.total() * mat.elemSize());
+  return mat;
 }
 
 ImageProvider::ImageProvider()
@@ -231,65 +258,137 @@ std::shared_ptr<uint8_t[]> ImageProvider::getPixels(const DataParameters& params
   if(!params)
     return nullptr;
 
-  int dimCount = params.dimCount();
-  long start[dimCount], end[dimCount], inc[dimCount];
-  size_t pixelCount = 1;
-  for(int i = 0; i < dimCount; ++i) {
-    size_t length = (params.end()[i] - params.start()[i] + 1) / params.inc()[i];
-    pixelCount *= length;
-  }
-
-  std::shared_ptr<uint8_t[]> data(new uint8_t[pixelCount * DataType::dataSize(params.type())]);
-  if(readPixels(params, data.get()))
+  auto data = BufferPool::global().acquire(params.byteSize());
+  if(data && readPixels(params, data.get()))
     return data;
 
   return nullptr;
 }
 
-cv::Mat ImageProvider::getImageMatrix(int index) {
-  auto params = getImageParameters(index);
-  // Read only the first layer
-  params.setDimension(2, 1, 1, 1);
+std::vector<std::shared_ptr<uint8_t[]>> ImageProvider::getParts(const std::vector<DataParameters>& parts) {
+  std::vector<std::shared_ptr<uint8_t[]>> data;
+  data.reserve(parts.size());
+  for(auto& part : parts)
+    data.push_back(getPixels(part));
+  return data;
+}
+
+void ImageProvider::setAccessOrder(const std::vector<int>& indices) {
+}
+
+std::unique_ptr<AsyncReader> ImageProvider::createAsyncReader() {
+  return std::make_unique<ThreadPoolReader>(this);
+}
 
-  int matType;
-  switch(params.type()) {
+int ImageProvider::matrixType(DataType::EnumType type) {
+  switch(type) {
     case IO::DataType::BYTE:
-      matType = CV_8SC1;
-      break;
+      return CV_8SC1;
     case IO::DataType::UBYTE:
-      matType = CV_8UC1;
-      break;
+      return CV_8UC1;
     case IO::DataType::SHORT:
-      matType = CV_16SC1;
-      break;
+      return CV_16SC1;
     case IO::DataType::USHORT:
-      matType = CV_16UC1;
-      break;
+      return CV_16UC1;
+    case IO::DataType::INT:
+      return CV_32SC1;
+    case IO::DataType::FLOAT:
+      return CV_32FC1;
+    case IO::DataType::DOUBLE:
+      return CV_64FC1;
     default:
-      spdlog::error("Unknown params type: {}", (int)params.type());
-      assert(false);
+      return -1;
   }
+}
 
-  cv::Mat mat;
-  mat.create(params.height(), params.width(), matType);
+DataParameters ImageProvider::matrixParameters(int index) {
+  auto params = getImageParameters(index);
+  // Read only the first layer
+  params.setDimension(2, 1, 1, 1);
+
+  // OpenCV has no unsigned 32 bit or 64 bit integer matrices
+  if(matrixType(params.type()) < 0)
+    return params.withType(IO::DataType::DOUBLE);
+  return params;
+}
 
-  if(readPixels(params, mat.ptr()))
-    return mat;
+Async<std::shared_ptr<uint8_t[]>> ImageProvider::pixels(const DataParameters& params, Executor *resume) {
+  return Async<std::shared_ptr<uint8_t[]>>([this, params]() { return getPixels(params); }, resume);
+}
 
-  spdlog::error("Reading image to a matrix failed");
-  return cv::Mat();
+Async<cv::Mat> ImageProvider::matrix(int index, Executor *resume) {
+  return Async<cv::Mat>([this, index]() { return getImageMatrix(index); }, resume);
 }
 
-CachedImageProvider::CachedImageProvider(ImageProvider* provider, size_t maxCachedEntries)
+cv::Mat ImageProvider::getImageMatrix(int index) {
+  auto params = matrixParameters(index);
+  auto data = getPixels(params);
+  if(!data) {
+    spdlog::error("Reading image to a matrix failed");
+    return cv::Mat();
+  }
+
+  return wrapBuffer(std::move(data), params.height(), params.width(), matrixType(params.type()));
+}
+
+CachedImageProvider::CachedImageProvider(ImageProvider* provider, size_t maxBytes, size_t shardCount)
   : m_provider(provider)
-  , m_cacheSize(maxCachedEntries) {
+  , m_maxBytes(maxBytes)
+  , m_usedBytes(0)
+  , m_useClock(0)
+  , m_hits(0)
+  , m_misses(0)
+  , m_coalesced(0)
+  , m_evictions(0) {
+  m_imageCount = m_provider->imageCount();
 
+  for(size_t i = 0; i < std::max<size_t>(shardCount, 1); ++i)
+    m_shards.push_back(std::make_unique<Shard>());
 }
 
 CachedImageProvider::~CachedImageProvider() {
   delete m_provider;
 }
 
+void CachedImageProvider::setMaxBytes(size_t maxBytes) {
+  m_maxBytes = maxBytes;
+  evict();
+}
+
+size_t CachedImageProvider::maxBytes() const {
+  return m_maxBytes;
+}
+
+CachedImageProvider::Statistics CachedImageProvider::statistics() const {
+  Statistics stats = {
+    .m_hits = m_hits,
+    .m_misses = m_misses,
+    .m_coalesced = m_coalesced,
+    .m_evictions = m_evictions,
+    .m_entries = 0,
+    .m_bytes = m_usedBytes,
+    .m_pinnedEntries = 0,
+    .m_pinnedBytes = 0,
+  };
+
+  for(auto& shard : m_shards) {
+    std::lock_guard lock(shard->m_mutex);
+    stats.m_entries += shard->m_entries.size();
+
+    for(auto& entry : shard->m_entries) {
+      if(entry.m_data.use_count() > 1) {
+        ++stats.m_pinnedEntries;
+        stats.m_pinnedBytes += entry.m_size;
+      }
+    }
+  }
+  return stats;
+}
+
+CachedImageProvider::Shard& CachedImageProvider::shardFor(const DataParameters& params) {
+  return *m_shards[DataParamHash()(params) % m_shards.size()];
+}
+
 DataParameters CachedImageProvider::getImageParameters(int index) {
   return m_provider->getImageParameters(index);
 }
@@ -298,40 +397,163 @@ std::shared_ptr<uint8_t[]> CachedImageProvider::getPixels(const DataParameters&
   if(!params)
     return nullptr;
 
-  auto iter = m_cache.find(params);
-  if(iter == m_cache.end()) {
-    auto data = m_provider->getPixels(params);
-    if(!data)
-      return nullptr;
+  auto& shard = shardFor(params);
+  std::unique_lock lock(shard.m_mutex);
+
+  auto iter = shard.m_lookup.find(params);
+  if(iter != shard.m_lookup.end()) {
+    // Move the entry to the front of the list
+    ++m_hits;
+    shard.m_entries.splice(shard.m_entries.begin(), shard.m_entries, iter->second);
+    iter->second->m_lastUse = ++m_useClock;
+    updateOldest(shard);
+    return iter->second->m_data;
+  }
 
-    auto cacheEntry = m_cache.insert({ params, data });
-    m_loadOrder.push_back(&cacheEntry.first->first);
+  auto flight = shard.m_inFlight.find(params);
+  if(flight != shard.m_inFlight.end()) {
+    // Somebody is already reading this, wait for their result
+    ++m_coalesced;
+    auto future = flight->second;
+    lock.unlock();
+    return future.get();
+  }
 
-    if(m_loadOrder.size() > m_cacheSize) {
-      cleanupCache();
+  ++m_misses;
+  std::promise<Buffer> promise;
+  shard.m_inFlight.insert({ params, promise.get_future().share() });
+  lock.unlock();
+
+  // Read without holding the lock so other entries of the shard stay available
+  Buffer data;
+  try {
+    data = m_provider->getPixels(params);
+  } catch(...) {
+    // Waiters get the same exception and later requests read again
+    lock.lock();
+    shard.m_inFlight.erase(params);
+    lock.unlock();
+    promise.set_exception(std::current_exception());
+    throw;
+  }
+
+  lock.lock();
+  shard.m_inFlight.erase(params);
+  if(data) {
+    size_t size = params.byteSize();
+    shard.m_entries.push_front({ params, data, size, ++m_useClock });
+    shard.m_lookup.insert({ params, shard.m_entries.begin() });
+    updateOldest(shard);
+    m_usedBytes += size;
+  }
+  lock.unlock();
+
+  if(m_usedBytes > m_maxBytes)
+    evict();
+
+  promise.set_value(data);
+  return data;
+}
+
+bool CachedImageProvider::readPixels(const DataParameters& params, void *ptr) {
+  auto& shard = shardFor(params);
+  Buffer data;
+  {
+    std::unique_lock lock(shard.m_mutex);
+    auto iter = shard.m_lookup.find(params);
+    if(iter != shard.m_lookup.end()) {
+      ++m_hits;
+      shard.m_entries.splice(shard.m_entries.begin(), shard.m_entries, iter->second);
+      iter->second->m_lastUse = ++m_useClock;
+      updateOldest(shard);
+      data = iter->second->m_data;
+    } else {
+      auto flight = shard.m_inFlight.find(params);
+      if(flight != shard.m_inFlight.end()) {
+        // Wait for the running read (e.g. a prefetch) instead of reading twice
+        ++m_coalesced;
+        auto future = flight->second;
+        lock.unlock();
+        data = future.get();
+      }
     }
-    return data;
   }
-  return iter->second;
+
+  if(!data) {
+    // Reads into caller buffers don't populate the cache
+    return m_provider->readPixels(params, ptr);
+  }
+
+  // Cached buffers are never modified, copying can happen without the lock
+  memcpy(ptr, data.get(), params.byteSize());
+  return true;
 }
 
 double CachedImageProvider::maxTypeValue() {
   return m_provider->maxTypeValue();
 }
 
-void CachedImageProvider::cleanupCache() {
-  // Try to remove oldest unused entry from cache
-  auto iter = m_loadOrder.begin();
-  while(iter != m_loadOrder.end() && m_loadOrder.size() > m_cacheSize) {
-    auto& params = **iter;
-    auto ptr = m_cache[params];
-    if(ptr.use_count() > 1) {
-      // Use count = 1 means that only the cache is referencing this pointer
-      ++iter;
+void CachedImageProvider::updateOldest(Shard& shard) {
+  shard.m_oldestUse = shard.m_entries.empty() ? UINT64_MAX : shard.m_entries.back().m_lastUse;
+}
+
+bool CachedImageProvider::skipPinned(Shard& shard) {
+  for(size_t i = 0; i < shard.m_entries.size(); ++i) {
+    // Use count = 1 means that only the cache is referencing this buffer,
+    // anything else is still in use and pinned in the cache.
+    auto oldest = std::prev(shard.m_entries.end());
+    if(oldest->m_data.use_count() == 1) {
+      updateOldest(shard);
+      return true;
+    }
+
+    // Being in use counts as a use, so the entry isn't looked at again
+    // by every following eviction
+    oldest->m_lastUse = ++m_useClock;
+    shard.m_entries.splice(shard.m_entries.begin(), shard.m_entries, oldest);
+  }
+
+  updateOldest(shard);
+  return false;
+}
+
+void CachedImageProvider::evict() {
+  std::lock_guard evictLock(m_evictMutex);
+  // Shards with nothing but pinned entries are left alone for the rest of this call
+  std::vector<bool> pinned(m_shards.size(), false);
+  while(m_usedBytes > m_maxBytes) {
+    // Find the shard holding the least recently used entry of the whole cache
+    size_t oldest = m_shards.size();
+    uint64_t oldestUse = UINT64_MAX;
+    for(size_t i = 0; i < m_shards.size(); ++i) {
+      uint64_t use = m_shards[i]->m_oldestUse;
+      if(!pinned[i] && use < oldestUse) {
+        oldest = i;
+        oldestUse = use;
+      }
+    }
+
+    // Everything left is pinned
+    if(oldest == m_shards.size())
+      break;
+
+    auto& shard = *m_shards[oldest];
+    std::lock_guard lock(shard.m_mutex);
+    if(!skipPinned(shard)) {
+      pinned[oldest] = true;
       continue;
     }
-    iter = m_loadOrder.erase(iter);
-    m_cache.erase(params);
+
+    // Skipped pinned entries or reads in between changed the oldest entry,
+    // another shard could hold an older one now
+    if(shard.m_oldestUse > oldestUse)
+      continue;
+
+    auto iter = std::prev(shard.m_entries.end());
+    m_usedBytes -= iter->m_size;
+    shard.m_lookup.erase(iter->m_params);
+    shard.m_entries.erase(iter);
+    updateOldest(shard);
+    ++m_evictions;
   }
 }
-
@@ -0,0 +1,210 @@
+#include "io/pyramid.hpp"
+#include "io/async_reader.hpp"
+#include "io/buffer_pool.hpp"
+#include "io/convert.hpp"
+#include "io/kernels.hpp"
+
+#include <type_traits>
+
+#include <spdlog/spdlog.h>
+
+using namespace IO;
+
+// Averages 2x2 blocks of the source into a level half the size. Sums are
+// done in a wider type so the loop stays a plain integer add and shift,
+// the shift rounds halves up for signed data as well. 16 bit images,
+// which is what cameras produce, go through the vectorized kernel.
+template<typename T>
+static void halveLevel(const T *src, long srcWidth, T *dst, long width, long height) {
+  if constexpr(std::is_same_v<T, uint16_t>) {
+    for(long y = 0; y < height; ++y)
+      Kernels::halve16(src + (2 * y) * srcWidth, src + (2 * y + 1) * srcWidth, dst + y * width, width);
+    return;
+  }
+
+  using Acc = std::conditional_t<std::is_floating_point_v<T>, double,
+              std::conditional_t<(sizeof(T) < 4), int32_t,
+              std::conditional_t<(sizeof(T) < 8), int64_t, __int128>>>;
+
+  for(long y = 0; y < height; ++y) {
+    const T *row0 = src + (2 * y) * srcWidth;
+    const T *row1 = row0 + srcWidth;
+    T *out = dst + y * width;
+
+    for(long x = 0; x < width; ++x) {
+      Acc sum = (Acc)row0[2 * x] + row0[2 * x + 1] + row1[2 * x] + row1[2 * x + 1];
+      if constexpr(std::is_floating_point_v<T>)
+        out[x] = (T)(sum * 0.25);
+      else
+        out[x] = (T)((sum + 2) >> 2);
+    }
+  }
+}
+
+static bool halveLevel(DataType::EnumType type, const uint8_t *src, long srcWidth, uint8_t *dst, long width, long height) {
+  return dispatchDataType(type, [&]<typename T>(std::type_identity<T>) {
+    halveLevel((const T*)src, srcWidth, (T*)dst, width, height);
+  });
+}
+
+PyramidProvider::Level::operator bool() const {
+  return m_data != nullptr;
+}
+
+PyramidProvider::PyramidProvider(ImageProvider *provider, size_t maxBytes)
+  : m_provider(provider)
+  , m_maxBytes(maxBytes)
+  , m_usedBytes(0) {
+  m_imageCount = m_provider->imageCount();
+}
+
+PyramidProvider::~PyramidProvider() {
+  delete m_provider;
+}
+
+DataParameters PyramidProvider::baseParameters(int index) {
+  auto params = m_provider->getImageParameters(index);
+  // Read only the first layer
+  params.setDimension(2, 1, 1, 1);
+  return params;
+}
+
+int PyramidProvider::levelCount(int index) {
+  auto params = baseParameters(index);
+  if(!params)
+    return 0;
+
+  int count = 1;
+  for(long width = params.width() / 2, height = params.height() / 2;
+      width >= MIN_LEVEL_WIDTH && height > 0;
+      width /= 2, height /= 2)
+    ++count;
+  return count;
+}
+
+PyramidProvider::Level PyramidProvider::baseLevel(int index) {
+  auto params = baseParameters(index);
+  if(!params)
+    return {};
+
+  return {
+    .m_level = 0,
+    .m_width = params.width(),
+    .m_height = params.height(),
+    .m_type = params.type(),
+    .m_data = m_provider->getPixels(params),
+  };
+}
+
+PyramidProvider::Level PyramidProvider::level(int index, int level) {
+  if(level <= 0)
+    return baseLevel(index);
+
+  {
+    std::lock_guard lock(m_mutex);
+    auto iter = m_lookup.find(index);
+    if(iter != m_lookup.end()) {
+      m_pyramids.splice(m_pyramids.begin(), m_pyramids, iter->second);
+      auto& levels = iter->second->m_levels;
+      return level <= levels.size() ? levels[level - 1] : Level();
+    }
+  }
+
+  // Built without the lock, two threads building the same pyramid at the
+  // same time just do the work twice
+  Pyramid pyramid;
+  if(!buildPyramid(index, pyramid))
+    return {};
+
+  Level result = level <= pyramid.m_levels.size() ? pyramid.m_levels[level - 1] : Level();
+
+  std::lock_guard lock(m_mutex);
+  if(!m_lookup.contains(index)) {
+    m_usedBytes += pyramid.m_size;
+    m_pyramids.push_front(std::move(pyramid));
+    m_lookup[index] = m_pyramids.begin();
+    cleanupCache();
+  }
+  return result;
+}
+
+PyramidProvider::Level PyramidProvider::getLevel(int index, long minWidth) {
+  auto params = baseParameters(index);
+  if(!params)
+    return {};
+
+  int levelIndex = 0;
+  for(long width = params.width() / 2, height = params.height() / 2;
+      width >= MIN_LEVEL_WIDTH && width >= minWidth && height > 0;
+      width /= 2, height /= 2)
+    ++levelIndex;
+
+  return level(index, levelIndex);
+}
+
+bool PyramidProvider::buildPyramid(int index, Pyramid& pyramid) {
+  auto previous = baseLevel(index);
+  if(!previous.m_data)
+    return false;
+
+  pyramid.m_index = index;
+  pyramid.m_size = 0;
+
+  size_t pixelSize = DataType::dataSize(previous.m_type);
+  while(previous.m_width / 2 >= MIN_LEVEL_WIDTH && previous.m_height / 2 > 0) {
+    Level next = {
+      .m_level = previous.m_level + 1,
+      .m_width = previous.m_width / 2,
+      .m_height = previous.m_height / 2,
+      .m_type = previous.m_type,
+    };
+    size_t size = next.m_width * next.m_height * pixelSize;
+    next.m_data = BufferPool::global().acquire(size);
+
+    if(!next.m_data || !halveLevel(next.m_type, previous.m_data.get(), previous.m_width, next.m_data.get(), next.m_width, next.m_height))
+      return false;
+
+    pyramid.m_size += size;
+    pyramid.m_levels.push_back(next);
+    previous = std::move(next);
+  }
+
+  spdlog::trace("Built {} pyramid levels for image {}", pyramid.m_levels.size(), index);
+  return true;
+}
+
+void PyramidProvider::cleanupCache() {
+  // Remove least recently used pyramids, the newest one is always kept
+  while(m_usedBytes > m_maxBytes && m_pyramids.size() > 1) {
+    auto& pyramid = m_pyramids.back();
+    m_usedBytes -= pyramid.m_size;
+    m_lookup.erase(pyramid.m_index);
+    m_pyramids.pop_back();
+  }
+}
+
+void PyramidProvider::setAccessOrder(const std::vector<int>& indices) {
+  m_provider->setAccessOrder(indices);
+}
+
+std::unique_ptr<AsyncReader> PyramidProvider::createAsyncReader() {
+  // Full resolution reads don't touch the pyramid
+  return m_provider->createAsyncReader();
+}
+
+DataParameters PyramidProvider::getImageParameters(int index) {
+  return m_provider->getImageParameters(index);
+}
+
+std::shared_ptr<uint8_t[]> PyramidProvider::getPixels(const DataParameters& params) {
+  return m_provider->getPixels(params);
+}
+
+bool PyramidProvider::readPixels(const DataParameters& params, void *ptr) {
+  return m_provider->readPixels(params, ptr);
+}
+
+double PyramidProvider::maxTypeValue() {
+  return m_provider->maxTypeValue();
+}
+
@@ -0,0 +1,64 @@
+#include "io/read_ahead.hpp"
+
+using namespace IO;
+
+ReadAhead::ReadAhead(size_t depth)
+  : m_depth(depth)
+  , m_lastPosition(-1)
+  , m_direction(0) {
+}
+
+size_t ReadAhead::depth() const {
+  return m_depth;
+}
+
+void ReadAhead::setOrder(const std::vector<int>& indices) {
+  std::lock_guard lock(m_mutex);
+  m_order = indices;
+  m_orderPosition.clear();
+  for(size_t i = 0; i < m_order.size(); ++i)
+    m_orderPosition[m_order[i]] = i;
+
+  // Positions in the old order don't mean anything anymore
+  m_lastPosition = -1;
+  m_direction = 0;
+}
+
+std::vector<int> ReadAhead::accessed(int index, long imageCount) {
+  std::vector<int> next;
+  if(m_depth == 0)
+    return next;
+
+  std::lock_guard lock(m_mutex);
+  bool ordered = !m_order.empty();
+  long count = ordered ? m_order.size() : imageCount;
+
+  long position = -1;
+  if(ordered) {
+    auto found = m_orderPosition.find(index);
+    if(found != m_orderPosition.end())
+      position = found->second;
+  } else if(index >= 0 && index < imageCount) {
+    position = index;
+  }
+
+  // An explicit order is followed forwards unless it is stepped backwards
+  if(position < 0)
+    m_direction = 0;
+  else if(position == m_lastPosition + 1)
+    m_direction = 1;
+  else if(position == m_lastPosition - 1)
+    m_direction = -1;
+  else if(position != m_lastPosition)
+    m_direction = ordered ? 1 : 0;
+
+  for(long i = 1; m_direction != 0 && i <= (long)m_depth; ++i) {
+    long nextPosition = position + i * m_direction;
+    if(nextPosition < 0 || nextPosition >= count)
+      break;
+    next.push_back(ordered ? m_order[nextPosition] : nextPosition);
+  }
+
+  m_lastPosition = position;
+  return next;
+}
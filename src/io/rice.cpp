@@ -0,0 +1,267 @@
+#include "io/rice.hpp"
+#include "io/convert.hpp"
+#include "io/thread_pool.hpp"
+
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <latch>
+#include <string>
+#include <type_traits>
+
+#include <unistd.h>
+
+#include <spdlog/spdlog.h>
+
+using namespace IO;
+
+// Tiles of all images are decompressed on the same workers
+static ThreadPool& decompressionPool() {
+  static ThreadPool pool;
+  return pool;
+}
+
+// Same scaling rules as MappedFits, integer zero points stay in integers
+template<typename Src, typename Dst>
+static void convertRun(const Src *src, Dst *dst, long count, double bscale, double bzero) {
+  if constexpr(std::is_integral_v<Dst>) {
+    if(bscale == 1.0 && std::trunc(bzero) == bzero) {
+      const int64_t zero = static_cast<int64_t>(bzero);
+      for(long i = 0; i < count; ++i)
+        dst[i] = static_cast<Dst>(static_cast<int64_t>(src[i]) + zero);
+      return;
+    }
+  }
+
+  for(long i = 0; i < count; ++i)
+    dst[i] = static_cast<Dst>(src[i] * bscale + bzero);
+}
+
+RiceTiles::RiceTiles()
+  : m_fd(-1) {
+}
+
+size_t RiceTiles::tileCount() const {
+  return m_tiles.size();
+}
+
+std::unique_ptr<RiceTiles> RiceTiles::load(fitsfile *fptr, const HduInfo& hdu, int fd) {
+  if(fd < 0 || !hdu.m_compressed || hdu.m_dims.empty() || hdu.m_dims.size() > 3)
+    return nullptr;
+
+  int status = 0;
+  char value[FLEN_VALUE];
+  fits_read_key(fptr, TSTRING, "ZCMPTYPE", value, nullptr, &status);
+  if(status || std::string(value) != "RICE_1")
+    return nullptr;
+
+  // Floating point images are quantized and scaled per tile
+  int zbitpix = 0;
+  fits_read_key(fptr, TINT, "ZBITPIX", &zbitpix, nullptr, &status);
+  if(status || zbitpix < 0)
+    return nullptr;
+
+  int column = 0, scaleColumn = 0;
+  fits_get_colnum(fptr, CASEINSEN, "COMPRESSED_DATA", &column, &status);
+  if(status)
+    return nullptr;
+  if(fits_get_colnum(fptr, CASEINSEN, "ZSCALE", &scaleColumn, &status) == 0)
+    return nullptr;
+  status = 0;
+
+  std::unique_ptr<RiceTiles> tiles(new RiceTiles());
+  tiles->m_dims = hdu.m_dims;
+  tiles->m_bzero = hdu.m_bzero;
+  tiles->m_bscale = hdu.m_bscale;
+  tiles->m_bytePix = zbitpix / 8;
+  tiles->m_blockSize = 32;
+
+  // Compression parameters are stored as ZNAMEn/ZVALn pairs
+  for(int i = 1; ; ++i) {
+    char name[FLEN_VALUE];
+    std::string key = "ZNAME" + std::to_string(i);
+    if(fits_read_key(fptr, TSTRING, key.c_str(), name, nullptr, &status)) {
+      status = 0;
+      break;
+    }
+
+    int parameter = 0;
+    key = "ZVAL" + std::to_string(i);
+    fits_read_key(fptr, TINT, key.c_str(), &parameter, nullptr, &status);
+    if(std::string(name) == "BLOCKSIZE")
+      tiles->m_blockSize = parameter;
+    else if(std::string(name) == "BYTEPIX")
+      tiles->m_bytePix = parameter;
+  }
+  if(tiles->m_bytePix != 1 && tiles->m_bytePix != 2 && tiles->m_bytePix != 4)
+    return nullptr;
+
+  for(size_t i = 0; i < tiles->m_dims.size(); ++i) {
+    // Default tiles are whole rows
+    long tileDim = i == 0 ? tiles->m_dims[0] : 1;
+    std::string key = "ZTILE" + std::to_string(i + 1);
+    if(fits_read_key(fptr, TLONG, key.c_str(), &tileDim, nullptr, &status) == KEY_NO_EXIST)
+      status = 0;
+    tiles->m_tileDims.push_back(tileDim);
+    tiles->m_tileCounts.push_back((tiles->m_dims[i] + tileDim - 1) / tileDim);
+  }
+
+  LONGLONG rowCount = 0, rowLength = 0, heapStart = 0;
+  fits_get_num_rowsll(fptr, &rowCount, &status);
+  fits_read_key(fptr, TLONGLONG, "NAXIS1", &rowLength, nullptr, &status);
+  if(fits_read_key(fptr, TLONGLONG, "THEAP", &heapStart, nullptr, &status) == KEY_NO_EXIST) {
+    status = 0;
+    heapStart = rowLength * rowCount;
+  }
+  if(status)
+    return nullptr;
+
+  for(LONGLONG row = 1; row <= rowCount; ++row) {
+    LONGLONG length = 0, offset = 0;
+    fits_read_descriptll(fptr, column, row, &length, &offset, &status);
+    // Tiles which didn't compress are stored in another column
+    if(status || length == 0)
+      return nullptr;
+    tiles->m_tiles.push_back({ hdu.m_dataOffset + heapStart + offset, (uint64_t)length });
+  }
+
+  size_t expectedTiles = 1;
+  for(long count : tiles->m_tileCounts)
+    expectedTiles *= count;
+  if(tiles->m_tiles.size() != expectedTiles)
+    return nullptr;
+
+  tiles->m_fd = fd;
+
+  spdlog::debug("Using parallel Rice decompression for {} tiles of the HDU at {}", tiles->m_tiles.size(), hdu.m_headerOffset);
+  return tiles;
+}
+
+bool RiceTiles::decompressTile(size_t tile, const uint8_t *data, const DataParameters& params, uint8_t *dst) const {
+  // Position of the tile inside of the image, missing axes have a size of 1
+  long tileStart[3] = { 0, 0, 0 }, tileSize[3] = { 1, 1, 1 };
+  long regionStart[3] = { 0, 0, 0 }, regionSize[3] = { 1, 1, 1 };
+  size_t index = tile;
+  long pixelCount = 1;
+  for(size_t i = 0; i < m_dims.size(); ++i) {
+    tileStart[i] = (index % m_tileCounts[i]) * m_tileDims[i];
+    tileSize[i] = std::min(m_tileDims[i], m_dims[i] - tileStart[i]);
+    index /= m_tileCounts[i];
+    pixelCount *= tileSize[i];
+
+    regionStart[i] = params.start()[i] - 1;
+    regionSize[i] = params.end()[i] - params.start()[i] + 1;
+  }
+
+  std::vector<uint8_t> pixels(pixelCount * m_bytePix);
+  int result;
+  switch(m_bytePix) {
+    case 1:
+      result = fits_rdecomp_byte((unsigned char*)data, m_tiles[tile].m_size, pixels.data(), pixelCount, m_blockSize);
+      break;
+    case 2:
+      result = fits_rdecomp_short((unsigned char*)data, m_tiles[tile].m_size, (unsigned short*)pixels.data(), pixelCount, m_blockSize);
+      break;
+    default:
+      result = fits_rdecomp((unsigned char*)data, m_tiles[tile].m_size, (unsigned int*)pixels.data(), pixelCount, m_blockSize);
+      break;
+  }
+  if(result != 0)
+    return false;
+
+  // Copy the part of the tile which overlaps the region
+  long from[3], to[3];
+  for(int i = 0; i < 3; ++i) {
+    from[i] = std::max(tileStart[i], regionStart[i]);
+    to[i] = std::min(tileStart[i] + tileSize[i], regionStart[i] + regionSize[i]);
+    if(from[i] >= to[i])
+      return true;
+  }
+
+  const size_t pixelSize = DataType::dataSize(params.type());
+  dispatchDataType(params.type(), [&]<typename Dst>(std::type_identity<Dst>) {
+    auto copy = [&]<typename Src>(const Src *src) {
+      for(long z = from[2]; z < to[2]; ++z) {
+        for(long y = from[1]; y < to[1]; ++y) {
+          const Src *srcRow = src + ((z - tileStart[2]) * tileSize[1] + (y - tileStart[1])) * tileSize[0] + (from[0] - tileStart[0]);
+          size_t dstOffset = ((z - regionStart[2]) * regionSize[1] + (y - regionStart[1])) * regionSize[0] + (from[0] - regionStart[0]);
+          convertRun(srcRow, (Dst*)(dst + dstOffset * pixelSize), to[0] - from[0], m_bscale, m_bzero);
+        }
+      }
+    };
+
+    // Decompressed values are the signed integers stored in the file,
+    // only 8 bit data is unsigned
+    switch(m_bytePix) {
+      case 1: copy((const uint8_t*)pixels.data()); break;
+      case 2: copy((const int16_t*)pixels.data()); break;
+      default: copy((const int32_t*)pixels.data()); break;
+    }
+  });
+  return true;
+}
+
+bool RiceTiles::read(const DataParameters& params, void *ptr) const {
+  if((size_t)params.dimCount() != m_dims.size())
+    return false;
+  for(int i = 0; i < params.dimCount(); ++i) {
+    if(params.inc()[i] != 1 || params.start()[i] < 1 || params.end()[i] > m_dims[i])
+      return false;
+  }
+
+  // Tiles overlapping the region
+  std::vector<size_t> needed;
+  for(size_t tile = 0; tile < m_tiles.size(); ++tile) {
+    size_t index = tile;
+    bool overlaps = true;
+    for(size_t i = 0; i < m_dims.size() && overlaps; ++i) {
+      long start = (index % m_tileCounts[i]) * m_tileDims[i];
+      long end = std::min(start + m_tileDims[i], m_dims[i]);
+      index /= m_tileCounts[i];
+      overlaps = start < params.end()[i] && end > params.start()[i] - 1;
+    }
+    if(overlaps)
+      needed.push_back(tile);
+  }
+  if(needed.empty())
+    return true;
+
+  // Compressed tiles are stored next to each other, read them all at once
+  uint64_t begin = UINT64_MAX, end = 0;
+  for(size_t tile : needed) {
+    begin = std::min(begin, m_tiles[tile].m_offset);
+    end = std::max(end, m_tiles[tile].m_offset + m_tiles[tile].m_size);
+  }
+
+  std::vector<uint8_t> compressed(end - begin);
+  size_t done = 0;
+  while(done < compressed.size()) {
+    ssize_t count = pread(m_fd, compressed.data() + done, compressed.size() - done, begin + done);
+    if(count <= 0) {
+      spdlog::error("Failed to read compressed tiles");
+      return false;
+    }
+    done += count;
+  }
+
+  std::atomic<bool> failed = false;
+  std::latch finished(needed.size());
+  for(size_t tile : needed) {
+    decompressionPool().submit([&, tile]() {
+      // The latch has to be counted down even if the tile throws
+      try {
+        if(!decompressTile(tile, compressed.data() + (m_tiles[tile].m_offset - begin), params, (uint8_t*)ptr))
+          failed = true;
+      } catch(...) {
+        failed = true;
+      }
+      finished.count_down();
+    });
+  }
+  finished.wait();
+
+  if(failed)
+    spdlog::error("Failed to decompress Rice tiles");
+  return !failed;
+}
+
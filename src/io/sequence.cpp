@@ -1,21 +1,20 @@
 #include "io/sequence.hpp"
+#include "io/sequence_writer.hpp"
+#include "io/provider.hpp"
 #include "objects/image.hpp"
-#include "objects/registration.hpp"
-#include "objects/stats.hpp"
 
 #include <ctime>
 #include <fstream>
 #include <iostream>
 #include <format>
 
-#include <opencv2/core/mat.hpp>
-
 #include <spdlog/spdlog.h>
 
 using namespace IO;
 
 Sequence::Sequence()
   : ObjectBase("SequenceObject")
+  , Gio::ListModel()
   , m_sequenceName(*this, "name")
   , m_fileIndexFirst(*this, "first-file-index")
   , m_imageCount(*this, "image-count")
@@ -30,6 +29,7 @@ Sequence::Sequence()
   , m_registrationLayer(*this, "registration-layer")
   , m_dirty(*this, "dirty", false) {
   m_oldReference = -1;
+  m_updateDepth = 0;
   m_referenceImageIndex.get_proxy().signal_changed().connect(sigc::mem_fun(*this, &Sequence::referenceChanged));
 }
 
@@ -45,13 +45,11 @@ Glib::RefPtr<Sequence> Sequence::create() {
 Glib::RefPtr<Sequence> Sequence::readSequence(const std::filesystem::path& filepath) {
   spdlog::info("Reading sequence file '{}'", filepath.c_str());
 
-  std::ifstream file(filepath);
-  if(!file.is_open()) {
-    spdlog::error("Failed to open file '{}'", filepath.c_str());
+  SequenceFile file;
+  if(!file.read(filepath))
     return nullptr;
-  }
 
-  return readStream(file);
+  return create(file);
 }
 
 void Sequence::referenceChanged() {
@@ -60,254 +58,47 @@ void Sequence::referenceChanged() {
     return;
   }
 
-  auto oldRef = image(m_oldReference);
+  m_store.changeReference(m_oldReference, m_referenceImageIndex.get_value());
   m_oldReference = m_referenceImageIndex.get_value();
 
-  // Make sure that oldRef has a valid registration with an identity matrix.
-  if(!oldRef->getRegistration()) {
-    oldRef->setRegistration(Obj::Registration::create());
-  } else {
-    auto reg = oldRef->getRegistration();
-    reg->matrix().reset();
-  }
-
-  auto newRef = image(m_referenceImageIndex.get_value());
-  if(!newRef->getRegistration()) {
-    // New reference doesn't have a registration (so it is effectively an identity matrix),
-    // so there is no need to do any recalculation
-    return;
+  // Every registration is relative to the reference, all of them changed
+  if(m_journal) {
+    m_journal->appendReference(m_oldReference);
+    for(size_t row = 0; row < m_store.size(); ++row)
+      m_journal->appendImage(m_store, row);
   }
 
-  auto newRefMat = newRef->getRegistration()->matrix().read();
-  auto newRefInverse = newRefMat.inv();
-
-  for(auto& img : m_images) {
-    if(!img->getRegistration()) {
-      // Skip images without valid registration
-      continue;
-    }
-
-    auto reg = img->getRegistration();
-    auto regMat = reg->matrix().read();
-    // TODO: This works for translation only matrices but will have to be checked for more complex ones.
-    auto newMat = newRefInverse * regMat;
-    reg->matrix().write(newMat);
-  }
+  reloadImages();
+  markDirty();
 }
 
 Glib::RefPtr<Sequence> Sequence::readStream(std::istream& stream) {
-  Glib::RefPtr<Sequence> sequence;
-
-  char line[512];
-  const char* scanfmt = 0;
-  int imageIndex = 0, statIndex = 0, regIndex = 0;
-  while(stream.good()) {
-    stream.getline(line, 512);
-    switch(line[0]) {
-      case '#':
-        continue;
-      case 'S': {
-        if(line[2] == '"') {
-          spdlog::error("Sequence doesn't have a name and will not be loaded!");
-          return nullptr;
-        }
-        if(line[2] == '\'')
-          scanfmt = "'%511[^']' %d %d %d %d %d %d %d %d";
-        else
-          scanfmt = "%511s %d %d %d %d %d %d %d %d";
-
-        if(sequence) {
-          spdlog::error("Sequence contains multiple header definitions!");
-          return nullptr;
-        }
-
-        sequence = Sequence::create();
-        char seqName[512];
-
-        int start, count, selCount, fixed, reference, version, variable, fzFlag;
-
-        if(sscanf(line + 2, scanfmt, seqName,
-                  &start, &count, &selCount, &fixed,
-                  &reference, &version, &variable, &fzFlag) < 6) {
-          spdlog::error("Sequence header error");
-          return nullptr;
-        }
-
-        sequence->m_sequenceName.set_value(seqName);
-        sequence->m_fileIndexFirst.set_value(start);
-        sequence->m_imageCount.set_value(count);
-        sequence->m_selectedCount.set_value(selCount);
-        sequence->m_fileIndexFixedLength.set_value(fixed);
-        sequence->m_referenceImageIndex.set_value(reference);
-        sequence->m_version.set_value(version);
-        sequence->m_variableSizeImages.set_value(variable);
-        sequence->m_fzFlag.set_value(fzFlag);
-
-        if(version <= 3) {
-          spdlog::error("Sequence versions below or equal to 3 are unsupported!");
-          return nullptr;
-        }
-        break;
-      }
-      case 'L':
-        if(line[1] == ' ') {
-          int layerCount;
-          if(sscanf(line + 2, "%d", &layerCount) != 1) {
-            spdlog::error("Sequence file format error");
-            return nullptr;
-          }
-          sequence->m_layerCount.set_value(layerCount);
-        }
-        break;
-      case 'I': {
-        int fileIndex, included, width, height;
-        int tokenCount = sscanf(line + 2, "%d %d %d,%d",
-                           &fileIndex, &included, &width, &height);
-        if((tokenCount != 4 && sequence->getVariableSizeImages()) ||
-            (tokenCount != 2 && !sequence->getVariableSizeImages())) {
-          spdlog::error("Sequence file format error");
-          return nullptr;
-        }
-
-        auto img = Obj::Image::create(imageIndex++, sequence->getLayerCount(), sequence);
-        img->setFileIndex(fileIndex);
-        img->setIncluded(included);
-        if(tokenCount > 2) {
-          img->setWidth(width);
-          img->setHeight(height);
-        }
-        sequence->m_images.push_back(img);
-        break;
-      }
-      case 'T':
-        if(line[1] != 'F') {
-          spdlog::error("Sequence type not supported! (only FITS sequences are currently supported)");
-          return nullptr;
-        }
-        // Type F = Single fits file sequence (I think?)
-        sequence->m_sequenceType.set_value(SequenceType::SINGLE_FITS);
-        break;
-      case 'M': {
-        int layer = 0;
-        if(line[1] >= '0' && line[1] <= '9') {
-          // Regular (demosaiced) channel
-          layer = line[1] - '0';
-        } else if(line[1] == '*') {
-          // CFA channel
-        } else {
-          spdlog::error("Invalid M line layer index!");
-          return nullptr;
-        }
-        if(line[2] != '-') {
-          spdlog::error("Invalid M line layer index!");
-          return nullptr;
-        }
-        int image, consumed;
-        if(sscanf(line + 3, "%d%n", &image, &consumed) != 1) {
-          spdlog::error("Invalid or missing M line image index!");
-          return nullptr;
-        }
-        auto img = sequence->m_images[image];
-        if(!img) {
-          spdlog::error("Stats defined for non-existant image");
-          return nullptr;
-        }
-        long totalPixels, goodPixels;
-        double mean, median, sigma, avgDev, mad, sqrtBWMV, location, scale, min, max, normValue, bgNoise;
-        int tokenCount = sscanf(line + 4 + consumed, "%ld %ld %lg %lg %lg %lg %lg %lg %lg %lg %lg %lg %lg %lg",
-                                &totalPixels, &goodPixels,
-                                &mean, &median,
-                                &sigma, &avgDev,
-                                &mad, &sqrtBWMV,
-                                &location, &scale,
-                                &min, &max,
-                                &normValue, &bgNoise);
-        if(tokenCount != 14) {
-          spdlog::error("Malformed M line, file loading terminated.");
-          return nullptr;
-        }
-        if(img->getStats(layer)) {
-          spdlog::error("Redefinition of stats on an image layer");
-          return nullptr;
-        }
-        auto stats = Obj::Stats::create();
-        stats->setTotalPixels(totalPixels);
-        stats->setGoodPixels(goodPixels);
-        stats->setMean(mean);
-        stats->setMedian(median);
-        stats->setSigma(sigma);
-        stats->setAvgDev(avgDev);
-        stats->setMad(mad);
-        stats->setSqrtBWMV(sqrtBWMV);
-        stats->setLocation(location);
-        stats->setScale(scale);
-        stats->setMin(min);
-        stats->setMax(max);
-        stats->setNormValue(normValue);
-        stats->setBgNoise(bgNoise);
-        img->setStats(layer, stats);
-        break;
-      }
-      // case 'D':
-      //   std::cout << "Warning! D line is currently unsupported in sequences!" << std::endl;
-      //   break;
-      case 'R': {
-        int layer;
-        if(line[1] == '*') {
-          layer = -1;
-        } else if(line[1] >= '0' && line[1] <= '9') {
-          layer = line[1] - '0';
-        } else {
-          spdlog::error("Sequence registration error");
-          return nullptr;
-        }
-
-        if(regIndex == 0) {
-          sequence->m_registrationLayer.set_value(layer);
-        } else {
-          if(sequence->m_registrationLayer.get_value() != layer) {
-            spdlog::error("Sequence registers more than one layer, this is currently not supported");
-            return nullptr;
-          }
-        }
-
-        float FWHM, weightedFWHM, roundness, backgroundLevel;
-        double quality;
-        int numberOfStars;
-        double homographyMatrix[9];
-        int tokenCount = sscanf(line + 3, "%g %g %g %lg %g %d H %lg %lg %lg %lg %lg %lg %lg %lg %lg",
-                                &FWHM, &weightedFWHM, &roundness,
-                                &quality, &backgroundLevel, &numberOfStars,
-                                &homographyMatrix[0], &homographyMatrix[1], &homographyMatrix[2],
-                                &homographyMatrix[3], &homographyMatrix[4], &homographyMatrix[5],
-                                &homographyMatrix[6], &homographyMatrix[7], &homographyMatrix[8]);
-
-        if(tokenCount != 15) {
-          spdlog::error("Sequence registration error");
-          return nullptr;
-        }
-
-        auto reg = Obj::Registration::create();
-        reg->setFWHM(FWHM);
-        reg->setWeightedFWHM(weightedFWHM);
-        reg->setRoundness(roundness);
-        reg->setQuality(quality);
-        reg->setBackgroundLevel(backgroundLevel);
-        reg->setNumberOfStars(numberOfStars);
-        reg->matrix().write(homographyMatrix);
-
-        auto img = sequence->m_images[regIndex++];
-        img->setRegistration(reg);
-        break;
-      }
-      case 0:
-        // Ignore empty line
-        break;
-      default:
-        spdlog::warn("Unsupported line '{}' in sequence!", line[0]);
-        break;
-    }
-  }
+  std::string text((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+  SequenceFile file;
+  if(!file.parse(text))
+    return nullptr;
+
+  return create(file);
+}
+
+Glib::RefPtr<Sequence> Sequence::create(const SequenceFile& file) {
+  auto sequence = Sequence::create();
+  sequence->m_sequenceName.set_value(file.m_name);
+  sequence->m_fileIndexFirst.set_value(file.m_fileIndexFirst);
+  sequence->m_imageCount.set_value(file.m_imageCount);
+  sequence->m_selectedCount.set_value(file.m_selectedCount);
+  sequence->m_fileIndexFixedLength.set_value(file.m_fileIndexFixedLength);
+  sequence->m_referenceImageIndex.set_value(file.m_referenceImageIndex);
+  sequence->m_version.set_value(file.m_version);
+  sequence->m_variableSizeImages.set_value(file.m_variableSizeImages);
+  sequence->m_fzFlag.set_value(file.m_fzFlag);
+  sequence->m_layerCount.set_value(file.m_layerCount);
+  sequence->m_sequenceType.set_value(file.m_type);
+  sequence->m_registrationLayer.set_value(file.m_registrationLayer);
+
+  if(!sequence->m_store.load(file))
+    return nullptr;
+  sequence->m_wrappers.resize(sequence->m_store.size(), nullptr);
 
   sequence->validate();
   sequence->markClean();
@@ -333,16 +124,12 @@ Glib::PropertyProxy_ReadOnly<bool> Sequence::propertyDirty() {
 }
 
 void Sequence::validate() {
-  if(m_images.size() != m_imageCount.get_value()) {
+  if(m_store.size() != m_imageCount.get_value()) {
     spdlog::warn("Read more images than specified in the headers, correcting header information");
-    m_imageCount.set_value(m_images.size());
-  }
-  int selected = 0;
-  for(auto& img : m_images) {
-    if(img->getIncluded())
-      ++selected;
+    m_imageCount.set_value(m_store.size());
   }
 
+  int selected = m_store.includedCount();
   if(selected != m_selectedCount.get_value()) {
     spdlog::warn("Header selected image count doesn't match the actual selected image count, correcting");
     m_selectedCount.set_value(selected);
@@ -351,25 +138,15 @@ void Sequence::validate() {
 
 void Sequence::prepareWrite(IO::ImageProvider& provider) {
   // Make sure that there are no gaps in registration and stats.
-  bool calcRegistration = false;
+  bool changed = m_store.fillRegistrationGaps();
   bool calcStats = false;
-  for(auto iter = m_images.rbegin(); iter != m_images.rend(); ++iter) {
-    auto& img = *iter;
-
-    if(img->getRegistration()) {
-      // Make sure all other registrations get filled
-      calcRegistration = true;
-    } else if(calcRegistration) {
-      // Set with empty registration
-      img->setRegistration(Obj::Registration::create());
-    }
-
+  for(int i = m_store.size() - 1; i >= 0; --i) {
     bool hasAny = false;
     bool hasAll = true;
-    for(uint l = 0; l < m_layerCount.get_value(); ++l) {
-      if(img->getStats(l))
+    for(int l = 0; l < m_store.layerCount(); ++l) {
+      if(m_store.stats(i, l))
         hasAny = true;
-      if(!img->getStats(l))
+      else
         hasAll = false;
     }
 
@@ -379,112 +156,91 @@ void Sequence::prepareWrite(IO::ImageProvider& provider) {
 
     if((hasAny && !hasAll) || (!hasAny && calcStats)) {
       // Calculate missing stats
-      img->calculateStats(provider);
+      changed |= fillStats(i, provider);
     }
   }
-}
 
-void Sequence::writeStream(std::ostream& stream) {
-  // Start off with the header
-  stream << "S '";
-  stream << m_sequenceName.get_value();
-  stream << "' ";
-  stream << m_fileIndexFirst.get_value() << ' ';
-  stream << m_imageCount.get_value() << ' ';
-  stream << m_selectedCount.get_value() << ' ';
-  stream << m_fileIndexFixedLength.get_value() << ' ';
-  stream << m_referenceImageIndex.get_value() << ' ';
-  stream << m_version.get_value() << ' ';
-  stream << m_variableSizeImages.get_value() << ' ';
-  stream << m_fzFlag.get_value() << '\n';
-
-  // Emit sequence type
-  switch(m_sequenceType.get_value()) {
-    case SequenceType::SINGLE_FITS:
-      stream << "TF\n";
-      break;
-    case SequenceType::MULTI_FITS:
-      // No additional info for this type
-      break;
+  if(changed) {
+    reloadImages();
+    markDirty();
   }
-  // Layer count
-  stream << "L " << m_layerCount.get_value() << '\n';
-  
-  // Write all images
-  for(auto& img : m_images) {
-    stream << std::format("I {} {}", img->getFileIndex(), img->getIncluded() ? 1 : 0);
-    if(m_variableSizeImages.get_value()) {
-      stream << std::format(" {},{}", img->getWidth(), img->getWidth());
-    }
-    stream << '\n';
+}
+
+bool Sequence::fillStats(int index, IO::ImageProvider& provider) {
+  auto params = provider.getImageParameters(m_store.fileIndex(index));
+  bool changed = false;
+
+  for(int l = 0; l < m_store.layerCount(); ++l) {
+    if(m_store.stats(index, l))
+      continue;
+
+    m_store.setStats(index, l, {
+      .m_totalPixels = (long)params.width() * params.height(),
+      .m_goodPixels = -1,
+      .m_mean = -999999,
+      .m_median = -999999,
+      .m_sigma = -999999,
+      .m_avgDev = -999999,
+      .m_mad = -999999,
+      .m_sqrtBWMV = -999999,
+      .m_location = -999999,
+      .m_scale = -999999,
+      // TODO: Calculate these
+      .m_min = 0,
+      .m_max = (double)provider.maxTypeValue(),
+      .m_normValue = (double)provider.maxTypeValue(),
+      .m_bgNoise = -999999,
+    });
+    changed = true;
   }
+  return changed;
+}
 
-  // Write layer data
-  for(uint l = 0; l < m_layerCount.get_value(); ++l) {
-    if(m_registrationLayer.get_value() == l) {
-      // Write registration info for layer
-      for(uint i = 0; i < m_imageCount.get_value(); ++i) {
-        auto& img = m_images[i];
-        if(!img->getRegistration()) {
-          // Registration info is written without gaps so the first image
-          // without it means that all images above also don't have it.
-          break;
-        }
-        auto& reg = *img->getRegistration();
-
-        // Write registration line
-        double matrix[9];
-        reg.matrix().read(matrix);
-        stream << std::format("R{} {} {} {} {} {} {} H {} {} {} {} {} {} {} {} {}\n",
-                              l,
-                              reg.getFWHM(),
-                              reg.getWeightedFWHM(),
-                              reg.getRoundness(),
-                              reg.getQuality(),
-                              reg.getBackgroundLevel(),
-                              reg.getNumberOfStars(),
-                              matrix[0],
-                              matrix[1],
-                              matrix[2],
-                              matrix[3],
-                              matrix[4],
-                              matrix[5],
-                              matrix[6],
-                              matrix[7],
-                              matrix[8]);
-      }
-    }
+void Sequence::calculateStats(int index, IO::ImageProvider& provider) {
+  if(!fillStats(index, provider))
+    return;
 
-    // Write all image stats for this layer
-    for(uint i = 0; i < m_imageCount; ++i) {
-      auto& img = m_images[i];
-      if(!img->getStats(l)) {
-        // Image stats are written without gaps so the first image
-        // without them means that all images above also don't have them.
-        break;
-      }
-
-      // Write the M line
-      auto& stats = *img->getStats(l);
-
-      stream << std::format("M{}-{} {} {} {} {} {} {} {} {} {} {} {} {} {} {}\n",
-                            l, i,
-                            stats.getTotalPixels(),
-                            stats.getGoodPixels(),
-                            stats.getMean(),
-                            stats.getMedian(),
-                            stats.getSigma(),
-                            stats.getAvgDev(),
-                            stats.getMad(),
-                            stats.getSqrtBWMV(),
-                            stats.getLocation(),
-                            stats.getScale(),
-                            stats.getMin(),
-                            stats.getMax(),
-                            stats.getNormValue(),
-                            stats.getBgNoise());
-    }
+  if(m_wrappers[index])
+    m_wrappers[index]->load();
+  notifyImageChanged(index);
+  markDirty();
+}
+
+void Sequence::reloadImages() {
+  UpdateScope update(*this);
+  for(auto wrapper : m_wrappers) {
+    if(wrapper)
+      wrapper->load();
   }
+  notifyImageChanged(-1);
+}
+
+SequenceFile Sequence::contents() const {
+  SequenceFile file;
+  file.m_hasHeader = true;
+  file.m_name = m_sequenceName.get_value();
+  file.m_fileIndexFirst = m_fileIndexFirst.get_value();
+  file.m_imageCount = m_imageCount.get_value();
+  file.m_selectedCount = m_selectedCount.get_value();
+  file.m_fileIndexFixedLength = m_fileIndexFixedLength.get_value();
+  file.m_referenceImageIndex = m_referenceImageIndex.get_value();
+  file.m_version = m_version.get_value();
+  file.m_variableSizeImages = m_variableSizeImages.get_value();
+  file.m_fzFlag = m_fzFlag.get_value();
+  file.m_layerCount = m_layerCount.get_value();
+  file.m_type = m_sequenceType.get_value();
+  file.m_registrationLayer = m_registrationLayer.get_value();
+
+  // Registrations and stats are written without gaps, so the first image
+  // without them means that all images above also don't have them.
+  m_store.save(file);
+  return file;
+}
+
+void Sequence::writeStream(std::ostream& stream) {
+  std::string text;
+  SequenceWriter::format(contents(), text);
+  stream.write(text.data(), text.size());
 }
 
 Glib::PropertyProxy<Glib::ustring> Sequence::propertySequenceName() {
@@ -583,19 +339,111 @@ int Sequence::getRegistrationLayer() const {
   return m_registrationLayer.get_value();
 }
 
-Glib::RefPtr<Obj::Image> Sequence::image(int index) const {
-  return m_images[index];
+SequenceStore& Sequence::store() {
+  return m_store;
 }
 
-// GType Sequence::get_item_type_vfunc() {
-//   return Obj::Image::get_type();
-// }
+const SequenceStore& Sequence::store() const {
+  return m_store;
+}
 
-// guint Sequence::get_n_items_vfunc() {
-//   return m_images.size();
-// }
+Glib::RefPtr<Obj::Image> Sequence::image(int index) {
+  auto wrapper = m_wrappers[index];
+  if(wrapper) {
+    wrapper->reference();
+    return Glib::make_refptr_for_instance(wrapper);
+  }
 
-// gpointer Sequence::get_item_vfunc(guint position) {
-//   return m_images[position]->gobj();
-// }
+  // Images keep their sequence alive
+  reference();
+  auto img = Obj::Image::create(index, Glib::make_refptr_for_instance(this));
+  m_wrappers[index] = img.get();
+  return img;
+}
+
+void Sequence::forgetImage(int index, Obj::Image *image) {
+  if(index >= 0 && (size_t)index < m_wrappers.size() && m_wrappers[index] == image)
+    m_wrappers[index] = nullptr;
+}
+
+Sequence::image_changed_signal_type Sequence::signalImageChanged() {
+  return m_signalImageChanged;
+}
+
+void Sequence::notifyImageChanged(int index) {
+  if(m_updateDepth > 0) {
+    if(!m_pendingChange)
+      m_pendingChange = index;
+    else if(*m_pendingChange != index)
+      m_pendingChange = -1;
+    return;
+  }
+  m_signalImageChanged.emit(index);
+}
+
+void Sequence::imageEdited(int index) {
+  if(m_journal && index >= 0)
+    m_journal->appendImage(m_store, index);
+  markDirty();
+}
+
+void Sequence::setJournal(std::unique_ptr<EditJournal>&& journal) {
+  m_journal = std::move(journal);
+}
+
+EditJournal *Sequence::journal() {
+  return m_journal.get();
+}
+
+bool Sequence::replayJournal(const std::filesystem::path& sequencePath) {
+  int reference = m_referenceImageIndex.get_value();
+  if(EditJournal::replay(sequencePath, m_store, reference) == 0)
+    return false;
+
+  if(reference != m_referenceImageIndex.get_value()) {
+    // Journaled registrations are relative to the new reference already
+    m_oldReference = -1;
+    m_referenceImageIndex.set_value(reference);
+  }
+  m_selectedCount.set_value(m_store.includedCount());
 
+  reloadImages();
+  markDirty();
+  return true;
+}
+
+void Sequence::beginUpdate() {
+  ++m_updateDepth;
+}
+
+void Sequence::endUpdate() {
+  if(--m_updateDepth > 0 || !m_pendingChange)
+    return;
+
+  int index = *m_pendingChange;
+  m_pendingChange.reset();
+  m_signalImageChanged.emit(index);
+}
+
+Sequence::UpdateScope::UpdateScope(Sequence& sequence)
+  : m_sequence(sequence) {
+  m_sequence.beginUpdate();
+}
+
+Sequence::UpdateScope::~UpdateScope() {
+  m_sequence.endUpdate();
+}
+
+GType Sequence::get_item_type_vfunc() {
+  return G_TYPE_OBJECT;
+}
+
+guint Sequence::get_n_items_vfunc() {
+  return m_store.size();
+}
+
+gpointer Sequence::get_item_vfunc(guint position) {
+  if(position >= m_store.size())
+    return nullptr;
+  return image(position)->gobj_copy();
+}
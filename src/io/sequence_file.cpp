@@ -0,0 +1,328 @@
+#include "io/sequence_file.hpp"
+
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <spdlog/spdlog.h>
+
+using namespace IO;
+
+// Reads whitespace separated values from a line, following the sscanf
+// rules the format was defined with
+class Fields {
+  const char *m_ptr;
+  const char *m_end;
+
+public:
+  Fields(std::string_view text)
+    : m_ptr(text.data())
+    , m_end(text.data() + text.size()) {
+  }
+
+  std::string_view rest() const {
+    return std::string_view(m_ptr, m_end - m_ptr);
+  }
+
+  void skipSpace() {
+    while(m_ptr != m_end && (*m_ptr == ' ' || *m_ptr == '\t' || *m_ptr == '\r'))
+      ++m_ptr;
+  }
+
+  bool literal(char c) {
+    if(m_ptr == m_end || *m_ptr != c)
+      return false;
+    ++m_ptr;
+    return true;
+  }
+
+  std::string_view token() {
+    skipSpace();
+    auto begin = m_ptr;
+    while(m_ptr != m_end && *m_ptr != ' ' && *m_ptr != '\t' && *m_ptr != '\r')
+      ++m_ptr;
+    return std::string_view(begin, m_ptr - begin);
+  }
+
+  template<typename T>
+  bool integer(T& value) {
+    skipSpace();
+    if(m_ptr != m_end && *m_ptr == '+')
+      ++m_ptr;
+    auto result = std::from_chars(m_ptr, m_end, value);
+    if(result.ec != std::errc())
+      return false;
+    m_ptr = result.ptr;
+    return true;
+  }
+
+  template<typename T>
+  bool real(T& value) {
+    skipSpace();
+    if(m_ptr != m_end && *m_ptr == '+')
+      ++m_ptr;
+#if __cpp_lib_to_chars >= 201611L
+    auto result = std::from_chars(m_ptr, m_end, value);
+    if(result.ec == std::errc()) {
+      m_ptr = result.ptr;
+      return true;
+    }
+    if(result.ec != std::errc::result_out_of_range)
+      return false;
+#endif
+    // Values out of range are rounded to zero or infinity like strtod does
+    return realFallback(value);
+  }
+
+private:
+  template<typename T>
+  bool realFallback(T& value) {
+    char buffer[64];
+    size_t length = 0;
+    while(m_ptr + length != m_end && length < sizeof(buffer) - 1 && m_ptr[length] != ' ' && m_ptr[length] != '\t' && m_ptr[length] != '\r')
+      ++length;
+    memcpy(buffer, m_ptr, length);
+    buffer[length] = 0;
+
+    char *end;
+    double number = strtod(buffer, &end);
+    if(end == buffer)
+      return false;
+    value = static_cast<T>(number);
+    m_ptr += end - buffer;
+    return true;
+  }
+};
+
+bool SequenceFile::parse(std::string_view text) {
+  *this = SequenceFile();
+
+  size_t offset = 0;
+  while(offset < text.size()) {
+    size_t end = text.find('\n', offset);
+    if(end == std::string_view::npos)
+      end = text.size();
+    std::string_view line = text.substr(offset, end - offset);
+    offset = end + 1;
+
+    if(line.empty())
+      continue;
+    char second = line.size() > 1 ? line[1] : 0;
+
+    switch(line[0]) {
+      case '#':
+        continue;
+      case 'S': {
+        if(line.size() > 2 && line[2] == '"') {
+          spdlog::error("Sequence doesn't have a name and will not be loaded!");
+          return false;
+        }
+        if(m_hasHeader) {
+          spdlog::error("Sequence contains multiple header definitions!");
+          return false;
+        }
+        m_hasHeader = true;
+
+        Fields fields(line.substr(std::min<size_t>(2, line.size())));
+        if(fields.literal('\'')) {
+          auto rest = fields.rest();
+          auto quote = rest.find('\'');
+          if(quote == std::string_view::npos) {
+            spdlog::error("Sequence header error");
+            return false;
+          }
+          m_name = rest.substr(0, quote);
+          fields = Fields(rest.substr(quote + 1));
+        } else {
+          m_name = fields.token();
+        }
+
+        int variable = 0, fzFlag = 0;
+        if(m_name.empty() ||
+           !fields.integer(m_fileIndexFirst) || !fields.integer(m_imageCount) ||
+           !fields.integer(m_selectedCount) || !fields.integer(m_fileIndexFixedLength) ||
+           !fields.integer(m_referenceImageIndex)) {
+          spdlog::error("Sequence header error");
+          return false;
+        }
+        // Older files end the header early
+        if(fields.integer(m_version) && fields.integer(variable))
+          fields.integer(fzFlag);
+        m_variableSizeImages = variable;
+        m_fzFlag = fzFlag;
+
+        if(m_version <= 3) {
+          spdlog::error("Sequence versions below or equal to 3 are unsupported!");
+          return false;
+        }
+        if(m_imageCount > 0) {
+          m_images.reserve(m_imageCount);
+          m_registrations.reserve(m_imageCount);
+        }
+        break;
+      }
+      case 'L':
+        if(second == ' ') {
+          Fields fields(line.substr(2));
+          if(!fields.integer(m_layerCount)) {
+            spdlog::error("Sequence file format error");
+            return false;
+          }
+          if(m_imageCount > 0 && m_layerCount > 0)
+            m_stats.reserve((size_t)m_imageCount * m_layerCount);
+        }
+        break;
+      case 'I': {
+        Fields fields(line.substr(std::min<size_t>(2, line.size())));
+        ImageLine image = { .m_width = -1, .m_height = -1 };
+        int included;
+        int tokenCount = 0;
+        if(fields.integer(image.m_fileIndex) && fields.integer(included)) {
+          tokenCount = 2;
+          if(fields.integer(image.m_width) && fields.literal(',') && fields.integer(image.m_height))
+            tokenCount = 4;
+        }
+
+        if((tokenCount != 4 && m_variableSizeImages) || (tokenCount != 2 && !m_variableSizeImages)) {
+          spdlog::error("Sequence file format error");
+          return false;
+        }
+        if(tokenCount == 2)
+          image.m_width = image.m_height = -1;
+        image.m_included = included;
+        m_images.push_back(image);
+        break;
+      }
+      case 'T':
+        if(second == 'F') {
+          // Type F = Single fits file sequence (I think?)
+          m_type = SequenceType::SINGLE_FITS;
+        } else if(second == 'S') {
+          // Type S = SER video
+          m_type = SequenceType::SER;
+        } else {
+          spdlog::error("Sequence type not supported! (only FITS and SER sequences are currently supported)");
+          return false;
+        }
+        break;
+      case 'M': {
+        StatsLine stats;
+        stats.m_layer = 0;
+        if(second >= '0' && second <= '9') {
+          // Regular (demosaiced) channel
+          stats.m_layer = second - '0';
+        } else if(second == '*') {
+          // CFA channel
+        } else {
+          spdlog::error("Invalid M line layer index!");
+          return false;
+        }
+        if(line.size() < 3 || line[2] != '-') {
+          spdlog::error("Invalid M line layer index!");
+          return false;
+        }
+
+        Fields fields(line.substr(3));
+        if(!fields.integer(stats.m_image)) {
+          spdlog::error("Invalid or missing M line image index!");
+          return false;
+        }
+        if(!fields.integer(stats.m_totalPixels) || !fields.integer(stats.m_goodPixels) ||
+           !fields.real(stats.m_mean) || !fields.real(stats.m_median) ||
+           !fields.real(stats.m_sigma) || !fields.real(stats.m_avgDev) ||
+           !fields.real(stats.m_mad) || !fields.real(stats.m_sqrtBWMV) ||
+           !fields.real(stats.m_location) || !fields.real(stats.m_scale) ||
+           !fields.real(stats.m_min) || !fields.real(stats.m_max) ||
+           !fields.real(stats.m_normValue) || !fields.real(stats.m_bgNoise)) {
+          spdlog::error("Malformed M line, file loading terminated.");
+          return false;
+        }
+        m_stats.push_back(stats);
+        break;
+      }
+      // case 'D':
+      //   std::cout << "Warning! D line is currently unsupported in sequences!" << std::endl;
+      //   break;
+      case 'R': {
+        int layer;
+        if(second == '*') {
+          layer = -1;
+        } else if(second >= '0' && second <= '9') {
+          layer = second - '0';
+        } else {
+          spdlog::error("Sequence registration error");
+          return false;
+        }
+
+        if(m_registrations.empty()) {
+          m_registrationLayer = layer;
+        } else if(m_registrationLayer != layer) {
+          spdlog::error("Sequence registers more than one layer, this is currently not supported");
+          return false;
+        }
+
+        RegistrationLine reg;
+        Fields fields(line.substr(std::min<size_t>(3, line.size())));
+        bool valid = fields.real(reg.m_FWHM) && fields.real(reg.m_weightedFWHM) && fields.real(reg.m_roundness) &&
+                     fields.real(reg.m_quality) && fields.real(reg.m_backgroundLevel) && fields.integer(reg.m_numberOfStars) &&
+                     fields.token() == "H";
+        for(int i = 0; i < 9 && valid; ++i)
+          valid = fields.real(reg.m_matrix[i]);
+
+        if(!valid) {
+          spdlog::error("Sequence registration error");
+          return false;
+        }
+        m_registrations.push_back(reg);
+        break;
+      }
+      default:
+        spdlog::warn("Unsupported line '{}' in sequence!", line[0]);
+        break;
+    }
+  }
+
+  if(!m_hasHeader) {
+    spdlog::error("Sequence file has no header");
+    return false;
+  }
+  return true;
+}
+
+bool SequenceFile::read(const std::filesystem::path& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if(fd < 0) {
+    spdlog::error("Failed to open file '{}'", path.c_str());
+    return false;
+  }
+
+  struct stat info;
+  if(fstat(fd, &info) != 0) {
+    spdlog::error("Failed to read file '{}'", path.c_str());
+    close(fd);
+    return false;
+  }
+  if(info.st_size == 0) {
+    close(fd);
+    return parse(std::string_view());
+  }
+
+  void *address = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping stays valid after the descriptor is closed
+  close(fd);
+  if(address == MAP_FAILED) {
+    spdlog::error("Failed to map file '{}'", path.c_str());
+    return false;
+  }
+  // The text is read once from start to end
+  madvise(address, info.st_size, MADV_SEQUENTIAL);
+
+  bool result = parse(std::string_view(static_cast<const char *>(address), info.st_size));
+  munmap(address, info.st_size);
+  return result;
+}
@@ -0,0 +1,274 @@
+#include "io/sequence_store.hpp"
+
+#include <cmath>
+#include <cstring>
+
+#include <spdlog/spdlog.h>
+
+using namespace IO;
+
+static const SequenceStore::Matrix IDENTITY = { 1, 0, 0, 0, 1, 0, 0, 0, 1 };
+
+SequenceStore::SequenceStore()
+  : m_layerCount(0) {
+}
+
+size_t SequenceStore::size() const {
+  return m_fileIndex.size();
+}
+
+int SequenceStore::layerCount() const {
+  return m_layerCount;
+}
+
+void SequenceStore::resize(size_t size, int layerCount) {
+  m_layerCount = layerCount;
+
+  m_fileIndex.resize(size, 0);
+  m_included.resize(size, 0);
+  m_width.resize(size, 0);
+  m_height.resize(size, 0);
+
+  m_hasRegistration.resize(size, 0);
+  m_matrices.resize(size * 9, 0);
+  m_FWHM.resize(size, 0);
+  m_weightedFWHM.resize(size, 0);
+  m_roundness.resize(size, 0);
+  m_quality.resize(size, 0);
+  m_backgroundLevel.resize(size, 0);
+  m_numberOfStars.resize(size, 0);
+
+  m_hasStats.resize(layerCount);
+  m_stats.resize(layerCount);
+  for(int l = 0; l < layerCount; ++l) {
+    m_hasStats[l].resize(size, 0);
+    m_stats[l].resize(size);
+  }
+}
+
+bool SequenceStore::load(const SequenceFile& file) {
+  size_t count = file.m_images.size();
+  resize(0, 0);
+  resize(count, file.m_layerCount);
+
+  for(size_t row = 0; row < count; ++row) {
+    auto& line = file.m_images[row];
+    m_fileIndex[row] = line.m_fileIndex;
+    m_included[row] = line.m_included;
+    m_width[row] = std::max(line.m_width, 0);
+    m_height[row] = std::max(line.m_height, 0);
+  }
+
+  for(auto& line : file.m_stats) {
+    if(line.m_image < 0 || (size_t)line.m_image >= count || line.m_layer < 0 || line.m_layer >= m_layerCount) {
+      spdlog::error("Stats defined for non-existant image or layer");
+      return false;
+    }
+    if(stats(line.m_image, line.m_layer)) {
+      spdlog::error("Redefinition of stats on an image layer");
+      return false;
+    }
+    setStats(line.m_image, line.m_layer, line);
+  }
+
+  // Registrations belong to the images in the order they are listed
+  if(file.m_registrations.size() > count) {
+    spdlog::error("Sequence registration error");
+    return false;
+  }
+  for(size_t row = 0; row < file.m_registrations.size(); ++row) {
+    auto& line = file.m_registrations[row];
+    setRegistration(row, { line.m_FWHM, line.m_weightedFWHM, line.m_roundness,
+                           line.m_quality, line.m_backgroundLevel, line.m_numberOfStars });
+    setMatrix(row, line.m_matrix);
+  }
+  return true;
+}
+
+void SequenceStore::save(SequenceFile& file) const {
+  size_t count = size();
+  file.m_images.clear();
+  file.m_images.reserve(count);
+  for(size_t row = 0; row < count; ++row)
+    file.m_images.push_back({ m_fileIndex[row], m_included[row] != 0, m_width[row], m_height[row] });
+
+  file.m_registrations.clear();
+  for(size_t row = 0; row < count && m_hasRegistration[row]; ++row) {
+    SequenceFile::RegistrationLine line = {
+      .m_FWHM = m_FWHM[row],
+      .m_weightedFWHM = m_weightedFWHM[row],
+      .m_roundness = m_roundness[row],
+      .m_quality = m_quality[row],
+      .m_backgroundLevel = m_backgroundLevel[row],
+      .m_numberOfStars = m_numberOfStars[row],
+    };
+    memcpy(line.m_matrix, matrix(row), sizeof(line.m_matrix));
+    file.m_registrations.push_back(line);
+  }
+
+  file.m_stats.clear();
+  for(int l = 0; l < m_layerCount; ++l) {
+    for(size_t row = 0; row < count && m_hasStats[l][row]; ++row)
+      file.m_stats.push_back(m_stats[l][row]);
+  }
+}
+
+int SequenceStore::fileIndex(size_t row) const {
+  return m_fileIndex[row];
+}
+
+bool SequenceStore::included(size_t row) const {
+  return m_included[row];
+}
+
+int SequenceStore::width(size_t row) const {
+  return m_width[row];
+}
+
+int SequenceStore::height(size_t row) const {
+  return m_height[row];
+}
+
+void SequenceStore::setFileIndex(size_t row, int value) {
+  m_fileIndex[row] = value;
+}
+
+void SequenceStore::setIncluded(size_t row, bool value) {
+  m_included[row] = value;
+}
+
+void SequenceStore::setWidth(size_t row, int value) {
+  m_width[row] = value;
+}
+
+void SequenceStore::setHeight(size_t row, int value) {
+  m_height[row] = value;
+}
+
+size_t SequenceStore::includedCount() const {
+  size_t count = 0;
+  for(uint8_t included : m_included)
+    count += included != 0;
+  return count;
+}
+
+bool SequenceStore::hasRegistration(size_t row) const {
+  return m_hasRegistration[row];
+}
+
+const double *SequenceStore::matrix(size_t row) const {
+  return m_hasRegistration[row] ? &m_matrices[row * 9] : IDENTITY.data();
+}
+
+SequenceStore::RegistrationValues SequenceStore::registration(size_t row) const {
+  return { m_FWHM[row], m_weightedFWHM[row], m_roundness[row],
+           m_quality[row], m_backgroundLevel[row], m_numberOfStars[row] };
+}
+
+void SequenceStore::setRegistration(size_t row, const RegistrationValues& values) {
+  if(!m_hasRegistration[row]) {
+    m_hasRegistration[row] = 1;
+    memcpy(&m_matrices[row * 9], IDENTITY.data(), sizeof(IDENTITY));
+  }
+  m_FWHM[row] = values.m_FWHM;
+  m_weightedFWHM[row] = values.m_weightedFWHM;
+  m_roundness[row] = values.m_roundness;
+  m_quality[row] = values.m_quality;
+  m_backgroundLevel[row] = values.m_backgroundLevel;
+  m_numberOfStars[row] = values.m_numberOfStars;
+}
+
+void SequenceStore::setMatrix(size_t row, const double *matrix) {
+  if(!m_hasRegistration[row])
+    setRegistration(row, {});
+  memcpy(&m_matrices[row * 9], matrix, 9 * sizeof(double));
+}
+
+void SequenceStore::clearRegistration(size_t row) {
+  m_hasRegistration[row] = 0;
+}
+
+const SequenceFile::StatsLine *SequenceStore::stats(size_t row, int layer) const {
+  if(layer < 0 || layer >= m_layerCount || !m_hasStats[layer][row])
+    return nullptr;
+  return &m_stats[layer][row];
+}
+
+void SequenceStore::setStats(size_t row, int layer, const SequenceFile::StatsLine& values) {
+  if(layer < 0 || layer >= m_layerCount)
+    return;
+  m_stats[layer][row] = values;
+  m_stats[layer][row].m_image = row;
+  m_stats[layer][row].m_layer = layer;
+  m_hasStats[layer][row] = 1;
+}
+
+void SequenceStore::clearStats(size_t row, int layer) {
+  if(layer >= 0 && layer < m_layerCount)
+    m_hasStats[layer][row] = 0;
+}
+
+void SequenceStore::changeReference(size_t oldReference, size_t newReference) {
+  // Make sure that the old reference has a valid registration with an identity matrix
+  setMatrix(oldReference, IDENTITY.data());
+
+  // New reference without a registration is effectively an identity
+  // matrix, so there is nothing to recalculate
+  if(!m_hasRegistration[newReference])
+    return;
+
+  double inverse[9];
+  if(!invert(matrix(newReference), inverse)) {
+    spdlog::error("Registration of the new reference image can't be inverted");
+    return;
+  }
+
+  // TODO: This works for translation only matrices but will have to be checked for more complex ones.
+  for(size_t row = 0; row < size(); ++row) {
+    if(!m_hasRegistration[row])
+      continue;
+
+    double *m = &m_matrices[row * 9];
+    double result[9];
+    for(int r = 0; r < 3; ++r) {
+      for(int c = 0; c < 3; ++c)
+        result[r * 3 + c] = inverse[r * 3] * m[c] + inverse[r * 3 + 1] * m[3 + c] + inverse[r * 3 + 2] * m[6 + c];
+    }
+    memcpy(m, result, sizeof(result));
+  }
+}
+
+bool SequenceStore::fillRegistrationGaps() {
+  bool changed = false;
+  bool fill = false;
+  for(size_t row = size(); row-- > 0;) {
+    if(m_hasRegistration[row]) {
+      fill = true;
+    } else if(fill) {
+      setRegistration(row, {});
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+bool SequenceStore::invert(const double *m, double *inverse) {
+  double c00 = m[4] * m[8] - m[5] * m[7];
+  double c01 = m[5] * m[6] - m[3] * m[8];
+  double c02 = m[3] * m[7] - m[4] * m[6];
+  double det = m[0] * c00 + m[1] * c01 + m[2] * c02;
+  if(det == 0 || !std::isfinite(det))
+    return false;
+
+  double f = 1.0 / det;
+  inverse[0] = c00 * f;
+  inverse[1] = (m[2] * m[7] - m[1] * m[8]) * f;
+  inverse[2] = (m[1] * m[5] - m[2] * m[4]) * f;
+  inverse[3] = c01 * f;
+  inverse[4] = (m[0] * m[8] - m[2] * m[6]) * f;
+  inverse[5] = (m[2] * m[3] - m[0] * m[5]) * f;
+  inverse[6] = c02 * f;
+  inverse[7] = (m[1] * m[6] - m[0] * m[7]) * f;
+  inverse[8] = (m[0] * m[4] - m[1] * m[3]) * f;
+  return true;
+}
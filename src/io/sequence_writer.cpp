@@ -0,0 +1,587 @@
+#include "io/sequence_writer.hpp"
+
+#include <charconv>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <spdlog/spdlog.h>
+
+using namespace IO;
+
+// Shortest representation which reads back to the same value, this is
+// what std::format prints as well
+template<typename T>
+static inline void append(std::string& text, T value) {
+  char buffer[64];
+  auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+  text.append(buffer, result.ptr);
+}
+
+static inline void append(std::string& text, bool value) {
+  text += value ? '1' : '0';
+}
+
+// Journal records are a header, the patches as offset, size and bytes and
+// a checksum over all of it. Torn records at the end fail the checksum.
+static const uint32_t JOURNAL_MAGIC = 0x324a5153; // "SQJ2"
+
+struct JournalHeader {
+  uint32_t m_magic;
+  uint32_t m_patchCount;
+  // Bytes before this offset which aren't patched stay the same
+  uint64_t m_stableEnd;
+  // Sequence file size after the patches
+  uint64_t m_newSize;
+  uint64_t m_bodySize;
+  // Checksums of the bytes the patches leave alone and of the patched
+  // file, a sequence changed by somebody else doesn't match them
+  uint64_t m_stableSum;
+  uint64_t m_newSum;
+};
+
+struct JournalPatch {
+  uint64_t m_offset;
+  uint64_t m_size;
+  const char *m_data;
+};
+
+static const uint64_t CHECKSUM_BASIS = 0xcbf29ce484222325ull;
+
+static uint64_t checksum(const char *data, size_t size, uint64_t hash = CHECKSUM_BASIS) {
+  // FNV-1a
+  for(size_t i = 0; i < size; ++i) {
+    hash ^= static_cast<uint8_t>(data[i]);
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+// Checksum of the bytes before end which none of the patches covers,
+// patches are sorted by their offset
+static uint64_t stableChecksum(const char *data, const std::vector<JournalPatch>& patches, uint64_t end) {
+  uint64_t hash = CHECKSUM_BASIS;
+  uint64_t offset = 0;
+  for(auto& patch : patches) {
+    if(patch.m_offset >= end)
+      break;
+    hash = checksum(data + offset, patch.m_offset - offset, hash);
+    offset = patch.m_offset + patch.m_size;
+  }
+  if(offset < end)
+    hash = checksum(data + offset, end - offset, hash);
+  return hash;
+}
+
+template<typename T>
+static void appendRaw(std::string& data, const T& value) {
+  data.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+static bool writeAll(int fd, const char *data, size_t size, size_t offset) {
+  while(size > 0) {
+    ssize_t written = pwrite(fd, data, size, offset);
+    if(written < 0) {
+      if(errno == EINTR)
+        continue;
+      return false;
+    }
+    data += written;
+    size -= written;
+    offset += written;
+  }
+  return true;
+}
+
+SequenceWriter::SequenceWriter(const std::filesystem::path& path)
+  : m_path(path)
+  , m_journalPath(journalPath(path))
+  , m_journalSize(0)
+  , m_hasWritten(false)
+  , m_fileSize(0)
+  , m_fileTime(0)
+  , m_lastWriteSize(0)
+  , m_keepJournal(false) {
+}
+
+void SequenceWriter::format(const SequenceFile& file, std::string& text) {
+  text.clear();
+  formatFile(file, text, nullptr);
+}
+
+void SequenceWriter::formatFile(const SequenceFile& file, std::string& text, std::vector<Slot> *slots) {
+  auto add = [&](SlotKind kind, size_t record) {
+    size_t offset = text.size();
+    formatSlot(file, { 0, 0, kind, record }, text);
+    if(slots)
+      slots->push_back({ offset, text.size() - offset, kind, record });
+  };
+
+  add(HEADER, 0);
+  add(LAYERS, 0);
+  for(size_t i = 0; i < file.m_images.size(); ++i)
+    add(IMAGE, i);
+
+  for(int l = 0; l < file.m_layerCount; ++l) {
+    if(file.m_registrationLayer == l) {
+      for(size_t i = 0; i < file.m_registrations.size(); ++i)
+        add(REGISTRATION, i);
+    }
+    for(size_t i = 0; i < file.m_stats.size(); ++i) {
+      if(file.m_stats[i].m_layer == l)
+        add(STATS, i);
+    }
+  }
+}
+
+void SequenceWriter::formatSlot(const SequenceFile& file, const Slot& slot, std::string& text) {
+  switch(slot.m_kind) {
+    case HEADER:
+      formatHeader(file, text);
+      break;
+    case LAYERS:
+      // Emit sequence type
+      switch(file.m_type) {
+        case SequenceType::SINGLE_FITS:
+          text += "TF\n";
+          break;
+        case SequenceType::SER:
+          text += "TS\n";
+          break;
+        case SequenceType::MULTI_FITS:
+          // No additional info for this type
+          break;
+      }
+      text += "L ";
+      append(text, file.m_layerCount);
+      text += '\n';
+      break;
+    case IMAGE:
+      formatImage(file, file.m_images[slot.m_record], text);
+      break;
+    case REGISTRATION:
+      formatRegistration(file.m_registrationLayer, file.m_registrations[slot.m_record], text);
+      break;
+    case STATS:
+      formatStats(file.m_stats[slot.m_record], text);
+      break;
+  }
+}
+
+void SequenceWriter::formatHeader(const SequenceFile& file, std::string& text) {
+  text += "S '";
+  text += file.m_name;
+  text += "' ";
+  append(text, file.m_fileIndexFirst);
+  text += ' ';
+  append(text, file.m_imageCount);
+  text += ' ';
+  append(text, file.m_selectedCount);
+  text += ' ';
+  append(text, file.m_fileIndexFixedLength);
+  text += ' ';
+  append(text, file.m_referenceImageIndex);
+  text += ' ';
+  append(text, file.m_version);
+  text += ' ';
+  append(text, file.m_variableSizeImages);
+  text += ' ';
+  append(text, file.m_fzFlag);
+  text += '\n';
+}
+
+void SequenceWriter::formatImage(const SequenceFile& file, const SequenceFile::ImageLine& line, std::string& text) {
+  text += "I ";
+  append(text, line.m_fileIndex);
+  text += ' ';
+  append(text, line.m_included);
+  if(file.m_variableSizeImages) {
+    text += ' ';
+    append(text, line.m_width);
+    text += ',';
+    append(text, line.m_height);
+  }
+  text += '\n';
+}
+
+void SequenceWriter::formatRegistration(int layer, const SequenceFile::RegistrationLine& line, std::string& text) {
+  text += 'R';
+  append(text, layer);
+  for(float value : { line.m_FWHM, line.m_weightedFWHM, line.m_roundness }) {
+    text += ' ';
+    append(text, value);
+  }
+  text += ' ';
+  append(text, line.m_quality);
+  text += ' ';
+  append(text, line.m_backgroundLevel);
+  text += ' ';
+  append(text, line.m_numberOfStars);
+  text += " H";
+  for(double value : line.m_matrix) {
+    text += ' ';
+    append(text, value);
+  }
+  text += '\n';
+}
+
+void SequenceWriter::formatStats(const SequenceFile::StatsLine& line, std::string& text) {
+  text += 'M';
+  append(text, line.m_layer);
+  text += '-';
+  append(text, line.m_image);
+  text += ' ';
+  append(text, line.m_totalPixels);
+  text += ' ';
+  append(text, line.m_goodPixels);
+  for(double value : { line.m_mean, line.m_median, line.m_sigma, line.m_avgDev, line.m_mad, line.m_sqrtBWMV,
+                       line.m_location, line.m_scale, line.m_min, line.m_max, line.m_normValue, line.m_bgNoise }) {
+    text += ' ';
+    append(text, value);
+  }
+  text += '\n';
+}
+
+bool SequenceWriter::write(const SequenceFile& file) {
+  m_buffer.clear();
+  m_slots.clear();
+  formatFile(file, m_buffer, &m_slots);
+  m_hasWritten = false;
+
+  auto tempPath = m_path;
+  tempPath += ".tmp";
+  int fd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0) {
+    spdlog::error("Failed to open {} for sequence save", tempPath.c_str());
+    return false;
+  }
+  bool success = writeAll(fd, m_buffer.data(), m_buffer.size(), 0) && fsync(fd) == 0;
+  success = close(fd) == 0 && success;
+  if(!success) {
+    spdlog::error("Failed to write sequence {}", tempPath.c_str());
+    std::filesystem::remove(tempPath);
+    return false;
+  }
+
+  // Without the journal the old file stays as it is, patches of it
+  // must not end up in the new one after a crash
+  std::error_code error;
+  std::filesystem::remove(m_journalPath, error);
+  m_journalSize = 0;
+  std::filesystem::rename(tempPath, m_path, error);
+  if(error) {
+    spdlog::error("Failed to replace sequence {}: {}", m_path.c_str(), error.message());
+    return false;
+  }
+
+  m_written = file;
+  m_lastWriteSize = m_buffer.size();
+  rememberFile();
+  return true;
+}
+
+bool SequenceWriter::update(const SequenceFile& file) {
+  if(!sameLayout(file) || !fileUnchanged() || m_journalSize > MAX_JOURNAL_SIZE)
+    return write(file);
+
+  // Lines which kept their size are patched, everything from the first
+  // line which grew to the end of the file is written again
+  std::vector<size_t> patches;
+  size_t tail = std::string::npos;
+  m_next.clear();
+  for(size_t i = 0; i < m_slots.size(); ++i) {
+    auto& slot = m_slots[i];
+    size_t offset = m_next.size();
+
+    bool changed;
+    switch(slot.m_kind) {
+      case IMAGE:
+        changed = !(file.m_images[slot.m_record] == m_written.m_images[slot.m_record]);
+        break;
+      case REGISTRATION:
+        changed = !(file.m_registrations[slot.m_record] == m_written.m_registrations[slot.m_record]);
+        break;
+      case STATS:
+        changed = !(file.m_stats[slot.m_record] == m_written.m_stats[slot.m_record]);
+        break;
+      default:
+        // Header values are cheap to compare as text
+        changed = true;
+        break;
+    }
+
+    if(!changed) {
+      m_next.append(m_buffer, slot.m_offset, slot.m_size);
+    } else {
+      m_line.clear();
+      formatSlot(file, slot, m_line);
+      // Trailing spaces are skipped by the parsers
+      m_line.pop_back();
+      if(m_line.size() < slot.m_size)
+        m_line.append(slot.m_size - 1 - m_line.size(), ' ');
+      else
+        m_line.append(LINE_SLACK, ' ');
+      m_line += '\n';
+
+      if(m_line.size() != slot.m_size) {
+        tail = std::min(tail, offset);
+      } else if(m_buffer.compare(slot.m_offset, slot.m_size, m_line) != 0 && offset < tail) {
+        patches.push_back(i);
+      }
+      m_next += m_line;
+    }
+
+    slot.m_offset = offset;
+    slot.m_size = m_next.size() - offset;
+  }
+
+  m_lastWriteSize = 0;
+  if(patches.empty() && tail == std::string::npos)
+    return true;
+
+  if(!appendJournal(patches, tail, m_buffer.size())) {
+    spdlog::warn("Failed to journal the changes of {}, writing all of it", m_path.c_str());
+    return write(file);
+  }
+
+  int fd = open(m_path.c_str(), O_WRONLY);
+  if(fd < 0) {
+    spdlog::error("Failed to open {} for sequence save", m_path.c_str());
+    m_hasWritten = false;
+    return false;
+  }
+
+  bool success = true;
+  for(size_t i : patches) {
+    auto& slot = m_slots[i];
+    if(slot.m_offset >= tail)
+      break;
+    success = success && writeAll(fd, m_next.data() + slot.m_offset, slot.m_size, slot.m_offset);
+    m_lastWriteSize += slot.m_size;
+  }
+  if(tail != std::string::npos) {
+    success = success && writeAll(fd, m_next.data() + tail, m_next.size() - tail, tail);
+    success = success && ftruncate(fd, m_next.size()) == 0;
+    m_lastWriteSize += m_next.size() - tail;
+  }
+  success = success && fsync(fd) == 0;
+  success = close(fd) == 0 && success;
+
+  if(!success) {
+    spdlog::error("Failed to update sequence {}", m_path.c_str());
+    // The file is in an unknown state, the next save writes all of it
+    m_hasWritten = false;
+    return false;
+  }
+
+  // The patches are on disk, the journal isn't needed anymore
+  if(!m_keepJournal) {
+    std::error_code error;
+    std::filesystem::remove(m_journalPath, error);
+    if(!error)
+      m_journalSize = 0;
+  }
+
+  std::swap(m_buffer, m_next);
+  m_written = file;
+  rememberFile();
+  return true;
+}
+
+bool SequenceWriter::appendJournal(const std::vector<size_t>& patches, size_t tail, uint64_t oldSize) {
+  std::string record;
+  JournalHeader header = {
+    .m_magic = JOURNAL_MAGIC,
+    .m_patchCount = (uint32_t)patches.size(),
+    .m_stableEnd = tail != std::string::npos ? tail : oldSize,
+    .m_newSize = m_next.size(),
+    .m_bodySize = 0,
+    .m_stableSum = 0,
+    .m_newSum = checksum(m_next.data(), m_next.size()),
+  };
+  appendRaw(record, header);
+
+  std::vector<JournalPatch> ranges;
+  auto addPatch = [&](uint64_t offset, uint64_t size) {
+    appendRaw(record, offset);
+    appendRaw(record, size);
+    record.append(m_next, offset, size);
+    ranges.push_back({ offset, size, nullptr });
+  };
+  for(size_t i : patches)
+    addPatch(m_slots[i].m_offset, m_slots[i].m_size);
+  if(tail != std::string::npos) {
+    addPatch(tail, m_next.size() - tail);
+    ++header.m_patchCount;
+  }
+
+  // Unpatched lines before the tail are the same in both files
+  header.m_stableSum = stableChecksum(m_buffer.data(), ranges, header.m_stableEnd);
+  header.m_bodySize = record.size() - sizeof(header);
+  memcpy(record.data(), &header, sizeof(header));
+  appendRaw(record, checksum(record.data(), record.size()));
+
+  int fd = open(m_journalPath.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+  if(fd < 0)
+    return false;
+  bool success = writeAll(fd, record.data(), record.size(), m_journalSize) && fdatasync(fd) == 0;
+  success = close(fd) == 0 && success;
+  if(success)
+    m_journalSize += record.size();
+  return success;
+}
+
+std::filesystem::path SequenceWriter::journalPath(const std::filesystem::path& path) {
+  auto journal = path;
+  journal += ".journal";
+  return journal;
+}
+
+bool SequenceWriter::recover(const std::filesystem::path& path) {
+  auto journal = journalPath(path);
+  std::ifstream stream(journal, std::ios::binary);
+  if(!stream.is_open())
+    return true;
+  std::string data((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+  stream.close();
+
+  // Complete records in the order they were written
+  std::vector<std::pair<size_t, JournalHeader>> records;
+  size_t offset = 0;
+  while(offset + sizeof(JournalHeader) <= data.size()) {
+    JournalHeader header;
+    memcpy(&header, data.data() + offset, sizeof(header));
+    size_t size = sizeof(header) + header.m_bodySize;
+    if(header.m_magic != JOURNAL_MAGIC || header.m_bodySize > data.size() || offset + size + sizeof(uint64_t) > data.size())
+      break;
+
+    uint64_t sum;
+    memcpy(&sum, data.data() + offset + size, sizeof(sum));
+    if(sum != checksum(data.data() + offset, size))
+      break;
+    records.push_back({ offset, header });
+    offset += size + sizeof(sum);
+  }
+
+  std::error_code error;
+  if(records.empty()) {
+    std::filesystem::remove(journal, error);
+    return true;
+  }
+
+  std::ifstream sequence(path, std::ios::binary);
+  if(!sequence.is_open()) {
+    spdlog::warn("Dropping journal {}, the sequence is gone", journal.c_str());
+    std::filesystem::remove(journal, error);
+    return false;
+  }
+  std::string contents((std::istreambuf_iterator<char>(sequence)), std::istreambuf_iterator<char>());
+  sequence.close();
+
+  // Records are applied to the contents one after another, each of them
+  // has to find the file as it was written or already patched by it
+  bool changed = false;
+  std::vector<JournalPatch> patches;
+  for(auto& [start, header] : records) {
+    patches.clear();
+    const char *ptr = data.data() + start + sizeof(header);
+    const char *end = ptr + header.m_bodySize;
+    bool valid = true;
+    for(uint32_t i = 0; i < header.m_patchCount && valid; ++i) {
+      JournalPatch patch;
+      valid = end - ptr >= (ptrdiff_t)(sizeof(patch.m_offset) + sizeof(patch.m_size));
+      if(!valid)
+        break;
+      memcpy(&patch.m_offset, ptr, sizeof(patch.m_offset));
+      memcpy(&patch.m_size, ptr + sizeof(patch.m_offset), sizeof(patch.m_size));
+      patch.m_data = ptr + sizeof(patch.m_offset) + sizeof(patch.m_size);
+      ptr = patch.m_data + patch.m_size;
+      valid = patch.m_size <= header.m_newSize && patch.m_offset <= header.m_newSize - patch.m_size && ptr <= end;
+      patches.push_back(patch);
+    }
+
+    if(valid && checksum(contents.data(), contents.size()) == header.m_newSum)
+      continue;
+
+    if(!valid || contents.size() < header.m_stableEnd ||
+       stableChecksum(contents.data(), patches, header.m_stableEnd) != header.m_stableSum) {
+      spdlog::warn("Dropping journal {}, it doesn't belong to the sequence", journal.c_str());
+      std::filesystem::remove(journal, error);
+      return false;
+    }
+
+    contents.resize(header.m_newSize);
+    for(auto& patch : patches)
+      memcpy(contents.data() + patch.m_offset, patch.m_data, patch.m_size);
+    changed = true;
+  }
+
+  if(changed) {
+    int fd = open(path.c_str(), O_WRONLY);
+    if(fd < 0) {
+      spdlog::error("Failed to open {} to apply its journal", path.c_str());
+      return false;
+    }
+
+    bool success = writeAll(fd, contents.data(), contents.size(), 0);
+    success = success && ftruncate(fd, contents.size()) == 0;
+    success = success && fsync(fd) == 0;
+    success = close(fd) == 0 && success;
+    if(!success) {
+      spdlog::error("Failed to apply journal {}", journal.c_str());
+      return false;
+    }
+    spdlog::info("Recovered {} interrupted saves of {}", records.size(), path.c_str());
+  }
+
+  std::filesystem::remove(journal, error);
+  return true;
+}
+
+size_t SequenceWriter::lastWriteSize() const {
+  return m_lastWriteSize;
+}
+
+void SequenceWriter::keepJournal(bool keep) {
+  m_keepJournal = keep;
+}
+
+bool SequenceWriter::sameLayout(const SequenceFile& file) const {
+  if(!m_hasWritten)
+    return false;
+  if(file.m_type != m_written.m_type || file.m_layerCount != m_written.m_layerCount ||
+     file.m_registrationLayer != m_written.m_registrationLayer ||
+     file.m_variableSizeImages != m_written.m_variableSizeImages)
+    return false;
+  if(file.m_images.size() != m_written.m_images.size() ||
+     file.m_registrations.size() != m_written.m_registrations.size() ||
+     file.m_stats.size() != m_written.m_stats.size())
+    return false;
+
+  for(size_t i = 0; i < file.m_stats.size(); ++i) {
+    if(file.m_stats[i].m_image != m_written.m_stats[i].m_image || file.m_stats[i].m_layer != m_written.m_stats[i].m_layer)
+      return false;
+  }
+  return true;
+}
+
+bool SequenceWriter::fileUnchanged() const {
+  // Somebody else might have saved the sequence in the meantime
+  std::error_code error;
+  auto size = std::filesystem::file_size(m_path, error);
+  if(error || size != m_fileSize)
+    return false;
+  auto time = std::filesystem::last_write_time(m_path, error);
+  return !error && time.time_since_epoch().count() == m_fileTime;
+}
+
+void SequenceWriter::rememberFile() {
+  std::error_code error;
+  m_fileSize = std::filesystem::file_size(m_path, error);
+  if(!error)
+    m_fileTime = std::filesystem::last_write_time(m_path, error).time_since_epoch().count();
+  m_hasWritten = !error;
+}
@@ -0,0 +1,314 @@
+#include "io/ser.hpp"
+#include "io/convert.hpp"
+#include "io/kernels.hpp"
+
+#include <bit>
+#include <cstring>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <spdlog/spdlog.h>
+
+using namespace IO;
+
+// SER timestamps count 100 ns ticks from 0001-01-01, this is the Unix epoch
+#define SER_UNIX_EPOCH 621355968000000000ll
+
+struct SerFile::Mapping {
+  uint8_t *m_address;
+  size_t m_size;
+
+  Mapping(uint8_t *address, size_t size)
+    : m_address(address)
+    , m_size(size) {
+  }
+
+  ~Mapping() {
+    munmap(m_address, m_size);
+  }
+};
+
+template<typename T>
+static inline T byteSwap(T value) {
+  if constexpr(sizeof(T) == 2)
+    return static_cast<T>(__builtin_bswap16(value));
+  else if constexpr(sizeof(T) == 4)
+    return static_cast<T>(__builtin_bswap32(value));
+  else if constexpr(sizeof(T) == 8)
+    return static_cast<T>(__builtin_bswap64(value));
+  return value;
+}
+
+// Header values are always stored in little-endian byte order
+template<typename T>
+static inline T loadLittleEndian(const uint8_t *ptr) {
+  T value;
+  memcpy(&value, ptr, sizeof(T));
+  if constexpr(std::endian::native == std::endian::big)
+    value = byteSwap(value);
+  return value;
+}
+
+static std::string headerString(const uint8_t *ptr, size_t size) {
+  std::string value(reinterpret_cast<const char *>(ptr), strnlen(reinterpret_cast<const char *>(ptr), size));
+  auto end = value.find_last_not_of(' ');
+  value.resize(end == std::string::npos ? 0 : end + 1);
+  return value;
+}
+
+// Converts pixels which are step bytes apart into native values of the
+// destination type
+template<typename Src, typename Dst>
+static void convertRow(const uint8_t *src, Dst *dst, long count, size_t step, bool swap) {
+  if constexpr(std::is_same_v<Src, uint16_t> && std::is_same_v<Dst, uint16_t>) {
+    if(swap && step == sizeof(Src)) {
+      Kernels::swap16(src, dst, count, 0);
+      return;
+    }
+  }
+
+  for(long i = 0; i < count; ++i) {
+    Src value;
+    memcpy(&value, src + i * step, sizeof(Src));
+    if(swap)
+      value = byteSwap(value);
+    dst[i] = static_cast<Dst>(value);
+  }
+}
+
+SerFile::SerFile(const std::filesystem::path& filename)
+  : m_path(filename)
+  , m_colorId(MONO)
+  , m_littleEndian(true)
+  , m_width(0)
+  , m_height(0)
+  , m_pixelDepth(0)
+  , m_planes(1)
+  , m_bytesPerPixel(1)
+  , m_frameSize(0)
+  , m_timestamps(nullptr) {
+  m_imageCount = -1;
+
+  int fd = open(filename.c_str(), O_RDONLY);
+  if(fd < 0) {
+    spdlog::error("Failed to open SER file {}", filename.c_str());
+    return;
+  }
+
+  struct stat info;
+  if(fstat(fd, &info) != 0 || info.st_size < (off_t)HEADER_SIZE) {
+    spdlog::error("SER file {} is too small to be valid", filename.c_str());
+    close(fd);
+    return;
+  }
+
+  void *address = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping stays valid after the descriptor is closed
+  close(fd);
+  if(address == MAP_FAILED) {
+    spdlog::error("Failed to map SER file {}", filename.c_str());
+    return;
+  }
+  // Frames are mostly read in order
+  madvise(address, info.st_size, MADV_SEQUENTIAL);
+
+  m_mapping = std::make_shared<Mapping>(static_cast<uint8_t *>(address), info.st_size);
+  if(!parseHeader()) {
+    m_mapping = nullptr;
+    return;
+  }
+
+  spdlog::info("Mapped SER file {} with {} frames of {}x{}", filename.c_str(), m_imageCount, m_width, m_height);
+}
+
+bool SerFile::parseHeader() {
+  const uint8_t *base = m_mapping->m_address;
+  const size_t size = m_mapping->m_size;
+
+  if(memcmp(base, "LUCAM-RECORDER", 14) != 0) {
+    spdlog::error("{} is not a SER file", m_path.c_str());
+    return false;
+  }
+
+  int32_t colorId = loadLittleEndian<int32_t>(base + 18);
+  int32_t littleEndian = loadLittleEndian<int32_t>(base + 22);
+  int32_t width = loadLittleEndian<int32_t>(base + 26);
+  int32_t height = loadLittleEndian<int32_t>(base + 30);
+  int32_t depth = loadLittleEndian<int32_t>(base + 34);
+  int32_t frameCount = loadLittleEndian<int32_t>(base + 38);
+  m_observer = headerString(base + 42, 40);
+  m_instrument = headerString(base + 82, 40);
+  m_telescope = headerString(base + 122, 40);
+
+  if(width <= 0 || height <= 0 || depth < 1 || depth > 16 || frameCount < 0) {
+    spdlog::error("SER file {} has an invalid header", m_path.c_str());
+    return false;
+  }
+
+  switch(colorId) {
+    case MONO:
+    case BAYER_RGGB: case BAYER_GRBG: case BAYER_GBRG: case BAYER_BGGR:
+    case BAYER_CYYM: case BAYER_YCMY: case BAYER_YMCY: case BAYER_MYYC:
+      m_planes = 1;
+      break;
+    case RGB:
+    case BGR:
+      m_planes = 3;
+      break;
+    default:
+      spdlog::error("SER file {} has an unsupported color id {}", m_path.c_str(), colorId);
+      return false;
+  }
+
+  m_colorId = static_cast<ColorId>(colorId);
+  // The specification says 1 means little-endian, capture software
+  // agrees and that is what every current camera writes
+  m_littleEndian = littleEndian != 0;
+  m_width = width;
+  m_height = height;
+  m_pixelDepth = depth;
+  m_bytesPerPixel = depth > 8 ? 2 : 1;
+  m_frameSize = static_cast<size_t>(width) * height * m_planes * m_bytesPerPixel;
+
+  size_t dataEnd = HEADER_SIZE + m_frameSize * frameCount;
+  if(dataEnd > size) {
+    // Captures which were cut short still have their complete frames
+    size_t complete = (size - HEADER_SIZE) / m_frameSize;
+    spdlog::warn("SER file {} is truncated, using {} of {} frames", m_path.c_str(), complete, frameCount);
+    frameCount = complete;
+    dataEnd = HEADER_SIZE + m_frameSize * frameCount;
+  } else if(size >= dataEnd + frameCount * sizeof(int64_t)) {
+    m_timestamps = base + dataEnd;
+  }
+
+  m_imageCount = frameCount;
+  return true;
+}
+
+SerFile::ColorId SerFile::colorId() const {
+  return m_colorId;
+}
+
+int SerFile::pixelDepth() const {
+  return m_pixelDepth;
+}
+
+const std::string& SerFile::observer() const {
+  return m_observer;
+}
+
+const std::string& SerFile::instrument() const {
+  return m_instrument;
+}
+
+const std::string& SerFile::telescope() const {
+  return m_telescope;
+}
+
+const uint8_t *SerFile::rawFrame(int index) const {
+  if(index < 0 || index >= m_imageCount)
+    return nullptr;
+  return m_mapping->m_address + HEADER_SIZE + index * m_frameSize;
+}
+
+bool SerFile::hasTimestamps() const {
+  return m_timestamps;
+}
+
+int64_t SerFile::timestamp(int index) const {
+  if(!m_timestamps || index < 0 || index >= m_imageCount)
+    return 0;
+  return loadLittleEndian<int64_t>(m_timestamps + index * sizeof(int64_t));
+}
+
+double SerFile::unixTime(int64_t timestamp) {
+  return (timestamp - SER_UNIX_EPOCH) / 1e7;
+}
+
+DataParameters SerFile::getImageParameters(int index) {
+  if(index < 0 || index >= m_imageCount)
+    return DataParameters(index);
+
+  long dims[] = { m_width, m_height, m_planes };
+  return DataParameters(index, m_bytesPerPixel == 1 ? DataType::UBYTE : DataType::USHORT, m_planes == 1 ? 2 : 3, dims);
+}
+
+bool SerFile::isDirectView(const DataParameters& params) const {
+  // Frames are handed out without a conversion if they are stored in the
+  // requested type and native byte order
+  if(m_planes != 1)
+    return false;
+  if(m_bytesPerPixel == 1 && params.type() != DataType::UBYTE)
+    return false;
+  if(m_bytesPerPixel == 2 && (params.type() != DataType::USHORT || m_littleEndian != (std::endian::native == std::endian::little)))
+    return false;
+
+  // Rows have to be read in full
+  return params.inc()[0] == 1 && params.inc()[1] == 1 && params.start()[0] == 1 && params.end()[0] == m_width;
+}
+
+std::shared_ptr<uint8_t[]> SerFile::getPixels(const DataParameters& params) {
+  if(!params || params.index() < 0 || params.index() >= m_imageCount || params.dimCount() != (m_planes == 1 ? 2 : 3))
+    return nullptr;
+
+  if(isDirectView(params) && params.start()[1] >= 1 && params.end()[1] <= m_height && params.start()[1] <= params.end()[1]) {
+    // Pointer into the mapping which keeps the whole mapping alive
+    auto ptr = rawFrame(params.index()) + (params.start()[1] - 1) * m_width * m_bytesPerPixel;
+    return std::shared_ptr<uint8_t[]>(m_mapping, const_cast<uint8_t *>(ptr));
+  }
+
+  return ImageProvider::getPixels(params);
+}
+
+bool SerFile::readPixels(const DataParameters& params, void *ptr) {
+  int dimCount = params.dimCount();
+  if(!params || params.index() < 0 || params.index() >= m_imageCount || dimCount != (m_planes == 1 ? 2 : 3))
+    return false;
+
+  const long dims[] = { m_width, m_height, m_planes };
+  long count[3] = { 1, 1, 1 };
+  for(int i = 0; i < dimCount; ++i) {
+    auto start = params.start()[i], end = params.end()[i], inc = params.inc()[i];
+    if(start < 1 || end > dims[i] || start > end || inc < 1)
+      return false;
+    count[i] = (end - start + 1) / inc;
+  }
+
+  // Color planes are interleaved in the file
+  const size_t pixelStep = m_planes * m_bytesPerPixel;
+  const size_t rowStep = m_width * pixelStep;
+  const bool swap = m_littleEndian != (std::endian::native == std::endian::little);
+  const uint8_t *frame = rawFrame(params.index());
+
+  auto convert = [&]<typename Src>(std::type_identity<Src>) {
+    return dispatchDataType(params.type(), [&]<typename Dst>(std::type_identity<Dst>) {
+      Dst *dst = static_cast<Dst *>(ptr);
+      for(long layer = 0; layer < count[2]; ++layer) {
+        long plane = dimCount == 3 ? params.start()[2] - 1 + layer * params.inc()[2] : 0;
+        // Planes are served in RGB order
+        if(m_colorId == BGR)
+          plane = 2 - plane;
+
+        for(long row = 0; row < count[1]; ++row) {
+          long y = params.start()[1] - 1 + row * params.inc()[1];
+          const uint8_t *src = frame + y * rowStep + (params.start()[0] - 1) * pixelStep + plane * m_bytesPerPixel;
+          convertRow<Src, Dst>(src, dst, count[0], params.inc()[0] * pixelStep, swap);
+          dst += count[0];
+        }
+      }
+    });
+  };
+
+  if(m_bytesPerPixel == 1)
+    return convert(std::type_identity<uint8_t>{});
+  return convert(std::type_identity<uint16_t>{});
+}
+
+double SerFile::maxTypeValue() {
+  // Values use the low bits of the stored pixels
+  return (1 << m_pixelDepth) - 1;
+}
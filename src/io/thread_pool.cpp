@@ -0,0 +1,75 @@
+#include "io/thread_pool.hpp"
+
+using namespace IO;
+
+ThreadPool::ThreadPool(size_t threadCount)
+  : m_running(0)
+  , m_stop(false) {
+  if(threadCount == 0)
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+  for(size_t i = 0; i < threadCount; ++i)
+    m_threads.emplace_back(&ThreadPool::worker, this);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard lock(m_mutex);
+    m_stop = true;
+    m_jobs.clear();
+  }
+  m_jobAdded.notify_all();
+
+  for(auto& thread : m_threads)
+    thread.join();
+}
+
+size_t ThreadPool::threadCount() const {
+  return m_threads.size();
+}
+
+void ThreadPool::submit(std::function<void()>&& job) {
+  {
+    std::lock_guard lock(m_mutex);
+    m_jobs.push_back(std::move(job));
+  }
+  m_jobAdded.notify_one();
+}
+
+void ThreadPool::post(std::function<void()>&& job) {
+  submit(std::move(job));
+}
+
+void ThreadPool::clear() {
+  std::lock_guard lock(m_mutex);
+  m_jobs.clear();
+  if(m_running == 0)
+    m_idle.notify_all();
+}
+
+void ThreadPool::wait() {
+  std::unique_lock lock(m_mutex);
+  m_idle.wait(lock, [this]() { return m_jobs.empty() && m_running == 0; });
+}
+
+void ThreadPool::worker() {
+  std::unique_lock lock(m_mutex);
+  while(true) {
+    m_jobAdded.wait(lock, [this]() { return m_stop || !m_jobs.empty(); });
+    if(m_stop)
+      return;
+
+    auto job = std::move(m_jobs.front());
+    m_jobs.pop_front();
+    ++m_running;
+
+    lock.unlock();
+    job();
+    lock.lock();
+
+    --m_running;
+    if(m_jobs.empty() && m_running == 0)
+      m_idle.notify_all();
+  }
+}
+
@@ -0,0 +1,131 @@
+#include "io/tiled.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+using namespace IO;
+
+TiledImageProvider::TiledImageProvider(ImageProvider *provider, long tileSize)
+  : m_provider(provider)
+  , m_tileSize(tileSize) {
+  m_imageCount = m_provider->imageCount();
+}
+
+TiledImageProvider::~TiledImageProvider() {
+  delete m_provider;
+}
+
+long TiledImageProvider::tileSize() const {
+  return m_tileSize;
+}
+
+bool TiledImageProvider::isTiled(const DataParameters& params, const DataParameters& image) const {
+  if(!params || !image || params.dimCount() != image.dimCount())
+    return false;
+  if(params.dimCount() < 2 || params.dimCount() > 3)
+    return false;
+  if(params.inc()[0] != 1 || params.inc()[1] != 1)
+    return false;
+
+  // Whole layers are cheaper to read in one go
+  return params.start()[0] != 1 || params.end()[0] != image.end()[0]
+      || params.start()[1] != 1 || params.end()[1] != image.end()[1];
+}
+
+DataParameters TiledImageProvider::tileParameters(const DataParameters& image, long tileX, long tileY, long layer) const {
+  DataParameters tile(image);
+  long x = tileX * m_tileSize + 1;
+  long y = tileY * m_tileSize + 1;
+  tile.setDimension(0, x, std::min(x + m_tileSize - 1, image.end()[0]), 1);
+  tile.setDimension(1, y, std::min(y + m_tileSize - 1, image.end()[1]), 1);
+  tile.setDimension(2, layer, layer, 1);
+  return tile;
+}
+
+std::shared_ptr<uint8_t[]> TiledImageProvider::getPixels(const DataParameters& params) {
+  if(!isTiled(params, m_provider->getImageParameters(params.index())))
+    return m_provider->getPixels(params);
+
+  // Assembled into a new buffer by readPixels
+  return ImageProvider::getPixels(params);
+}
+
+bool TiledImageProvider::readPixels(const DataParameters& params, void *ptr) {
+  auto image = m_provider->getImageParameters(params.index());
+  if(!isTiled(params, image))
+    return m_provider->readPixels(params, ptr);
+
+  if(params.end()[0] > image.end()[0] || params.end()[1] > image.end()[1]) {
+    spdlog::error("Region is outside of image {}", params.index());
+    return false;
+  }
+
+  // Tiles are read in the requested type, so they can be copied as they are
+  image = image.withType(params.type());
+  const size_t pixelSize = DataType::dataSize(params.type());
+  const long startX = params.start()[0], endX = params.end()[0];
+  const long startY = params.start()[1], endY = params.end()[1];
+  const long width = params.width();
+  const long height = params.height();
+
+  long layerStart = 1, layerInc = 1, layerCount = 1;
+  if(params.dimCount() == 3) {
+    layerStart = params.start()[2];
+    layerInc = params.inc()[2];
+    layerCount = params.layerCount();
+  }
+
+  std::vector<DataParameters> tiles;
+  std::vector<long> tileLayers;
+  for(long layer = 0; layer < layerCount; ++layer) {
+    for(long tileY = (startY - 1) / m_tileSize; tileY <= (endY - 1) / m_tileSize; ++tileY) {
+      for(long tileX = (startX - 1) / m_tileSize; tileX <= (endX - 1) / m_tileSize; ++tileX) {
+        tiles.push_back(tileParameters(image, tileX, tileY, layerStart + layer * layerInc));
+        tileLayers.push_back(layer);
+      }
+    }
+  }
+
+  // All tiles are read as one access, so a provider reading ahead schedules
+  // the region once instead of once per tile
+  auto tileData = m_provider->getParts(tiles);
+
+  uint8_t *dst = (uint8_t*)ptr;
+  for(size_t i = 0; i < tiles.size(); ++i) {
+    auto& tile = tiles[i];
+    auto& data = tileData[i];
+    if(!data)
+      return false;
+    uint8_t *layerDst = dst + tileLayers[i] * width * height * pixelSize;
+
+    // Part of the tile which is inside of the region
+    const long tileStartX = tile.start()[0], tileStartY = tile.start()[1];
+    const long tileWidth = tile.width();
+    const long x0 = std::max(startX, tileStartX), x1 = std::min(endX, tile.end()[0]);
+    const long y0 = std::max(startY, tileStartY), y1 = std::min(endY, tile.end()[1]);
+
+    for(long y = y0; y <= y1; ++y) {
+      memcpy(layerDst + ((y - startY) * width + (x0 - startX)) * pixelSize,
+             data.get() + ((y - tileStartY) * tileWidth + (x0 - tileStartX)) * pixelSize,
+             (x1 - x0 + 1) * pixelSize);
+    }
+  }
+
+  return true;
+}
+
+void TiledImageProvider::setAccessOrder(const std::vector<int>& indices) {
+  m_provider->setAccessOrder(indices);
+}
+
+DataParameters TiledImageProvider::getImageParameters(int index) {
+  return m_provider->getImageParameters(index);
+}
+
+double TiledImageProvider::maxTypeValue() {
+  return m_provider->maxTypeValue();
+}
+
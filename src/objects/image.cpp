@@ -7,27 +7,181 @@
 using namespace Obj;
 using namespace IO;
 
-Image::Image(int seqIndex, int layerCount, const Glib::RefPtr<IO::Sequence>& sequence)
+static void statsFromLine(const SequenceFile::StatsLine& line, Stats& stats) {
+  stats.setTotalPixels(line.m_totalPixels);
+  stats.setGoodPixels(line.m_goodPixels);
+  stats.setMean(line.m_mean);
+  stats.setMedian(line.m_median);
+  stats.setSigma(line.m_sigma);
+  stats.setAvgDev(line.m_avgDev);
+  stats.setMad(line.m_mad);
+  stats.setSqrtBWMV(line.m_sqrtBWMV);
+  stats.setLocation(line.m_location);
+  stats.setScale(line.m_scale);
+  stats.setMin(line.m_min);
+  stats.setMax(line.m_max);
+  stats.setNormValue(line.m_normValue);
+  stats.setBgNoise(line.m_bgNoise);
+}
+
+static SequenceFile::StatsLine lineFromStats(const Stats& stats) {
+  return {
+    .m_totalPixels = stats.getTotalPixels(),
+    .m_goodPixels = stats.getGoodPixels(),
+    .m_mean = stats.getMean(),
+    .m_median = stats.getMedian(),
+    .m_sigma = stats.getSigma(),
+    .m_avgDev = stats.getAvgDev(),
+    .m_mad = stats.getMad(),
+    .m_sqrtBWMV = stats.getSqrtBWMV(),
+    .m_location = stats.getLocation(),
+    .m_scale = stats.getScale(),
+    .m_min = stats.getMin(),
+    .m_max = stats.getMax(),
+    .m_normValue = stats.getNormValue(),
+    .m_bgNoise = stats.getBgNoise(),
+  };
+}
+
+Image::Image(int seqIndex, const Glib::RefPtr<IO::Sequence>& sequence)
   : ObjectBase("ImageObject")
   , m_sequenceIndex(*this, "sequence-index", seqIndex)
   , m_fileIndex(*this, "file-index")
   , m_included(*this, "included")
   , m_width(*this, "width")
   , m_height(*this, "height")
-  , m_stats(layerCount)
+  , m_stats(sequence->store().layerCount())
   , m_sequence(sequence)
-  , m_connStats(layerCount)
+  , m_loading(false)
+  , m_connStats(sequence->store().layerCount())
   , m_xOffset(*this, "x-offset")
   , m_yOffset(*this, "y-offset") {
   m_notified = false;
 
-  auto slot = sigc::mem_fun(*this, &Image::notifyRedraw);
+  auto slot = sigc::mem_fun(*this, &Image::valuesModified);
   m_fileIndex.get_proxy().signal_changed().connect(slot);
   m_included.get_proxy().signal_changed().connect(slot);
+  m_width.get_proxy().signal_changed().connect(sigc::mem_fun(*this, &Image::writeValues));
+  m_height.get_proxy().signal_changed().connect(sigc::mem_fun(*this, &Image::writeValues));
+
+  load();
+  m_notified = false;
+}
+
+Image::~Image() {
+  m_sequence->forgetImage(m_sequenceIndex.get_value(), this);
+}
+
+Glib::RefPtr<Image> Image::create(int seqIndex, const Glib::RefPtr<IO::Sequence>& sequence) {
+  return Glib::make_refptr_for_instance(new Image(seqIndex, sequence));
+}
+
+void Image::load() {
+  auto& store = m_sequence->store();
+  int row = m_sequenceIndex.get_value();
+
+  // Loading only reports a single change
+  IO::Sequence::UpdateScope update(*m_sequence);
+  m_loading = true;
+  m_fileIndex.set_value(store.fileIndex(row));
+  m_included.set_value(store.included(row));
+  m_width.set_value(store.width(row));
+  m_height.set_value(store.height(row));
+
+  if(store.hasRegistration(row)) {
+    if(!m_registration)
+      setRegistration(Registration::create());
+
+    auto values = store.registration(row);
+    m_registration->beginUpdate();
+    m_registration->setFWHM(values.m_FWHM);
+    m_registration->setWeightedFWHM(values.m_weightedFWHM);
+    m_registration->setRoundness(values.m_roundness);
+    m_registration->setQuality(values.m_quality);
+    m_registration->setBackgroundLevel(values.m_backgroundLevel);
+    m_registration->setNumberOfStars(values.m_numberOfStars);
+    m_registration->matrix().write(store.matrix(row));
+    m_registration->endUpdate();
+  } else if(m_registration) {
+    setRegistration(nullptr);
+  }
+
+  for(int l = 0; l < m_stats.size(); ++l) {
+    auto line = store.stats(row, l);
+    if(line) {
+      if(!m_stats[l])
+        setStats(l, Stats::create());
+      m_stats[l]->beginUpdate();
+      statsFromLine(*line, *m_stats[l]);
+      m_stats[l]->endUpdate();
+    } else if(m_stats[l]) {
+      setStats(l, nullptr);
+    }
+  }
+  m_loading = false;
+}
+
+void Image::valuesModified() {
+  writeValues();
+  notifyRedraw();
 }
 
-Glib::RefPtr<Image> Image::create(int seqIndex, int layerCount, const Glib::RefPtr<IO::Sequence>& sequence) {
-  return Glib::make_refptr_for_instance(new Image(seqIndex, layerCount, sequence));
+void Image::registrationModified() {
+  writeRegistration();
+  notifyRedraw();
+}
+
+void Image::statsModified(int layer) {
+  writeStats(layer);
+  notifyRedraw();
+}
+
+void Image::writeValues() {
+  if(m_loading)
+    return;
+
+  auto& store = m_sequence->store();
+  int row = m_sequenceIndex.get_value();
+  store.setFileIndex(row, m_fileIndex.get_value());
+  store.setIncluded(row, m_included.get_value());
+  store.setWidth(row, m_width.get_value());
+  store.setHeight(row, m_height.get_value());
+}
+
+void Image::writeRegistration() {
+  if(m_loading)
+    return;
+
+  auto& store = m_sequence->store();
+  int row = m_sequenceIndex.get_value();
+  if(!m_registration) {
+    store.clearRegistration(row);
+    return;
+  }
+
+  store.setRegistration(row, {
+    .m_FWHM = m_registration->getFWHM(),
+    .m_weightedFWHM = m_registration->getWeightedFWHM(),
+    .m_roundness = m_registration->getRoundness(),
+    .m_quality = m_registration->getQuality(),
+    .m_backgroundLevel = m_registration->getBackgroundLevel(),
+    .m_numberOfStars = m_registration->getNumberOfStars(),
+  });
+  double matrix[9];
+  m_registration->matrix().read(matrix);
+  store.setMatrix(row, matrix);
+}
+
+void Image::writeStats(int layer) {
+  if(m_loading)
+    return;
+
+  auto& store = m_sequence->store();
+  int row = m_sequenceIndex.get_value();
+  if(m_stats[layer])
+    store.setStats(row, layer, lineFromStats(*m_stats[layer]));
+  else
+    store.clearStats(row, layer);
 }
 
 void Image::setRegistration(const Glib::RefPtr<Registration>& value) {
@@ -46,11 +200,12 @@ void Image::setRegistration(const Glib::RefPtr<Registration>& value) {
   }
 
   if(value) {
-    m_connRegistration = value->signalModified().connect(sigc::mem_fun(*this, &Image::notifyRedraw));
+    m_connRegistration = value->signalModified().connect(sigc::mem_fun(*this, &Image::registrationModified));
     m_xBind = Glib::Binding::bind_property(value->matrix().property(2), m_xOffset.get_proxy(), Glib::Binding::Flags::SYNC_CREATE | Glib::Binding::Flags::BIDIRECTIONAL);
     m_yBind = Glib::Binding::bind_property(value->matrix().property(5), m_yOffset.get_proxy(), Glib::Binding::Flags::SYNC_CREATE | Glib::Binding::Flags::BIDIRECTIONAL);
   }
 
+  writeRegistration();
   notifyRedraw();
 }
 
@@ -60,9 +215,10 @@ void Image::setStats(int layer, const Glib::RefPtr<Stats>& value) {
   if(!m_connStats[layer].empty())
     m_connStats[layer].disconnect();
   if(value) {
-    m_connStats[layer] = value->signalModified().connect(sigc::mem_fun(*this, &Image::notifyRedraw));
+    m_connStats[layer] = value->signalModified().connect(sigc::bind(sigc::mem_fun(*this, &Image::statsModified), layer));
   }
 
+  writeStats(layer);
   notifyRedraw();
 }
 
@@ -75,38 +231,8 @@ Glib::RefPtr<Stats> Image::getStats(int layer) {
 }
 
 void Image::calculateStats(ImageProvider& provider) {
-  auto params = provider.getImageParameters(m_fileIndex.get_value());
-  bool changed = false;
-
-  for(int i = 0; i < m_stats.size(); ++i) {
-    if(m_stats[i])
-      continue;
-
-    auto stats = Stats::create();
-    stats->setTotalPixels(params.width() * params.height());
-    stats->setGoodPixels(-1);
-    stats->setMean(-999999);
-    stats->setMedian(-999999);
-    stats->setSigma(-999999);
-    stats->setAvgDev(-999999);
-    stats->setMad(-999999);
-    stats->setSqrtBWMV(-999999);
-    stats->setLocation(-999999);
-    stats->setScale(-999999);
-    stats->setNormValue(provider.maxTypeValue());
-    stats->setBgNoise(-999999);
-    
-    // TODO: Calculate these
-    stats->setMin(0);
-    stats->setMax(provider.maxTypeValue());
-    
-    m_stats[i] = stats;
-    m_connStats[i] = stats->signalModified().connect(sigc::mem_fun(*this, &Image::notifyRedraw));
-    changed = true;
-  }
-
-  if(changed)
-    notifyRedraw();
+  // Reloads this image when something was added
+  m_sequence->calculateStats(m_sequenceIndex.get_value(), provider);
 }
 
 Glib::PropertyProxy_ReadOnly<int> Image::propertySequenceIndex() {
@@ -170,7 +296,7 @@ Image::redraw_signal_type Image::signalRedraw() {
 }
 
 bool Image::isReference() {
-  return m_sequence.lock()->getReferenceImageIndex() == m_sequenceIndex.get_value();
+  return m_sequence->getReferenceImageIndex() == m_sequenceIndex.get_value();
 }
 
 void Image::notifyRedraw() {
@@ -179,8 +305,11 @@ void Image::notifyRedraw() {
     m_notified = true;
   }
 
+  m_sequence->notifyImageChanged(m_sequenceIndex.get_value());
+
   // Any change to a sequence's object marks it as dirty.
-  m_sequence.lock()->markDirty();
+  if(!m_loading)
+    m_sequence->imageEdited(m_sequenceIndex.get_value());
 }
 
 bool Image::isMarked() {
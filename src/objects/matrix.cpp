@@ -14,7 +14,9 @@ HomographyMatrix::HomographyMatrix()
   , m_h12(*this, "h12", 0)
   , m_h20(*this, "h20", 0)
   , m_h21(*this, "h21", 0)
-  , m_h22(*this, "h22", 0) {
+  , m_h22(*this, "h22", 0)
+  , m_updateDepth(0)
+  , m_modifiedPending(false) {
   m_accessArray[0] = &m_h00;
   m_accessArray[1] = &m_h01;
   m_accessArray[2] = &m_h02;
@@ -24,14 +26,48 @@ HomographyMatrix::HomographyMatrix()
   m_accessArray[6] = &m_h20;
   m_accessArray[7] = &m_h21;
   m_accessArray[8] = &m_h22;
+
+  for(int i = 0; i < 9; ++i)
+    m_accessArray[i]->get_proxy().signal_changed().connect(sigc::mem_fun(*this, &HomographyMatrix::emitModified));
+}
+
+HomographyMatrix::modified_signal_type HomographyMatrix::signalModified() {
+  return m_signalModified;
+}
+
+void HomographyMatrix::emitModified() {
+  if(m_updateDepth > 0) {
+    m_modifiedPending = true;
+    return;
+  }
+  m_signalModified.emit();
+}
+
+void HomographyMatrix::beginUpdate() {
+  // Property notifications are held back as well, so bindings only see
+  // the final values
+  if(m_updateDepth++ == 0)
+    freeze_notify();
+}
+
+void HomographyMatrix::endUpdate() {
+  if(m_updateDepth == 1)
+    thaw_notify();
+  if(--m_updateDepth > 0 || !m_modifiedPending)
+    return;
+
+  m_modifiedPending = false;
+  m_signalModified.emit();
 }
 
 void HomographyMatrix::reset() {
+  beginUpdate();
   for(int i = 0; i < 9; ++i)
     set(i, 0);
   set(0, 1);
   set(4, 1);
   set(8, 1);
+  endUpdate();
 }
 
 cv::Mat HomographyMatrix::read() const {
@@ -48,8 +84,10 @@ void HomographyMatrix::write(const cv::Mat& matrix) {
     return;
   }
     
+  beginUpdate();
   for(int i = 0; i < 9; ++i)
     set(i, matrix.at<double>(i));
+  endUpdate();
 }
 
 Glib::PropertyProxy<double> HomographyMatrix::property(int i) {
@@ -9,7 +9,9 @@ Registration::Registration()
   , m_roundness(*this, "roundness")
   , m_quality(*this, "quality")
   , m_backgroundLevel(*this, "background-level")
-  , m_numberOfStars(*this, "number-of-stars") {
+  , m_numberOfStars(*this, "number-of-stars")
+  , m_updateDepth(0)
+  , m_modifiedPending(false) {
   auto slot = sigc::mem_fun(*this, &Registration::emitModified);
   m_FWHM.get_proxy().signal_changed().connect(slot);
   m_weightedFWHM.get_proxy().signal_changed().connect(slot);
@@ -18,12 +20,10 @@ Registration::Registration()
   m_backgroundLevel.get_proxy().signal_changed().connect(slot);
   m_numberOfStars.get_proxy().signal_changed().connect(slot);
 
-  for(int i = 0; i < 9; ++i)
-    m_matrix.property(i).signal_changed().connect(slot);
+  // A whole matrix write is a single change
+  m_matrix.signalModified().connect(slot);
 
-  m_matrix.set(0, 1);
-  m_matrix.set(4, 1);
-  m_matrix.set(8, 1);
+  m_matrix.reset();
 }
 
 Glib::RefPtr<Registration> Registration::create() {
@@ -35,6 +35,27 @@ Registration::modified_signal_type Registration::signalModified() {
 }
 
 void Registration::emitModified() {
+  if(m_updateDepth > 0) {
+    m_modifiedPending = true;
+    return;
+  }
+  m_signalModified.emit();
+}
+
+void Registration::beginUpdate() {
+  if(m_updateDepth++ == 0)
+    freeze_notify();
+  m_matrix.beginUpdate();
+}
+
+void Registration::endUpdate() {
+  m_matrix.endUpdate();
+  if(m_updateDepth == 1)
+    thaw_notify();
+  if(--m_updateDepth > 0 || !m_modifiedPending)
+    return;
+
+  m_modifiedPending = false;
   m_signalModified.emit();
 }
 
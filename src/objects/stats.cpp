@@ -18,7 +18,9 @@ Stats::Stats()
   , m_min(*this, "min")
   , m_max(*this, "max")
   , m_normValue(*this, "normalization-value")
-  , m_bgNoise(*this, "background-noise") {
+  , m_bgNoise(*this, "background-noise")
+  , m_updateDepth(0)
+  , m_modifiedPending(false) {
   auto slot = sigc::mem_fun(*this, &Stats::emitModified);
   m_totalPixels.get_proxy().signal_changed().connect(slot);
   m_goodPixels.get_proxy().signal_changed().connect(slot);
@@ -45,6 +47,25 @@ Stats::modified_signal_type Stats::signalModified() {
 }
 
 void Stats::emitModified() {
+  if(m_updateDepth > 0) {
+    m_modifiedPending = true;
+    return;
+  }
+  m_signalModified.emit();
+}
+
+void Stats::beginUpdate() {
+  if(m_updateDepth++ == 0)
+    freeze_notify();
+}
+
+void Stats::endUpdate() {
+  if(m_updateDepth == 1)
+    thaw_notify();
+  if(--m_updateDepth > 0 || !m_modifiedPending)
+    return;
+
+  m_modifiedPending = false;
   m_signalModified.emit();
 }
 
@@ -45,7 +45,7 @@ void App::openFile(const Glib::VariantBase& variant) {
 void App::saveFile(const Glib::VariantBase& variant) {
   if(m_state) {
     m_state->saveSequence();
-    spdlog::info("Sequence saved under the same name");
+    spdlog::info("Saving sequence under the same name");
   }
 }
 
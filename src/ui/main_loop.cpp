@@ -0,0 +1,21 @@
+#include "ui/main_loop.hpp"
+
+#include <glib.h>
+
+using namespace UI;
+
+void MainLoopExecutor::post(std::function<void()>&& job) {
+  // g_idle_add can be called from any thread, unlike the glibmm wrappers
+  auto ptr = new std::function<void()>(std::move(job));
+  g_idle_add_full(G_PRIORITY_DEFAULT, [](gpointer data) -> gboolean {
+    (*static_cast<std::function<void()>*>(data))();
+    return G_SOURCE_REMOVE;
+  }, ptr, [](gpointer data) {
+    delete static_cast<std::function<void()>*>(data);
+  });
+}
+
+MainLoopExecutor& UI::mainLoop() {
+  static MainLoopExecutor executor;
+  return executor;
+}
@@ -1,5 +1,6 @@
 #include "ui/pages/cv.hpp"
 #include "glibmm/refptr.h"
+#include "io/buffer_pool.hpp"
 #include "ui/state.hpp"
 #include "ui/widgets/util.hpp"
 #include "ui/window.hpp"
@@ -9,6 +10,25 @@
 
 using namespace UI::Pages;
 
+// Lets the provider read ahead in processing order while a batch runs,
+// stepping through the sequence afterwards uses its own order again
+class BatchAccessOrder {
+  UI::State& m_state;
+
+public:
+  BatchAccessOrder(UI::State& state, const std::list<Glib::RefPtr<Obj::Image>>& images)
+    : m_state(state) {
+    std::vector<int> order;
+    for(auto& img : images)
+      order.push_back(img->getFileIndex());
+    m_state.m_imageFile->setAccessOrder(order);
+  }
+
+  ~BatchAccessOrder() {
+    m_state.m_imageFile->setAccessOrder(m_state.m_accessOrder);
+  }
+};
+
 CV::CV(const Glib::RefPtr<Gtk::Builder>& builder, Window& window)
   : Page("cv")
   , m_keypointModel(Gio::ListStore<KeypointObject>::create())
@@ -144,20 +164,21 @@ void CV::dropContext() {
 
 std::list<Glib::RefPtr<Obj::Image>> CV::getImageList() {
   std::list<Glib::RefPtr<Obj::Image>> processImages;
+  // Only the images that get processed need image objects
+  auto& store = m_state->m_sequence->store();
+  uint reference = m_state->m_sequence->getReferenceImageIndex();
   if(m_onlySelected->get_active()) {
     for(uint i = 0; i < m_state->m_sequence->getImageCount(); ++i) {
-      auto img = m_state->m_sequence->image(i);
-      if(!img->getIncluded() || img->isReference())
+      if(!store.included(i) || i == reference)
         continue;
-      processImages.push_back(img);
+      processImages.push_back(m_state->m_sequence->image(i));
     }
   } else {
     // All images get processed
     for(uint i = 0; i < m_state->m_sequence->getImageCount(); ++i) {
-      auto img = m_state->m_sequence->image(i);
-      if(img->isReference())
+      if(i == reference)
         continue;
-      processImages.push_back(img);
+      processImages.push_back(m_state->m_sequence->image(i));
     }
   }
 
@@ -168,7 +189,7 @@ void CV::findKeypoints(const Glib::VariantBase& variant) {
   if(!m_state)
     return;
   if(!m_cvContext) {
-    m_cvContext = createCVContext(m_state->m_imageFile);
+    m_cvContext = createCVContext(*m_state->m_imageFile);
     spdlog::debug("Created new OpenCV context");
   }
 
@@ -180,14 +201,19 @@ void CV::findKeypoints(const Glib::VariantBase& variant) {
   // Process other images
   std::list<Glib::RefPtr<Obj::Image>> processImages = getImageList();
   spdlog::info("Finding keypoints in {} images", processImages.size());
-  for(auto& img : processImages) {
-    m_cvContext->findKeypoints(img);
+  BatchAccessOrder order(*m_state, processImages);
+  {
+    IO::Sequence::UpdateScope update(*m_state->m_sequence);
+    m_cvContext->findKeypoints(processImages);
   }
 
   // TODO: Add a suggestion if reference image has less keypoints than any 
   // image processed. An image with more keypoints will work better for alignment.
 
   spdlog::info("Finished keypoint detection!");
+
+  auto stats = IO::BufferPool::global().statistics();
+  spdlog::debug("Pixel buffers: {} allocated, {} reused ({:.0f}%), {} idle", stats.m_allocations, stats.m_reuses, stats.reuseRate() * 100, stats.m_idleBuffers);
   selectionChanged(0, 0);
 }
 
@@ -199,8 +225,12 @@ void CV::matchFeatures(const Glib::VariantBase& variant) {
 
   std::list<Glib::RefPtr<Obj::Image>> processImages = getImageList();
   spdlog::info("Matching features in {} images", processImages.size());
-  for(auto& img : processImages) {
-    m_cvContext->matchFeatures(img);
+  BatchAccessOrder order(*m_state, processImages);
+  {
+    IO::Sequence::UpdateScope update(*m_state->m_sequence);
+    for(auto& img : processImages) {
+      m_cvContext->matchFeatures(img);
+    }
   }
 
   spdlog::info("Finished feature matching!");
@@ -231,8 +261,13 @@ void CV::alignFeatures(const Glib::VariantBase& variant) {
 
   std::list<Glib::RefPtr<Obj::Image>> processImages = getImageList();
   spdlog::info("Aligning features in {} images", processImages.size());
-  for(auto& img : processImages) {
-    m_cvContext->alignFeatures(img);
+  BatchAccessOrder order(*m_state, processImages);
+  {
+    // Views are updated once all matrices are written
+    IO::Sequence::UpdateScope update(*m_state->m_sequence);
+    for(auto& img : processImages) {
+      m_cvContext->alignFeatures(img);
+    }
   }
 
   spdlog::info("Finished feature alignment!");
@@ -1,5 +1,13 @@
 #include "ui/state.hpp"
+#include "io/fits_pool.hpp"
+#include "io/mapped_fits.hpp"
+#include "io/multi_fits.hpp"
+#include "io/prefetch.hpp"
+#include "io/ser.hpp"
+#include "io/tiled.hpp"
+#include "ui/main_loop.hpp"
 
+#include <cstdlib>
 #include <memory>
 #include <utility>
 #include <fstream>
@@ -8,33 +16,216 @@
 using namespace UI;
 using namespace IO;
 
-State::State(const std::filesystem::path& sequenceFilePath, const std::shared_ptr<Sequence>& sequence, Fits&& image)
+State::State(const std::filesystem::path& sequenceFilePath, const std::shared_ptr<Sequence>& sequence, std::unique_ptr<ImageProvider>&& image)
   : m_sequenceFilePath(sequenceFilePath)
+  , m_writer(sequenceFilePath)
+  , m_saveThread(1)
+  , m_pendingSaves(0)
   , m_sequence(sequence)
-  , m_imageFile(std::move(image)) {
+  , m_imageFile(std::make_unique<PyramidProvider>(image.release(), cacheBudget() / 4))
+  , m_multiFits(nullptr) {
+}
+
+State::~State() {
+  // Queued saves would be dropped with the thread
+  waitForSave();
+}
+
+size_t State::cacheBudget() {
+  // Budget can be changed through the environment, value is in megabytes
+  const char *env = std::getenv("IMAGE_ALIGNER_CACHE_MB");
+  if(env) {
+    char *end;
+    unsigned long long value = std::strtoull(env, &end, 10);
+    if(end != env && *end == 0)
+      return value * 1024 * 1024;
+    spdlog::warn("Invalid IMAGE_ALIGNER_CACHE_MB value '{}', using the default", env);
+  }
+  return DEFAULT_CACHE_BUDGET;
 }
 
 std::shared_ptr<State> State::fromSequenceFile(const std::filesystem::path& sequence_path) {
+  // Finish a save which was interrupted
+  SequenceWriter::recover(sequence_path);
+
   auto sequence = Sequence::readSequence(sequence_path);
   if(!sequence)
     return nullptr;
 
+  // Edits which weren't saved before the program died
+  sequence->replayJournal(sequence_path);
+  sequence->setJournal(std::make_unique<EditJournal>(sequence_path, sequence->store().size()));
+
+  if(sequence->getSequenceType() == SequenceType::MULTI_FITS)
+    return fromMultiFits(sequence_path, sequence);
+  if(sequence->getSequenceType() == SequenceType::SER)
+    return fromSer(sequence_path, sequence);
+
   std::filesystem::path fits_path(sequence_path);
   fits_path.replace_extension("fit");
-  Fits fits(fits_path.string());
+  std::unique_ptr<ImageProvider> fits;
+  HeaderTable::Lookup lookup;
+  if(sequence->getSequenceType() == SequenceType::SINGLE_FITS && !sequence->getFzFlag()) {
+    // Uncompressed cubes are served straight from a memory mapping, which
+    // pages in the following images ahead of the reads
+    auto mapped = new MappedFits(fits_path);
+    fits.reset(mapped);
+    if(fits->imageCount() < 0) {
+      spdlog::warn("Falling back to cfitsio for {}", fits_path.c_str());
+      fits = nullptr;
+    } else {
+      lookup = [mapped](int index) -> const HduInfo* {
+        auto& hdus = mapped->index();
+        return index >= 0 && index < (int)hdus.size() ? &hdus[index] : nullptr;
+      };
+    }
+  }
+  if(!fits) {
+    // Region reads are split into tiles which get cached on their own
+    auto pool = new FitsPool(fits_path);
+    auto cache = new CachedImageProvider(pool, cacheBudget());
+    fits.reset(new TiledImageProvider(new PrefetchingProvider(cache)));
+    lookup = [hdus = pool->index()](int index) -> const HduInfo* {
+      return hdus && index >= 0 && index < (int)hdus->size() ? &(*hdus)[index] : nullptr;
+    };
+  }
+
+  auto state = std::make_shared<State>(sequence_path, sequence, std::move(fits));
+  state->m_imagePath = fits_path;
+
+  std::filesystem::path preview_path(sequence_path);
+  preview_path.replace_extension("preview");
+  state->m_previews = std::make_unique<PreviewCache>(preview_path);
 
-  return std::make_shared<State>(sequence_path, sequence, std::move(fits));
+  std::vector<int> indices;
+  for(int i = 0; i < sequence->getImageCount(); ++i)
+    indices.push_back(i);
+  state->loadHeaders(indices, lookup, { fits_path });
+
+  return state;
 }
 
-void State::saveSequence() {
-  std::ofstream stream(m_sequenceFilePath, std::ios::out | std::ios::trunc);
-  if(!stream.is_open()) {
-    spdlog::error("Failed to open stream for sequence save");
-    return;
+std::shared_ptr<State> State::fromMultiFits(const std::filesystem::path& sequence_path, const std::shared_ptr<Sequence>& sequence) {
+  std::vector<int> fileIndices;
+  for(int i = 0; i < sequence->getImageCount(); ++i)
+    fileIndices.push_back(sequence->store().fileIndex(i));
+
+  auto files = new MultiFits(sequence_path.parent_path(), sequence->getSequenceName(), fileIndices,
+                             sequence->getFileIndexFixedLength(), sequence->getFzFlag());
+  if(files->imageCount() < 0) {
+    delete files;
+    return nullptr;
+  }
+
+  auto cache = new CachedImageProvider(files, cacheBudget());
+  std::unique_ptr<ImageProvider> provider(new TiledImageProvider(new PrefetchingProvider(cache)));
+
+  auto state = std::make_shared<State>(sequence_path, sequence, std::move(provider));
+  state->m_multiFits = files;
+  // File indices can have gaps and don't start at 0, read ahead along them
+  state->m_accessOrder = fileIndices;
+  state->m_imageFile->setAccessOrder(state->m_accessOrder);
+
+  std::filesystem::path preview_path(sequence_path);
+  preview_path.replace_extension("preview");
+  state->m_previews = std::make_unique<PreviewCache>(preview_path);
+
+  std::vector<std::filesystem::path> sources;
+  for(int fileIndex : fileIndices) {
+    auto path = files->path(fileIndex);
+    if(!path.empty())
+      sources.push_back(path);
   }
-  m_sequence->prepareWrite(m_imageFile);
-  m_sequence->writeStream(stream);
+  state->loadHeaders(fileIndices, [files](int fileIndex) { return files->info(fileIndex); }, sources);
+
+  return state;
+}
 
+std::shared_ptr<State> State::fromSer(const std::filesystem::path& sequence_path, const std::shared_ptr<Sequence>& sequence) {
+  std::filesystem::path ser_path(sequence_path);
+  ser_path.replace_extension("ser");
+  // Frames are served straight from the mapping, like uncompressed FITS
+  std::unique_ptr<ImageProvider> ser(new SerFile(ser_path));
+  if(ser->imageCount() < 0)
+    return nullptr;
+
+  auto state = std::make_shared<State>(sequence_path, sequence, std::move(ser));
+  state->m_imagePath = ser_path;
+
+  std::filesystem::path preview_path(sequence_path);
+  preview_path.replace_extension("preview");
+  state->m_previews = std::make_unique<PreviewCache>(preview_path);
+
+  return state;
+}
+
+void State::loadHeaders(const std::vector<int>& indices, const HeaderTable::Lookup& lookup,
+                        const std::vector<std::filesystem::path>& sources) {
+  std::filesystem::path path(m_sequenceFilePath);
+  path.replace_extension("headers");
+  m_headers = HeaderTable::load(path);
+  if(m_headers && m_headers->indices() == indices)
+    return;
+
+  m_headers = HeaderTable::build(indices, lookup, sources);
+  m_headers->save(path);
+}
+
+std::filesystem::path State::imageSource(int fileIndex) const {
+  if(m_multiFits)
+    return m_multiFits->path(fileIndex);
+  return m_imagePath;
+}
+
+void State::saveSequence() {
+  m_sequence->prepareWrite(*m_imageFile);
+  // Edits made while the snapshot is written mark the sequence dirty again
+  auto contents = std::make_shared<SequenceFile>(m_sequence->contents());
   m_sequence->markClean();
+  ++m_pendingSaves;
+  // Journaled edits up to here are in the snapshot
+  uint64_t journaled = m_sequence->journal() ? m_sequence->journal()->position() : 0;
+
+  // The state is only touched again on the main loop
+  std::weak_ptr<State> weakState = weak_from_this();
+  m_saveThread.submit([this, contents, weakState, journaled]() {
+    bool saved = m_writer.update(*contents);
+    if(saved)
+      spdlog::debug("Saved sequence, {} bytes written", m_writer.lastWriteSize());
+
+    UI::mainLoop().post([weakState, saved, journaled]() {
+      auto state = weakState.lock();
+      if(!state)
+        return;
+
+      // Keep the changes around so they can be saved again
+      if(!saved)
+        state->m_sequence->markDirty();
+      else if(auto journal = state->m_sequence->journal())
+        journal->dropSaved(journaled);
+
+      if(--state->m_pendingSaves == 0) {
+        auto jobs = std::move(state->m_afterSave);
+        state->m_afterSave.clear();
+        for(auto& job : jobs)
+          job();
+      }
+    });
+  });
+}
+
+void State::waitForSave() {
+  m_saveThread.wait();
+}
+
+bool State::savePending() const {
+  return m_pendingSaves > 0;
 }
 
+void State::afterSave(std::function<void()>&& job) {
+  if(m_pendingSaves == 0) {
+    job();
+    return;
+  }
+  m_afterSave.push_back(std::move(job));
+}
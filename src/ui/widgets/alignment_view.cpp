@@ -1,7 +1,11 @@
 #include "ui/widgets/alignment_view.hpp"
 #include "ui/state.hpp"
+#include "ui/main_loop.hpp"
+#include "io/convert.hpp"
 
 #include <GL/gl.h>
+#include <algorithm>
+#include <cmath>
 #include <spdlog/spdlog.h>
 
 using namespace UI;
@@ -35,6 +39,12 @@ AlignmentView::AlignmentView(BaseObjectType* cobject, const Glib::RefPtr<Gtk::Bu
   m_aspectFrame = dynamic_cast<Gtk::AspectFrame*>(get_parent());
 
   m_refAspect = 0;
+  m_refLoad = 0;
+  m_alignLoad = 0;
+  for(int i = 0; i < 4; ++i) {
+    m_refRegion[i] = i < 2 ? 0 : 1;
+    m_alignRegion[i] = i < 2 ? 0 : 1;
+  }
 
   viewTypeChanged();
 }
@@ -86,6 +96,8 @@ bool AlignmentView::render(const Glib::RefPtr<Gdk::GLContext>& context) {
 
   m_program->uniform1i("u_RefTexture", 0);
   m_program->uniform1i("u_AlignTexture", 1);
+  m_program->uniform4f("u_RefRegion", m_refRegion);
+  m_program->uniform4f("u_AlignRegion", m_alignRegion);
 
   if(m_viewSection) {
     m_program->uniform4f("u_ViewSelection",
@@ -121,7 +133,7 @@ bool AlignmentView::render(const Glib::RefPtr<Gdk::GLContext>& context) {
 
   auto refStats = m_referenceImage->getStats(0);
   auto aliStats = m_alignImage->getStats(0);
-  double typeMax = m_state->m_imageFile.maxTypeValue();
+  double typeMax = m_state->m_imageFile->maxTypeValue();
   m_program->uniform2f("u_RefLevels", refStats->getMin() / typeMax, refStats->getMax() / typeMax);
   m_program->uniform2f("u_AlignLevels", aliStats->getMin() / typeMax, aliStats->getMax() / typeMax);
 
@@ -142,10 +154,10 @@ void AlignmentView::referenceChanged() {
   m_referenceImage = m_sequenceView->getImage(m_state->m_sequence->getReferenceImageIndex());
   if(!m_referenceImage->getStats(0)) {
     // Guarantee that stats are available for drawing
-    m_referenceImage->calculateStats(m_state->m_imageFile);
+    m_referenceImage->calculateStats(*m_state->m_imageFile);
   }
 
-  auto params = m_state->m_imageFile.getImageParameters(m_referenceImage->getFileIndex());
+  auto params = m_state->m_imageFile->getImageParameters(m_referenceImage->getFileIndex());
 
   // Read only the first layer
   params.setDimension(2, 1, 1, 1);
@@ -155,14 +167,7 @@ void AlignmentView::referenceChanged() {
   m_pixelSize = 1.0 / params.width();
   m_refAspect = (float)params.width() / params.height();
 
-  if(params.type() != DataType::SHORT && params.type() != DataType::USHORT) {
-    spdlog::error("Not a short type 16 bit image");
-    return;
-  }
-
-  auto data = m_state->m_imageFile.getPixels(params);
-  m_refTexture->load(params.width(), params.height(), GL_RED, GL_UNSIGNED_SHORT, data.get(), GL_R16);
-
+  loadTexture(m_refTexture, m_referenceImage, m_refRegion, m_refLoad);
   queue_draw();
 }
 
@@ -211,7 +216,7 @@ void AlignmentView::sequenceViewSelectionChanged(uint position, uint nitems) {
   m_alignImage = m_sequenceView->getSelected();
 
   if(!m_alignImage->getStats(0))
-    m_alignImage->calculateStats(m_state->m_imageFile);
+    m_alignImage->calculateStats(*m_state->m_imageFile);
   if(!m_alignImage->getRegistration())
     m_alignImage->setRegistration(Registration::create());
 
@@ -233,18 +238,7 @@ void AlignmentView::sequenceViewSelectionChanged(uint position, uint nitems) {
   // New redraw signal
   m_alignSigConn = m_alignImage->signalRedraw().connect(sigc::mem_fun(*this, &AlignmentView::queue_draw));
 
-  auto params = m_state->m_imageFile.getImageParameters(m_alignImage->getFileIndex());
-  // Read only the first layer
-  params.setDimension(2, 1, 1, 1);
-
-  if(params.type() != DataType::SHORT && params.type() != DataType::USHORT) {
-    spdlog::error("Not a short type 16 bit image");
-    return;
-  }
-
-  auto data = m_state->m_imageFile.getPixels(params);
-  m_alignTexture->load(params.width(), params.height(), GL_RED, GL_UNSIGNED_SHORT, data.get(), GL_R16);
-
+  loadTexture(m_alignTexture, m_alignImage, m_alignRegion, m_alignLoad);
   queue_draw();
 }
 
@@ -254,7 +248,99 @@ void AlignmentView::pickArea() {
     m_aspectFrame->set_ratio(selection->m_width / selection->m_height);
 
     spdlog::info("Selected ({}, {}), ({}, {})", selection->m_x, selection->m_y, selection->m_width, selection->m_height);
+
+    // Only the picked area gets loaded now
+    if(m_referenceImage)
+      loadTexture(m_refTexture, m_referenceImage, m_refRegion, m_refLoad);
+    if(m_alignImage)
+      loadTexture(m_alignTexture, m_alignImage, m_alignRegion, m_alignLoad);
     queue_draw();
   });
 }
 
+long AlignmentView::textureWidth() {
+  // Enough texels for every screen pixel of the viewed area
+  double width = get_width() * get_scale_factor();
+  if(m_viewSection && m_viewSection->m_width > 0)
+    width /= m_viewSection->m_width;
+  return std::ceil(width);
+}
+
+IO::Task AlignmentView::loadTexture(std::shared_ptr<GL::Texture> target, Glib::RefPtr<Obj::Image> image, float *region, uint& loadId) {
+  // The state keeps the provider alive during the read. Only a weak
+  // reference to the texture is kept, once it's gone so is the view.
+  auto state = m_state;
+  std::weak_ptr<GL::Texture> weakTexture = target;
+  target = nullptr;
+  uint id = ++loadId;
+
+  std::shared_ptr<uint8_t[]> data;
+  DataType::EnumType type;
+  long width, height;
+  float covered[4];
+
+  int fileIndex = image->getFileIndex();
+  if(!m_viewSection) {
+    long minWidth = textureWidth();
+    auto level = co_await Async<PyramidProvider::Level>([state, fileIndex, minWidth]() {
+      return state->m_imageFile->getLevel(fileIndex, minWidth);
+    }, &mainLoop());
+
+    data = level.m_data;
+    type = level.m_type;
+    width = level.m_width;
+    height = level.m_height;
+    covered[0] = 0;
+    covered[1] = 0;
+    covered[2] = 1;
+    covered[3] = 1;
+  } else {
+    // Read the picked area at full resolution, with a margin around it so
+    // aligned images which are a bit off still have data to show
+    auto params = state->m_imageFile->getImageParameters(fileIndex);
+    params.setDimension(2, 1, 1, 1);
+    long imageWidth = params.width();
+    long imageHeight = params.height();
+
+    double x = m_viewSection->m_x * imageWidth;
+    double y = m_viewSection->m_y * m_refAspect * imageHeight;
+    double w = m_viewSection->m_width * imageWidth;
+    double h = m_viewSection->m_height * m_refAspect * imageHeight;
+    double margin = std::max({ w / 2, h / 2, 64.0 });
+
+    long x0 = std::clamp<long>(std::floor(x - margin), 0, imageWidth - 1);
+    long y0 = std::clamp<long>(std::floor(y - margin), 0, imageHeight - 1);
+    long x1 = std::clamp<long>(std::ceil(x + w + margin), x0 + 1, imageWidth);
+    long y1 = std::clamp<long>(std::ceil(y + h + margin), y0 + 1, imageHeight);
+
+    // Parameters are 1 based and inclusive
+    params.setDimension(0, x0 + 1, x1, 1);
+    params.setDimension(1, y0 + 1, y1, 1);
+
+    data = co_await state->m_imageFile->pixels(params, &mainLoop());
+    type = params.type();
+    width = params.width();
+    height = params.height();
+    covered[0] = (float)x0 / imageWidth;
+    covered[1] = (float)y0 / imageHeight;
+    covered[2] = (float)width / imageWidth;
+    covered[3] = (float)height / imageHeight;
+  }
+
+  // Back on the main loop, the view may be gone or have started a newer load
+  auto texture = weakTexture.lock();
+  if(!texture || id != loadId || !data)
+    co_return;
+
+  std::copy(covered, covered + 4, region);
+  if(type == DataType::SHORT || type == DataType::USHORT) {
+    texture->load(width, height, GL_RED, GL_UNSIGNED_SHORT, data.get(), GL_R16);
+  } else {
+    // Other types are uploaded as floats normalized to the type maximum,
+    // which is what sampling a 16 bit texture gives as well
+    std::vector<float> pixels(width * height);
+    convertToFloat(type, data.get(), pixels.data(), pixels.size(), 1.0 / state->m_imageFile->maxTypeValue());
+    texture->load(width, height, GL_RED, GL_FLOAT, pixels.data(), GL_R32F);
+  }
+  queue_draw();
+}
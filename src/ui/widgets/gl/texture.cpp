@@ -38,6 +38,9 @@ void Texture::unbind() {
 void Texture::load(uint width, uint height, int srcFormat, int srcType, const void *data, int dstFormat) {
   prepare_context();
   bind();
+  // Rows are tightly packed, regions and pyramid levels can have an
+  // odd width which the default 4 byte row alignment would shear
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
   glTexImage2D(GL_TEXTURE_2D, 0, dstFormat, width, height, 0, srcFormat, srcType, data);
 }
 
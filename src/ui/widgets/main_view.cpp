@@ -71,19 +71,23 @@ void MainView::resetViewport() {
 void MainView::connectState(const std::shared_ptr<UI::State>& state) {
   m_state = state;
   m_images.clear();
+  m_selectedImage = nullptr;
+  m_connImageChanged.disconnect();
 
   // Calculate pixel size from reference image
-  auto refSeqImg = m_state->m_sequence->image(m_state->m_sequence->getReferenceImageIndex());
-  auto refParams = m_state->m_imageFile.getImageParameters(refSeqImg->getFileIndex());
+  auto& store = m_state->m_sequence->store();
+  auto refParams = m_state->m_imageFile->getImageParameters(store.fileIndex(m_state->m_sequence->getReferenceImageIndex()));
   m_pixelSize = 1.0 / refParams.width();
   m_refAspect = (double) refParams.width() / refParams.height();
 
   // Construct image views for all images in the sequence
   for(int i = 0; i < m_state->m_sequence->getImageCount(); ++i) {
-    auto imageView = std::make_shared<ViewImage>(*this, m_sequenceView->getImage(i));
-    imageView->imageObject()->signalRedraw().connect(sigc::mem_fun(*this, &MainView::queue_draw));
-    m_images.push_back(imageView);
+    m_images.push_back(std::make_shared<ViewImage>(*this, m_state->m_sequence, i));
   }
+  m_connImageChanged = m_state->m_sequence->signalImageChanged().connect(sigc::hide(sigc::mem_fun(*this, &MainView::queue_draw)));
+
+  // Keep newly generated previews for the next time the sequence is opened
+  m_state->m_previews->save();
 
   sequenceViewSelectionChanged(0, 0);
   resetViewport();
@@ -91,7 +95,7 @@ void MainView::connectState(const std::shared_ptr<UI::State>& state) {
 
 std::shared_ptr<ViewImage> MainView::getView(int seqIndex) {
   for(auto& view : m_images) {
-    if(view->imageObject()->getSequenceIndex() == seqIndex)
+    if(view->index() == seqIndex)
       return view;
   }
   return nullptr;
@@ -109,7 +113,7 @@ void MainView::sequenceViewSelectionChanged(uint position, uint nitems) {
   // Extract selected image object
   auto iter = m_images.begin();
   while(iter != m_images.end()) {
-    if((*iter)->imageObject()->getSequenceIndex() == selectedIndex)
+    if((*iter)->index() == selectedIndex)
       break;
     ++iter;
   }
@@ -134,18 +138,19 @@ void MainView::sequenceViewSelectionChanged(uint position, uint nitems) {
     }
   }
  
-  auto imgObj = selectedImage->imageObject();
+  auto imgObj = m_state->m_sequence->image(selectedIndex);
+  m_selectedImage = imgObj;
 
   auto minAdj = m_minLevelBtn->get_adjustment();
   auto maxAdj = m_maxLevelBtn->get_adjustment();
   minAdj->set_lower(0);
-  minAdj->set_upper(m_state->m_imageFile.maxTypeValue());
+  minAdj->set_upper(m_state->m_imageFile->maxTypeValue());
   maxAdj->set_lower(0);
-  maxAdj->set_upper(m_state->m_imageFile.maxTypeValue());
+  maxAdj->set_upper(m_state->m_imageFile->maxTypeValue());
 
   auto stats = imgObj->getStats(0);
   if(!stats) {
-    imgObj->calculateStats(m_state->m_imageFile);
+    imgObj->calculateStats(*m_state->m_imageFile);
     stats = imgObj->getStats(0);
   }
   m_levelBindings[0] = Glib::Binding::bind_property(stats->propertyMin(), m_minLevelBtn->property_value(), Glib::Binding::Flags::SYNC_CREATE | Glib::Binding::Flags::BIDIRECTIONAL);
@@ -227,10 +232,11 @@ void MainView::renderModeDefault() {
 
   // Render all images
   bool hideUnselected = m_hideUnselected->get_active();
+  auto& store = m_state->m_sequence->store();
   for(auto iter = m_images.rbegin(); iter != m_images.rend(); ++iter) {
     auto& image = *iter;
     int flags = 0;
-    if(!image->imageObject()->getIncluded()) {
+    if(!store.included(image->index())) {
       if(hideUnselected)
         continue;
       // Indicate that the image is not selected
@@ -275,7 +281,7 @@ void MainView::renderModeKeypoints() {
     return;
 
   // If the image is marked as dirty we need to rebuild the keypoints mesh
-  auto img = view->imageObject();
+  auto img = m_state->m_sequence->image(view->index());
   if(img->isMarked() || m_keypointCount == 0) {
     rebuildKeypointMesh(img);
   }
@@ -290,6 +296,7 @@ void MainView::renderModeKeypoints() {
   m_imgProgram->uniformMat3fv("u_Transform", 1, false, matrix);
 
   view->render(*m_imgProgram, false);
+  img->clearRedrawFlag();
 
   // Draw keypoints
   m_keypointsVAO->bind();
@@ -450,8 +457,8 @@ void MainView::renderModeMatches() {
     return;
 
   // If any image is marked as dirty we need to rebuild the keypoints mesh
-  auto img = imgView->imageObject();
-  auto ref = refView->imageObject();
+  auto img = m_state->m_sequence->image(imgView->index());
+  auto ref = m_state->m_sequence->image(refView->index());
   if(ref->isMarked() || img->isMarked() || m_keypointCount == 0) {
     rebuildMatchMeshes(ref, img);
   }
@@ -472,6 +479,8 @@ void MainView::renderModeMatches() {
   matrix[2] = -1.0f;
   m_imgProgram->uniformMat3fv("u_Transform", 1, true, matrix);
   refView->render(*m_imgProgram, false);
+  img->clearRedrawFlag();
+  ref->clearRedrawFlag();
 
   // Draw keypoints
   m_keypointsVAO->bind();
@@ -599,8 +608,9 @@ std::shared_ptr<UI::State> MainView::state() {
   return m_state;
 }
 
-ViewImage::ViewImage(MainView& area, const Glib::RefPtr<Image>& image)
-  : m_imageObject(image) {
+ViewImage::ViewImage(MainView& area, const Glib::RefPtr<IO::Sequence>& sequence, int index)
+  : m_sequence(sequence)
+  , m_index(index) {
   m_vertices = area.createBuffer();
   m_texture = area.createTexture();
   m_vao = area.createVertexArray();
@@ -610,12 +620,12 @@ ViewImage::ViewImage(MainView& area, const Glib::RefPtr<Image>& image)
   m_vao->attribPointer(0, 2, GL_FLOAT, false, 4 * sizeof(float), 0);
   m_vao->attribPointer(1, 2, GL_FLOAT, false, 4 * sizeof(float), 2 * sizeof(float));
 
-  loadTexture(area.state()->m_imageFile, image->getSequenceIndex());
+  loadTexture(*area.state(), sequence->store().fileIndex(index));
 
   m_vao->unbind();
 
   m_pixelSize = area.pixelSize();
-  m_maxValue = area.state()->m_imageFile.maxTypeValue();
+  m_maxValue = area.state()->m_imageFile->maxTypeValue();
 }
 
 // 2 floats for position, 2 for UV
@@ -645,43 +655,35 @@ void ViewImage::makeVertices(float scaleX, float scaleY) {
   m_vertices->store(sizeof(buffer), buffer);
 }
 
-void ViewImage::loadTexture(ImageProvider& image, int index) {
-  auto params = image.getImageParameters(index);
-  // Read only the first layer
-  params.setDimension(2, 1, 1, 1);
-
-  // Make large images use a subset of pixels to save VRAM
-  int scale = params.width() / 500;
-  if(scale < 0) scale = 1;
-  params.setDimension(0, -1, -1, scale);
-  params.setDimension(1, -1, -1, scale);
-
-  if(params.type() != DataType::SHORT && params.type() != DataType::USHORT) {
-    spdlog::error("Not a short type 16 bit image");
+void ViewImage::loadTexture(State& state, int index) {
+  auto preview = state.m_previews->get(*state.m_imageFile, state.imageSource(index), index);
+  if(!preview) {
+    spdlog::error("Failed to create preview of image {}", index);
     return;
   }
 
-  auto data = image.getPixels(params);
-  m_texture->load(params.width(), params.height(), GL_RED, GL_UNSIGNED_SHORT, data.get(), GL_R16);
+  m_texture->load(preview.m_width, preview.m_height, GL_RED, GL_UNSIGNED_SHORT, preview.m_data.get(), GL_R16);
 
-  m_aspect = (double)params.width() / params.height();
+  m_aspect = (double)preview.m_width / preview.m_height;
   makeVertices(1.0, 1.0 / m_aspect);
 }
 
-Glib::RefPtr<Image> ViewImage::imageObject() {
-  return m_imageObject;
+int ViewImage::index() const {
+  return m_index;
 }
 
 void ViewImage::render(GL::Program& program, bool applyMatrix) {
+  auto& store = m_sequence->store();
   if(applyMatrix) {
     float matrix[9];
-    if(!m_imageObject->isReference()) {
-      auto reg = m_imageObject->getRegistration();
-      if(!reg) {
+    if(m_sequence->getReferenceImageIndex() != m_index) {
+      if(!store.hasRegistration(m_index)) {
         // Identity matrix
         HomographyMatrix::identity(matrix);
       } else {
-        reg->matrix().read(matrix);
+        auto reg = store.matrix(m_index);
+        for(int i = 0; i < 9; ++i)
+          matrix[i] = reg[i];
 
         // Scale translations by pixel size
         matrix[2] *=  m_pixelSize;
@@ -695,10 +697,10 @@ void ViewImage::render(GL::Program& program, bool applyMatrix) {
     program.uniformMat3fv("u_Transform", 1, true, matrix);
   }
 
-  auto stats = m_imageObject->getStats(0);
+  auto stats = store.stats(m_index, 0);
   if(stats) {
-    float min = stats->getMin() / m_maxValue;
-    float max = stats->getMax() / m_maxValue;
+    float min = stats->m_min / m_maxValue;
+    float max = stats->m_max / m_maxValue;
     program.uniform2f("u_Levels", min, max);
   } else {
     program.uniform2f("u_Levels", 0, 1);
@@ -712,7 +714,5 @@ void ViewImage::render(GL::Program& program, bool applyMatrix) {
 
   m_vao->unbind();
   m_texture->unbind();
-
-  m_imageObject->clearRedrawFlag();
 }
 
@@ -14,7 +14,7 @@ SequenceView::SequenceView() : Glib::ObjectBase("SequenceView") {
 SequenceView::SequenceView(BaseObjectType *cobject, const Glib::RefPtr<Gtk::Builder>& builder)
   : Glib::ObjectBase("SequenceView")
   , Gtk::ColumnView(cobject)
-  , m_model(Gio::ListStore<Image>::create())
+  , m_selection(Gtk::SingleSelection::create())
   , m_idColFactory(Gtk::SignalListItemFactory::create())
   , m_selectColFactory(Gtk::SignalListItemFactory::create())
   , m_xOffsetFactory(Gtk::SignalListItemFactory::create())
@@ -37,7 +37,7 @@ SequenceView::SequenceView(BaseObjectType *cobject, const Glib::RefPtr<Gtk::Buil
   append_column(Gtk::ColumnViewColumn::create("Y Offset", m_yOffsetFactory));
   
   // Set selection model
-  set_model(Gtk::SingleSelection::create(m_model));
+  set_model(m_selection);
 
   m_refImageSelector = builder->get_widget<Gtk::SpinButton>("ref_image_spin_btn");
   m_refImageSelector->signal_value_changed().connect(sigc::mem_fun(*this, &SequenceView::referenceChanged));
@@ -55,19 +55,9 @@ void SequenceView::referenceChanged() {
   rows[m_lastRefIndex]->add_css_class("refimg");
 }
 
-Glib::RefPtr<Gio::ListStore<Image>>& SequenceView::model() {
-  return m_model;
-}
-
 void SequenceView::connectState(const std::shared_ptr<UI::State>& state) {
-  // Clear the model
-  m_model->remove_all();
-
-  // Populate with new sequence
-  // TODO: Turn IO::Sequence into a valid ListModel
-  for(int i = 0; i < state->m_sequence->getImageCount(); ++i) {
-    m_model->append(state->m_sequence->image(i));
-  }
+  m_sequence = state->m_sequence;
+  m_selection->set_model(m_sequence);
 
   // Set reference image index
   auto adj = m_refImageSelector->get_adjustment();
@@ -92,7 +82,7 @@ void SequenceView::prevImage() {
 
 void SequenceView::nextImage() {
   uint selected = getSelectedIndex();
-  if(selected < m_model->get_n_items() - 1) {
+  if(selected < m_selection->get_n_items() - 1) {
     get_model()->select_item(selected + 1, true);
   }
 }
@@ -102,11 +92,13 @@ uint SequenceView::getSelectedIndex() {
 }
 
 Glib::RefPtr<Image> SequenceView::getSelected() {
-  return m_model->get_item(getSelectedIndex());
+  return getImage(getSelectedIndex());
 }
 
 Glib::RefPtr<Image> SequenceView::getImage(int index) {
-  return m_model->get_item(index);
+  if(!m_sequence || index < 0 || index >= m_sequence->getImageCount())
+    return nullptr;
+  return m_sequence->image(index);
 }
 
 void SequenceView::labelColSetup(const ListItem& item) {
@@ -17,6 +17,7 @@ Window::Window() {
   m_alignmentView = Gtk::Builder::get_widget_derived<AlignmentView>(builder, "alignment_view");
 
   m_saveChangesDialog = 0;
+  m_closeAfterSave = false;
 
   signal_close_request().connect(sigc::mem_fun(*this, &Window::closeRequest), false);
 
@@ -36,6 +37,19 @@ void Window::setState(const std::shared_ptr<UI::State>& state) {
 }
 
 bool Window::closeRequest() {
+  if(m_state && m_state->savePending()) {
+    // The sequence only looks clean until the save reports its result,
+    // a failed save makes the next attempt ask again
+    if(!m_closeAfterSave) {
+      m_closeAfterSave = true;
+      m_state->afterSave([this]() {
+        m_closeAfterSave = false;
+        this->close();
+      });
+    }
+    return true;
+  }
+
   if(m_state && m_state->m_sequence->isDirty()) {
     // Trying to close with unsaved changes
     m_saveChangesDialog = adw_alert_dialog_new("Save Changes?", "Open sequence has unsaved changes. Changes which are not saved will be permanently lost.");
@@ -64,16 +78,20 @@ bool Window::closeRequest() {
 void Window::saveChangesFinish(GAsyncResult *result) {
   std::string response = adw_alert_dialog_choose_finish(ADW_ALERT_DIALOG(m_saveChangesDialog), result);
   m_saveChangesDialog = 0;
+  m_closeAfterSave = false;
 
   if(response == "cancel") {
     // Do nothing
     return;
   } else if(response == "discard") {
-    // Mark sequence as clean and try to close again
+    // Mark sequence as clean and try to close again, the edits must not
+    // come back from the journal either
+    if(auto journal = m_state->m_sequence->journal())
+      journal->discard();
     m_state->m_sequence->markClean();
     this->close();
   } else if(response == "save") {
-    // Save sequence and close again
+    // Save sequence and close again, closing waits for the save to finish
     m_state->saveSequence();
     this->close();
   }
@@ -0,0 +1,91 @@
+#include "io/provider.hpp"
+#include "io/thread_pool.hpp"
+
+#include "io_util.hpp"
+
+#include <future>
+#include <thread>
+
+// Executor which remembers the thread of its only worker
+class SingleThread : public Executor {
+public:
+  ThreadPool m_pool;
+  std::thread::id m_id;
+
+  SingleThread() : m_pool(1) {
+    std::promise<std::thread::id> id;
+    m_pool.submit([&]() { id.set_value(std::this_thread::get_id()); });
+    m_id = id.get_future().get();
+  }
+
+  virtual void post(std::function<void()>&& job) override {
+    m_pool.submit(std::move(job));
+  }
+};
+
+static Task readAll(ImageProvider& provider, Executor *resume, std::promise<bool>& result) {
+  auto caller = std::this_thread::get_id();
+  bool ok = true;
+  for(int i = 0; i < provider.imageCount(); ++i) {
+    auto data = co_await provider.pixels(provider.getImageParameters(i), resume);
+    ok = ok && data && data[0] == i;
+  }
+
+  // Reads never block the thread which started the coroutine
+  ok = ok && std::this_thread::get_id() != caller;
+  result.set_value(ok);
+}
+
+int main() {
+  MockProvider provider(4);
+
+  // Resumed on the I/O threads
+  std::promise<bool> direct;
+  readAll(provider, nullptr, direct);
+  if(!direct.get_future().get())
+    return 1;
+
+  // Resumed through an executor
+  SingleThread worker;
+  std::promise<std::thread::id> resumedOn;
+  [](ImageProvider& provider, Executor *resume, std::promise<std::thread::id>& result) -> Task {
+    auto mat = co_await provider.matrix(2, resume);
+    result.set_value(mat.empty() ? std::thread::id() : std::this_thread::get_id());
+  }(provider, &worker, resumedOn);
+  if(resumedOn.get_future().get() != worker.m_id)
+    return 1;
+
+  std::promise<bool> batch;
+  readAll(provider, &worker, batch);
+  if(!batch.get_future().get())
+    return 1;
+
+  // Failed reads are rethrown in the coroutine
+  provider.m_fail = true;
+  std::promise<bool> failed;
+  [](ImageProvider& provider, Executor *resume, std::promise<bool>& result) -> Task {
+    try {
+      co_await provider.pixels(provider.getImageParameters(0), resume);
+      result.set_value(false);
+    } catch(const std::exception&) {
+      result.set_value(true);
+    }
+  }(provider, &worker, failed);
+  if(!failed.get_future().get())
+    return 1;
+
+  // Uncaught ones end the coroutine without taking the process down
+  struct Unwound {
+    std::promise<void>& m_done;
+    ~Unwound() { m_done.set_value(); }
+  };
+  std::promise<void> unwound;
+  [](ImageProvider& provider, std::promise<void>& done) -> Task {
+    Unwound guard{done};
+    co_await provider.pixels(provider.getImageParameters(0));
+  }(provider, unwound);
+  unwound.get_future().get();
+  provider.m_fail = false;
+
+  return 0;
+}
@@ -0,0 +1,134 @@
+#include "io/async_reader.hpp"
+#include "io/mapped_fits.hpp"
+
+#include "io_util.hpp"
+
+#include <set>
+
+int main() {
+  auto path = std::filesystem::temp_directory_path() / "async_read_test.fit";
+  // Every pixel holds 1000 * hdu + y * width + x
+  writeFits(path, 20, 10, 4, [](int hdu, long i) { return 1000 * hdu + i; });
+
+  MappedFits fits(path);
+  if(fits.imageCount() != 4)
+    return 1;
+
+  std::vector<DataParameters> batch;
+  for(int i = 0; i < 4; ++i)
+    batch.push_back(fits.getImageParameters(i));
+
+  // Complete rows, converted to another type
+  auto rows = fits.getImageParameters(1).withType(DataType::FLOAT);
+  rows.setDimension(1, 3, 5, 1);
+  batch.push_back(rows);
+
+  // Not contiguous in the file
+  auto columns = fits.getImageParameters(2);
+  columns.setDimension(0, 2, 5, 1);
+  batch.push_back(columns);
+
+  auto reader = fits.createAsyncReader();
+  reader->submit(batch);
+  if(reader->pending() != batch.size())
+    return 1;
+
+  size_t completed = 0;
+  while(auto completion = reader->next()) {
+    ++completed;
+    auto& params = completion->m_params;
+    if(!completion->m_data)
+      return 1;
+
+    if(params == rows) {
+      auto data = (const float*)completion->m_data.get();
+      if(data[0] != 1000 + 2 * 20 || data[3 * 20 - 1] != 1000 + 5 * 20 - 1)
+        return 1;
+    } else if(params == columns) {
+      auto data = (const uint16_t*)completion->m_data.get();
+      if(data[0] != 2000 + 1 || data[5] != 2000 + 20 + 2)
+        return 1;
+    } else {
+      auto data = (const uint16_t*)completion->m_data.get();
+      int base = 1000 * params.index();
+      if(data[0] != base || data[199] != base + 199)
+        return 1;
+    }
+  }
+
+  if(completed != batch.size() || reader->pending() != 0)
+    return 1;
+
+  // A limit below a single image still reads one image at a time
+  ThreadPoolReader limited(&fits, 4, 1);
+  limited.submit(batch);
+  completed = 0;
+  while(auto completion = limited.next()) {
+    if(!completion->m_data)
+      return 1;
+    ++completed;
+  }
+
+  if(completed != batch.size() || limited.pending() != 0)
+    return 1;
+
+  std::filesystem::remove(path);
+
+  // 8 bit images are viewed in place, a binary table between them isn't an image
+  auto bytePath = std::filesystem::temp_directory_path() / "async_read_test_8bit.fit";
+  {
+    std::ofstream stream(bytePath, std::ios::binary);
+    for(auto extension : { "", "'BINTABLE'", "'IMAGE   '" }) {
+      bool table = std::string_view(extension) == "'BINTABLE'";
+      writeCard(stream, *extension ? std::format("{:<8}= {:>20}", "XTENSION", extension) : std::format("{:<8}= {:>20}", "SIMPLE", "T"));
+      writeCard(stream, std::format("{:<8}= {:>20}", "BITPIX", 8));
+      writeCard(stream, std::format("{:<8}= {:>20}", "NAXIS", 2));
+      writeCard(stream, std::format("{:<8}= {:>20}", "NAXIS1", 4));
+      writeCard(stream, std::format("{:<8}= {:>20}", "NAXIS2", 3));
+      if(table) {
+        writeCard(stream, std::format("{:<8}= {:>20}", "PCOUNT", 0));
+        writeCard(stream, std::format("{:<8}= {:>20}", "GCOUNT", 1));
+        writeCard(stream, std::format("{:<8}= {:>20}", "TFIELDS", 1));
+        writeCard(stream, std::format("{:<8}= {:>20}", "TFORM1", "'4A      '"));
+      }
+      writeCard(stream, "END");
+      stream << std::string(2880 - (table ? 10 : 6) * 80, ' ');
+      for(int i = 0; i < 12; ++i)
+        stream.put((char)i);
+      stream << std::string(2880 - 12, '\0');
+    }
+  }
+
+  MappedFits bytes(bytePath);
+  if(bytes.imageCount() != 3 || bytes.index()[1].isImage() || !bytes.index()[2].isImage())
+    return 1;
+
+  auto view = bytes.getImageParameters(2);
+  view.setDimension(1, 2, 3, 1);
+  auto data = bytes.getPixels(view);
+  if(!data || data[0] != 4 || data[7] != 11)
+    return 1;
+
+  // Rows past the end of the HDU aren't handed out from the mapping
+  view.setDimension(1, 2, 4, 1);
+  if(bytes.getPixels(view))
+    return 1;
+
+  std::filesystem::remove(bytePath);
+
+  // Reads which throw complete without data
+  MockProvider failing(3);
+  failing.m_fail = true;
+  ThreadPoolReader failingReader(&failing);
+  failingReader.submit({ failing.getImageParameters(0), failing.getImageParameters(1), failing.getImageParameters(2) });
+  completed = 0;
+  while(auto completion = failingReader.next()) {
+    if(completion->m_data)
+      return 1;
+    ++completed;
+  }
+  if(completed != 3)
+    return 1;
+
+  return 0;
+}
@@ -0,0 +1,98 @@
+#include "io/sequence.hpp"
+#include "objects/image.hpp"
+
+#include <glibmm/init.h>
+#include <sstream>
+#include <stdexcept>
+
+using namespace IO;
+using namespace Obj;
+
+static const char *INPUT1 =
+"S 'test_sequence' 0 3 2 0 0 4 0 0\n"
+"TF\n"
+"L 1\n"
+"I 0 1\n"
+"I 1 1\n"
+"I 3 0\n"
+"R0 0 1 2 3 4 5 H 1 0 10 0 1 20 0 0 1\n";
+
+int main() {
+  Glib::init();
+
+  // A matrix write is a single change of the registration
+  auto reg = Registration::create();
+  int modified = 0;
+  reg->signalModified().connect([&]() { ++modified; });
+
+  double matrix[9] = { 1, 0, 5, 0, 1, 6, 0, 0, 1 };
+  reg->matrix().write(matrix);
+  if(modified != 1 || reg->matrix().get(2) != 5)
+    return 1;
+
+  reg->beginUpdate();
+  reg->setFWHM(2);
+  reg->setQuality(0.5);
+  reg->matrix().reset();
+  if(modified != 1)
+    return 1;
+  reg->endUpdate();
+  if(modified != 2 || reg->matrix().get(2) != 0)
+    return 1;
+
+  std::istringstream istr(INPUT1);
+  auto seq = Sequence::readStream(istr);
+  if(!seq)
+    return 1;
+
+  std::vector<int> changes;
+  seq->signalImageChanged().connect([&](int index) { changes.push_back(index); });
+
+  // Changes of one image are reported once
+  auto first = seq->image(0);
+  seq->beginUpdate();
+  first->getRegistration()->matrix().write(matrix);
+  first->setIncluded(false);
+  seq->endUpdate();
+  if(changes.size() != 1 || changes[0] != 0 || !seq->isDirty())
+    return 1;
+  if(seq->store().matrix(0)[2] != 5 || seq->store().included(0))
+    return 1;
+
+  // Changes of several images are reported as a change of all images
+  changes.clear();
+  auto second = seq->image(1);
+  seq->beginUpdate();
+  second->setRegistration(Registration::create());
+  for(auto& img : { first, second })
+    img->getRegistration()->matrix().write(matrix);
+  seq->endUpdate();
+  if(changes.size() != 1 || changes[0] != -1 || !seq->store().hasRegistration(1))
+    return 1;
+
+  // Reference changes update all live images with one signal
+  changes.clear();
+  seq->propertyReferenceImageIndex().set_value(1);
+  if(changes.size() != 1 || changes[0] != -1)
+    return 1;
+  if(first->getRegistration()->matrix().get(2) != -5 || second->getRegistration()->matrix().get(2) != 0)
+    return 1;
+
+  // An update scope left by an exception still reports the change
+  changes.clear();
+  try {
+    Sequence::UpdateScope update(*seq);
+    first->setIncluded(true);
+    throw std::runtime_error("batch failed");
+  } catch(const std::runtime_error&) {
+  }
+  if(changes.size() != 1 || changes[0] != 0)
+    return 1;
+
+  // and later changes aren't held back
+  second->setIncluded(false);
+  if(changes.size() != 2 || changes[1] != 1)
+    return 1;
+
+  return 0;
+}
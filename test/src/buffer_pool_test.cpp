@@ -0,0 +1,56 @@
+#include "io/buffer_pool.hpp"
+
+#include <cstdint>
+
+using namespace IO;
+
+int main() {
+  // Room for two idle 3 MB frames
+  BufferPool pool(2 * (4 << 20));
+
+  const size_t frameSize = 3 << 20;
+  if(BufferPool::sizeClass(frameSize) != 4 << 20 || BufferPool::sizeClass(100) != 128 || BufferPool::sizeClass(1) != 64)
+    return 1;
+
+  uint8_t *last;
+  {
+    auto a = pool.acquire(frameSize);
+    auto b = pool.acquire(frameSize);
+    auto c = pool.acquire(frameSize);
+    if(!a || !b || !c)
+      return 1;
+    // Large buffers are huge page aligned
+    if((uintptr_t)a.get() % BufferPool::HUGE_PAGE_SIZE != 0)
+      return 1;
+    last = c.get();
+  }
+
+  // The last one released (a) didn't fit into the idle budget
+  auto stats = pool.statistics();
+  if(stats.m_allocations != 3 || stats.m_drops != 1 || stats.m_idleBuffers != 2)
+    return 1;
+
+  // Same sized buffers are reused
+  auto d = pool.acquire(frameSize - 100);
+  auto e = pool.acquire(frameSize);
+  if(d.get() != last && e.get() != last)
+    return 1;
+
+  // Small buffers are 64 byte aligned
+  auto small = pool.acquire(100);
+  if((uintptr_t)small.get() % BufferPool::ALIGNMENT != 0)
+    return 1;
+
+  stats = pool.statistics();
+  if(stats.m_reuses != 2 || stats.m_idleBuffers != 0 || stats.reuseRate() != 2.0 / 6.0)
+    return 1;
+
+  // Buffers can outlive their pool
+  auto pool2 = new BufferPool();
+  auto data = pool2->acquire(1000);
+  delete pool2;
+  data[999] = 1;
+  data.reset();
+
+  return 0;
+}
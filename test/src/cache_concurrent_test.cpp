@@ -0,0 +1,67 @@
+#include "io/provider.hpp"
+
+#include "io_util.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+int main() {
+  // Slow reads so concurrent requests overlap with them
+  auto provider = new MockProvider(4);
+  provider->m_delay = std::chrono::milliseconds(50);
+  CachedImageProvider cache(provider, 1 << 20);
+
+  std::atomic<bool> failed = false;
+  std::vector<std::thread> threads;
+  for(int i = 0; i < 16; ++i) {
+    threads.emplace_back([&, i]() {
+      int index = i % 4;
+      auto data = cache.getPixels(cache.getImageParameters(index));
+      if(!data || data[0] != index)
+        failed = true;
+    });
+  }
+  for(auto& thread : threads)
+    thread.join();
+
+  if(failed)
+    return 1;
+
+  // Every image is read from the provider once, no matter how many threads asked
+  if(provider->m_reads != 4)
+    return 1;
+
+  auto stats = cache.statistics();
+  if(stats.m_misses != 4 || stats.m_hits + stats.m_coalesced != 12 || stats.m_entries != 4)
+    return 1;
+
+  // A failed read is reported to everyone waiting for it and tried again later
+  auto params = cache.getImageParameters(0).withType(DataType::UBYTE);
+  provider->m_fail = true;
+  std::atomic<int> errors = 0;
+  threads.clear();
+  for(int i = 0; i < 4; ++i) {
+    threads.emplace_back([&]() {
+      try {
+        cache.getPixels(params);
+      } catch(const std::runtime_error&) {
+        ++errors;
+      }
+    });
+  }
+  for(auto& thread : threads)
+    thread.join();
+
+  if(errors != 4)
+    return 1;
+
+  provider->m_fail = false;
+  auto data = cache.getPixels(params);
+  if(!data || data[0] != 0)
+    return 1;
+
+  return 0;
+}
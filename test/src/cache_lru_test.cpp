@@ -0,0 +1,56 @@
+#include "io/provider.hpp"
+
+#include "io_util.hpp"
+
+int main() {
+  auto provider = new MockProvider(10);
+  // Room for exactly three images, the budget is shared by all shards
+  CachedImageProvider cache(provider, 3 * 200);
+
+  for(int index : { 0, 1, 2, 0, 3, 4, 0 }) {
+    auto data = cache.getPixels(cache.getImageParameters(index));
+    if(!data || data[0] != index)
+      return 1;
+  }
+
+  // Image 0 was used recently so 1 and 2 should have been evicted instead
+  if(provider->m_reads != 5)
+    return 1;
+
+  auto stats = cache.statistics();
+  if(stats.m_hits != 2 || stats.m_misses != 5 || stats.m_evictions != 2 || stats.m_bytes != 600)
+    return 1;
+
+  // Referenced buffers can't be evicted
+  auto pinned = cache.getPixels(cache.getImageParameters(3));
+  cache.setMaxBytes(0);
+
+  stats = cache.statistics();
+  if(stats.m_entries != 1 || stats.m_pinnedEntries != 1 || stats.m_pinnedBytes != 200)
+    return 1;
+
+  // Pinned entries are passed over while older unpinned ones get evicted,
+  // once released they are evicted like any other entry
+  auto many = new MockProvider(100);
+  CachedImageProvider views(many, 20 * 200);
+  std::vector<std::shared_ptr<uint8_t[]>> held;
+  for(int i = 0; i < 100; ++i) {
+    auto data = views.getPixels(views.getImageParameters(i));
+    if(i % 10 == 0)
+      held.push_back(data);
+  }
+  stats = views.statistics();
+  if(stats.m_entries != 20 || stats.m_pinnedEntries != 10 || stats.m_evictions != 80)
+    return 1;
+  for(int i = 0; i < 100; i += 10) {
+    if(!views.getPixels(views.getImageParameters(i)) || many->m_reads != 100)
+      return 1;
+  }
+
+  held.clear();
+  views.setMaxBytes(5 * 200);
+  if(views.statistics().m_entries != 5 || views.statistics().m_pinnedEntries != 0)
+    return 1;
+
+  return 0;
+}
@@ -0,0 +1,108 @@
+#include "io/sequence.hpp"
+#include "io/sequence_writer.hpp"
+#include "objects/image.hpp"
+
+#include <glibmm/init.h>
+#include <fstream>
+
+using namespace IO;
+using namespace Obj;
+
+static const char *INPUT1 =
+"S 'test_sequence' 0 3 2 0 0 4 0 0\n"
+"TF\n"
+"L 1\n"
+"I 0 1\n"
+"I 1 1\n"
+"I 3 0\n"
+"R0 0 1 2 3 4 5 H 1 0 10 0 1 20 0 0 1\n";
+
+static Glib::RefPtr<Sequence> reopen(const std::filesystem::path& path) {
+  auto seq = Sequence::readSequence(path);
+  if(seq)
+    seq->replayJournal(path);
+  return seq;
+}
+
+int main() {
+  Glib::init();
+
+  auto path = std::filesystem::temp_directory_path() / "edit_journal_test.seq";
+  std::filesystem::remove(EditJournal::journalPath(path));
+  std::ofstream(path) << INPUT1;
+
+  double matrix[9] = { 1, 0, 5, 0, 1, 6, 0, 0, 1 };
+  {
+    auto seq = reopen(path);
+    if(!seq || seq->isDirty())
+      return 1;
+    seq->setJournal(std::make_unique<EditJournal>(path, seq->store().size()));
+
+    seq->image(2)->setIncluded(true);
+    seq->image(0)->getRegistration()->matrix().write(matrix);
+    if(seq->journal()->position() != 2)
+      return 1;
+  }
+
+  // The program died without saving, the edits come back from the journal
+  {
+    auto seq = reopen(path);
+    if(!seq || !seq->isDirty() || seq->getSelectedCount() != 3)
+      return 1;
+    if(!seq->store().included(2) || seq->store().matrix(0)[2] != 5 || seq->store().matrix(0)[5] != 6)
+      return 1;
+
+    // The journal keeps the replayed edits until they are saved
+    seq->setJournal(std::make_unique<EditJournal>(path, seq->store().size()));
+    if(seq->journal()->position() != 2)
+      return 1;
+
+    // An edit made while the snapshot is saved stays in the journal
+    auto contents = seq->contents();
+    auto saved = seq->journal()->position();
+    seq->image(1)->setIncluded(false);
+    SequenceWriter writer(path);
+    if(!writer.write(contents) || !seq->journal()->dropSaved(saved))
+      return 1;
+    if(seq->journal()->position() != 3)
+      return 1;
+  }
+
+  {
+    auto seq = reopen(path);
+    if(!seq || !seq->isDirty())
+      return 1;
+    if(seq->store().included(1) || !seq->store().included(2) || seq->store().matrix(0)[2] != 5)
+      return 1;
+
+    // Reference changes journal the registrations of all images
+    seq->setJournal(std::make_unique<EditJournal>(path, seq->store().size()));
+    double shift[9] = { 1, 0, 2, 0, 1, 3, 0, 0, 1 };
+    auto second = seq->image(1);
+    second->setRegistration(Registration::create());
+    second->getRegistration()->matrix().write(shift);
+    seq->propertyReferenceImageIndex().set_value(1);
+  }
+
+  // A torn record at the end is ignored
+  std::ofstream(EditJournal::journalPath(path), std::ios::binary | std::ios::app) << "torn";
+
+  // Registrations are replayed as they were after the change, not changed again
+  auto expected = reopen(path);
+  if(!expected || expected->getReferenceImageIndex() != 1)
+    return 1;
+  if(expected->store().matrix(1)[2] != 0 || expected->store().matrix(0)[2] != -2 || expected->store().matrix(0)[5] != -3)
+    return 1;
+
+  // Discarded edits don't come back
+  expected->setJournal(std::make_unique<EditJournal>(path, expected->store().size()));
+  expected->journal()->discard();
+  if(std::filesystem::exists(EditJournal::journalPath(path)))
+    return 1;
+  auto discarded = reopen(path);
+  if(!discarded || discarded->isDirty() || discarded->getReferenceImageIndex() != 0)
+    return 1;
+
+  std::filesystem::remove(path);
+  return 0;
+}
@@ -0,0 +1,61 @@
+#include "io/fits_pool.hpp"
+
+#include "io_util.hpp"
+
+#include <atomic>
+#include <thread>
+
+int main() {
+  auto path = std::filesystem::temp_directory_path() / "fits_pool_test.fit";
+  // Every pixel holds 1000 * hdu + y * width + x
+  writeFits(path, 30, 20, 8, [](int hdu, long i) { return 1000 * hdu + i; });
+
+  FitsPool pool(path, 3);
+  if(pool.imageCount() != 8 || pool.handleCount() != 1)
+    return 1;
+  if(pool.getImageParameters(5).width() != 30 || pool.getImageParameters(5).height() != 20)
+    return 1;
+
+  // Every thread reads all HDUs starting at a different one, so
+  // different HDUs are read at the same time
+  std::atomic<bool> failed = false;
+  std::vector<std::thread> threads;
+  for(int t = 0; t < 6; ++t) {
+    threads.emplace_back([&, t]() {
+      for(int round = 0; round < 4; ++round) {
+        for(int i = 0; i < 8; ++i) {
+          int hdu = (t + i) % 8;
+          auto data = pool.getPixels(pool.getImageParameters(hdu));
+          if(!data) {
+            failed = true;
+            continue;
+          }
+
+          const uint16_t *pixels = (const uint16_t*)data.get();
+          for(long p = 0; p < 30 * 20; ++p) {
+            if(pixels[p] != 1000 * hdu + p) {
+              failed = true;
+              break;
+            }
+          }
+        }
+      }
+    });
+  }
+  for(auto& thread : threads)
+    thread.join();
+
+  if(failed || pool.handleCount() < 1 || pool.handleCount() > 3)
+    return 1;
+
+  // Regions are read through the handles as well
+  auto params = pool.getImageParameters(3);
+  params.setDimension(0, 5, 10, 1);
+  params.setDimension(1, 2, 4, 1);
+  auto region = pool.getPixels(params);
+  if(!region || ((uint16_t*)region.get())[0] != 3000 + 30 + 4 || ((uint16_t*)region.get())[6 * 3 - 1] != 3000 + 3 * 30 + 9)
+    return 1;
+
+  std::filesystem::remove(path);
+  return 0;
+}
@@ -0,0 +1,72 @@
+#include "io/convert.hpp"
+#include "io/hdu.hpp"
+#include "io/preview_cache.hpp"
+
+#include "io_util.hpp"
+
+#include <climits>
+#include <cmath>
+
+int main() {
+  // 1000x20 float images with values rising from 0 to 2
+  auto provider = new MockProvider(1, { 1000, 20 }, DataType::FLOAT, [](const DataParameters& params, void *ptr) {
+    fillPixels<float>(params, ptr, [](long x, long y) { return x / 500.0f; });
+  }, 2.0);
+  PyramidProvider pyramid(provider, 1 << 24);
+
+  // Float images are read into float matrices
+  auto mat = provider->getImageMatrix(0);
+  if(mat.empty() || mat.type() != CV_32FC1)
+    return 1;
+
+  // Previews are normalized to the maximum value
+  auto preview = PreviewCache::makePreview(pyramid, 0);
+  if(!preview || preview.m_width != 500 || preview.m_type != DataType::FLOAT)
+    return 1;
+  // Pixels 998 and 999 average to 1.997 of 2
+  uint16_t last = preview.m_data[preview.m_width - 1];
+  if(std::abs(last - 1.997 / 2.0 * 65535) > 1)
+    return 1;
+
+  int32_t ints[3] = { -10, 0, 1000 };
+  float floats[3];
+  if(!convertToFloat(DataType::INT, ints, floats, 3, 0.5) || floats[0] != -5 || floats[2] != 500)
+    return 1;
+
+  // Types follow fits_get_img_equivtype
+  if(HduInfo::equivalentType(16, 32768, 1) != DataType::USHORT || HduInfo::equivalentType(8, -128, 1) != DataType::BYTE)
+    return 1;
+  if(HduInfo::equivalentType(32, 2147483648.0, 1) != DataType::UINT || HduInfo::equivalentType(32, 0, 1) != DataType::INT)
+    return 1;
+  if(HduInfo::equivalentType(64, 9223372036854775808.0, 1) != DataType::ULONG || HduInfo::equivalentType(64, 0, 1) != DataType::LONG)
+    return 1;
+  if(HduInfo::equivalentType(64, 0.5, 1) != DataType::DOUBLE || HduInfo::equivalentType(32, 0, 2) != DataType::DOUBLE)
+    return 1;
+  // Other integer zero points move the data into a wider type
+  if(HduInfo::equivalentType(8, 10, 1) != DataType::SHORT || HduInfo::equivalentType(16, 1000, 1) != DataType::INT)
+    return 1;
+  if(HduInfo::equivalentType(16, 0, 0.5) != DataType::FLOAT || HduInfo::equivalentType(-32, 10, 2) != DataType::FLOAT)
+    return 1;
+
+  // Unsigned 32 bit images use the full range of the type
+  HduIndex uints(1);
+  uints[0].m_type = HduInfo::equivalentType(32, 2147483648.0, 1);
+  uints[0].m_dims = { 10, 10 };
+  if(indexMaxTypeValue(uints) != UINT_MAX)
+    return 1;
+
+  // Maximum of float data comes from DATAMAX
+  HduIndex index(2);
+  for(auto& hdu : index) {
+    hdu.m_type = DataType::FLOAT;
+    hdu.m_dims = { 10, 10 };
+  }
+  if(indexMaxTypeValue(index) != 1.0)
+    return 1;
+  index[0].m_cards["DATAMAX"] = "4000.";
+  index[1].m_cards["DATAMAX"] = "5000.";
+  if(indexMaxTypeValue(index) != 5000.0)
+    return 1;
+
+  return 0;
+}
@@ -0,0 +1,113 @@
+#include "io/fits.hpp"
+
+#include "io_util.hpp"
+
+int main() {
+  auto path = std::filesystem::temp_directory_path() / "hdu_index_test.fit";
+  {
+    // Empty primary HDU followed by images of width 10 + hdu where every
+    // pixel holds 100 * hdu + y * width + x
+    std::ofstream stream(path, std::ios::binary);
+    writeCard(stream, std::format("{:<8}= {:>20}", "SIMPLE", "T"));
+    writeCard(stream, std::format("{:<8}= {:>20}", "BITPIX", 8));
+    writeCard(stream, std::format("{:<8}= {:>20}", "NAXIS", 0));
+    writeCard(stream, "END");
+    stream << std::string(2880 - 4 * 80, ' ');
+
+    for(int hdu = 1; hdu <= 3; ++hdu) {
+      long width = 10 + hdu, height = 8;
+      std::vector<std::string> cards = {
+        std::format("{:<8}= {:>20}", "XTENSION", "'IMAGE   '"),
+        std::format("{:<8}= {:>20}", "BITPIX", 16),
+        std::format("{:<8}= {:>20}", "NAXIS", 2),
+        std::format("{:<8}= {:>20}", "NAXIS1", width),
+        std::format("{:<8}= {:>20}", "NAXIS2", height),
+        std::format("{:<8}= {:>20}", "PCOUNT", 0),
+        std::format("{:<8}= {:>20}", "GCOUNT", 1),
+        std::format("{:<8}= {:>20}", "BZERO", 32768),
+        std::format("{:<8}= {:>20} / exposure in seconds", "EXPTIME", 10 * hdu),
+      };
+      // The last image has no filter
+      if(hdu != 3)
+        cards.push_back(std::format("{:<8}= {:<20}", "FILTER", hdu == 1 ? "'R '" : "'O''III'"));
+      cards.push_back("END");
+
+      for(auto& card : cards)
+        writeCard(stream, card);
+      stream << std::string(2880 - cards.size() * 80, ' ');
+
+      for(long i = 0; i < width * height; ++i) {
+        int16_t stored = (int16_t)(100 * hdu + i - 32768);
+        char bytes[2] = { (char)((uint16_t)stored >> 8), (char)(stored & 0xff) };
+        stream.write(bytes, 2);
+      }
+      stream << std::string((2880 - width * height * 2 % 2880) % 2880, '\0');
+    }
+  }
+
+  Fits fits(path);
+  auto index = fits.index();
+  if(fits.imageCount() != 4 || !index || index->size() != 4)
+    return 1;
+
+  // The primary HDU holds no image
+  if((*index)[0].isImage() || fits.getImageParameters(0))
+    return 1;
+
+  for(int hdu = 1; hdu <= 3; ++hdu) {
+    auto params = fits.getImageParameters(hdu);
+    if(!params || params.index() != hdu || params.type() != DataType::USHORT)
+      return 1;
+    if(params.width() != 10 + hdu || params.height() != 8)
+      return 1;
+
+    auto& info = (*index)[hdu];
+    if(info.m_bitpix != 16 || info.m_bzero != 32768 || info.m_bscale != 1 || info.m_dataOffset % 2880 != 0)
+      return 1;
+
+    auto exposure = info.card("EXPTIME");
+    if(!exposure || *exposure != std::to_string(10 * hdu))
+      return 1;
+  }
+
+  // String cards lose their quotes and trailing spaces
+  auto filter = (*index)[1].card("FILTER");
+  if(!filter || *filter != "R")
+    return 1;
+  filter = (*index)[2].card("FILTER");
+  if(!filter || *filter != "O'III")
+    return 1;
+  if((*index)[3].card("FILTER") || (*index)[1].card("BZERO"))
+    return 1;
+
+  // Selecting an HDU moves cfitsio to it
+  fits.select(3);
+  long size[2] = { 0, 0 };
+  fits.imageSize(2, size);
+  if(fits.imageType() != SHORT_IMG || fits.imageDimensionCount() != 2 || size[0] != 12 || size[1] != 8)
+    return 1;
+  fits.select(4);
+  fits.imageSize(2, size);
+  if(size[0] != 13)
+    return 1;
+
+  auto data = fits.getPixels(fits.getImageParameters(2));
+  if(!data || ((uint16_t*)data.get())[0] != 200 || ((uint16_t*)data.get())[12 * 8 - 1] != 200 + 12 * 8 - 1)
+    return 1;
+
+  // A handle opened with the index doesn't build its own
+  Fits shared(path, index);
+  if(shared.index() != index || shared.imageCount() != fits.imageCount())
+    return 1;
+  for(int hdu = 0; hdu < 4; ++hdu) {
+    if(!(shared.getImageParameters(hdu) == fits.getImageParameters(hdu)))
+      return 1;
+  }
+
+  data = shared.getPixels(shared.getImageParameters(3));
+  if(!data || ((uint16_t*)data.get())[0] != 300 || ((uint16_t*)data.get())[13 * 8 - 1] != 300 + 13 * 8 - 1)
+    return 1;
+
+  std::filesystem::remove(path);
+  return 0;
+}
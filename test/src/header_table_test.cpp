@@ -0,0 +1,86 @@
+#include "io/header_table.hpp"
+
+#include <cmath>
+#include <fstream>
+#include <unistd.h>
+
+using namespace IO;
+
+int main() {
+  auto directory = std::filesystem::temp_directory_path() / ("header_table_test_" + std::to_string(getpid()));
+  std::filesystem::create_directories(directory);
+  auto source = directory / "images.fit";
+  auto path = directory / "images.headers";
+  std::ofstream(source) << "data";
+
+  // Every third image has no filter, image 7 has no header at all
+  const int imageCount = 1000;
+  HduIndex hdus(imageCount);
+  for(int i = 0; i < imageCount; ++i) {
+    hdus[i].m_cards["EXPTIME"] = std::to_string(i % 10);
+    hdus[i].m_cards["DATE-OBS"] = "2024-03-01T00:00:" + std::to_string(10 + i % 50) + ".5";
+    if(i % 3)
+      hdus[i].m_cards["FILTER"] = i % 2 ? "Ha" : "OIII";
+  }
+  std::vector<int> indices;
+  for(int i = 0; i < imageCount; ++i)
+    indices.push_back(i);
+  auto lookup = [&](int index) -> const HduInfo* {
+    return index == 7 ? nullptr : &hdus[index];
+  };
+
+  bool success = true;
+  auto check = [&](const HeaderTable& table) {
+    if(table.rowCount() != imageCount || table.indices() != indices)
+      success = false;
+    if(table.number("EXPTIME", 13) != 3 || !std::isnan(table.number("EXPTIME", 7)))
+      success = false;
+    if(table.column("EXPTIME")->m_numbers.size() != imageCount)
+      success = false;
+    if(table.filter("EXPTIME", 2, 3).size() != 200)
+      success = false;
+    for(int index : table.filter("FILTER", "Ha")) {
+      if(index % 3 == 0 || index % 2 == 0)
+        success = false;
+    }
+    // 1709251200 is 2024-03-01T00:00:00
+    if(table.number("DATE-OBS", 1) != 1709251211.5)
+      success = false;
+  };
+
+  auto built = HeaderTable::build(indices, lookup, { source });
+  check(*built);
+  if(!built->save(path))
+    success = false;
+
+  auto loaded = HeaderTable::load(path);
+  if(!loaded)
+    success = false;
+  else
+    check(*loaded);
+
+  // A corrupt row count is rejected before anything is allocated
+  auto corrupt = directory / "corrupt.headers";
+  std::filesystem::copy_file(path, corrupt);
+  {
+    std::fstream stream(corrupt, std::ios::in | std::ios::out | std::ios::binary);
+    uint32_t rowCount = 0xffffffff;
+    stream.seekp(16);
+    stream.write((const char*)&rowCount, sizeof(rowCount));
+  }
+  if(HeaderTable::load(corrupt))
+    success = false;
+
+  if(!std::isnan(HeaderTable::parseNumber("abc")) || HeaderTable::parseNumber("1.5D2") != 150)
+    success = false;
+  if(!std::isnan(HeaderTable::parseDate("2024-02-30")) || HeaderTable::parseDate("1970-01-02") != 86400)
+    success = false;
+
+  // Changing the source makes the table stale
+  std::ofstream(source, std::ios::app) << "more data";
+  if(HeaderTable::load(path))
+    success = false;
+
+  std::filesystem::remove_all(directory);
+  return success ? 0 : 1;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "io/provider.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace IO;
+
+// Provider of generated images, by default 10x10 16 bit images where every
+// byte holds the image index. Reads are counted and can be slowed down or
+// made to throw.
+class MockProvider : public ImageProvider {
+public:
+  using Fill = std::function<void(const DataParameters& params, void *ptr)>;
+
+  std::atomic<int> m_reads;
+  std::atomic<size_t> m_bytesRead;
+  std::atomic<bool> m_fail;
+  std::chrono::milliseconds m_delay;
+
+private:
+  std::vector<long> m_dims;
+  DataType::EnumType m_type;
+  Fill m_fill;
+  double m_maxValue;
+
+public:
+  MockProvider(int imageCount, std::vector<long> dims = { 10, 10 }, DataType::EnumType type = DataType::USHORT,
+               Fill fill = fillIndex, double maxValue = 65535)
+    : m_reads(0)
+    , m_bytesRead(0)
+    , m_fail(false)
+    , m_delay(0)
+    , m_dims(std::move(dims))
+    , m_type(type)
+    , m_fill(std::move(fill))
+    , m_maxValue(maxValue) {
+    m_imageCount = imageCount;
+  }
+
+  static void fillIndex(const DataParameters& params, void *ptr) {
+    memset(ptr, params.index(), params.byteSize());
+  }
+
+  virtual DataParameters getImageParameters(int index) override {
+    return DataParameters(index, m_type, m_dims.size(), m_dims.data());
+  }
+
+  virtual bool readPixels(const DataParameters& params, void *ptr) override {
+    ++m_reads;
+    m_bytesRead += params.byteSize();
+    if(m_delay.count() > 0)
+      std::this_thread::sleep_for(m_delay);
+    if(m_fail)
+      throw std::runtime_error("read failed");
+    m_fill(params, ptr);
+    return true;
+  }
+
+  virtual double maxTypeValue() override {
+    return m_maxValue;
+  }
+};
+
+// Fills the first layer of a region with fn(x, y), coordinates are 0 based
+// and relative to the whole image
+template<typename T, typename Fn>
+static void fillPixels(const DataParameters& params, void *ptr, Fn&& fn) {
+  T *data = (T*)ptr;
+  for(long y = 0; y < params.height(); ++y) {
+    for(long x = 0; x < params.width(); ++x)
+      data[y * params.width() + x] = (T)fn(params.start()[0] - 1 + x, params.start()[1] - 1 + y);
+  }
+}
+
+static void writeCard(std::ofstream& stream, const std::string& card) {
+  stream << card << std::string(80 - card.size(), ' ');
+}
+
+// Writes 16 bit unsigned images, pixel i of HDU hdu holds value(hdu, i)
+static void writeFits(const std::filesystem::path& path, long width, long height, int hduCount,
+                      const std::function<uint16_t(int hdu, long i)>& value) {
+  std::ofstream stream(path, std::ios::binary);
+  for(int hdu = 0; hdu < hduCount; ++hdu) {
+    if(hdu == 0)
+      writeCard(stream, std::format("{:<8}= {:>20}", "SIMPLE", "T"));
+    else
+      writeCard(stream, std::format("{:<8}= {:>20}", "XTENSION", "'IMAGE   '"));
+    writeCard(stream, std::format("{:<8}= {:>20}", "BITPIX", 16));
+    writeCard(stream, std::format("{:<8}= {:>20}", "NAXIS", 2));
+    writeCard(stream, std::format("{:<8}= {:>20}", "NAXIS1", width));
+    writeCard(stream, std::format("{:<8}= {:>20}", "NAXIS2", height));
+    writeCard(stream, std::format("{:<8}= {:>20}", "BZERO", 32768));
+    writeCard(stream, std::format("{:<8}= {:>20}", "BSCALE", 1));
+    writeCard(stream, "END");
+    stream << std::string(2880 - 8 * 80, ' ');
+
+    // Big-endian signed values with the zero point removed
+    for(long i = 0; i < width * height; ++i) {
+      int16_t stored = (int16_t)(value(hdu, i) - 32768);
+      char bytes[2] = { (char)((uint16_t)stored >> 8), (char)(stored & 0xff) };
+      stream.write(bytes, 2);
+    }
+
+    size_t dataSize = width * height * 2;
+    stream << std::string((2880 - dataSize % 2880) % 2880, '\0');
+  }
+}
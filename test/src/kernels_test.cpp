@@ -0,0 +1,86 @@
+#include "io/kernels.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+using namespace IO;
+
+int main() {
+  const size_t maxCount = 1031;
+  std::vector<uint8_t> bigEndian(2 * maxCount);
+  std::vector<uint16_t> native(maxCount);
+  srand(1);
+  for(auto& byte : bigEndian)
+    byte = rand();
+  for(auto& value : native)
+    value = rand();
+  // Values at the clamping limits
+  native[0] = 0;
+  native[1] = 65535;
+
+  std::vector<uint16_t> words(maxCount), expectedWords(maxCount);
+  std::vector<float> floats(maxCount), expectedFloats(maxCount);
+  std::vector<uint8_t> bytes(maxCount), expectedBytes(maxCount);
+  std::vector<uint16_t> halves(maxCount), expectedHalves(maxCount);
+  // Two source rows for every halved one
+  std::vector<uint16_t> rows(4 * maxCount);
+  for(auto& value : rows)
+    value = rand();
+  rows[0] = rows[1] = rows[2 * maxCount] = rows[2 * maxCount + 1] = 65535;
+
+  for(int level = Kernels::SCALAR; level <= Kernels::supportedLevel(); ++level) {
+    // Every count covers a different mix of vector loop and tail
+    for(size_t count : { 0, 1, 7, 8, 15, 16, 17, 31, 33, 64, 100, 1031 }) {
+      Kernels::setLevel(Kernels::SCALAR);
+      Kernels::swap16(bigEndian.data(), expectedWords.data(), count, 32768);
+      Kernels::swap16ToFloat(bigEndian.data(), expectedFloats.data(), count, 0.5f, 100.0f);
+      Kernels::levelsToByte(native.data(), expectedBytes.data(), count, 0.25f, 1000.0f, 9000.0f);
+      Kernels::halve16(rows.data(), rows.data() + 2 * maxCount, expectedHalves.data(), count);
+
+      Kernels::setLevel((Kernels::Level)level);
+      Kernels::swap16(bigEndian.data(), words.data(), count, 32768);
+      Kernels::swap16ToFloat(bigEndian.data(), floats.data(), count, 0.5f, 100.0f);
+      Kernels::levelsToByte(native.data(), bytes.data(), count, 0.25f, 1000.0f, 9000.0f);
+      Kernels::halve16(rows.data(), rows.data() + 2 * maxCount, halves.data(), count);
+
+      for(size_t i = 0; i < count; ++i) {
+        if(words[i] != expectedWords[i])
+          return 1;
+        if(std::abs(floats[i] - expectedFloats[i]) > 1e-3f)
+          return 1;
+        if(std::abs(bytes[i] - expectedBytes[i]) > 1)
+          return 1;
+        if(halves[i] != expectedHalves[i])
+          return 1;
+      }
+    }
+  }
+
+  // Scalar results against the formulas
+  Kernels::setLevel(Kernels::SCALAR);
+  const uint8_t data[4] = { 0x80, 0x00, 0x7f, 0xff };
+  uint16_t unsignedData[2];
+  Kernels::swap16(data, unsignedData, 2, 32768);
+  if(unsignedData[0] != 0 || unsignedData[1] != 65535)
+    return 1;
+
+  float floatData[2];
+  Kernels::swap16ToFloat(data, floatData, 2, 1.0f, 32768.0f);
+  if(floatData[0] != 0.0f || floatData[1] != 65535.0f)
+    return 1;
+
+  uint8_t byteData[2];
+  Kernels::levelsToByte(native.data(), byteData, 2, 1.0f, 1000.0f, 2000.0f);
+  if(byteData[0] != 0 || byteData[1] != 255)
+    return 1;
+
+  // Halves are rounded up, the largest values don't overflow
+  const uint16_t row0[4] = { 1, 2, 65535, 65535 }, row1[4] = { 1, 2, 65535, 65535 };
+  uint16_t halveData[2];
+  Kernels::halve16(row0, row1, halveData, 2);
+  if(halveData[0] != 2 || halveData[1] != 65535)
+    return 1;
+
+  return 0;
+}
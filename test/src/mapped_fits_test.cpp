@@ -0,0 +1,132 @@
+#include "io/mapped_fits.hpp"
+
+#include "io_util.hpp"
+
+// Writes one HDU with the given extra cards and raw big-endian data
+static void writeHdu(std::ofstream& stream, bool primary, int bitpix, long width, long height,
+                     const std::vector<std::string>& cards, const std::vector<uint8_t>& data) {
+  if(primary)
+    writeCard(stream, std::format("{:<8}= {:>20}", "SIMPLE", "T"));
+  else
+    writeCard(stream, std::format("{:<8}= {:>20}", "XTENSION", "'IMAGE   '"));
+  writeCard(stream, std::format("{:<8}= {:>20}", "BITPIX", bitpix));
+  writeCard(stream, std::format("{:<8}= {:>20}", "NAXIS", 2));
+  writeCard(stream, std::format("{:<8}= {:>20}", "NAXIS1", width));
+  writeCard(stream, std::format("{:<8}= {:>20}", "NAXIS2", height));
+  for(auto& card : cards)
+    writeCard(stream, card);
+  writeCard(stream, "END");
+  stream << std::string(2880 - (6 + cards.size()) * 80, ' ');
+
+  stream.write((const char*)data.data(), data.size());
+  stream << std::string((2880 - data.size() % 2880) % 2880, '\0');
+}
+
+int main() {
+  auto dir = std::filesystem::temp_directory_path() / "mapped_fits_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+
+  // Unsigned 16 bit data through BZERO = 32768, every pixel holds 1000 * hdu + y * width + x
+  auto path = dir / "ushort.fit";
+  writeFits(path, 20, 10, 3, [](int hdu, long i) { return 1000 * hdu + i; });
+
+  MappedFits fits(path);
+  if(fits.imageCount() != 3 || fits.maxTypeValue() != 65535)
+    return 1;
+  auto params = fits.getImageParameters(2);
+  if(params.type() != DataType::USHORT || params.width() != 20 || params.height() != 10)
+    return 1;
+
+  auto data = fits.getPixels(params);
+  if(!data || ((uint16_t*)data.get())[0] != 2000 || ((uint16_t*)data.get())[199] != 2199)
+    return 1;
+
+  // Every second column of every third row
+  auto strided = fits.getImageParameters(1);
+  strided.setDimension(0, 1, 20, 2);
+  strided.setDimension(1, 1, 9, 3);
+  if(strided.width() != 10 || strided.height() != 3)
+    return 1;
+  data = fits.getPixels(strided);
+  const uint16_t *pixels = (const uint16_t*)data.get();
+  if(!data || pixels[0] != 1000 || pixels[1] != 1000 + 2 || pixels[10] != 1000 + 3 * 20 || pixels[29] != 1000 + 6 * 20 + 18)
+    return 1;
+
+  // Converted to another type on the way
+  data = fits.getPixels(fits.getImageParameters(1).withType(DataType::FLOAT));
+  if(!data || ((const float*)data.get())[21] != 1021)
+    return 1;
+
+  // Scaled data is read as float, value = stored * BSCALE + BZERO
+  auto scaledPath = dir / "scaled.fit";
+  {
+    std::ofstream stream(scaledPath, std::ios::binary);
+    std::vector<uint8_t> stored;
+    for(int16_t value : { -4, -2, 0, 2, 4, 6 }) {
+      stored.push_back((uint16_t)value >> 8);
+      stored.push_back(value & 0xff);
+    }
+    writeHdu(stream, true, 16, 3, 2, {
+      std::format("{:<8}= {:>20}", "BZERO", 10),
+      std::format("{:<8}= {:>20}", "BSCALE", 0.5),
+    }, stored);
+  }
+
+  MappedFits scaled(scaledPath);
+  params = scaled.getImageParameters(0);
+  if(scaled.imageCount() != 1 || params.type() != DataType::FLOAT)
+    return 1;
+  data = scaled.getPixels(params);
+  const float *values = (const float*)data.get();
+  if(!data || values[0] != 8 || values[2] != 10 || values[5] != 13)
+    return 1;
+
+  // Unscaled 8 bit data is handed out straight from the mapping
+  auto bytePath = dir / "bytes.fit";
+  {
+    std::ofstream stream(bytePath, std::ios::binary);
+    std::vector<uint8_t> bytes(4 * 3);
+    for(size_t i = 0; i < bytes.size(); ++i)
+      bytes[i] = i;
+    writeHdu(stream, true, 8, 4, 3, {}, bytes);
+  }
+
+  MappedFits bytes(bytePath);
+  params = bytes.getImageParameters(0);
+  data = bytes.getPixels(params);
+  if(!data || data.get() != bytes.rawPixels(0))
+    return 1;
+  params.setDimension(1, 2, 3, 1);
+  data = bytes.getPixels(params);
+  if(!data || data.get() != bytes.rawPixels(0) + 4 || data[0] != 4)
+    return 1;
+
+  // Partial rows aren't contiguous and get copied
+  params.setDimension(0, 2, 3, 1);
+  data = bytes.getPixels(params);
+  if(!data || data.get() == bytes.rawPixels(0) + 5 || data[0] != 5 || data[3] != 10)
+    return 1;
+
+  // Tile compressed images can't be mapped
+  auto compressedPath = dir / "compressed.fit";
+  {
+    std::ofstream stream(compressedPath, std::ios::binary);
+    writeHdu(stream, true, 8, 4, 3, {}, std::vector<uint8_t>(12));
+    writeHdu(stream, false, 8, 4, 3, { std::format("{:<8}= {:>20}", "ZIMAGE", "T") }, std::vector<uint8_t>(12));
+  }
+  MappedFits compressed(compressedPath);
+  if(compressed.imageCount() != -1 || compressed.getPixels(compressed.getImageParameters(0)))
+    return 1;
+
+  // Files which end in the middle of the data are rejected
+  auto truncatedPath = dir / "truncated.fit";
+  writeFits(truncatedPath, 100, 100, 2, [](int, long) { return 0; });
+  std::filesystem::resize_file(truncatedPath, std::filesystem::file_size(truncatedPath) - 2880);
+  MappedFits truncated(truncatedPath);
+  if(truncated.imageCount() != -1)
+    return 1;
+
+  std::filesystem::remove_all(dir);
+  return 0;
+}
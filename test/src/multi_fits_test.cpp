@@ -0,0 +1,45 @@
+#include "io/multi_fits.hpp"
+
+#include "io_util.hpp"
+
+#include <atomic>
+#include <thread>
+
+int main() {
+  auto dir = std::filesystem::temp_directory_path() / "multi_fits_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+
+  // Image 4 is missing on purpose
+  for(int index : { 1, 2, 3, 5, 6, 7 })
+    writeFits(MultiFits::filePath(dir, "light_", index, 5, ".fit"), 20, 10, 1, [&](int, long) { return 1000 + index; });
+
+  MultiFits fits(dir, "light_", { 1, 2, 3, 4, 5, 6, 7 }, 5, false, 2);
+  if(fits.imageCount() != 6)
+    return 1;
+  if(fits.path(3).filename() != "light_00003.fit" || !fits.path(4).empty())
+    return 1;
+  if(fits.getImageParameters(4) || fits.getImageParameters(5).width() != 20)
+    return 1;
+
+  // Read all images from multiple threads through a pool of two handles
+  std::atomic<bool> failed = false;
+  std::vector<std::thread> threads;
+  for(int t = 0; t < 4; ++t) {
+    threads.emplace_back([&]() {
+      for(int index : { 1, 2, 3, 5, 6, 7 }) {
+        auto data = fits.getPixels(fits.getImageParameters(index));
+        if(!data || ((uint16_t*)data.get())[0] != 1000 + index)
+          failed = true;
+      }
+    });
+  }
+  for(auto& thread : threads)
+    thread.join();
+
+  if(failed || fits.handleCount() > 2)
+    return 1;
+
+  std::filesystem::remove_all(dir);
+  return 0;
+}
@@ -0,0 +1,106 @@
+#include "io/mapped_fits.hpp"
+#include "io/prefetch.hpp"
+
+#include "io_util.hpp"
+
+int main() {
+  auto provider = new MockProvider(20);
+  auto cache = new CachedImageProvider(provider, 1 << 20);
+  PrefetchingProvider prefetch(cache, 3);
+
+  // Stepping forwards prefetches the following images
+  prefetch.getPixels(prefetch.getImageParameters(4));
+  prefetch.getPixels(prefetch.getImageParameters(5));
+  prefetch.waitIdle();
+
+  int reads = provider->m_reads;
+  for(int index : { 6, 7, 8 }) {
+    auto data = prefetch.getPixels(prefetch.getImageParameters(index));
+    if(!data || data[0] != index)
+      return 1;
+  }
+  prefetch.waitIdle();
+
+  // 6, 7 and 8 were already cached, only images ahead of them were read
+  auto stats = cache->statistics();
+  if(stats.m_misses != reads + 3 || provider->m_reads != reads + 3)
+    return 1;
+
+  // Stepping backwards near the start doesn't go past the first image
+  prefetch.getPixels(prefetch.getImageParameters(2));
+  prefetch.getPixels(prefetch.getImageParameters(1));
+  prefetch.waitIdle();
+  if(!cache->statistics().m_entries || provider->m_reads != reads + 3 + 3)
+    return 1;
+
+  // Explicit order takes precedence over the direction
+  prefetch.setAccessOrder({ 15, 12, 18 });
+  prefetch.getPixels(prefetch.getImageParameters(15));
+  prefetch.waitIdle();
+  reads = provider->m_reads;
+
+  uint8_t buffer[200];
+  if(!prefetch.readPixels(prefetch.getImageParameters(12), buffer) || buffer[0] != 12)
+    return 1;
+  if(!prefetch.readPixels(prefetch.getImageParameters(18), buffer) || buffer[0] != 18)
+    return 1;
+  prefetch.waitIdle();
+  if(provider->m_reads != reads)
+    return 1;
+
+  // Stepping backwards through the order prefetches the earlier entries,
+  // indices which aren't listed are never read ahead
+  prefetch.setAccessOrder({ 14, 16, 17, 19 });
+  reads = provider->m_reads;
+  prefetch.getPixels(prefetch.getImageParameters(19));
+  prefetch.getPixels(prefetch.getImageParameters(17));
+  prefetch.waitIdle();
+  if(provider->m_reads != reads + 4)
+    return 1;
+  if(!prefetch.readPixels(prefetch.getImageParameters(16), buffer) || !prefetch.readPixels(prefetch.getImageParameters(14), buffer))
+    return 1;
+  prefetch.waitIdle();
+  if(provider->m_reads != reads + 4 || cache->statistics().m_entries != 18)
+    return 1;
+
+  // Prefetches which throw are dropped on the worker threads
+  auto failing = new MockProvider(10);
+  PrefetchingProvider failingPrefetch(new CachedImageProvider(failing, 1 << 20), 3);
+  failing->m_fail = true;
+  try {
+    failingPrefetch.getPixels(failingPrefetch.getImageParameters(0));
+    return 1;
+  } catch(const std::exception&) {
+  }
+  failingPrefetch.waitIdle();
+  if(failing->m_reads != 4)
+    return 1;
+
+  // Stepping through a mapped file advises the data of the following images
+  auto path = std::filesystem::temp_directory_path() / "prefetch_test.fit";
+  writeFits(path, 100, 100, 10, [](int hdu, long) { return hdu; });
+  MappedFits mapped(path, 3);
+  for(int index : { 2, 3 }) {
+    auto data = mapped.getPixels(mapped.getImageParameters(index));
+    if(!data || ((uint16_t*)data.get())[0] != index)
+      return 1;
+  }
+  if(mapped.advisedImages() != std::vector<int>{ 4, 5, 6 })
+    return 1;
+
+  // Not past the end of the file
+  for(int index : { 7, 8 })
+    mapped.getPixels(mapped.getImageParameters(index));
+  if(mapped.advisedImages() != std::vector<int>{ 9 })
+    return 1;
+
+  // Backwards along an access order
+  mapped.setAccessOrder({ 0, 2, 4, 6, 8 });
+  mapped.getPixels(mapped.getImageParameters(8));
+  mapped.getPixels(mapped.getImageParameters(6));
+  if(mapped.advisedImages() != std::vector<int>{ 4, 2, 0 })
+    return 1;
+
+  std::filesystem::remove(path);
+  return 0;
+}
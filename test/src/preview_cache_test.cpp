@@ -0,0 +1,66 @@
+#include "io/preview_cache.hpp"
+
+#include "io_util.hpp"
+
+#include <fstream>
+
+int main() {
+  auto dir = std::filesystem::temp_directory_path() / "preview_cache_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+
+  auto source = dir / "images.fit";
+  std::ofstream(source) << "data";
+  auto cachePath = dir / "images.preview";
+
+  // 1000x600 16 bit images with a 2x2 checker pattern
+  auto provider = new MockProvider(3, { 1000, 600 }, DataType::USHORT, [](const DataParameters& params, void *ptr) {
+    fillPixels<uint16_t>(params, ptr, [&](long x, long y) { return ((x + y) % 2) ? 1000 * params.index() : 3000; });
+  });
+  PyramidProvider pyramid(provider, 64 << 20);
+  {
+    PreviewCache cache(cachePath);
+    for(int i = 0; i < 3; ++i) {
+      auto preview = cache.get(pyramid, source, i);
+      // 1000 wide images use the first level, which averages 2x2 blocks
+      if(!preview || preview.m_width != 500 || preview.m_height != 300)
+        return 1;
+      if(preview.m_data[0] != (3000 + 1000 * i) / 2)
+        return 1;
+    }
+    if(!cache.save())
+      return 1;
+  }
+
+  // Reopening serves all previews from the file
+  provider->m_reads = 0;
+  {
+    PreviewCache cache(cachePath);
+    if(cache.size() != 3)
+      return 1;
+    auto preview = cache.get(pyramid, source, 2);
+    if(!preview || preview.m_data[preview.m_width * preview.m_height - 1] != 2500 || provider->m_reads != 0)
+      return 1;
+  }
+
+  // Levels wider than the preview width are skipped, 1499 wide images
+  // have levels 749 and 374 pixels wide
+  PyramidProvider wide(new MockProvider(2, { 1499, 600 }), 64 << 20);
+  {
+    PreviewCache cache(cachePath);
+    auto preview = cache.get(wide, dir / "wide.fit", 1);
+    if(!preview || preview.m_width != 374 || preview.m_height != 150 || preview.m_data[0] != 0x0101)
+      return 1;
+  }
+
+  // Changing the source drops its previews
+  std::ofstream(source) << "other data";
+  {
+    PreviewCache cache(cachePath);
+    if(cache.size() != 0)
+      return 1;
+  }
+
+  std::filesystem::remove_all(dir);
+  return 0;
+}
@@ -0,0 +1,43 @@
+#include "io/pyramid.hpp"
+
+#include "io_util.hpp"
+
+int main() {
+  // 130x64 16 bit images, columns alternate between 0 and 4
+  auto provider = new MockProvider(2, { 130, 64 }, DataType::USHORT, [](const DataParameters& params, void *ptr) {
+    fillPixels<uint16_t>(params, ptr, [](long x, long y) { return (x % 2) ? 4 : 0; });
+  });
+  PyramidProvider pyramid(provider, 1 << 20);
+
+  // 130, 65, 32, 16
+  if(pyramid.levelCount(0) != 4)
+    return 1;
+
+  auto level = pyramid.getLevel(0, 40);
+  if(!level || level.m_level != 1 || level.m_width != 65 || level.m_height != 32)
+    return 1;
+  if(((uint16_t*)level.m_data.get())[0] != 2)
+    return 1;
+
+  // Narrower requests are served from the same pyramid
+  level = pyramid.getLevel(0, 1);
+  if(!level || level.m_level != 3 || level.m_width != 16 || level.m_height != 8 || provider->m_reads != 1)
+    return 1;
+
+  // Wider than the image gives the full resolution
+  level = pyramid.getLevel(1, 1000);
+  if(!level || level.m_level != 0 || level.m_width != 130)
+    return 1;
+
+  // Negative averages are rounded the same way as positive ones,
+  // blocks of -1, -1, -1 and -2 average to -1.25
+  auto signedProvider = new MockProvider(1, { 64, 64 }, DataType::SHORT, [](const DataParameters& params, void *ptr) {
+    fillPixels<int16_t>(params, ptr, [](long x, long y) { return (x % 2 && y % 2) ? -2 : -1; });
+  });
+  PyramidProvider signedPyramid(signedProvider, 1 << 20);
+  level = signedPyramid.getLevel(0, 32);
+  if(!level || level.m_level != 1 || ((int16_t*)level.m_data.get())[0] != -1)
+    return 1;
+
+  return 0;
+}
@@ -0,0 +1,73 @@
+#include "io/fits.hpp"
+#include "io/rice.hpp"
+
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace IO;
+
+static const long WIDTH = 300;
+static const long HEIGHT = 200;
+
+static uint16_t pixelValue(long x, long y) {
+  return (uint16_t)(x * 7 + y * 311 + 20000);
+}
+
+int main() {
+  auto path = std::filesystem::temp_directory_path() / "rice_tiles_test.fits.fz";
+  std::filesystem::remove(path);
+
+  // Let cfitsio write a Rice compressed image with 100x10 tiles
+  std::vector<uint16_t> image(WIDTH * HEIGHT);
+  for(long y = 0; y < HEIGHT; ++y)
+    for(long x = 0; x < WIDTH; ++x)
+      image[y * WIDTH + x] = pixelValue(x, y);
+
+  int status = 0;
+  fitsfile *fptr;
+  std::string name = path.string() + "[compress R 100,10]";
+  long dims[2] = { WIDTH, HEIGHT };
+  fits_create_file(&fptr, name.c_str(), &status);
+  fits_create_img(fptr, USHORT_IMG, 2, dims, &status);
+  fits_write_img(fptr, TUSHORT, 1, WIDTH * HEIGHT, image.data(), &status);
+  fits_close_file(fptr, &status);
+  if(status)
+    return 1;
+
+  Fits fits(path);
+  auto index = fits.index();
+  if(fits.imageCount() != 2 || !index || !(*index)[1].m_compressed)
+    return 1;
+
+  // Tile table is readable
+  fits_open_file(&fptr, path.c_str(), READONLY, &status);
+  fits_movabs_hdu(fptr, 2, nullptr, &status);
+  int fd = open(path.c_str(), O_RDONLY);
+  auto tiles = RiceTiles::load(fptr, (*index)[1], fd);
+  fits_close_file(fptr, &status);
+  if(!tiles || tiles->tileCount() != 3 * 20)
+    return 1;
+
+  // Whole image and a region crossing tile borders
+  auto params = fits.getImageParameters(1);
+  std::vector<uint16_t> pixels(WIDTH * HEIGHT);
+  if(!tiles->read(params, pixels.data()) || pixels != image)
+    return 1;
+
+  params.setDimension(0, 90, 210, 1);
+  params.setDimension(1, 5, 25, 1);
+  if(!fits.readPixels(params, pixels.data()))
+    return 1;
+  for(long y = 4; y < 25; ++y) {
+    for(long x = 89; x < 210; ++x) {
+      if(pixels[(y - 4) * 121 + (x - 89)] != pixelValue(x, y))
+        return 1;
+    }
+  }
+
+  close(fd);
+  std::filesystem::remove(path);
+  return 0;
+}
@@ -0,0 +1,82 @@
+#include "io/sequence_file.hpp"
+
+#include <cmath>
+
+using namespace IO;
+
+static const char *INPUT1 =
+"S 'test sequence' 0 3 2 0 1 4 1 0\r\n"
+"# comment\n"
+"TS\n"
+"L 3\n"
+"I 0 1 6000,4000\n"
+"I 1 1 6000,4000\n"
+"I 3 0 5999,3999\n"
+"\n"
+"M0-0 12144384 -1 -101 -102 -103 -104 -105 -106 -107 -108 990 3889 65535 -1000\n"
+"M*-2 12144384 -1 -999999 1e400 -999999 -999999 -999999 -999999 -999999 -999999 1046 2317 65535 nan\n"
+"R1 0.5 1 2 3 4 5 H 10 11 12 13 14 15 16 17 1.8e1\n"
+"R1 0 1 2 3 4 5 H 10 11 12 13 14 15 16 17 18";
+
+static bool parses(const char *text) {
+  SequenceFile file;
+  return file.parse(text);
+}
+
+int main() {
+  SequenceFile file;
+  if(!file.parse(INPUT1))
+    return 1;
+
+  if(file.m_name != "test sequence" || file.m_imageCount != 3 || file.m_selectedCount != 2 ||
+     file.m_referenceImageIndex != 1 || file.m_version != 4 || !file.m_variableSizeImages || file.m_fzFlag)
+    return 1;
+  if(file.m_type != SequenceType::SER || file.m_layerCount != 3)
+    return 1;
+
+  if(file.m_images.size() != 3 || file.m_images[2].m_fileIndex != 3 || file.m_images[2].m_included ||
+     file.m_images[2].m_width != 5999 || file.m_images[2].m_height != 3999)
+    return 1;
+
+  if(file.m_stats.size() != 2)
+    return 1;
+  auto& stats = file.m_stats[0];
+  if(stats.m_image != 0 || stats.m_layer != 0 || stats.m_totalPixels != 12144384 || stats.m_goodPixels != -1 ||
+     stats.m_mean != -101 || stats.m_max != 3889 || stats.m_bgNoise != -1000)
+    return 1;
+  // Out of range values turn into infinity like with sscanf
+  if(file.m_stats[1].m_image != 2 || file.m_stats[1].m_layer != 0 || !std::isinf(file.m_stats[1].m_median) ||
+     !std::isnan(file.m_stats[1].m_bgNoise))
+    return 1;
+
+  if(file.m_registrations.size() != 2 || file.m_registrationLayer != 1)
+    return 1;
+  auto& reg = file.m_registrations[0];
+  if(reg.m_FWHM != 0.5f || reg.m_numberOfStars != 5 || reg.m_matrix[0] != 10 || reg.m_matrix[8] != 18)
+    return 1;
+
+  // Unquoted names and fixed size images
+  SequenceFile fixed;
+  if(!fixed.parse("S name 1 1 1 0 0 4 0 1\nI 5 1\n") || fixed.m_name != "name" || !fixed.m_fzFlag ||
+     fixed.m_images.size() != 1 || fixed.m_images[0].m_width != -1 || fixed.m_type != SequenceType::MULTI_FITS)
+    return 1;
+
+  if(parses("S \"\" 0 1 1 0 0 4 0 0\n"))
+    return 1;
+  if(parses("S 'a' 0 1 1 0 0 3 0 0\n"))
+    return 1;
+  if(parses("S 'a' 0 1 1 0 0 4 0 0\nS 'b' 0 1 1 0 0 4 0 0\n"))
+    return 1;
+  if(parses("S 'a' 0 1 1 0 0 4 0 0\nI 1 1 10,10\n"))
+    return 1;
+  if(parses("S 'a' 0 1 1 0 0 4 0 0\nI 1 1\nM0-0 1 2 3\n"))
+    return 1;
+  if(parses("S 'a' 0 1 1 0 0 4 0 0\nI 1 1\nR0 1 2 3 4 5 6 H 1 2 3\n"))
+    return 1;
+  if(parses("S 'a' 0 2 2 0 0 4 0 0\nI 1 1\nI 2 1\nR0 1 2 3 4 5 6 H 1 0 0 0 1 0 0 0 1\nR1 1 2 3 4 5 6 H 1 0 0 0 1 0 0 0 1\n"))
+    return 1;
+  if(parses("S 'a' 0 1 1 0 0 4 0 0\nTX\n"))
+    return 1;
+
+  return 0;
+}
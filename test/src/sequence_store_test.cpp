@@ -0,0 +1,106 @@
+#include "io/sequence_store.hpp"
+
+#include <chrono>
+#include <cmath>
+
+#include <spdlog/spdlog.h>
+
+using namespace IO;
+
+static const char *INPUT =
+"S 'store' 0 4 3 0 1 4 1 0\n"
+"L 2\n"
+"I 0 1 100,80\n"
+"I 1 1 100,80\n"
+"I 2 0 100,80\n"
+"I 3 1 90,70\n"
+"M0-0 8000 -1 1 2 3 4 5 6 7 8 0 65535 65535 9\n"
+"M0-1 8000 -1 1 2 3 4 5 6 7 8 0 65535 65535 9\n"
+"M1-0 8000 -1 1 2 3 4 5 6 7 8 0 65535 65535 9\n"
+"R0 1 2 3 4 5 6 H 1 0 0 0 1 0 0 0 1\n"
+"R0 1 2 3 4 5 6 H 1 0 10 0 1 -4 0 0 1\n";
+
+static bool same(const double *a, const double *b) {
+  for(int i = 0; i < 9; ++i) {
+    if(std::abs(a[i] - b[i]) > 1e-9)
+      return false;
+  }
+  return true;
+}
+
+int main() {
+  SequenceFile file;
+  if(!file.parse(INPUT))
+    return 1;
+
+  SequenceStore store;
+  if(!store.load(file))
+    return 1;
+
+  if(store.size() != 4 || store.layerCount() != 2 || store.includedCount() != 3)
+    return 1;
+  if(store.fileIndex(2) != 2 || store.included(2) || store.width(1) != 100 || store.height(1) != 80)
+    return 1;
+  if(store.width(3) != 90 || store.height(3) != 70)
+    return 1;
+
+  if(!store.hasRegistration(1) || store.hasRegistration(2) || store.registration(1).m_numberOfStars != 6)
+    return 1;
+  if(!store.stats(0, 1) || store.stats(1, 1) || !store.stats(1, 0) || store.stats(1, 0)->m_bgNoise != 9)
+    return 1;
+
+  // Saving gives back what was loaded
+  SequenceFile saved = file;
+  store.save(saved);
+  if(!(saved.m_images == file.m_images) || !(saved.m_registrations == file.m_registrations) || !(saved.m_stats == file.m_stats))
+    return 1;
+
+  // Registrations are written without gaps
+  store.setMatrix(3, file.m_registrations[1].m_matrix);
+  store.save(saved);
+  if(saved.m_registrations.size() != 2)
+    return 1;
+  if(!store.fillRegistrationGaps() || !store.hasRegistration(2) || store.fillRegistrationGaps())
+    return 1;
+  store.save(saved);
+  if(saved.m_registrations.size() != 4)
+    return 1;
+
+  // Moving the reference to image 1 moves its offset onto all others
+  store.changeReference(0, 1);
+  double identity[9] = { 1, 0, 0, 0, 1, 0, 0, 0, 1 };
+  double moved[9] = { 1, 0, -10, 0, 1, 4, 0, 0, 1 };
+  if(!same(store.matrix(1), identity) || !same(store.matrix(0), moved) || !same(store.matrix(2), moved) || !same(store.matrix(3), identity))
+    return 1;
+
+  // Stats of layers that don't exist are rejected
+  SequenceFile broken = file;
+  broken.m_stats[0].m_layer = 2;
+  SequenceStore rejected;
+  if(rejected.load(broken))
+    return 1;
+  broken = file;
+  broken.m_stats[1].m_image = 0;
+  if(rejected.load(broken))
+    return 1;
+
+  // Loading a large sequence only fills the columns
+  SequenceFile large;
+  large.m_layerCount = 3;
+  for(int i = 0; i < 100000; ++i) {
+    large.m_images.push_back({ i, true, 6000, 4000 });
+    large.m_registrations.push_back(file.m_registrations[1]);
+    for(int l = 0; l < 3; ++l) {
+      large.m_stats.push_back(file.m_stats[0]);
+      large.m_stats.back().m_image = i;
+      large.m_stats.back().m_layer = l;
+    }
+  }
+  auto start = std::chrono::steady_clock::now();
+  if(!store.load(large) || store.size() != 100000 || store.fileIndex(99999) != 99999 || !store.stats(99999, 2))
+    return 1;
+  auto end = std::chrono::steady_clock::now();
+  spdlog::info("Loaded 100000 images in {} ms", std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count());
+
+  return 0;
+}
@@ -0,0 +1,151 @@
+#include "io/sequence_writer.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+using namespace IO;
+
+static const char *INPUT1 =
+"S 'test_sequence' 0 3 2 0 1 4 0 0\n"
+"TF\n"
+"L 3\n"
+"I 0 1\n"
+"I 1 1\n"
+"I 3 0\n"
+"M0-0 12144384 -1 -101 -102 -103 -104 -105 -106 -107 -108 990 3889 65535 -1000\n"
+"R1 0 1 2 3 4 5 H 10 11 12 13 14 15 16 17 18\n"
+"M1-0 12144384 -1 -999999 -999999 -999999 -999999 -999999 -999999 -999999 -999999 1046 2317 65535 -999999\n"
+"M2-0 12144384 -1 -999999 -999999 -999999 -999999 -999999 -999999 -999999 -999999 1006 1603 65535 -999999\n";
+
+static std::string readFile(const std::filesystem::path& path) {
+  std::ifstream stream(path);
+  std::stringstream text;
+  text << stream.rdbuf();
+  return text.str();
+}
+
+int main() {
+  SequenceFile file;
+  if(!file.parse(INPUT1))
+    return 1;
+
+  // Same text as the file it was read from
+  std::string text;
+  SequenceWriter::format(file, text);
+  if(text != INPUT1)
+    return 1;
+
+  // A big sequence with registrations for every frame
+  const int frames = 30000;
+  std::string big = "S 'big' 0 30000 30000 5 0 4 0 0\nL 1\n";
+  for(int i = 0; i < frames; ++i)
+    big += "I " + std::to_string(i) + " 1\n";
+  for(int i = 0; i < frames; ++i)
+    big += "R0 2.5 2.75 0.875 0.5 1200.5 180 H 1 0 " + std::to_string(i % 100) + ".25 0 1 -3.5 0 0 1\n";
+  if(!file.parse(big))
+    return 1;
+
+  auto path = std::filesystem::temp_directory_path() / ("sequence_writer_test_" + std::to_string(getpid()) + ".seq");
+  SequenceWriter writer(path);
+  if(!writer.update(file) || writer.lastWriteSize() != big.size() || readFile(path) != big)
+    return 1;
+
+  // Nudging one frame only writes its line
+  file.m_registrations[100].m_matrix[2] = 1.5;
+  if(!writer.update(file) || writer.lastWriteSize() > 100)
+    return 1;
+  SequenceFile reread;
+  if(!reread.parse(readFile(path)) || reread.m_registrations[100].m_matrix[2] != 1.5 || reread.m_registrations.size() != frames)
+    return 1;
+
+  // A line which grows pushes the rest of the file back, but gets room
+  // to grow further
+  file.m_registrations[frames - 10].m_matrix[5] = -3.0625;
+  if(!writer.update(file) || writer.lastWriteSize() > 20 * 100)
+    return 1;
+  file.m_registrations[frames - 10].m_matrix[5] = -3.125;
+  if(!writer.update(file) || writer.lastWriteSize() > 100)
+    return 1;
+
+  // Unchanged contents write nothing
+  if(!writer.update(file) || writer.lastWriteSize() != 0)
+    return 1;
+
+  if(!reread.parse(readFile(path)) || reread.m_registrations[frames - 10].m_matrix[5] != -3.125 ||
+     reread.m_registrations[frames - 11].m_matrix[5] != -3.5 || reread.m_images.size() != frames)
+    return 1;
+
+  // Changes by somebody else and changes to the layout write everything
+  std::ofstream(path, std::ios::app) << "# comment\n";
+  if(!writer.update(file) || writer.lastWriteSize() < big.size())
+    return 1;
+  file.m_images.pop_back();
+  if(!writer.update(file) || writer.lastWriteSize() < big.size() - 100)
+    return 1;
+  SequenceWriter::format(file, text);
+  if(readFile(path) != text)
+    return 1;
+
+  // Patches are journaled before the file is touched and the journal is
+  // dropped once they are synced
+  auto journal = SequenceWriter::journalPath(path);
+  auto before = readFile(path);
+  auto unchanged = file;
+  file.m_images[5].m_included = false;
+  file.m_registrations[200].m_matrix[2] = 123456.0625;
+  if(!writer.update(file) || std::filesystem::exists(journal))
+    return 1;
+  auto after = readFile(path);
+
+  // A crash in between is repaired by applying the journal again
+  std::ofstream(path, std::ios::trunc) << before;
+  SequenceWriter crashing(path);
+  crashing.keepJournal(true);
+  if(!crashing.update(unchanged) || readFile(path) != before)
+    return 1;
+  if(!crashing.update(file) || !std::filesystem::exists(journal))
+    return 1;
+  std::ofstream(path, std::ios::trunc) << before;
+  if(!SequenceWriter::recover(path) || readFile(path) != after || std::filesystem::exists(journal))
+    return 1;
+
+  // Torn records at the end of the journal are ignored
+  SequenceWriter second(path);
+  second.keepJournal(true);
+  if(!second.update(file))
+    return 1;
+  file.m_images[6].m_included = false;
+  if(!second.update(file))
+    return 1;
+  after = readFile(path);
+  file.m_images[7].m_included = false;
+  if(!second.update(file))
+    return 1;
+  std::filesystem::resize_file(journal, std::filesystem::file_size(journal) - 3);
+  std::ofstream(path, std::ios::trunc) << after;
+  if(!SequenceWriter::recover(path) || readFile(path) != after)
+    return 1;
+
+  // A journal left behind isn't replayed over changes made by another
+  // program, even when they keep the size of the file
+  SequenceWriter third(path);
+  third.keepJournal(true);
+  if(!third.update(file))
+    return 1;
+  file.m_images[8].m_included = false;
+  if(!third.update(file) || !std::filesystem::exists(journal))
+    return 1;
+  after = readFile(path);
+  auto edited = after;
+  auto line = edited.find("\nI 9 1\n");
+  if(line == std::string::npos)
+    return 1;
+  edited[line + 5] = '0';
+  std::ofstream(path, std::ios::trunc) << edited;
+  if(SequenceWriter::recover(path) || readFile(path) != edited || std::filesystem::exists(journal))
+    return 1;
+
+  std::filesystem::remove(path);
+  return 0;
+}
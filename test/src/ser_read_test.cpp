@@ -0,0 +1,122 @@
+#include "io/ser.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <unistd.h>
+#include <vector>
+
+using namespace IO;
+
+static void writeInt(std::vector<uint8_t>& data, size_t offset, int32_t value) {
+  for(int i = 0; i < 4; ++i)
+    data[offset + i] = (value >> (8 * i)) & 0xff;
+}
+
+// Frame pixels are i + x + 10 * y + 100 * plane
+static std::vector<uint8_t> serFile(int colorId, int depth, int width, int height, int frames, bool timestamps) {
+  int planes = colorId >= SerFile::RGB ? 3 : 1;
+  int bytes = depth > 8 ? 2 : 1;
+  std::vector<uint8_t> data(SerFile::HEADER_SIZE, 0);
+  memcpy(data.data(), "LUCAM-RECORDER", 14);
+  writeInt(data, 18, colorId);
+  writeInt(data, 22, 1);
+  writeInt(data, 26, width);
+  writeInt(data, 30, height);
+  writeInt(data, 34, depth);
+  writeInt(data, 38, frames);
+  memcpy(data.data() + 42, "observer", 8);
+
+  for(int i = 0; i < frames; ++i) {
+    for(int y = 0; y < height; ++y) {
+      for(int x = 0; x < width; ++x) {
+        for(int plane = 0; plane < planes; ++plane) {
+          int value = i + x + 10 * y + 100 * plane;
+          data.push_back(value & 0xff);
+          if(bytes == 2)
+            data.push_back(value >> 8);
+        }
+      }
+    }
+  }
+
+  if(timestamps) {
+    for(int64_t i = 0; i < frames; ++i) {
+      int64_t value = 621355968000000000ll + i * 10000000;
+      for(int b = 0; b < 8; ++b)
+        data.push_back((value >> (8 * b)) & 0xff);
+    }
+  }
+  return data;
+}
+
+static std::filesystem::path writeFile(const std::string& name, const std::vector<uint8_t>& data) {
+  auto path = std::filesystem::temp_directory_path() / (name + std::to_string(getpid()) + ".ser");
+  std::ofstream(path, std::ios::binary).write((const char*)data.data(), data.size());
+  return path;
+}
+
+int main() {
+  bool success = true;
+
+  // Mono 16 bit frames are handed out from the mapping
+  auto monoPath = writeFile("ser_mono_", serFile(SerFile::MONO, 12, 8, 6, 5, true));
+  {
+    SerFile ser(monoPath);
+    if(ser.imageCount() != 5 || ser.maxTypeValue() != 4095 || ser.observer() != "observer")
+      success = false;
+
+    auto params = ser.getImageParameters(3);
+    if(params.type() != DataType::USHORT || params.width() != 8 || params.height() != 6 || params.dimCount() != 2)
+      success = false;
+
+    auto pixels = ser.getPixels(params);
+    auto values = reinterpret_cast<const uint16_t *>(pixels.get());
+    if(!pixels || (const uint8_t *)values != ser.rawFrame(3) || values[2 * 8 + 5] != 3 + 5 + 20)
+      success = false;
+
+    // Every second pixel of a region, converted
+    long start[] = { 2, 3 }, end[] = { 7, 6 }, inc[] = { 2, 1 };
+    DataParameters region(4, DataType::FLOAT, 2, start, end, inc);
+    std::vector<float> floats(region.byteSize() / sizeof(float));
+    if(!ser.readPixels(region, floats.data()) || floats.size() != 3 * 4)
+      success = false;
+    else if(floats[0] != 4 + 1 + 20 || floats[1] != 4 + 3 + 20 || floats[3] != 4 + 1 + 30)
+      success = false;
+
+    if(!ser.hasTimestamps() || SerFile::unixTime(ser.timestamp(2)) != 2.0)
+      success = false;
+
+    // Frames outside of the file are rejected
+    if(ser.getPixels(params.withIndex(-1)) || ser.readPixels(region.withIndex(-1), floats.data()))
+      success = false;
+  }
+
+  // Color planes are split and returned in RGB order
+  auto colorPath = writeFile("ser_color_", serFile(SerFile::BGR, 8, 4, 3, 2, false));
+  {
+    SerFile ser(colorPath);
+    auto params = ser.getImageParameters(1);
+    if(ser.imageCount() != 2 || params.dimCount() != 3 || params.layerCount() != 3 || ser.hasTimestamps())
+      success = false;
+
+    auto pixels = ser.getPixels(params);
+    // Red is stored last, 1 + x + 10 * y + 200
+    if(!pixels || pixels[0] != 201 || pixels[12 + 5] != 100 + 1 + 1 + 10 || pixels[24 + 11] != 1 + 3 + 20)
+      success = false;
+  }
+
+  // Only complete frames of a cut short capture are used
+  auto data = serFile(SerFile::MONO, 8, 4, 4, 3, false);
+  data.resize(data.size() - 5);
+  auto truncatedPath = writeFile("ser_truncated_", data);
+  if(SerFile(truncatedPath).imageCount() != 2)
+    success = false;
+
+  auto invalidPath = writeFile("ser_invalid_", std::vector<uint8_t>(SerFile::HEADER_SIZE, 'x'));
+  if(SerFile(invalidPath).imageCount() >= 0)
+    success = false;
+
+  for(auto& path : { monoPath, colorPath, truncatedPath, invalidPath })
+    std::filesystem::remove(path);
+  return success ? 0 : 1;
+}
@@ -0,0 +1,42 @@
+#include "io/provider.hpp"
+
+#include "io_util.hpp"
+
+int main() {
+  // 16x8 images with 3 layers filled with their index
+  auto provider = new MockProvider(4, { 16, 8, 3 });
+  CachedImageProvider cache(provider, 1 << 20, 1);
+
+  auto params = cache.getImageParameters(2);
+  params.setDimension(2, 1, 1, 1);
+
+  {
+    auto mat = cache.getImageMatrix(2);
+    if(mat.empty() || mat.type() != CV_16UC1 || mat.rows != 8 || mat.cols != 16)
+      return 1;
+
+    // The matrix uses the cached buffer instead of a copy
+    auto data = cache.getPixels(params);
+    if(mat.data != data.get() || provider->m_reads != 1)
+      return 1;
+    data.reset();
+
+    // and keeps it pinned, also through copies
+    cv::Mat copy = mat;
+    mat.release();
+    auto stats = cache.statistics();
+    if(stats.m_pinnedEntries != 1 || stats.m_pinnedBytes != 16 * 8 * 2)
+      return 1;
+  }
+
+  // Released matrices don't pin the buffer anymore
+  auto stats = cache.statistics();
+  if(stats.m_entries != 1 || stats.m_pinnedEntries != 0)
+    return 1;
+
+  cache.setMaxBytes(0);
+  if(cache.statistics().m_entries != 0)
+    return 1;
+
+  return 0;
+}
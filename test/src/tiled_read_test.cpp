@@ -0,0 +1,98 @@
+#include "io/prefetch.hpp"
+#include "io/tiled.hpp"
+
+#include "io_util.hpp"
+
+#include <vector>
+
+static bool checkRegion(ImageProvider& provider, long x0, long y0, long x1, long y1) {
+  auto params = provider.getImageParameters(0);
+  params.setDimension(0, x0, x1, 1);
+  params.setDimension(1, y0, y1, 1);
+
+  auto data = provider.getPixels(params);
+  if(!data)
+    return false;
+
+  const uint16_t *pixels = (const uint16_t*)data.get();
+  for(long y = y0; y <= y1; ++y) {
+    for(long x = x0; x <= x1; ++x) {
+      if(pixels[(y - y0) * params.width() + (x - x0)] != (uint16_t)((x - 1) + (y - 1) * 1000))
+        return false;
+    }
+  }
+  return true;
+}
+
+int main() {
+  // 1000x700 16 bit images where every pixel holds x + y * 1000
+  auto grid = new MockProvider(1, { 1000, 700 }, DataType::USHORT, [](const DataParameters& params, void *ptr) {
+    auto value = [](long x, long y) { return x + y * 1000; };
+    if(params.type() == DataType::FLOAT)
+      fillPixels<float>(params, ptr, value);
+    else
+      fillPixels<uint16_t>(params, ptr, value);
+  });
+  auto cache = new CachedImageProvider(grid, 1 << 24);
+  TiledImageProvider tiled(cache, 100);
+
+  // Covers 2x2 tiles
+  if(!checkRegion(tiled, 150, 180, 230, 260))
+    return 1;
+  if(grid->m_bytesRead != 4 * 100 * 100 * 2)
+    return 1;
+
+  // Overlapping region only reads the missing column of tiles
+  if(!checkRegion(tiled, 180, 150, 320, 250))
+    return 1;
+  if(grid->m_bytesRead != 6 * 100 * 100 * 2)
+    return 1;
+
+  // Edge tiles are clipped to the image
+  if(!checkRegion(tiled, 950, 650, 1000, 700))
+    return 1;
+  if(grid->m_bytesRead != 7 * 100 * 100 * 2)
+    return 1;
+
+  // Whole images aren't tiled
+  auto params = tiled.getImageParameters(0);
+  if(!tiled.getPixels(params) || grid->m_bytesRead != 7 * 100 * 100 * 2 + params.byteSize())
+    return 1;
+
+  // Regions in another type are assembled from tiles of that type
+  params = params.withType(DataType::FLOAT);
+  params.setDimension(0, 150, 230, 1);
+  params.setDimension(1, 180, 260, 1);
+  auto data = tiled.getPixels(params);
+  if(!data)
+    return 1;
+  const float *pixels = (const float*)data.get();
+  if(pixels[0] != 149 + 179 * 1000 || pixels[params.width() * params.height() - 1] != 229 + 259 * 1000)
+    return 1;
+
+  // Stepping through a region reads ahead all of its tiles in the next image
+  auto frames = new MockProvider(4, { 1000, 700 });
+  auto frameCache = new CachedImageProvider(frames, 1 << 24);
+  auto prefetch = new PrefetchingProvider(frameCache, 1);
+  TiledImageProvider tiledFrames(prefetch, 100);
+  for(int index : { 0, 1 }) {
+    auto region = tiledFrames.getImageParameters(index);
+    region.setDimension(0, 150, 230, 1);
+    region.setDimension(1, 180, 260, 1);
+    if(!tiledFrames.getPixels(region))
+      return 1;
+  }
+  prefetch->waitIdle();
+  if(frames->m_reads != 3 * 4)
+    return 1;
+
+  auto region = tiledFrames.getImageParameters(2);
+  region.setDimension(0, 150, 230, 1);
+  region.setDimension(1, 180, 260, 1);
+  auto frame = tiledFrames.getPixels(region);
+  prefetch->waitIdle();
+  if(!frame || frame[0] != 2 || frames->m_reads != 4 * 4)
+    return 1;
+
+  return 0;
+}